@@ -4,10 +4,17 @@
 #include <cassert>
 #include <sstream>
 #include <map>
+#include <memory>
+#include <vector>
 
 #include <QtWidgets>
 #include <QApplication>
 #include <QSysInfo>
+#include <QCommandLineParser>
+
+#include "src/common/tickreplay.h"
+#include "src/common/instrument.h"
+#include "src/common/exprengine.h"
 
 
 /** @brief Normal Probability Density Function (mean = 0) and standard deviation = 1  */
@@ -137,6 +144,7 @@ public:
     virtual size_t   Count() const = 0;
     virtual QVariant GetProperty(QString name) = 0;
     virtual void     SetProperty(QString name, QVariant value) = 0;
+    virtual QStringList PropertyNames() const = 0;
 };
 
 class PropertyChangedObserver: public InotifyPropertyChanged
@@ -152,6 +160,7 @@ public:
     }
     void NotifyObservers(QString propertyName)
     {
+        INSTRUMENT_SCOPE("PropertyChangedObserver::NotifyObservers");
         for(auto&& hnd: observers)
             hnd(propertyName);
     }
@@ -189,6 +198,13 @@ public:
         return it->second->Set(value);
     }
 
+    QStringList PropertyNames() const
+    {
+        QStringList names;
+        for(auto const& p: pmap)
+            names << p.first;
+        return names;
+    }
 
 protected:
     PropertyMap pmap;
@@ -265,6 +281,7 @@ public:
 
     void Recalculate()
     {
+        INSTRUMENT_SCOPE("BLSFormula::Recalculate");
         double K     = m_K->Get().toDouble();
         double S     = m_S->Get().toDouble();
         double T     = m_T->Get().toDouble();
@@ -407,7 +424,70 @@ void SetBinding1W( Binding const& binding,
     });
 } // --- End of SetBinding ----- //
 
+/** Binds a target property to an expression of the source properties,
+ *  e.g. "Vcall - Vput" or "S * exp(-r * T)", see exprengine.h for the syntax.
+ *  The expression is compiled once and re-evaluated only when a property it
+ *  references changes, not on every notification of the source. A source
+ *  notifies each of its outputs in turn, so the evaluation is deferred to
+ *  the event loop and done once for all the changes of the same turn,
+ *  when every output is up to date. The properties are the ones of the
+ *  source when the binding is created.
+ */
+class ExpressionBinding
+{
+    InotifyPropertyChanged*     m_source;
+    QObject*                    m_target;
+    QByteArray                  m_property;
+    Converter                   m_conv;
+    QStringList                 m_names;
+    std::shared_ptr<Expression> m_expr;
+    bool                        m_pending = false;
+public:
+    ExpressionBinding(InotifyPropertyChanged* source,
+                      QObject* target,
+                      QString property,
+                      Converter conv = Converter::DoubleToQString())
+        : m_source(source), m_target(target), m_property(property.toLatin1())
+        , m_conv(conv), m_names(source->PropertyNames())
+    {
+        source->Subscribe([this](QString name){
+            int i = m_names.indexOf(name);
+            if(m_pending || m_expr == nullptr || i < 0 || !m_expr->DependsOn(i))
+                return;
+            m_pending = true;
+            QMetaObject::invokeMethod(m_target, [this]{ this->Update(); },
+                                      Qt::QueuedConnection);
+        });
+    }
+
+    ExpressionBinding(ExpressionBinding const&) = delete;
+    ExpressionBinding& operator=(ExpressionBinding const&) = delete;
+
+    /** Replaces the expression, the previous one is kept on error */
+    bool SetExpression(QString const& text, QString* error = nullptr)
+    {
+        auto expr = Expression::Compile(text, m_names, error);
+        if(expr == nullptr)
+            return false;
+        m_expr = expr;
+        std::cout << " [INFO] Binding " << text.toStdString() << " depends on "
+                  << expr->Dependencies().join(", ").toStdString() << std::endl;
+        this->Update();
+        return true;
+    }
 
+    void Update()
+    {
+        INSTRUMENT_SCOPE("ExpressionBinding::Update");
+        m_pending = false;
+        std::vector<double> inputs(m_names.size(), 0.0);
+        for(int i = 0; i < m_names.size(); i++)
+            if(m_expr->DependsOn(i))
+                inputs[i] = m_source->GetProperty(m_names[i]).toDouble();
+        m_target->setProperty(m_property.constData(),
+                              m_conv.m_convert_to(m_expr->Evaluate(inputs)));
+    }
+};
 
 
 int main(int argc, char** argv)
@@ -433,6 +513,15 @@ int main(int argc, char** argv)
     QLabel* labelVcall = new QLabel("0.0");
     form->addRow("Vcall - Call Option Price = ", labelVcall);
 
+    // User-defined derived field
+    QLineEdit* entryExpr = new QLineEdit("Vcall - Vput");
+    form->addRow("Derived field: ", entryExpr);
+    QLabel* labelExpr = new QLabel("0.0");
+    form->addRow("Value = ", labelExpr);
+
+    QLabel* labelForward = new QLabel("0.0");
+    form->addRow("S * exp(-r * T) = ", labelForward);
+
     QSlider* sliderK1 = new QSlider();
     sliderK1->setMaximum(100);
     sliderK1->setMinimum(0);
@@ -467,6 +556,37 @@ int main(int argc, char** argv)
     Binding b_Vcall = {&bls, "Vcall", BindingMode::OneWay};
     SetBinding1W(b_Vcall, labelVcall, "text");
 
+    ExpressionBinding b_forward(&bls, labelForward, "text");
+    b_forward.SetExpression("S * exp(-r * T)");
+
+    ExpressionBinding b_expr(&bls, labelExpr, "text");
+    auto applyExpr = [&]{
+        QString error;
+        bool ok = b_expr.SetExpression(entryExpr->text(), &error);
+        entryExpr->setStyleSheet(ok ? "" : "color: red");
+        entryExpr->setToolTip(error);
+    };
+    QObject::connect(entryExpr, &QLineEdit::editingFinished, applyExpr);
+    applyExpr();
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    TickReplay::AddOptions(parser);
+    Instrument::Session::AddOptions(parser);
+    parser.process(app);
+    Instrument::Session instrument(parser);
+
+    // Recorded workload driving the bindings through SetProperty()
+    TickReplay replay([&](TickField field, double value){
+        static const char* names[] = {"K", "S", "T", "sigma", "r"};
+        if(field < TickField::Count)
+            bls.SetProperty(names[static_cast<int>(field)], value);
+    });
+    replay.SetPaintProbe(labelVcall);
+    int replayStatus = 0;
+    if(!replay.StartFromCommandLine(parser, &replayStatus))
+        return replayStatus;
+
     std::cout << " [INFO] Application Running " << std::endl;
 
     return app.exec();
@@ -2,6 +2,7 @@
 #include <iomanip>
 #include <functional>
 #include <cassert>
+#include <vector>
 
 #include <QtWidgets>
 #include <QApplication>
@@ -9,6 +10,40 @@
 #include <QSysInfo>
 #include <QJSEngine>
 #include <QDebug>
+#include <QElapsedTimer>
+
+#include "src/common/exprengine.h"
+#include "src/common/scriptcache.h"
+#include "src/form1/blackscholes.h"
+
+/** Pricing routines exposed to scripts as the global object "native".
+ *
+ *  price(chain) takes an ArrayBuffer of BatchStride doubles per option and
+ *  returns an ArrayBuffer of call prices, so a whole chain costs a single
+ *  JS <-> C++ transition. ArrayBuffer and QByteArray share their storage,
+ *  the inputs and the prices are not copied across the bridge.
+ *  priceOne() is the scalar version, one transition per option.
+ */
+class PricingBridge: public QObject
+{
+    Q_OBJECT
+public:
+    using QObject::QObject;
+
+    Q_INVOKABLE QByteArray price(QByteArray const& chain) const
+    {
+        size_t n = static_cast<size_t>(chain.size()) / (BatchStride * sizeof(double));
+        QByteArray prices(static_cast<int>(n * sizeof(double)), Qt::Uninitialized);
+        BlackScholesCallBatch(reinterpret_cast<double const*>(chain.constData()), n,
+                              reinterpret_cast<double*>(prices.data()));
+        return prices;
+    }
+
+    Q_INVOKABLE double priceOne(double S, double K, double T, double sigma, double r) const
+    {
+        return BlackScholesCall(S, K, T, sigma, r);
+    }
+};
 
 
 int main(int argc, char** argv)
@@ -29,7 +64,72 @@ int main(int argc, char** argv)
     out = jsfunc.call(args);
     std::cout << "out = " << out.toNumber() << std::endl;
 
+    // Same function compiled once and applied to whole arrays
+    auto sumSquares = Expression::Compile("a * a + b * b", {"a", "b"});
+    std::vector<double> a = {3.5, 1.0, 2.0}, b = {6.8, 2.0, 3.0}, result(a.size());
+    sumSquares->Evaluate({a.data(), b.data()}, a.size(), result.data());
+    for(size_t i = 0; i < result.size(); i++)
+        std::cout << "compiled(" << a[i] << ", " << b[i] << ") = " << result[i] << std::endl;
 
+    //==== Batched native calls, one transition per chain ====//
+    // Owned by the application, not by the script engine
+    auto bridge = new PricingBridge(&app);
+    engine.globalObject().setProperty("native", engine.newQObject(bridge));
+
+    // Chain of strikes around the spot, built on the C++ side
+    const int n = 20000;
+    QByteArray chain(n * BatchStride * static_cast<int>(sizeof(double)), Qt::Uninitialized);
+    double* option = reinterpret_cast<double*>(chain.data());
+    for(int i = 0; i < n; i++, option += BatchStride)
+    {
+        option[0] = 50.0;
+        option[1] = 40.0 + 20.0 * i / n;
+        option[2] = 0.5;
+        option[3] = 0.30;
+        option[4] = 0.05;
+    }
+    QJSValue buffer = engine.toScriptValue(chain);
+
+    const QString batched =
+        "function(chain) {"
+        "    var prices = new Float64Array(native.price(chain));"
+        "    var sum = 0;"
+        "    for(var i = 0; i < prices.length; i++) sum += prices[i];"
+        "    return sum / prices.length;"
+        "}";
+    const QString scalar =
+        "function(chain) {"
+        "    var o = new Float64Array(chain), n = o.length / 5, sum = 0;"
+        "    for(var i = 0; i < n; i++)"
+        "        sum += native.priceOne(o[5*i], o[5*i+1], o[5*i+2], o[5*i+3], o[5*i+4]);"
+        "    return sum / n;"
+        "}";
+
+    FunctionCache<QJSEngine, QJSValue> cache(engine);
+    QElapsedTimer timer;
+    for(QString const& source: {scalar, batched})
+    {
+        // The second and later runs reuse the compiled function
+        for(int run = 0; run < 3; run++)
+        {
+            timer.start();
+            QJSValue fn = cache.Get(source);
+            out = fn.call({buffer});
+            if(out.isError())
+            {
+                std::cout << " [ERROR] " << out.toString().toStdString() << std::endl;
+                break;
+            }
+            std::cout << " [INFO] " << (source == batched ? "price(chain)" : "priceOne() ")
+                      << " mean = " << out.toNumber() << "  "
+                      << timer.nsecsElapsed() / n << " ns/option" << std::endl;
+        }
+    }
+    std::cout << " [INFO] Function cache: " << cache.Hits() << " hits, "
+              << cache.Misses() << " misses" << std::endl;
 
     return 0;
 }
+
+// Required by AUTOMOC for a Q_OBJECT class defined in a .cpp file
+#include "jsenginetest.moc"
@@ -1,10 +1,127 @@
 #include <iostream>
+#include <algorithm>
 
 #include <QtCore>
 #include <QApplication>
 #include <QTimer>
 #include <QtNetwork/QtNetwork>
 
+#include "src/network/fetchengine.h"
+#include "src/network/localserver.h"
+#include "src/network/streaming.h"
+#include "src/network/httpcache.h"
+
+/** Default location of the HTTP cache, kept between runs */
+QString CacheDirectory(QCommandLineParser const& parser)
+{
+    if(!parser.value("cache").isEmpty())
+        return parser.value("cache");
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/http";
+}
+
+/** Experiment 2: many concurrent requests through the FetchEngine, against
+ *  the local stand-in server unless a URL is given. Exits when all the
+ *  responses arrived. */
+int RunBenchmark(QApplication& app, QCommandLineParser const& parser)
+{
+    int    count  = std::max(parser.value("bench").toInt(), 1);
+    int    window = parser.value("concurrency").toInt();
+    qint64 size   = parser.value("size").toLongLong();
+
+    LocalServer server;
+    QUrl url(parser.value("url"));
+    if(url.isEmpty())
+    {
+        QString error;
+        if(!server.Listen(0, &error))
+        {
+            std::cout << " [ERROR] Cannot start the local server: "
+                      << error.toStdString() << std::endl;
+            return 1;
+        }
+        url = server.Url(QString("/bytes/%1").arg(size));
+    }
+    std::cout << " [INFO] " << count << " requests to " << url.toString().toStdString()
+              << ", " << window << " in flight" << std::endl;
+
+    FetchEngine engine(window);
+    engine.SetPipelining(parser.isSet("pipelining"));
+    if(parser.isSet("cache"))
+    {
+        engine.EnableCache(CacheDirectory(parser),
+                           parser.value("cache-size").toLongLong() << 20, 8 << 20);
+        server.SetMaxAge(parser.value("max-age").toInt());
+    }
+    qint64 mismatches = 0;
+    for(int i = 0; i < count; i++)
+        engine.Get(url, [&](FetchEngine::Response const& r){
+            if(!r.Ok())
+                std::cout << " [ERROR] " << r.error.toStdString() << std::endl;
+            else if(parser.value("url").isEmpty() && r.body.size() != size)
+                mismatches++;
+            if(engine.Pending() == 0)
+                QApplication::exit(0);
+        });
+    app.exec();
+
+    engine.Report(std::cout);
+    if(mismatches > 0)
+        std::cout << " [ERROR] " << mismatches << " bodies of a wrong size" << std::endl;
+    if(parser.value("url").isEmpty())
+        std::cout << " [INFO] Server: " << server.Requests() << " requests on "
+                  << server.Connections() << " connections, "
+                  << server.NotModified() << " not modified" << std::endl;
+    return mismatches == 0 ? 0 : 1;
+}
+
+/** Experiment 3: a single large body streamed to a file, or through a line
+ *  parser on a worker thread, without holding it in memory. */
+int RunStream(QApplication& app, QCommandLineParser const& parser)
+{
+    LocalServer server;
+    QUrl url(parser.value("url"));
+    if(url.isEmpty())
+    {
+        QString error;
+        if(!server.Listen(0, &error))
+        {
+            std::cout << " [ERROR] Cannot start the local server: "
+                      << error.toStdString() << std::endl;
+            return 1;
+        }
+        url = server.Url(QString("/bytes/%1").arg(parser.value("size")));
+    }
+
+    std::shared_ptr<BodyConsumer> consumer;
+    std::shared_ptr<LineConsumer> lines;
+    if(parser.isSet("download"))
+    {
+        consumer = std::make_shared<FileConsumer>(parser.value("download"));
+    }
+    else
+    {
+        lines = std::make_shared<LineConsumer>([](const char*, int){ return true; });
+        consumer = std::make_shared<BackgroundConsumer>(lines);
+    }
+
+    FetchEngine engine;
+    engine.SetReadBufferSize(parser.value("read-buffer").toLongLong());
+    int status = 0;
+    engine.Stream(url, consumer, [&](FetchEngine::Response const& r){
+        if(!r.Ok())
+        {
+            std::cout << " [ERROR] " << r.error.toStdString() << std::endl;
+            status = 1;
+        }
+        QApplication::exit(0);
+    });
+    app.exec();
+
+    engine.Report(std::cout);
+    if(lines)
+        std::cout << " [INFO] " << lines->Lines() << " lines" << std::endl;
+    return status;
+}
 
 int main(int argc, char** argv)
 {
@@ -12,6 +129,48 @@ int main(int argc, char** argv)
     QApplication app(argc, argv);
     std::cout << " [INFO] Starting application" << std::endl;
 
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption benchOption(
+        "bench", "Run <count> concurrent requests instead of the single request.", "count");
+    QCommandLineOption concurrencyOption(
+        "concurrency", "Requests in flight per host.", "n", "6");
+    QCommandLineOption sizeOption(
+        "size", "Body size of the local server responses.", "bytes", "1024");
+    QCommandLineOption urlOption(
+        "url", "Benchmark this URL instead of the local server.", "url");
+    QCommandLineOption pipeliningOption(
+        "pipelining", "Allow HTTP pipelining.");
+    QCommandLineOption downloadOption(
+        "download", "Stream one response body to <file>.", "file");
+    QCommandLineOption linesOption(
+        "count-lines", "Stream one response body through a line parser.");
+    QCommandLineOption readBufferOption(
+        "read-buffer", "Chunk size of streamed bodies.", "bytes", "262144");
+    QCommandLineOption cacheOption(
+        "cache", "Cache the benchmark responses in <dir>.", "dir");
+    QCommandLineOption cacheSizeOption(
+        "cache-size", "Size limit of the disk cache.", "MB", "50");
+    QCommandLineOption maxAgeOption(
+        "max-age", "Seconds the local server responses stay fresh.", "seconds", "0");
+    parser.addOption(benchOption);
+    parser.addOption(concurrencyOption);
+    parser.addOption(sizeOption);
+    parser.addOption(urlOption);
+    parser.addOption(pipeliningOption);
+    parser.addOption(downloadOption);
+    parser.addOption(linesOption);
+    parser.addOption(readBufferOption);
+    parser.addOption(cacheOption);
+    parser.addOption(cacheSizeOption);
+    parser.addOption(maxAgeOption);
+    parser.process(app);
+
+    if(parser.isSet(benchOption))
+        return RunBenchmark(app, parser);
+    if(parser.isSet(downloadOption) || parser.isSet(linesOption))
+        return RunStream(app, parser);
+
     // ===============================================================//
     std::cout << " [===== EXPERIMENT 1 - Simple HTTP GET Request ======]\n"
               << std::endl;
@@ -20,6 +179,9 @@ int main(int argc, char** argv)
     QUrl url;
     url.setUrl("http://www.httpbin.org/get");
     QNetworkAccessManager qnam;
+    // Owned by qnam, later runs revalidate instead of downloading again
+    qnam.setCache(new HttpCache(CacheDirectory(parser),
+                                parser.value(cacheSizeOption).toLongLong() << 20, 1 << 20));
 
     QNetworkReply* reply = qnam.get(QNetworkRequest(url));
 
@@ -42,10 +204,16 @@ int main(int argc, char** argv)
       // QVariant contentSize = reply->attribute(QNetworkRequest::ContentLengthHeader);
 
        std::cout << " [INFO] Status code  = " << statusCode.toInt() << std::endl;
+       std::cout << " [INFO] From cache   = "
+                 << reply->attribute(QNetworkRequest::SourceIsFromCacheAttribute).toBool()
+                 << std::endl;
     //  std::cout << " [INFO] Content Size = " << contentSize.toInt() << std::endl;
 
+       // Written as is, no conversion to std::string
+       QByteArray body = reply->readAll();
        std::cout << "\n Output: ";
-       std::cout << reply->readAll().toStdString() << std::endl;
+       std::cout.write(body.constData(), body.size());
+       std::cout << std::endl;
 
        // Force exiting QT event loop shuttind down this app
        QApplication::exit(0);
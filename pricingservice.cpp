@@ -0,0 +1,95 @@
+#include <iostream>
+#include <algorithm>
+
+#include <QtCore>
+#include <QCoreApplication>
+#include <QCommandLineParser>
+
+#include "src/pricing/pricingserver.h"
+#include "src/pricing/loadgenerator.h"
+
+/** Load test of a pricing service, the one of this process unless --url is
+ *  given. Exits when all the responses arrived. */
+int RunLoad(QCoreApplication& app, QCommandLineParser const& parser, PricingServer* server)
+{
+    LoadGenerator::Profile profile;
+    profile.connections = parser.value("connections").toInt();
+    profile.depth       = parser.value("depth").toInt();
+    profile.batch       = parser.value("batch").toInt();
+    profile.requests    = std::max(parser.value("requests").toLongLong(), 1LL);
+    profile.binary      = parser.isSet("binary");
+
+    QUrl url = server ? server->Url("/price") : QUrl(parser.value("url"));
+    std::cout << " [INFO] Load test of " << url.toString().toStdString() << std::endl;
+    LoadGenerator load(url, profile);
+    load.Start([]{ QCoreApplication::exit(0); });
+    app.exec();
+
+    load.Report(std::cout);
+    if(server)
+        server->Report(std::cout);
+    return load.Failed() == 0 && load.Mismatches() == 0 ? 0 : 1;
+}
+
+int main(int argc, char** argv)
+{
+    // No GUI, the service runs in the background
+    QCoreApplication app(argc, argv);
+    std::cout << " [INFO] Starting application" << std::endl;
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption portOption(
+        "port", "Port of the service on 127.0.0.1, 0 picks a free one.", "port", "8765");
+    QCommandLineOption threadsOption(
+        "threads", "Pricing threads.", "n", QString::number(QThread::idealThreadCount()));
+    QCommandLineOption benchOption(
+        "bench", "Load test the service in this process, then exit.");
+    QCommandLineOption urlOption(
+        "url", "Load test the pricing endpoint at <url> instead, e.g. "
+               "http://127.0.0.1:8765/price.", "url");
+    QCommandLineOption connectionsOption(
+        "connections", "Load test connections.", "n", "8");
+    QCommandLineOption depthOption(
+        "depth", "Requests in flight per connection.", "n", "1");
+    QCommandLineOption batchOption(
+        "batch", "Options per request.", "n", "64");
+    QCommandLineOption requestsOption(
+        "requests", "Requests of the load test.", "count", "10000");
+    QCommandLineOption binaryOption(
+        "binary", "Load test with binary requests instead of JSON.");
+    parser.addOption(portOption);
+    parser.addOption(threadsOption);
+    parser.addOption(benchOption);
+    parser.addOption(urlOption);
+    parser.addOption(connectionsOption);
+    parser.addOption(depthOption);
+    parser.addOption(batchOption);
+    parser.addOption(requestsOption);
+    parser.addOption(binaryOption);
+    parser.process(app);
+
+    if(parser.isSet(urlOption))
+        return RunLoad(app, parser, nullptr);
+
+    PricingServer server(parser.value(threadsOption).toInt());
+    QString error;
+    quint16 port = parser.isSet(benchOption) ? 0 : parser.value(portOption).toUShort();
+    if(!server.Listen(port, &error))
+    {
+        std::cout << " [ERROR] Cannot listen on port " << port << ": "
+                  << error.toStdString() << std::endl;
+        return 1;
+    }
+    if(parser.isSet(benchOption))
+        return RunLoad(app, parser, &server);
+
+    std::cout << " [INFO] Pricing service on " << server.Url("/price").toString().toStdString()
+              << " with " << server.Threads() << " threads" << std::endl
+              << " [INFO] curl -d '{\"options\": [[100, 95, 0.5, 0.2, 0.05]]}'"
+                 " -H 'Content-Type: application/json' "
+              << server.Url("/price").toString().toStdString() << std::endl;
+    int status = app.exec();
+    server.Report(std::cout);
+    return status;
+}
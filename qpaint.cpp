@@ -2,48 +2,197 @@
 #include <functional>
 #include <optional>
 #include <map>
+#include <cmath>
+#include <random>
 
 #include <QtWidgets>
 #include <QPolygon>
 #include <QApplication>
+#include <QCommandLineParser>
 
+#include "src/common/instrument.h"
+#include "src/paint/scene.h"
+#include "src/paint/timeserieschart.h"
+#include "src/form1/blackscholes.h"
+
+/** Retained drawing: the scene is built once and paintEvent blits the
+ *  cached layers, only the cursor marker is drawn on each paint. */
 class Canvas: public QWidget
 {
+    Scene         scene;
+    Scene::Layer& chart  = scene.AddLayer(true);
+    Scene::Layer& shapes = scene.AddLayer(true);
+    Scene::Layer& cursor = scene.AddLayer(false);
+
+public:
+    /** primitives: random walk segments drawn behind the shapes */
+    explicit Canvas(int primitives)
+    {
+        // Every pixel is painted by paintEvent
+        this->setAttribute(Qt::WA_OpaquePaintEvent);
+        this->setMouseTracking(true);
+        scene.SetUpdateHandler([this](QRect const& rect){ this->update(rect); });
+
+        this->BuildChart(primitives);
+        shapes.AddText(QPointF(0, 0), "hello world QT Painter");
+        shapes.SetPen(QPen(Qt::red, 2, Qt::SolidLine));
+        shapes.AddLine(QLineF(100.5, 200.4, 90.12, 56.24));
+        shapes.AddRect(QRectF(50, 180, 90, 140));
+        cursor.SetPen(QPen(Qt::darkGreen, 1));
+        scene.Update();
+        std::cout << " [INFO] Scene of " << scene.Primitives() << " primitives" << std::endl;
+    }
 
+    Scene& GetScene() { return scene; }
 
-    void paintEvent(QPaintEvent* event)
+protected:
+    void resizeEvent(QResizeEvent*) override
     {
+        scene.SetViewport(this->size(), this->devicePixelRatioF());
+        // Origin 250 pixels above the bottom left corner, y down
+        scene.SetTransform(QTransform::fromTranslate(200.5, this->height() - 250.0));
+    }
+
+    /** Only the old and new marker areas are repainted */
+    void mouseMoveEvent(QMouseEvent* event) override
+    {
+        QPointF p = scene.Transform().inverted().map(QPointF(event->pos()));
+        cursor.Clear();
+        cursor.AddRect(QRectF(p - QPointF(4, 4), QSizeF(8, 8)));
+        cursor.AddText(p + QPointF(8, -8),
+                       QString("%1, %2").arg(p.x(), 0, 'f', 1).arg(p.y(), 0, 'f', 1));
+        scene.Update();
+    }
+
+    void leaveEvent(QEvent*) override
+    {
+        cursor.Clear();
+        scene.Update();
+    }
+
+    void paintEvent(QPaintEvent* event) override
+    {
+        INSTRUMENT_SCOPE("Canvas::paintEvent");
 
         // Graphics context
         QPainter qp{this};
-        qp.setRenderHint(QPainter::Antialiasing);
-        
-        QPen pen(Qt::red, 2, Qt::SolidLine);
+        qp.fillRect(event->rect(), this->palette().window());
+        scene.Paint(qp, event->rect());
+    }
 
-        qp.scale(1, -1);
-        qp.translate(0, -this->height());
+private:
+    void BuildChart(int primitives)
+    {
+        if(primitives <= 0)
+            return;
+        // Same chart on each run
+        QRandomGenerator random(42);
+        chart.SetPen(QPen(QColor(70, 130, 180), 0));
+        chart.Reserve(static_cast<size_t>(primitives));
+        QPointF p(-200.0, 0.0);
+        for(int i = 1; i <= primitives; i++)
+        {
+            double y = qBound(-240.0, p.y() + random.generateDouble() * 10.0 - 5.0, 240.0);
+            QPointF q(-200.0 + 400.0 * i / primitives, y);
+            chart.AddLine(QLineF(p, q));
+            p = q;
+        }
+    }
+};
 
-        qp.translate(200.5, 250.0);
-        qp.scale(1, -1);
-        qp.drawText(QPointF(0, 0), "hello world QT Painter");
 
-        qp.setPen(pen);
-        qp.drawLine(QPointF(100.5f, 200.4f), QPointF(90.12f, 56.24f));
-        qp.drawRect(50, 180, 90, 140);
+/** Spot price following a geometric Brownian motion, one point per second,
+ *  and the delta of a one year call struck at 100 */
+struct MarketWalk
+{
+    static constexpr double Sigma = 0.20;
+    static constexpr double Rate  = 0.05;
+    static constexpr double Year  = 365.0 * 24 * 3600;
 
-        // QPolygon pl(QPoint{10, 25}, QPoint{200, 60}, QPoint{90, 80}, QPoint{260, 80});
-        //ctx.drawPolygon(pl);
+    std::mt19937_64 random{7};
+    std::normal_distribution<double> normal;
+    double t = 0.0;
+    double S = 100.0;
 
+    /** n spot points, the delta every 100 points */
+    void Run(TimeSeriesChart& spotChart, int spot, TimeSeriesChart& deltaChart, int delta, size_t n)
+    {
+        const double step = Sigma * std::sqrt(1.0 / Year);
+        for(size_t i = 0; i < n; i++, t += 1.0)
+        {
+            S *= std::exp(step * normal(random) - step * step / 2);
+            spotChart.Append(spot, t, S);
+            if(static_cast<qint64>(t) % 100 == 0)
+                deltaChart.Append(delta, t, normal_cdf((std::log(S / 100.0) + Rate
+                                                        + Sigma * Sigma / 2) / Sigma));
+        }
     }
-
 };
 
+/** Two charts of streaming data: decimated spot price and its delta */
+int RunChart(QApplication& app, QCommandLineParser const& parser)
+{
+    QWidget window;
+    auto spotChart  = new TimeSeriesChart;
+    auto deltaChart = new TimeSeriesChart;
+    auto layout = new QVBoxLayout(&window);
+    layout->addWidget(spotChart, 2);
+    layout->addWidget(deltaChart, 1);
+    int spot  = spotChart->AddSeries("Spot", QColor(70, 130, 180));
+    int delta = deltaChart->AddSeries("Delta", QColor(200, 80, 40));
+
+    MarketWalk walk;
+    size_t n = parser.value("chart").toULongLong();
+    spotChart->Reserve(spot, n);
+    QElapsedTimer timer;
+    timer.start();
+    walk.Run(*spotChart, spot, *deltaChart, delta, n);
+    std::cout << " [INFO] " << n << " points generated in " << timer.elapsed() << " ms" << std::endl;
+    spotChart->FitAll();
+    deltaChart->FitAll();
+
+    // Appended once per frame, the charts scroll along
+    QTimer stream;
+    size_t perFrame = parser.value("stream").toULongLong();
+    QObject::connect(&stream, &QTimer::timeout, [&]{
+        walk.Run(*spotChart, spot, *deltaChart, delta, perFrame);
+    });
+    if(perFrame > 0)
+        stream.start(16);
+
+    window.setWindowTitle("Time series");
+    window.resize(900, 600);
+    window.show();
+    return app.exec();
+}
 
 int main(int argc, char** argv)
 {
     QApplication qapp(argc, argv);
 
-    Canvas window;
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption primitivesOption(
+        "primitives", "Draw a chart of <n> line segments.", "n", "0");
+    QCommandLineOption immediateOption(
+        "immediate", "Draw every layer on each paint instead of caching them.");
+    QCommandLineOption chartOption(
+        "chart", "Show a time series chart of <n> points instead of the canvas.", "n");
+    QCommandLineOption streamOption(
+        "stream", "Points appended to the chart per frame.", "n", "0");
+    parser.addOption(primitivesOption);
+    parser.addOption(immediateOption);
+    parser.addOption(chartOption);
+    parser.addOption(streamOption);
+    Instrument::Session::AddOptions(parser);
+    parser.process(qapp);
+    Instrument::Session instrument(parser);
+
+    if(parser.isSet(chartOption))
+        return RunChart(qapp, parser);
+
+    Canvas window(parser.value(primitivesOption).toInt());
+    window.GetScene().SetCaching(!parser.isSet(immediateOption));
     window.resize(400, 500);
     window.show();
 
@@ -1,11 +1,20 @@
 #include <iostream>
 #include <functional>
 #include <cmath>
+#include <random>
+#include <vector>
 
 #include <QApplication>
 #include <QDebug>
+#include <QElapsedTimer>
+#include <QCommandLineParser>
 #include <QtScript/QScriptEngine>
 
+#include "src/common/exprengine.h"
+#include "src/common/scriptcache.h"
+#include "src/common/scriptpool.h"
+#include "src/form1/blackscholes.h"
+
 
 
 // QScript Native Function
@@ -21,10 +30,166 @@ QScriptValue hypothenuse(QScriptContext *context, QScriptEngine *engine)
 }
 
 
+// Scalar pricing, one script <-> C++ transition per option
+QScriptValue priceOne(QScriptContext *context, QScriptEngine *)
+{
+   return BlackScholesCall(context->argument(0).toNumber(), context->argument(1).toNumber(),
+                           context->argument(2).toNumber(), context->argument(3).toNumber(),
+                           context->argument(4).toNumber());
+}
+
+// Batched pricing, price(chain) for a whole chain. QtScript has no typed
+// arrays: the chain is a QByteArray of BatchStride doubles per option
+// wrapped in a variant, and so are the prices returned. QByteArray is
+// implicitly shared, neither is copied across the bridge.
+QScriptValue priceChain(QScriptContext *context, QScriptEngine *engine)
+{
+   QByteArray chain = context->argument(0).toVariant().toByteArray();
+   size_t n = static_cast<size_t>(chain.size()) / (BatchStride * sizeof(double));
+   QByteArray prices(static_cast<int>(n * sizeof(double)), Qt::Uninitialized);
+   BlackScholesCallBatch(reinterpret_cast<double const*>(chain.constData()), n,
+                         reinterpret_cast<double*>(prices.data()));
+   return engine->newVariant(QVariant(prices));
+}
+
+/** Globals and natives available to every script */
+void RegisterNatives(QScriptEngine& engine)
+{
+    engine.globalObject().setProperty("PI", 3.1415);
+    engine.globalObject().setProperty("hypothenuse", engine.newFunction(hypothenuse));
+    engine.globalObject().setProperty("priceOne", engine.newFunction(priceOne));
+    engine.globalObject().setProperty("price", engine.newFunction(priceChain));
+}
+
+/** Prices a chain of n strikes from a script, once with one native call per
+ *  option and once with a single price(chain) call. Script functions come
+ *  from a cache, so repeated runs do not compile them again. */
+void PriceChainFromScript(QScriptEngine& engine, int n)
+{
+    RegisterNatives(engine);
+
+    QByteArray chain(n * BatchStride * static_cast<int>(sizeof(double)), Qt::Uninitialized);
+    double* option = reinterpret_cast<double*>(chain.data());
+    for(int i = 0; i < n; i++, option += BatchStride)
+    {
+        option[0] = 50.0;
+        option[1] = 40.0 + 20.0 * i / n;
+        option[2] = 0.5;
+        option[3] = 0.30;
+        option[4] = 0.05;
+    }
+    QScriptValue buffer = engine.newVariant(QVariant(chain));
+
+    const QString scalar =
+        "function(n) {"
+        "    var sum = 0;"
+        "    for(var i = 0; i < n; i++) sum += priceOne(50, 40 + 20 * i / n, 0.5, 0.30, 0.05);"
+        "    return sum / n;"
+        "}";
+    const QString batched = "function(chain) { return price(chain); }";
+
+    FunctionCache<QScriptEngine, QScriptValue> cache(engine);
+    QElapsedTimer timer;
+    for(int run = 0; run < 3; run++)
+    {
+        timer.start();
+        double mean = cache.Get(scalar).call(QScriptValue(), QScriptValueList() << n).toNumber();
+        double scalarNs = timer.nsecsElapsed();
+
+        timer.restart();
+        QByteArray prices = cache.Get(batched).call(QScriptValue(), QScriptValueList() << buffer)
+                                 .toVariant().toByteArray();
+        double sum = 0.0;
+        for(int i = 0; i < n; i++)
+            sum += reinterpret_cast<double const*>(prices.constData())[i];
+        double batchedNs = timer.nsecsElapsed();
+
+        std::cout << " [INFO] Chain of " << n << ": priceOne() mean = " << mean << " "
+                  << scalarNs / n << " ns/option, price(chain) mean = " << sum / n << " "
+                  << batchedNs / n << " ns/option" << std::endl;
+    }
+    std::cout << " [INFO] Function cache: " << cache.Hits() << " hits, "
+              << cache.Misses() << " misses" << std::endl;
+}
+
+/** Monte Carlo price of a European payoff given as an expression of the
+ *  terminal spot S and K, T, r, sigma. The payoff is compiled once and
+ *  evaluated over all paths, compared with one script call per path. */
+void PriceCustomPayoff(QScriptEngine& engine, QString const& payoff, int paths)
+{
+    const double S0 = 50.0, K = 50.0, T = 0.5, r = 0.05, sigma = 0.30;
+    QString error;
+    auto expr = Expression::Compile(payoff, {"S", "K", "T", "r", "sigma"}, &error);
+    if(expr == nullptr)
+    {
+        std::cout << " [ERROR] Payoff " << payoff.toStdString() << ": "
+                  << error.toStdString() << std::endl;
+        return;
+    }
+    std::cout << " [INFO] Payoff " << payoff.toStdString() << " compiled to:\n"
+              << expr->Disassemble().toStdString();
+
+    // Terminal spot of each path, other inputs are the same for all paths
+    std::mt19937_64 rng(42);
+    std::normal_distribution<double> z;
+    std::vector<double> spot(paths), values(paths);
+    double drift = (r - 0.5 * sigma * sigma) * T, vol = sigma * std::sqrt(T);
+    for(double& s: spot)
+        s = S0 * std::exp(drift + vol * z(rng));
+    std::vector<double> vK(paths, K), vT(paths, T), vr(paths, r), vsigma(paths, sigma);
+
+    QElapsedTimer timer;
+    timer.start();
+    expr->Evaluate({spot.data(), vK.data(), vT.data(), vr.data(), vsigma.data()},
+                   paths, values.data());
+    double compiledNs = timer.nsecsElapsed();
+    double sum = 0.0;
+    for(double v: values)
+        sum += v;
+    std::cout << " [INFO] Compiled: price = " << std::exp(-r * T) * sum / paths << " in "
+              << compiledNs / 1e6 << " ms, " << compiledNs / paths << " ns/path" << std::endl;
+
+    // Same payoff as a script function, valid only if it is also JavaScript
+    engine.evaluate("var exp = Math.exp, log = Math.log, sqrt = Math.sqrt, abs = Math.abs,"
+                    "    min = Math.min, max = Math.max, pow = Math.pow, PI = Math.PI;");
+    QScriptValue fn = engine.evaluate("(function(S, K, T, r, sigma){ return " + payoff + "; })");
+    if(engine.hasUncaughtException())
+    {
+        std::cout << " [WARNING] Payoff is not valid JavaScript, no script comparison"
+                  << std::endl;
+        engine.clearExceptions();
+        return;
+    }
+    int scriptPaths = std::min(paths, 100000);
+    double scriptSum = 0.0;
+    timer.restart();
+    for(int i = 0; i < scriptPaths; i++)
+        scriptSum += fn.call(QScriptValue(), QScriptValueList() << spot[i] << K << T << r << sigma)
+                       .toNumber();
+    double scriptNs = timer.nsecsElapsed();
+    double compiledSum = 0.0;
+    for(int i = 0; i < scriptPaths; i++)
+        compiledSum += values[i];
+    std::cout << " [INFO] Script:   " << scriptPaths << " paths in " << scriptNs / 1e6 << " ms, "
+              << scriptNs / scriptPaths << " ns/path, results "
+              << (std::fabs(scriptSum - compiledSum) <= 1e-9 * std::fabs(compiledSum) + 1e-9
+                  ? "match" : "DIFFER") << std::endl;
+}
+
 int main(int argc, char** argv)
 {
     QApplication app(argc, argv);
 
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption payoffOption(
+        "payoff", "Payoff expression of S, K, T, r and sigma.", "expr", "max(S - K, 0)");
+    QCommandLineOption pathsOption(
+        "paths", "Number of Monte Carlo paths.", "count", "1000000");
+    parser.addOption(payoffOption);
+    parser.addOption(pathsOption);
+    parser.process(app);
+
     QScriptEngine engine;
     QScriptValue  result;
     QString       code;
@@ -61,6 +226,45 @@ int main(int argc, char** argv)
     result = engine.evaluate("hypothenuse(6.0, 8.0)");
     qDebug() << "\n hypothenuse(6, 8) = " << result.toNumber();
 
+    //==== Compiled expressions, parsed once instead of on each call =====//
+    code = " 3.0 * Math.exp(-2.0) + Math.sqrt(5.0 * 8.0 / 100.0)";
+    auto expr = Expression::Compile(code, {});
+    qDebug() << "\n Compiled expr = " << code << " result = " << expr->Evaluate({});
+
+    PriceCustomPayoff(engine, parser.value(payoffOption),
+                      std::max(1, parser.value(pathsOption).toInt()));
+
+    //==== Batched native calls, one transition per chain =====//
+    PriceChainFromScript(engine, 20000);
+
+    //==== Independent scripts in parallel on a pool of engines =====//
+    ScriptPool pool(RegisterNatives);
+    QStringList scripts;
+    for(int i = 0; i < 2 * pool.Threads(); i++)
+        scripts << QString("var sum = 0;"
+                           "for(var i = 0; i < 100000; i++)"
+                           "    sum += priceOne(50, %1, 0.5, 0.30, 0.05);"
+                           "sum / 100000").arg(40 + i);
+    scripts << "hypothenuse(6.0, 8.0) * PI";
+    scripts << "while(true) { }";           // Aborted when out of budget
+    scripts << "undefinedFunction(sum)";    // Variables of other scripts are not visible
+
+    QElapsedTimer elapsed;
+    elapsed.start();
+    int remaining = scripts.size();
+    for(int i = 0; i < scripts.size(); i++)
+        pool.Evaluate(scripts[i], 1000, &app, [&, i](ScriptPool::Result const& r){
+            std::cout << " [INFO] Script " << i << " on engine " << r.worker << ": "
+                      << (r.Ok() ? r.value.toString() : r.error).toStdString()
+                      << " (" << r.elapsedNs / 1000000 << " ms)" << std::endl;
+            if(--remaining == 0)
+            {
+                std::cout << " [INFO] " << scripts.size() << " scripts on " << pool.Threads()
+                          << " engines in " << elapsed.elapsed() << " ms" << std::endl;
+                app.quit();
+            }
+        });
+
     return app.exec();
 
 }
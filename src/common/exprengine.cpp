@@ -0,0 +1,754 @@
+#include "exprengine.h"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+using Op          = Expression::Op;
+using Instruction = Expression::Instruction;
+
+namespace {
+
+// Elements evaluated by each instruction at once, the temporaries of a
+// block of a typical payoff stay in the L1 cache.
+constexpr size_t BlockSize = 256;
+
+// Nesting of parentheses, ?: and unary operators in the source, bounds the
+// recursion of the parser. Chains of binary operators are not nested, the
+// AST they produce is walked without recursion.
+constexpr int MaxDepth = 256;
+
+// Registers of the single evaluation kept on the stack
+constexpr int ScalarRegisters = 64;
+
+enum class Type { Number, Bool };
+
+struct Node
+{
+    enum Kind { Const, Var, Apply };
+
+    Kind   kind;
+    Type   type  = Type::Number;
+    Op     op    = Op::Add;
+    double value = 0.0;
+    int    var   = -1;
+    std::vector<std::unique_ptr<Node>> args;
+
+    Node() = default;
+    Node(Node const&) = delete;
+    Node& operator=(Node const&) = delete;
+
+    /** A long chain such as a + b + c + ... is a left tree as deep as the
+     *  chain is long, release it without recursion. */
+    ~Node()
+    {
+        std::vector<std::unique_ptr<Node>> pending = std::move(args);
+        while(!pending.empty())
+        {
+            std::unique_ptr<Node> node = std::move(pending.back());
+            pending.pop_back();
+            if(node == nullptr)
+                continue;
+            for(std::unique_ptr<Node>& arg: node->args)
+                pending.push_back(std::move(arg));
+            node->args.clear();
+        }
+    }
+};
+
+using NodePtr = std::unique_ptr<Node>;
+
+double NormalPdf(double x)
+{
+    return 0.39894228040143267794 * std::exp(-0.5 * x * x);
+}
+
+double NormalCdf(double x)
+{
+    return 0.5 * std::erfc(-x * 0.70710678118654752440);
+}
+
+/** Scalar semantics of the instructions, used for constant folding */
+double ApplyOp(Op op, double a, double b, double c)
+{
+    switch(op)
+    {
+    case Op::Neg:    return -a;
+    case Op::Not:    return a == 0.0 ? 1.0 : 0.0;
+    case Op::Add:    return a + b;
+    case Op::Sub:    return a - b;
+    case Op::Mul:    return a * b;
+    case Op::Div:    return a / b;
+    case Op::Pow:    return std::pow(a, b);
+    case Op::Lt:     return a <  b ? 1.0 : 0.0;
+    case Op::Le:     return a <= b ? 1.0 : 0.0;
+    case Op::Gt:     return a >  b ? 1.0 : 0.0;
+    case Op::Ge:     return a >= b ? 1.0 : 0.0;
+    case Op::Eq:     return a == b ? 1.0 : 0.0;
+    case Op::Ne:     return a != b ? 1.0 : 0.0;
+    case Op::And:    return a != 0.0 && b != 0.0 ? 1.0 : 0.0;
+    case Op::Or:     return a != 0.0 || b != 0.0 ? 1.0 : 0.0;
+    case Op::Select: return a != 0.0 ? b : c;
+    case Op::Exp:    return std::exp(a);
+    case Op::Log:    return std::log(a);
+    case Op::Sqrt:   return std::sqrt(a);
+    case Op::Abs:    return std::fabs(a);
+    case Op::Floor:  return std::floor(a);
+    case Op::Ceil:   return std::ceil(a);
+    case Op::Ncdf:   return NormalCdf(a);
+    case Op::Npdf:   return NormalPdf(a);
+    case Op::Min:    return std::min(a, b);
+    case Op::Max:    return std::max(a, b);
+    }
+    return 0.0;
+}
+
+const char* OpName(Op op)
+{
+    static const char* names[] = {
+        "neg", "not", "add", "sub", "mul", "div", "pow",
+        "lt", "le", "gt", "ge", "eq", "ne", "and", "or", "select",
+        "exp", "log", "sqrt", "abs", "floor", "ceil", "ncdf", "npdf", "min", "max"
+    };
+    return names[static_cast<int>(op)];
+}
+
+struct Function
+{
+    const char* name;
+    Op          op;
+    int         arity;
+};
+
+const Function Functions[] = {
+    {"exp",  Op::Exp,   1}, {"log",  Op::Log,  1}, {"sqrt", Op::Sqrt, 1},
+    {"abs",  Op::Abs,   1}, {"floor", Op::Floor, 1}, {"ceil", Op::Ceil, 1},
+    {"ncdf", Op::Ncdf,  1}, {"npdf", Op::Npdf, 1}, {"pow",  Op::Pow,  2},
+    {"min",  Op::Min,   2}, {"max",  Op::Max,  2}
+};
+
+} // --- End of namespace --- //
+
+/** Parser, type checker and code generator */
+class ExpressionCompiler
+{
+public:
+    ExpressionCompiler(QString const& source, QStringList const& variables)
+        : src(source), variables(variables)
+    {
+    }
+
+    auto Compile(QString* error) -> std::shared_ptr<Expression>
+    {
+        if(variables.size() > 64)
+            return this->Fail(error, "Too many variables, 64 at most");
+        this->Next();
+        NodePtr root = this->Ternary();
+        if(root != nullptr && token != End)
+            this->Error("Unexpected '" + text + "'");
+        if(root == nullptr)
+            return this->Fail(error, message);
+
+        std::shared_ptr<Expression> expr(new Expression);
+        expr->source    = src;
+        expr->variables = variables;
+        this->CollectConstants(root.get(), *expr);
+        expr->registers = variables.size() + static_cast<int>(expr->constants.size());
+        nextTemp = expr->registers;
+        expr->result    = this->Emit(root.get(), *expr);
+        expr->registers = std::max(expr->registers, nextTemp);
+        if(expr->registers > 0xFFFF)
+            return this->Fail(error, "Expression too large");
+        return expr;
+    }
+
+private:
+    enum Token { End, Number, Name, Symbol };
+
+    QString     src;
+    QStringList variables;
+    int         pos = 0;
+    Token       token = End;
+    QString     text;
+    double      number = 0.0;
+    int         tokenPos = 0;
+    int         depth = 0;
+    QString     message;
+    // Register allocation
+    int         nextTemp = 0;
+    std::vector<int> freeTemps;
+
+    std::shared_ptr<Expression> Fail(QString* error, QString const& msg)
+    {
+        if(error) *error = msg;
+        return nullptr;
+    }
+
+    /** at: position of the error, the current token by default */
+    NodePtr Error(QString const& msg, int at = -1)
+    {
+        // The first error is the meaningful one
+        if(message.isEmpty())
+            message = QString("%1 at column %2").arg(msg).arg((at < 0 ? tokenPos : at) + 1);
+        return nullptr;
+    }
+
+    //-------- Lexer --------//
+
+    void Next()
+    {
+        while(pos < src.size() && src[pos].isSpace())
+            pos++;
+        tokenPos = pos;
+        if(pos >= src.size())
+        {
+            token = End;
+            text  = "end of expression";
+            return;
+        }
+        QChar ch = src[pos];
+        if(ch.isDigit() || (ch == '.' && pos + 1 < src.size() && src[pos + 1].isDigit()))
+        {
+            int start = pos;
+            while(pos < src.size() && (src[pos].isDigit() || src[pos] == '.'))
+                pos++;
+            if(pos < src.size() && (src[pos] == 'e' || src[pos] == 'E'))
+            {
+                pos++;
+                if(pos < src.size() && (src[pos] == '+' || src[pos] == '-'))
+                    pos++;
+                while(pos < src.size() && src[pos].isDigit())
+                    pos++;
+            }
+            text  = src.mid(start, pos - start);
+            token = Number;
+            bool ok = false;
+            number = text.toDouble(&ok);
+            if(!ok)
+                token = Symbol;     // Reported as unexpected by the parser
+            return;
+        }
+        if(ch.isLetter() || ch == '_')
+        {
+            int start = pos;
+            while(pos < src.size() && (src[pos].isLetterOrNumber() || src[pos] == '_'
+                                       || src[pos] == '.'))
+                pos++;
+            text  = src.mid(start, pos - start);
+            token = Name;
+            return;
+        }
+        static const char* twoChars[] = {"<=", ">=", "==", "!=", "&&", "||", "**"};
+        for(const char* sym: twoChars)
+            if(src.midRef(pos, 2) == QLatin1String(sym))
+            {
+                text  = sym;
+                token = Symbol;
+                pos  += 2;
+                return;
+            }
+        text  = QString(ch);
+        token = Symbol;
+        pos++;
+    }
+
+    bool Accept(const char* symbol)
+    {
+        if(token != Symbol || text != QLatin1String(symbol))
+            return false;
+        this->Next();
+        return true;
+    }
+
+    /** Counts the nesting of the recursive rules while in scope */
+    struct Nesting
+    {
+        int& depth;
+        explicit Nesting(int& depth): depth(depth) { ++depth; }
+        ~Nesting() { --depth; }
+        bool TooDeep() const { return depth > MaxDepth; }
+    };
+
+    //-------- Typed AST --------//
+
+    NodePtr Make(Op op, Type type, std::vector<NodePtr> args)
+    {
+        bool constant = std::all_of(args.begin(), args.end(),
+                                    [](NodePtr const& n){ return n->kind == Node::Const; });
+        auto node  = std::make_unique<Node>();
+        node->type = type;
+        if(constant)
+        {
+            double v[3] = {0.0, 0.0, 0.0};
+            for(size_t i = 0; i < args.size(); i++)
+                v[i] = args[i]->value;
+            node->kind  = Node::Const;
+            node->value = ApplyOp(op, v[0], v[1], v[2]);
+            return node;
+        }
+        node->kind = Node::Apply;
+        node->op   = op;
+        node->args = std::move(args);
+        return node;
+    }
+
+    NodePtr Check(NodePtr node, Type type, const char* what)
+    {
+        if(node == nullptr)
+            return nullptr;
+        if(node->type != type)
+            return this->Error(QString("%1 expects a %2").arg(what)
+                               .arg(type == Type::Number ? "number" : "boolean"));
+        return node;
+    }
+
+    NodePtr Binary(Op op, NodePtr a, NodePtr b, Type operands, Type result, const char* what)
+    {
+        a = this->Check(std::move(a), operands, what);
+        b = this->Check(std::move(b), operands, what);
+        if(a == nullptr || b == nullptr)
+            return nullptr;
+        std::vector<NodePtr> args;
+        args.push_back(std::move(a));
+        args.push_back(std::move(b));
+        return this->Make(op, result, std::move(args));
+    }
+
+    //-------- Parser, lowest precedence first --------//
+
+    NodePtr Ternary()
+    {
+        Nesting nesting(depth);
+        if(nesting.TooDeep())
+            return this->Error("Expression nested too deeply");
+        NodePtr cond = this->LogicalOr();
+        if(cond == nullptr || !this->Accept("?"))
+            return cond;
+        cond = this->Check(std::move(cond), Type::Bool, "Condition");
+        NodePtr a = this->Ternary();
+        if(a == nullptr)
+            return nullptr;
+        if(!this->Accept(":"))
+            return this->Error("Expected ':'");
+        NodePtr b = this->Ternary();
+        if(cond == nullptr || b == nullptr)
+            return nullptr;
+        if(a->type != b->type)
+            return this->Error("Branches of ?: have different types");
+        Type type = a->type;
+        std::vector<NodePtr> args;
+        args.push_back(std::move(cond));
+        args.push_back(std::move(a));
+        args.push_back(std::move(b));
+        return this->Make(Op::Select, type, std::move(args));
+    }
+
+    NodePtr LogicalOr()
+    {
+        NodePtr lhs = this->LogicalAnd();
+        while(lhs != nullptr && this->Accept("||"))
+            lhs = this->Binary(Op::Or, std::move(lhs), this->LogicalAnd(),
+                               Type::Bool, Type::Bool, "||");
+        return lhs;
+    }
+
+    NodePtr LogicalAnd()
+    {
+        NodePtr lhs = this->Equality();
+        while(lhs != nullptr && this->Accept("&&"))
+            lhs = this->Binary(Op::And, std::move(lhs), this->Equality(),
+                               Type::Bool, Type::Bool, "&&");
+        return lhs;
+    }
+
+    NodePtr Equality()
+    {
+        NodePtr lhs = this->Relational();
+        while(lhs != nullptr)
+        {
+            Op op;
+            if(this->Accept("=="))      op = Op::Eq;
+            else if(this->Accept("!=")) op = Op::Ne;
+            else break;
+            // Booleans compare as well as numbers
+            NodePtr rhs = this->Relational();
+            if(rhs == nullptr)
+                return nullptr;
+            Type type = lhs->type;
+            lhs = this->Binary(op, std::move(lhs), std::move(rhs), type, Type::Bool, "Comparison");
+        }
+        return lhs;
+    }
+
+    NodePtr Relational()
+    {
+        NodePtr lhs = this->Additive();
+        while(lhs != nullptr)
+        {
+            Op op;
+            if(this->Accept("<="))      op = Op::Le;
+            else if(this->Accept(">=")) op = Op::Ge;
+            else if(this->Accept("<"))  op = Op::Lt;
+            else if(this->Accept(">"))  op = Op::Gt;
+            else break;
+            lhs = this->Binary(op, std::move(lhs), this->Additive(),
+                               Type::Number, Type::Bool, "Comparison");
+        }
+        return lhs;
+    }
+
+    NodePtr Additive()
+    {
+        NodePtr lhs = this->Multiplicative();
+        while(lhs != nullptr)
+        {
+            Op op;
+            if(this->Accept("+"))      op = Op::Add;
+            else if(this->Accept("-")) op = Op::Sub;
+            else break;
+            lhs = this->Binary(op, std::move(lhs), this->Multiplicative(),
+                               Type::Number, Type::Number, "Arithmetic");
+        }
+        return lhs;
+    }
+
+    NodePtr Multiplicative()
+    {
+        NodePtr lhs = this->Unary();
+        while(lhs != nullptr)
+        {
+            Op op;
+            if(this->Accept("*"))      op = Op::Mul;
+            else if(this->Accept("/")) op = Op::Div;
+            else break;
+            lhs = this->Binary(op, std::move(lhs), this->Unary(),
+                               Type::Number, Type::Number, "Arithmetic");
+        }
+        return lhs;
+    }
+
+    NodePtr Unary()
+    {
+        Nesting nesting(depth);
+        if(nesting.TooDeep())
+            return this->Error("Expression nested too deeply");
+        if(this->Accept("+"))
+            return this->Check(this->Unary(), Type::Number, "Unary +");
+        Op   op;
+        Type type;
+        if(this->Accept("-"))      { op = Op::Neg; type = Type::Number; }
+        else if(this->Accept("!")) { op = Op::Not; type = Type::Bool;   }
+        else return this->Power();
+        NodePtr arg = this->Check(this->Unary(), type, op == Op::Neg ? "Unary -" : "!");
+        if(arg == nullptr)
+            return nullptr;
+        std::vector<NodePtr> args;
+        args.push_back(std::move(arg));
+        return this->Make(op, type, std::move(args));
+    }
+
+    NodePtr Power()
+    {
+        NodePtr base = this->Primary();
+        // ^ is the bitwise xor of JavaScript, not a power
+        if(base != nullptr && token == Symbol && text == "^")
+            return this->Error("Use ** for a power, ^ is not supported");
+        if(base != nullptr && this->Accept("**"))
+            // Right associative, and binds tighter than unary minus on its left
+            return this->Binary(Op::Pow, std::move(base), this->Unary(),
+                                Type::Number, Type::Number, "Power");
+        return base;
+    }
+
+    NodePtr Primary()
+    {
+        if(token == Number)
+        {
+            auto node   = std::make_unique<Node>();
+            node->kind  = Node::Const;
+            node->value = number;
+            this->Next();
+            return node;
+        }
+        if(this->Accept("("))
+        {
+            NodePtr inner = this->Ternary();
+            if(inner != nullptr && !this->Accept(")"))
+                return this->Error("Expected ')'");
+            return inner;
+        }
+        if(token != Name)
+            return this->Error("Unexpected '" + text + "'");
+
+        QString name    = text;
+        int     namePos = tokenPos;
+        this->Next();
+        if(token == Symbol && text == "(")
+            return this->Call(name, namePos);
+
+        int var = variables.indexOf(name);
+        if(var >= 0)
+        {
+            auto node  = std::make_unique<Node>();
+            node->kind = Node::Var;
+            node->var  = var;
+            return node;
+        }
+        QString constant = name.startsWith("Math.") ? name.mid(5) : name;
+        if(constant == "PI" || constant == "E")
+        {
+            auto node   = std::make_unique<Node>();
+            node->kind  = Node::Const;
+            node->value = constant == "PI" ? 3.14159265358979323846 : 2.71828182845904523536;
+            return node;
+        }
+        if(constant == "true" || constant == "false")
+        {
+            auto node   = std::make_unique<Node>();
+            node->kind  = Node::Const;
+            node->type  = Type::Bool;
+            node->value = constant == "true" ? 1.0 : 0.0;
+            return node;
+        }
+        return this->Error("Unknown variable '" + name + "'", namePos);
+    }
+
+    NodePtr Call(QString const& name, int namePos)
+    {
+        QString fname = name.startsWith("Math.") ? name.mid(5) : name;
+        auto fn = std::find_if(std::begin(Functions), std::end(Functions),
+                               [&](Function const& f){ return fname == QLatin1String(f.name); });
+        if(fn == std::end(Functions))
+            return this->Error("Unknown function '" + name + "'", namePos);
+        this->Accept("(");
+        std::vector<NodePtr> args;
+        if(!this->Accept(")"))
+        {
+            do
+            {
+                NodePtr arg = this->Check(this->Ternary(), Type::Number, fn->name);
+                if(arg == nullptr)
+                    return nullptr;
+                args.push_back(std::move(arg));
+            } while(this->Accept(","));
+            if(!this->Accept(")"))
+                return this->Error("Expected ')'");
+        }
+        if(static_cast<int>(args.size()) != fn->arity)
+            return this->Error(QString("%1() takes %2 argument(s)").arg(fn->name).arg(fn->arity));
+        return this->Make(fn->op, Type::Number, std::move(args));
+    }
+
+    //-------- Code generation --------//
+
+    // The AST is walked with explicit stacks, its height is not bounded
+
+    void CollectConstants(Node* root, Expression& expr)
+    {
+        std::vector<Node*> pending = {root};
+        while(!pending.empty())
+        {
+            Node* node = pending.back();
+            pending.pop_back();
+            if(node->kind == Node::Const)
+            {
+                auto it = std::find(expr.constants.begin(), expr.constants.end(), node->value);
+                if(it == expr.constants.end())
+                    it = expr.constants.insert(expr.constants.end(), node->value);
+                node->var = variables.size() + static_cast<int>(it - expr.constants.begin());
+            }
+            if(node->kind == Node::Var)
+                expr.used |= uint64_t(1) << node->var;
+            for(auto arg = node->args.rbegin(); arg != node->args.rend(); ++arg)
+                pending.push_back(arg->get());
+        }
+    }
+
+    /** Returns the register holding the value of root */
+    int Emit(Node* root, Expression& expr)
+    {
+        if(root->kind != Node::Apply)
+            return root->var;
+        // Operations whose operands are being emitted, operands left to right
+        struct Frame
+        {
+            Node*  node;
+            size_t next;
+            int    regs[3];
+        };
+        std::vector<Frame> stack = {{root, 0, {0, 0, 0}}};
+        for(;;)
+        {
+            Frame& frame = stack.back();
+            if(frame.next < frame.node->args.size())
+            {
+                Node* arg = frame.node->args[frame.next].get();
+                if(arg->kind == Node::Apply)
+                    stack.push_back({arg, 0, {0, 0, 0}});
+                else
+                    frame.regs[frame.next++] = arg->var;
+                continue;
+            }
+            int dst = this->EmitInstruction(frame.node, frame.regs, expr);
+            stack.pop_back();
+            if(stack.empty())
+                return dst;
+            Frame& parent = stack.back();
+            parent.regs[parent.next++] = dst;
+        }
+    }
+
+    /** Appends the instruction of node, its operands are in regs */
+    int EmitInstruction(Node* node, int const* regs, Expression& expr)
+    {
+        // Each temporary is read once (tree), so operands are free for the
+        // result: instructions are element-wise, dst may alias an operand.
+        for(size_t i = 0; i < node->args.size(); i++)
+            if(regs[i] >= static_cast<int>(variables.size() + expr.constants.size()))
+                freeTemps.push_back(regs[i]);
+        int dst;
+        if(freeTemps.empty())
+            dst = nextTemp++;
+        else
+        {
+            dst = freeTemps.back();
+            freeTemps.pop_back();
+        }
+        expr.code.push_back({node->op, uint16_t(dst), uint16_t(regs[0]),
+                             uint16_t(regs[1]), uint16_t(regs[2])});
+        return dst;
+    }
+};
+
+//======= Expression Implementation ==========//
+
+auto Expression::Compile(QString const& source, QStringList const& variables,
+                         QString* error) -> std::shared_ptr<Expression>
+{
+    return ExpressionCompiler(source, variables).Compile(error);
+}
+
+QStringList Expression::Dependencies() const
+{
+    QStringList deps;
+    for(int i = 0; i < variables.size(); i++)
+        if(this->DependsOn(i))
+            deps << variables[i];
+    return deps;
+}
+
+void Expression::Evaluate(std::vector<double const*> const& columns, size_t n, double* out) const
+{
+    int nvars   = variables.size();
+    int nconsts = static_cast<int>(constants.size());
+    for(int v = 0; v < nvars; v++)
+        if(this->DependsOn(v) && (v >= static_cast<int>(columns.size()) || columns[v] == nullptr))
+        {
+            std::fill_n(out, n, std::numeric_limits<double>::quiet_NaN());
+            return;
+        }
+    // Constants broadcast once, temporaries reused by every block
+    std::vector<double> scratch(size_t(registers - nvars) * BlockSize);
+    std::vector<double*> reg(registers);
+    for(int r = nvars; r < registers; r++)
+        reg[r] = scratch.data() + size_t(r - nvars) * BlockSize;
+    for(int k = 0; k < nconsts; k++)
+        std::fill_n(reg[nvars + k], BlockSize, constants[k]);
+
+    for(size_t offset = 0; offset < n; offset += BlockSize)
+    {
+        size_t m = std::min(BlockSize, n - offset);
+        // Inputs are read in place
+        for(int v = 0; v < nvars; v++)
+            reg[v] = this->DependsOn(v) ? const_cast<double*>(columns[v]) + offset : nullptr;
+
+        for(Instruction const& ins: code)
+        {
+            double*       d = reg[ins.dst];
+            double const* a = reg[ins.a];
+            double const* b = reg[ins.b];
+            double const* c = reg[ins.c];
+            switch(ins.op)
+            {
+            #define EXPR_LOOP(expr) for(size_t i = 0; i < m; i++) d[i] = (expr); break
+            case Op::Neg:    EXPR_LOOP(-a[i]);
+            case Op::Not:    EXPR_LOOP(a[i] == 0.0 ? 1.0 : 0.0);
+            case Op::Add:    EXPR_LOOP(a[i] + b[i]);
+            case Op::Sub:    EXPR_LOOP(a[i] - b[i]);
+            case Op::Mul:    EXPR_LOOP(a[i] * b[i]);
+            case Op::Div:    EXPR_LOOP(a[i] / b[i]);
+            case Op::Pow:    EXPR_LOOP(std::pow(a[i], b[i]));
+            case Op::Lt:     EXPR_LOOP(a[i] <  b[i] ? 1.0 : 0.0);
+            case Op::Le:     EXPR_LOOP(a[i] <= b[i] ? 1.0 : 0.0);
+            case Op::Gt:     EXPR_LOOP(a[i] >  b[i] ? 1.0 : 0.0);
+            case Op::Ge:     EXPR_LOOP(a[i] >= b[i] ? 1.0 : 0.0);
+            case Op::Eq:     EXPR_LOOP(a[i] == b[i] ? 1.0 : 0.0);
+            case Op::Ne:     EXPR_LOOP(a[i] != b[i] ? 1.0 : 0.0);
+            case Op::And:    EXPR_LOOP(a[i] != 0.0 && b[i] != 0.0 ? 1.0 : 0.0);
+            case Op::Or:     EXPR_LOOP(a[i] != 0.0 || b[i] != 0.0 ? 1.0 : 0.0);
+            // Both branches are computed, expressions have no side effects
+            case Op::Select: EXPR_LOOP(a[i] != 0.0 ? b[i] : c[i]);
+            case Op::Exp:    EXPR_LOOP(std::exp(a[i]));
+            case Op::Log:    EXPR_LOOP(std::log(a[i]));
+            case Op::Sqrt:   EXPR_LOOP(std::sqrt(a[i]));
+            case Op::Abs:    EXPR_LOOP(std::fabs(a[i]));
+            case Op::Floor:  EXPR_LOOP(std::floor(a[i]));
+            case Op::Ceil:   EXPR_LOOP(std::ceil(a[i]));
+            case Op::Ncdf:   EXPR_LOOP(NormalCdf(a[i]));
+            case Op::Npdf:   EXPR_LOOP(NormalPdf(a[i]));
+            case Op::Min:    EXPR_LOOP(std::min(a[i], b[i]));
+            case Op::Max:    EXPR_LOOP(std::max(a[i], b[i]));
+            #undef EXPR_LOOP
+            }
+        }
+        std::copy_n(reg[result], m, out + offset);
+    }
+}
+
+double Expression::Evaluate(std::vector<double> const& inputs) const
+{
+    int nvars = variables.size();
+    for(int v = static_cast<int>(inputs.size()); v < nvars; v++)
+        if(this->DependsOn(v))
+            return std::numeric_limits<double>::quiet_NaN();
+    // One value per register, no block scratch: interpreted with ApplyOp
+    double              small[ScalarRegisters];
+    std::vector<double> large;
+    double* reg = small;
+    if(registers > ScalarRegisters)
+    {
+        large.resize(registers);
+        reg = large.data();
+    }
+    for(int v = 0; v < nvars; v++)
+        reg[v] = v < static_cast<int>(inputs.size()) ? inputs[v] : 0.0;
+    std::copy(constants.begin(), constants.end(), reg + nvars);
+    for(Instruction const& ins: code)
+        reg[ins.dst] = ApplyOp(ins.op, reg[ins.a], reg[ins.b], reg[ins.c]);
+    return reg[result];
+}
+
+QString Expression::Disassemble() const
+{
+    int nvars = variables.size();
+    auto name = [&](int r){
+        if(r < nvars)
+            return variables[r];
+        if(r < nvars + static_cast<int>(constants.size()))
+            return QString::number(constants[r - nvars], 'g', 17);
+        return QString("r%1").arg(r);
+    };
+    QString out;
+    for(Instruction const& ins: code)
+    {
+        int arity = ins.op == Op::Select ? 3
+                  : (ins.op == Op::Neg || ins.op == Op::Not
+                     || (ins.op >= Op::Exp && ins.op <= Op::Npdf)) ? 1 : 2;
+        out += QString("%1 = %2 %3").arg(name(ins.dst)).arg(OpName(ins.op)).arg(name(ins.a));
+        if(arity > 1) out += ", " + name(ins.b);
+        if(arity > 2) out += ", " + name(ins.c);
+        out += '\n';
+    }
+    out += "return " + name(result) + '\n';
+    return out;
+}
@@ -0,0 +1,340 @@
+#include "instrument.h"
+
+#include <mutex>
+#include <vector>
+#include <memory>
+#include <string>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+
+#include <QFile>
+#include <QTimer>
+#include <QThread>
+#include <QSaveFile>
+#include <QTextStream>
+#include <QCoreApplication>
+#include <QCommandLineParser>
+
+namespace Instrument
+{
+
+namespace {
+
+struct Event
+{
+    Site const* site;
+    int64_t     start;
+    int64_t     duration;
+};
+
+/** Trace events of one thread, the oldest are overwritten when it is full.
+ *  Only the owner thread writes, the exporter reads up to head. */
+struct ThreadBuffer
+{
+    static constexpr uint64_t Capacity = 1 << 16;
+    // Events next to the write position may be overwritten while exported
+    static constexpr uint64_t Margin   = 1 << 10;
+
+    std::unique_ptr<Event[]> events{new Event[Capacity]};
+    std::atomic<uint64_t>    head{0};
+    int                      tid;
+    QString                  name;
+};
+
+std::atomic<Site*>         sites{nullptr};
+std::atomic<bool>          tracing{false};
+std::mutex                 buffersMutex;
+// Never freed, pool threads live until the application exits and the
+// events of finished threads are still exported.
+std::vector<ThreadBuffer*> buffers;
+thread_local ThreadBuffer* threadBuffer = nullptr;
+
+ThreadBuffer* CurrentBuffer()
+{
+    if(threadBuffer != nullptr)
+        return threadBuffer;
+    auto buffer = new ThreadBuffer;
+    QCoreApplication* app = QCoreApplication::instance();
+    bool gui = app != nullptr && QThread::currentThread() == app->thread();
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    buffer->tid  = static_cast<int>(buffers.size()) + 1;
+    buffer->name = gui ? QString("GUI thread") : QString("Thread %1").arg(buffer->tid);
+    buffers.push_back(buffer);
+    threadBuffer = buffer;
+    return buffer;
+}
+
+QString JsonString(const char* text)
+{
+    QString s = QString::fromUtf8(text);
+    s.replace('\\', "\\\\").replace('"', "\\\"");
+    return '"' + s + '"';
+}
+
+} // --- End of namespace --- //
+
+//======= Histogram Implementation ==========//
+
+int Histogram::Index(int64_t value)
+{
+    if(value < (int64_t(1) << SubBits))
+        return static_cast<int>(value);
+    int msb   = 63 - __builtin_clzll(static_cast<uint64_t>(value));
+    int shift = msb - SubBits + 1;
+    // Top SubBits bits of the value, in [2^(SubBits - 1), 2^SubBits)
+    int sub   = static_cast<int>(value >> shift);
+    return (shift << (SubBits - 1)) + sub;
+}
+
+int64_t Histogram::Value(int index)
+{
+    if(index < (1 << SubBits))
+        return index;
+    int shift = (index >> (SubBits - 1)) - 1;
+    int64_t sub = index - (shift << (SubBits - 1));
+    // Middle of the bucket
+    return (sub << shift) + ((int64_t(1) << shift) >> 1);
+}
+
+void Histogram::Record(int64_t ns)
+{
+    ns = std::max<int64_t>(ns, 0);
+    counts[Index(ns)].fetch_add(1, std::memory_order_relaxed);
+    int64_t m = max.load(std::memory_order_relaxed);
+    while(ns > m && !max.compare_exchange_weak(m, ns, std::memory_order_relaxed))
+        ;
+}
+
+void Histogram::Reset()
+{
+    for(auto& c: counts)
+        c.store(0, std::memory_order_relaxed);
+    max.store(0, std::memory_order_relaxed);
+}
+
+uint64_t Histogram::Count() const
+{
+    uint64_t n = 0;
+    for(auto const& c: counts)
+        n += c.load(std::memory_order_relaxed);
+    return n;
+}
+
+int64_t Histogram::Percentile(double p) const
+{
+    uint64_t n = this->Count();
+    if(n == 0)
+        return 0;
+    uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(p * n + 0.5));
+    uint64_t seen = 0;
+    for(int i = 0; i < Buckets; i++)
+    {
+        seen += counts[i].load(std::memory_order_relaxed);
+        if(seen >= rank)
+            return std::min(Value(i), this->Max());
+    }
+    return this->Max();
+}
+
+//======= Site Implementation ==========//
+
+Site::Site(const char* name): name(name)
+{
+    // Lock-free push, sites are created by function-local statics
+    next = sites.load();
+    while(!sites.compare_exchange_weak(next, this))
+        ;
+}
+
+void Site::Record(int64_t start, int64_t duration)
+{
+    histogram.Record(duration);
+    if(!tracing.load(std::memory_order_relaxed))
+        return;
+    ThreadBuffer* buffer = CurrentBuffer();
+    uint64_t h = buffer->head.load(std::memory_order_relaxed);
+    buffer->events[h & (ThreadBuffer::Capacity - 1)] = {this, start, duration};
+    buffer->head.store(h + 1, std::memory_order_release);
+}
+
+//======= Reports ==========//
+
+void EnableTracing(bool enabled)
+{
+    tracing = enabled;
+}
+
+void Report(std::ostream& os)
+{
+    // Oldest site first, the list is built by prepending
+    std::vector<Site*> list;
+    for(Site* s = sites.load(); s != nullptr; s = s->next)
+        list.push_back(s);
+    std::reverse(list.begin(), list.end());
+
+    os << " [INFO] Timings (us)" << std::endl;
+    for(Site* s: list)
+    {
+        Histogram const& h = s->histogram;
+        uint64_t n = h.Count();
+        if(n == 0)
+            continue;
+        os << " [INFO]   " << std::left << std::setw(36) << s->Name() << std::right
+           << std::fixed << std::setprecision(1)
+           << " n = "    << std::setw(8) << n
+           << "  p50 = " << std::setw(9) << h.Percentile(0.50) / 1e3
+           << "  p90 = " << std::setw(9) << h.Percentile(0.90) / 1e3
+           << "  p99 = " << std::setw(9) << h.Percentile(0.99) / 1e3
+           << "  max = " << std::setw(9) << h.Max() / 1e3 << std::endl;
+    }
+}
+
+bool WriteChromeTrace(QString const& path, QString* error)
+{
+    std::vector<ThreadBuffer*> threads;
+    {
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        threads = buffers;
+    }
+    qint64 pid = QCoreApplication::applicationPid();
+
+    QSaveFile file(path);
+    if(!file.open(QFile::WriteOnly | QFile::Text))
+    {
+        if(error) *error = file.errorString();
+        return false;
+    }
+    QTextStream out(&file);
+    out.setRealNumberNotation(QTextStream::FixedNotation);
+    out.setRealNumberPrecision(3);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    auto separator = [&]{
+        if(!first) out << ",\n";
+        first = false;
+    };
+    for(ThreadBuffer* t: threads)
+    {
+        separator();
+        out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << t->tid
+            << ",\"args\":{\"name\":" << JsonString(t->name.toUtf8().constData()) << "}}";
+
+        uint64_t head = t->head.load(std::memory_order_acquire);
+        uint64_t keep = ThreadBuffer::Capacity - ThreadBuffer::Margin;
+        for(uint64_t i = head > keep ? head - keep : 0; i < head; i++)
+        {
+            Event const& e = t->events[i & (ThreadBuffer::Capacity - 1)];
+            separator();
+            // Timestamps in microseconds
+            out << "{\"name\":" << JsonString(e.site->Name()) << ",\"ph\":\"X\",\"pid\":" << pid
+                << ",\"tid\":" << t->tid << ",\"ts\":" << e.start / 1e3
+                << ",\"dur\":" << e.duration / 1e3 << "}";
+        }
+    }
+    out << "]}\n";
+    out.flush();
+    if(file.commit())
+        return true;
+    if(error) *error = file.errorString();
+    return false;
+}
+
+//======= StallDetector Implementation ==========//
+
+StallDetector::StallDetector(int thresholdMs)
+    : threshold(int64_t(thresholdMs) * 1000000), timer(new QTimer)
+{
+    int interval = std::max(thresholdMs / 4, 1);
+    lastBeat = Now();
+    expected = lastBeat + int64_t(interval) * 1000000;
+    timer->setInterval(interval);
+    timer->setTimerType(Qt::PreciseTimer);
+    QObject::connect(timer, &QTimer::timeout, [this]{ this->Beat(); });
+    timer->start();
+
+    watchdog = std::thread([this, interval]{
+        int64_t reported = 0;
+        while(!stop.load())
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(interval));
+            int64_t beat = lastBeat.load();
+            // Once per stall, the GUI thread cannot log while it is blocked
+            if(Now() - beat > threshold && beat != reported)
+            {
+                reported = beat;
+                std::cout << " [WARNING] GUI thread blocked for more than "
+                          << threshold / 1000000 << " ms" << std::endl;
+            }
+        }
+    });
+}
+
+StallDetector::~StallDetector()
+{
+    stop = true;
+    watchdog.join();
+    delete timer;
+}
+
+void StallDetector::Beat()
+{
+    static Site loopLatency("Event loop latency");
+    static Site stall("GUI thread stall");
+
+    int64_t now = Now();
+    loopLatency.histogram.Record(now - expected);
+    int64_t gap = now - lastBeat.load();
+    if(gap > threshold)
+    {
+        stall.Record(lastBeat.load(), gap);
+        std::cout << " [WARNING] GUI thread was blocked for " << gap / 1000000 << " ms"
+                  << std::endl;
+    }
+    lastBeat = now;
+    expected = now + int64_t(timer->interval()) * 1000000;
+}
+
+//======= Session Implementation ==========//
+
+void Session::AddOptions(QCommandLineParser& parser)
+{
+    QCommandLineOption traceOption(
+        "trace", "Write a Chrome trace (chrome://tracing) of the hot paths at exit.", "file");
+    QCommandLineOption stallOption(
+        "stall-ms", "Warn when the GUI thread is blocked longer than this, 0 disables.",
+        "ms", "100");
+    QCommandLineOption timingsOption(
+        "timings", "Print the latency percentiles of the hot paths at exit.");
+    parser.addOption(traceOption);
+    parser.addOption(stallOption);
+    parser.addOption(timingsOption);
+}
+
+Session::Session(QCommandLineParser const& parser)
+{
+    tracePath = parser.value("trace");
+    timings   = parser.isSet("timings");
+    EnableTracing(!tracePath.isEmpty());
+    int stallMs = parser.value("stall-ms").toInt();
+    if(stallMs > 0)
+        detector = new StallDetector(stallMs);
+}
+
+Session::~Session()
+{
+    delete detector;
+    if(timings)
+        Report(std::cout);
+    if(tracePath.isEmpty())
+        return;
+    EnableTracing(false);
+    QString error;
+    if(WriteChromeTrace(tracePath, &error))
+        std::cout << " [INFO] Trace written to " << tracePath.toStdString() << std::endl;
+    else
+        std::cout << " [ERROR] Cannot write trace " << tracePath.toStdString() << ": "
+                  << error.toStdString() << std::endl;
+}
+
+} // --- End of namespace Instrument --- //
@@ -0,0 +1,174 @@
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+
+#include <iosfwd>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstdint>
+
+#include <QString>
+
+class QTimer;
+class QCommandLineParser;
+
+/** Lightweight timing of hot paths, shared by the sample applications.
+ *
+ *  INSTRUMENT_SCOPE("name") at the top of a function records its duration
+ *  into a latency histogram of that site, and into a per-thread trace
+ *  buffer when tracing is enabled. Neither takes a lock: histogram counters
+ *  are atomic and each thread owns its trace buffer. The cost is two clock
+ *  reads and a few relaxed atomic increments.
+ *
+ *  Session turns the collected data into a percentile report and a Chrome
+ *  trace (chrome://tracing or https://ui.perfetto.dev) at exit, and runs
+ *  the StallDetector on the GUI thread.
+ */
+namespace Instrument
+{
+
+/** Monotonic time in nanoseconds. steady_clock reads the TSC through the
+ *  vDSO on Linux, so it is as cheap as RDTSC without its calibration and
+ *  cross-core caveats. */
+inline int64_t Now()
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+/** Log-linear latency histogram, the layout of HdrHistogram: 128 linear
+ *  sub-buckets per power of two, i.e. values within 1% from 1 ns to hours,
+ *  in a fixed array of counters. */
+class Histogram
+{
+public:
+    void Record(int64_t ns);
+    /** Not atomic with respect to concurrent Record() calls */
+    void Reset();
+
+    uint64_t Count() const;
+    /** p in [0, 1], in nanoseconds */
+    int64_t  Percentile(double p) const;
+    int64_t  Max() const { return max.load(std::memory_order_relaxed); }
+
+private:
+    // Values below 2^SubBits are exact, above 2^(SubBits - 1) sub-buckets
+    // per power of two
+    static constexpr int SubBits  = 8;
+    static constexpr int Buckets  = (64 - SubBits + 1) << (SubBits - 1);
+
+    std::atomic<uint64_t> counts[Buckets] = {};
+    std::atomic<int64_t>  max{0};
+
+    static int     Index(int64_t value);
+    static int64_t Value(int index);
+};
+
+/** Instrumented code location, created once (static) by INSTRUMENT_SCOPE */
+class Site
+{
+public:
+    explicit Site(const char* name);
+
+    Site(Site const&) = delete;
+    Site& operator=(Site const&) = delete;
+
+    const char* Name() const { return name; }
+    Histogram   histogram;
+
+    /** Records a completed interval in the histogram and trace buffer */
+    void Record(int64_t start, int64_t duration);
+
+private:
+    const char* name;
+    Site*       next;
+    friend void Report(std::ostream& os);
+};
+
+class ScopedTimer
+{
+    Site&   site;
+    int64_t start;
+public:
+    explicit ScopedTimer(Site& site): site(site), start(Now()) { }
+    ~ScopedTimer() { site.Record(start, Now() - start); }
+
+    ScopedTimer(ScopedTimer const&) = delete;
+    ScopedTimer& operator=(ScopedTimer const&) = delete;
+};
+
+/** Record trace events from now on, histograms are always recorded */
+void EnableTracing(bool enabled);
+
+/** Percentiles of every site that recorded something */
+void Report(std::ostream& os);
+
+/** Chrome trace event format, complete ("X") events of all threads */
+bool WriteChromeTrace(QString const& path, QString* error = nullptr);
+
+/** Detects when the GUI thread stops processing events.
+ *
+ *  A timer on the GUI thread beats every threshold / 4. How late each beat
+ *  is measures the event loop latency. A watchdog thread warns as soon as
+ *  the beats stop for longer than the threshold, while the GUI is still
+ *  blocked, and the stall duration is logged once the GUI thread resumes.
+ */
+class StallDetector
+{
+public:
+    /** Must be created on the GUI thread */
+    explicit StallDetector(int thresholdMs);
+    ~StallDetector();
+
+    StallDetector(StallDetector const&) = delete;
+    StallDetector& operator=(StallDetector const&) = delete;
+
+private:
+    int64_t              threshold;
+    QTimer*              timer;
+    std::thread          watchdog;
+    std::atomic<bool>    stop{false};
+    std::atomic<int64_t> lastBeat;
+    int64_t              expected;
+
+    void Beat();
+};
+
+/** Command line interface of the instrumentation:
+ *    --trace <file>     Write a Chrome trace of the hot paths at exit
+ *    --stall-ms <ms>    Stall detection threshold, 0 disables (default 100)
+ *    --timings          Print the latency percentiles at exit
+ */
+class Session
+{
+public:
+    static void AddOptions(QCommandLineParser& parser);
+
+    /** Created on the GUI thread after parser.process() */
+    explicit Session(QCommandLineParser const& parser);
+    ~Session();
+
+    Session(Session const&) = delete;
+    Session& operator=(Session const&) = delete;
+
+    /** True if --trace or --timings was given */
+    bool Enabled() const { return timings || !tracePath.isEmpty(); }
+
+private:
+    QString        tracePath;
+    bool           timings = false;
+    StallDetector* detector = nullptr;
+};
+
+} // --- End of namespace Instrument --- //
+
+#define INSTRUMENT_CONCAT2(a, b) a##b
+#define INSTRUMENT_CONCAT(a, b)  INSTRUMENT_CONCAT2(a, b)
+
+/** Times the enclosing scope */
+#define INSTRUMENT_SCOPE(name)                                                  \
+    static Instrument::Site INSTRUMENT_CONCAT(instrumentSite_, __LINE__){name}; \
+    Instrument::ScopedTimer INSTRUMENT_CONCAT(instrumentTimer_, __LINE__){      \
+        INSTRUMENT_CONCAT(instrumentSite_, __LINE__)}
+
+#endif // INSTRUMENT_H
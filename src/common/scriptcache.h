@@ -0,0 +1,60 @@
+#ifndef SCRIPTCACHE_H
+#define SCRIPTCACHE_H
+
+#include <QHash>
+#include <QString>
+
+/** Cache of compiled script functions, keyed by the hash of their source.
+ *
+ *  Evaluating function text parses and compiles it each time. Get() does
+ *  it once per distinct source and returns the same function object
+ *  afterwards. Works with QJSEngine/QJSValue and QScriptEngine/QScriptValue.
+ *
+ *  Example:
+ *    FunctionCache<QJSEngine, QJSValue> cache(engine);
+ *    QJSValue f = cache.Get("function(a, b) { return a * a + b * b; }");
+ */
+template<typename Engine, typename Value>
+class FunctionCache
+{
+public:
+    explicit FunctionCache(Engine& engine, int capacity = 256)
+        : engine(engine), capacity(capacity) { }
+
+    /** Compiled function of source, or the error value of the evaluation.
+     *  Errors are not cached. */
+    Value Get(QString const& source)
+    {
+        auto it = functions.constFind(source);
+        if(it != functions.constEnd())
+        {
+            hits++;
+            return it.value();
+        }
+        misses++;
+        // Parenthesized, so "function(...) {...}" is an expression
+        Value fn = engine.evaluate("(" + source + ")");
+        if(fn.isError())
+            return fn;
+        // Scripts generated on the fly must not grow the cache forever
+        if(functions.size() >= capacity)
+            functions.clear();
+        functions.insert(source, fn);
+        return fn;
+    }
+
+    void Clear() { functions.clear(); }
+
+    int  Size()   const { return functions.size(); }
+    long Hits()   const { return hits; }
+    long Misses() const { return misses; }
+
+private:
+    Engine&                engine;
+    int                    capacity;
+    QHash<QString, Value>  functions;
+    long                   hits   = 0;
+    long                   misses = 0;
+};
+
+#endif // SCRIPTCACHE_H
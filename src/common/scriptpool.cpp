@@ -0,0 +1,138 @@
+#include "scriptpool.h"
+
+#include <algorithm>
+
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QtScript/QScriptEngine>
+#include <QtScript/QScriptContext>
+
+/** Thread owning one engine. It needs a Qt thread: the budget timer is
+ *  delivered by the event dispatcher of the thread while the engine
+ *  processes events during the evaluation. */
+class ScriptPool::Worker: public QThread
+{
+public:
+    Worker(ScriptPool& pool, int index): pool(pool), index(index) { }
+
+protected:
+    void run() override
+    {
+        // Created here, so the engine and the timer belong to this thread
+        QScriptEngine engine;
+        pool.setup(engine);
+        // Gives the budget timer a chance to fire during long scripts
+        engine.setProcessEventsInterval(10);
+
+        bool aborted = false;
+        QTimer budget;
+        budget.setSingleShot(true);
+        budget.setTimerType(Qt::PreciseTimer);
+        QObject::connect(&budget, &QTimer::timeout, [&]{
+            aborted = true;
+            engine.abortEvaluation();
+        });
+
+        Job job;
+        QElapsedTimer timer;
+        while(pool.NextJob(job))
+        {
+            Result result;
+            result.worker = index;
+            aborted = false;
+            timer.start();
+            budget.start(job.budgetMs);
+
+            // Variables declared by the script go to this context
+            engine.pushContext();
+            QScriptValue value = engine.evaluate(job.source);
+            budget.stop();
+            if(aborted)
+            {
+                result.timedOut = true;
+                result.error = QString("Time budget of %1 ms exceeded").arg(job.budgetMs);
+            }
+            else if(engine.hasUncaughtException())
+                result.error = QString("Line %1: %2").arg(engine.uncaughtExceptionLineNumber())
+                                                     .arg(value.toString());
+            else
+                result.value = value.toVariant();
+            engine.popContext();
+            engine.clearExceptions();
+            result.elapsedNs = timer.nsecsElapsed();
+
+            Callback done = std::move(job.done);
+            QPointer<QObject> receiver = job.receiver;
+            QMetaObject::invokeMethod(&pool.relay, [receiver, done, result]{
+                if(receiver != nullptr)
+                    done(result);
+            }, Qt::QueuedConnection);
+            job = Job();
+        }
+    }
+
+private:
+    ScriptPool& pool;
+    int         index;
+};
+
+//======= ScriptPool Implementation ==========//
+
+ScriptPool::ScriptPool(Setup setup, int threads): setup(std::move(setup))
+{
+    for(int i = 0; i < std::max(threads, 1); i++)
+    {
+        workers.push_back(new Worker(*this, i));
+        workers.back()->start();
+    }
+}
+
+ScriptPool::~ScriptPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+        jobs.clear();
+    }
+    wakeup.notify_all();
+    // Scripts still running finish or run out of budget
+    for(Worker* w: workers)
+    {
+        w->wait();
+        delete w;
+    }
+}
+
+void ScriptPool::Evaluate(QString const& source, int budgetMs, QObject* receiver, Callback done)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back({source, std::max(budgetMs, 1), receiver, std::move(done)});
+    }
+    wakeup.notify_one();
+}
+
+int ScriptPool::Cancel()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    int n = static_cast<int>(jobs.size());
+    jobs.clear();
+    return n;
+}
+
+int ScriptPool::Pending() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return static_cast<int>(jobs.size());
+}
+
+bool ScriptPool::NextJob(Job& job)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    wakeup.wait(lock, [this]{ return stop || !jobs.empty(); });
+    if(stop)
+        return false;
+    job = std::move(jobs.front());
+    jobs.pop_front();
+    return true;
+}
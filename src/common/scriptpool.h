@@ -0,0 +1,90 @@
+#ifndef SCRIPTPOOL_H
+#define SCRIPTPOOL_H
+
+#include <deque>
+#include <mutex>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+#include <QString>
+#include <QVariant>
+#include <QThread>
+#include <QPointer>
+
+class QScriptEngine;
+
+/** Runs independent scripts in parallel on a pool of script engines.
+ *
+ *  Script engines are single-threaded, so each worker thread owns one,
+ *  created once and set up by the Setup callback (globals, natives), which
+ *  is the costly part of a new engine. Each script runs in its own
+ *  context: variables it declares do not leak into the next script, the
+ *  globals of the setup are shared.
+ *
+ *  A script running longer than its time budget is aborted. Results are
+ *  delivered on the thread that created the pool, usually the GUI thread,
+ *  as soon as each script completes.
+ *
+ *  Example:
+ *    ScriptPool pool([](QScriptEngine& e){ e.globalObject().setProperty("PI", M_PI); });
+ *    pool.Evaluate("PI * 2", 100, &window, [](ScriptPool::Result const& r){ ... });
+ */
+class ScriptPool
+{
+public:
+    struct Result
+    {
+        QVariant value;
+        QString  error;             // Empty on success
+        bool     timedOut  = false;
+        qint64   elapsedNs = 0;
+        int      worker    = 0;
+        bool Ok() const { return error.isEmpty(); }
+    };
+
+    using Setup    = std::function<void (QScriptEngine& engine)>;
+    using Callback = std::function<void (Result const& result)>;
+
+    explicit ScriptPool(Setup setup, int threads = QThread::idealThreadCount());
+    ~ScriptPool();
+
+    ScriptPool(ScriptPool const&) = delete;
+    ScriptPool& operator=(ScriptPool const&) = delete;
+
+    /** Queues source for the next idle engine. done is invoked on the thread
+     *  of the pool, and not at all if receiver is destroyed before. The
+     *  receiver must live in the thread of the pool. */
+    void Evaluate(QString const& source, int budgetMs, QObject* receiver, Callback done);
+
+    /** Drops the scripts not started yet, returns how many */
+    int Cancel();
+
+    int Threads() const { return static_cast<int>(workers.size()); }
+    int Pending() const;
+
+private:
+    struct Job
+    {
+        QString           source;
+        int               budgetMs;
+        QPointer<QObject> receiver;
+        Callback          done;
+    };
+
+    class Worker;
+
+    Setup                   setup;
+    // Lives in the thread of the pool, results are posted to it and the
+    // receivers checked there, where they cannot be destroyed meanwhile
+    QObject                 relay;
+    std::vector<Worker*>    workers;
+    mutable std::mutex      mutex;
+    std::condition_variable wakeup;
+    std::deque<Job>         jobs;
+    bool                    stop = false;
+
+    bool NextJob(Job& job);
+};
+
+#endif // SCRIPTPOOL_H
@@ -0,0 +1,29 @@
+#ifndef TASK_H
+#define TASK_H
+
+#include <utility>
+
+#include <QRunnable>
+
+/** QRunnable running a lambda, for QThreadPool::start(). The pool deletes
+ *  it after run() (autoDelete), QRunnable::create requires Qt 5.15.
+ *
+ *  Example:
+ *    QThreadPool::globalInstance()->start(MakeTask([=]{ this->Work(); }));
+ */
+template<typename Callable>
+class Task: public QRunnable
+{
+    Callable fn;
+public:
+    explicit Task(Callable fn): fn(std::move(fn)) { }
+    void run() override { fn(); }
+};
+
+template<typename Callable>
+auto MakeTask(Callable fn) -> QRunnable*
+{
+    return new Task<Callable>(std::move(fn));
+}
+
+#endif // TASK_H
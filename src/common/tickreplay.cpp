@@ -0,0 +1,360 @@
+#include "tickreplay.h"
+
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+
+#include <QEvent>
+#include <QTimer>
+#include <QWidget>
+#include <QSaveFile>
+#include <QCoreApplication>
+#include <QCommandLineParser>
+
+namespace {
+
+constexpr char Magic[8] = {'B', 'L', 'S', 'T', 'I', 'C', 'K', '1'};
+
+struct Header
+{
+    char    magic[8];
+    quint32 recordSize;
+    quint32 reserved;
+    quint64 count;
+};
+
+static_assert(sizeof(Header) == 24, "Header layout");
+static_assert(sizeof(TickRecord) == 24, "Record layout");
+
+// Longest run of dispatching before returning to the event loop
+constexpr qint64 SliceNs = 4000000;
+
+// Workload written by --replay-generate
+constexpr size_t GeneratedTicks = 100000;
+constexpr double GeneratedRate  = 10000;
+
+} // --- End of namespace --- //
+
+//======= TickFile Implementation ==========//
+
+TickFile::~TickFile()
+{
+    this->Close();
+}
+
+void TickFile::Close()
+{
+    if(base != nullptr)
+        file.unmap(base);
+    file.close();
+    base    = nullptr;
+    records = nullptr;
+    count   = 0;
+}
+
+bool TickFile::Open(QString const& path, QString* error)
+{
+    // The mapping of a previous file is released first
+    this->Close();
+    auto fail = [&](QString const& message){
+        this->Close();
+        if(error) *error = message;
+        return false;
+    };
+    file.setFileName(path);
+    if(!file.open(QFile::ReadOnly))
+        return fail(file.errorString());
+    qint64 size = file.size();
+    if(size < qint64(sizeof(Header)))
+        return fail("File too small");
+    base = file.map(0, size);
+    if(base == nullptr)
+        return fail(file.errorString());
+
+    Header header;
+    std::memcpy(&header, base, sizeof(Header));
+    if(std::memcmp(header.magic, Magic, sizeof(Magic)) != 0
+            || header.recordSize != sizeof(TickRecord))
+        return fail("Not a tick file");
+    if(header.count > quint64(size - sizeof(Header)) / sizeof(TickRecord))
+        return fail("Truncated tick file");
+    auto first = reinterpret_cast<TickRecord const*>(base + sizeof(Header));
+    // Replays wait for each record in turn, records are read-only in the
+    // mapping and cannot be sorted in place
+    for(quint64 i = 1; i < header.count; i++)
+        if(first[i].time < first[i - 1].time)
+            return fail(QString("Record %1 is older than the previous one").arg(i));
+    records = first;
+    count   = header.count;
+    return true;
+}
+
+bool TickFile::Write(QString const& path, std::vector<TickRecord> const& ticks, QString* error)
+{
+    Header header;
+    std::memcpy(header.magic, Magic, sizeof(Magic));
+    header.recordSize = sizeof(TickRecord);
+    header.reserved   = 0;
+    header.count      = ticks.size();
+
+    QSaveFile file(path);
+    if(file.open(QFile::WriteOnly)
+            && file.write(reinterpret_cast<const char*>(&header), sizeof(header)) >= 0
+            && file.write(reinterpret_cast<const char*>(ticks.data()),
+                          qint64(ticks.size() * sizeof(TickRecord))) >= 0
+            && file.commit())
+        return true;
+    if(error) *error = file.errorString();
+    return false;
+}
+
+std::vector<TickRecord> TickFile::Generate(size_t count, double rate, quint64 seed)
+{
+    std::mt19937_64 rng(seed);
+    std::normal_distribution<double>       z;
+    std::uniform_real_distribution<double> u;
+    std::exponential_distribution<double>  gap(rate);
+
+    // One trading day per second of recording
+    double dt    = 1.0 / (252.0 * rate);
+    double sigma = 0.30, spot = 50.0, time = 0.0;
+    std::vector<TickRecord> ticks;
+    ticks.reserve(count);
+    for(size_t i = 0; i < count; i++)
+    {
+        // Poisson arrivals, bursts are part of the workload
+        time += gap(rng);
+        TickRecord tick{static_cast<qint64>(time * 1e9), quint32(TickField::S), 0, 0.0};
+        double x = u(rng);
+        if(x < 0.001)
+        {
+            tick.field = quint32(TickField::K);
+            tick.value = std::round(spot);
+        }
+        else if(x < 0.002)
+        {
+            sigma = std::min(std::max(sigma + 0.02 * z(rng), 0.05), 1.0);
+            tick.field = quint32(TickField::Sigma);
+            tick.value = sigma;
+        }
+        else
+        {
+            spot *= std::exp(-0.5 * sigma * sigma * dt + sigma * std::sqrt(dt) * z(rng));
+            tick.value = spot;
+        }
+        ticks.push_back(tick);
+    }
+    return ticks;
+}
+
+//======= LatencyStats Implementation ==========//
+
+LatencyStats LatencyStats::Compute(std::vector<qint64>& samples)
+{
+    LatencyStats stats;
+    stats.count = samples.size();
+    if(samples.empty())
+        return stats;
+    auto percentile = [&](double p){
+        auto nth = samples.begin() + static_cast<ptrdiff_t>(p * (samples.size() - 1));
+        std::nth_element(samples.begin(), nth, samples.end());
+        return *nth / 1000.0;
+    };
+    stats.p50  = percentile(0.50);
+    stats.p90  = percentile(0.90);
+    stats.p99  = percentile(0.99);
+    stats.p999 = percentile(0.999);
+    stats.max  = *std::max_element(samples.begin(), samples.end()) / 1000.0;
+    return stats;
+}
+
+//======= TickReplay Implementation ==========//
+
+TickReplay::TickReplay(Sink sink, QObject* parent)
+    : QObject(parent), sink(std::move(sink))
+{
+}
+
+bool TickReplay::Open(QString const& path, QString* error)
+{
+    return ticks.Open(path, error);
+}
+
+void TickReplay::SetPaintProbe(QWidget* widget)
+{
+    if(probe != nullptr)
+        probe->removeEventFilter(this);
+    probe = widget;
+    if(probe != nullptr)
+        probe->installEventFilter(this);
+}
+
+double TickReplay::ParseSpeed(QString const& text)
+{
+    QString s = text.trimmed().toLower();
+    if(s == "max")
+        return 0.0;
+    if(s.endsWith('x'))
+        s.chop(1);
+    bool ok = false;
+    double speed = s.toDouble(&ok);
+    return ok && speed > 0.0 ? speed : -1.0;
+}
+
+void TickReplay::AddOptions(QCommandLineParser& parser)
+{
+    QCommandLineOption replayOption(
+        "replay", "Replay a binary tick file and report the update latency "
+                  "percentiles.", "file");
+    QCommandLineOption speedOption(
+        "replay-speed", "Replay speed: 1 (recorded), 10x, ... or max.", "speed", "1");
+    QCommandLineOption generateOption(
+        "replay-generate", "Write a synthetic tick file and exit.", "file");
+    QCommandLineOption exitOption(
+        "replay-exit", "Quit once the replay is done.");
+    parser.addOption(replayOption);
+    parser.addOption(speedOption);
+    parser.addOption(generateOption);
+    parser.addOption(exitOption);
+}
+
+bool TickReplay::StartFromCommandLine(QCommandLineParser const& parser, int* status)
+{
+    *status = 0;
+    QString error;
+    if(parser.isSet("replay-generate"))
+    {
+        QString path = parser.value("replay-generate");
+        if(TickFile::Write(path, TickFile::Generate(GeneratedTicks, GeneratedRate), &error))
+            std::cout << " [INFO] Wrote " << GeneratedTicks << " ticks to "
+                      << path.toStdString() << std::endl;
+        else
+        {
+            std::cout << " [ERROR] Cannot write " << path.toStdString() << ": "
+                      << error.toStdString() << std::endl;
+            *status = 1;
+        }
+        return false;
+    }
+    if(!parser.isSet("replay"))
+        return true;
+
+    double speed = ParseSpeed(parser.value("replay-speed"));
+    if(speed < 0.0)
+    {
+        std::cout << " [ERROR] Invalid replay speed " << parser.value("replay-speed").toStdString()
+                  << std::endl;
+        *status = 1;
+        return false;
+    }
+    QString path = parser.value("replay");
+    if(!this->Open(path, &error))
+    {
+        std::cout << " [ERROR] Cannot replay " << path.toStdString() << ": "
+                  << error.toStdString() << std::endl;
+        *status = 1;
+        return false;
+    }
+    std::cout << " [INFO] Replaying " << ticks.Count() << " ticks from "
+              << path.toStdString() << std::endl;
+    this->SetSpeed(speed);
+    bool exitAfter = parser.isSet("replay-exit");
+    this->Start([this, exitAfter]{
+        this->Report(std::cout);
+        if(exitAfter)
+            QCoreApplication::exit(0);
+    });
+    return true;
+}
+
+void TickReplay::Start(std::function<void ()> finished)
+{
+    this->finished = std::move(finished);
+    next = 0;
+    unpainted.clear();
+    updateLatency.clear();
+    paintLatency.clear();
+    updateLatency.reserve(ticks.Count());
+    if(probe != nullptr)
+        paintLatency.reserve(ticks.Count());
+    clock.start();
+    QTimer::singleShot(0, this, [this]{ this->Dispatch(); });
+}
+
+void TickReplay::Dispatch()
+{
+    qint64 sliceEnd = clock.nsecsElapsed() + SliceNs;
+    while(next < ticks.Count())
+    {
+        TickRecord const& tick = ticks[next];
+        qint64 now = clock.nsecsElapsed();
+        qint64 due = speed > 0.0 ? static_cast<qint64>(tick.time / speed) : now;
+        if(due > now)
+        {
+            // Sleep until the next tick is due, Qt timers have ms resolution
+            int delay = static_cast<int>((due - now) / 1000000);
+            QTimer::singleShot(delay, Qt::PreciseTimer, this, [this]{ this->Dispatch(); });
+            return;
+        }
+        if(now > sliceEnd)
+        {
+            // Let the event loop paint, ticks already due keep their time
+            QTimer::singleShot(0, this, [this]{ this->Dispatch(); });
+            return;
+        }
+        sink(static_cast<TickField>(tick.field), tick.value);
+        updateLatency.push_back(clock.nsecsElapsed() - due);
+        if(probe != nullptr)
+            unpainted.push_back(due);
+        next++;
+    }
+    elapsed = clock.nsecsElapsed();
+    if(probe != nullptr)
+        probe->update();
+    // Posted after the update request, so the last ticks can be painted
+    QTimer::singleShot(0, this, [this]{
+        if(finished)
+            finished();
+    });
+}
+
+bool TickReplay::eventFilter(QObject* watched, QEvent* event)
+{
+    if(watched == probe && event->type() == QEvent::Paint && !unpainted.empty())
+    {
+        // Approximates the end of the paint by its start, the paint event
+        // itself runs after the filter.
+        qint64 now = clock.nsecsElapsed();
+        for(qint64 ingest: unpainted)
+            paintLatency.push_back(now - ingest);
+        unpainted.clear();
+    }
+    return QObject::eventFilter(watched, event);
+}
+
+void TickReplay::Report(std::ostream& os) const
+{
+    auto line = [&](const char* name, std::vector<qint64> samples){
+        LatencyStats s = LatencyStats::Compute(samples);
+        os << " [INFO] " << std::left << std::setw(7) << name << std::right << std::fixed
+           << std::setprecision(1)
+           << " n = " << s.count
+           << "  p50 = "  << s.p50  << " us"
+           << "  p90 = "  << s.p90  << " us"
+           << "  p99 = "  << s.p99  << " us"
+           << "  p99.9 = " << s.p999 << " us"
+           << "  max = "  << s.max  << " us" << std::endl;
+    };
+    double seconds = elapsed / 1e9;
+    os << " [INFO] Replayed " << next << " ticks in " << std::fixed << std::setprecision(3)
+       << seconds << " s (" << std::setprecision(0) << (seconds > 0 ? next / seconds : 0.0)
+       << " ticks/s, speed " << (speed > 0.0 ? QString::number(speed).toStdString() + "x"
+                                             : std::string("max"))
+       << ")" << std::endl;
+    line("update", updateLatency);
+    if(probe != nullptr)
+        line("paint", paintLatency);
+}
@@ -0,0 +1,144 @@
+#ifndef TICKREPLAY_H
+#define TICKREPLAY_H
+
+#include <iosfwd>
+#include <vector>
+#include <functional>
+
+#include <QFile>
+#include <QString>
+#include <QObject>
+#include <QElapsedTimer>
+
+class QWidget;
+class QCommandLineParser;
+
+/** Pricing input changed by a recorded tick */
+enum class TickField: quint32 { K = 0, S, T, Sigma, R, Count };
+
+/** Record of a tick file, native byte order */
+struct TickRecord
+{
+    qint64  time;       // Nanoseconds since the start of the recording
+    quint32 field;      // TickField
+    quint32 reserved;
+    double  value;      // sigma and r as fractions
+};
+
+/** Binary tick file mapped into memory, records are read straight from
+ *  the mapping so a replay does not parse or copy anything.
+ *
+ *  Layout: 8 bytes magic "BLSTICK1", quint32 record size, quint32 reserved,
+ *  quint64 record count, then the TickRecord array sorted by time.
+ */
+class TickFile
+{
+public:
+    TickFile() = default;
+    ~TickFile();
+
+    TickFile(TickFile const&) = delete;
+    TickFile& operator=(TickFile const&) = delete;
+
+    /** Fails on records not sorted by time */
+    bool Open(QString const& path, QString* error = nullptr);
+    void Close();
+
+    size_t Count() const { return count; }
+    TickRecord const& operator[](size_t i) const { return records[i]; }
+    /** Recorded duration in nanoseconds */
+    qint64 Duration() const { return count == 0 ? 0 : records[count - 1].time; }
+
+    static bool Write(QString const& path, std::vector<TickRecord> const& ticks,
+                      QString* error = nullptr);
+
+    /** Deterministic workload: spot ticks of a geometric Brownian motion at
+     *  rate per second, with an occasional strike or volatility change. */
+    static std::vector<TickRecord> Generate(size_t count, double rate, quint64 seed = 42);
+
+private:
+    QFile             file;
+    uchar*            base    = nullptr;
+    TickRecord const* records = nullptr;
+    size_t            count   = 0;
+};
+
+/** Latency percentiles in microseconds */
+struct LatencyStats
+{
+    size_t count = 0;
+    double p50 = 0, p90 = 0, p99 = 0, p999 = 0, max = 0;
+
+    /** samples in nanoseconds, reordered */
+    static LatencyStats Compute(std::vector<qint64>& samples);
+};
+
+/** Replays a tick file into a pricing GUI on the GUI thread.
+ *
+ *  Ticks are delivered to the sink at their recorded times, at a multiple
+ *  of that speed, or as fast as possible (speed 0). Two latencies are
+ *  measured for each tick, from ingestion (the time the tick is due, or
+ *  the time it is read at max speed):
+ *   - update: until the sink returns, model and widget properties set;
+ *   - paint:  until the probe widget has painted the new value.
+ *  Ticks are dispatched in slices of a few milliseconds so that the event
+ *  loop keeps painting while a replay runs.
+ *
+ *  Applications expose it with AddOptions() and StartFromCommandLine():
+ *    --replay <file>          Replay the tick file, report at the end
+ *    --replay-speed <speed>   1 (recorded), 10x, ... or max
+ *    --replay-generate <file> Write a synthetic tick file and exit
+ *    --replay-exit            Quit once the report is printed
+ */
+class TickReplay: public QObject
+{
+public:
+    using Sink = std::function<void (TickField field, double value)>;
+
+    explicit TickReplay(Sink sink, QObject* parent = nullptr);
+
+    bool Open(QString const& path, QString* error = nullptr);
+
+    /** 1.0 = recorded speed, 0 = as fast as possible */
+    void SetSpeed(double speed) { this->speed = speed; }
+
+    /** Widget whose paint events complete the end-to-end latency */
+    void SetPaintProbe(QWidget* widget);
+
+    void Start(std::function<void ()> finished = nullptr);
+
+    /** Tick rate and latency percentiles of the last replay */
+    void Report(std::ostream& os) const;
+
+    /** Parses "max", "1", "10x", ... Returns -1 if invalid */
+    static double ParseSpeed(QString const& text);
+
+    static void AddOptions(QCommandLineParser& parser);
+
+    /** Generates a tick file or starts the replay requested on the command
+     *  line, if any. Returns false when the application must exit instead
+     *  of running, with the exit status in status. */
+    bool StartFromCommandLine(QCommandLineParser const& parser, int* status);
+
+protected:
+    bool eventFilter(QObject* watched, QEvent* event) override;
+
+private:
+    TickFile              ticks;
+    Sink                  sink;
+    double                speed = 1.0;
+    QWidget*              probe = nullptr;
+    std::function<void ()> finished;
+
+    QElapsedTimer         clock;
+    size_t                next = 0;
+    // Ingestion times of the ticks dispatched since the last paint
+    std::vector<qint64>   unpainted;
+    std::vector<qint64>   updateLatency;
+    std::vector<qint64>   paintLatency;
+    qint64                elapsed = 0;
+
+    void Dispatch();
+};
+
+#endif // TICKREPLAY_H
@@ -0,0 +1,51 @@
+#include "blackscholes.h"
+
+#include <cmath>
+
+/** @brief Black-Scholes price of an European call option without dividends.
+ *  sigma and r are fractions, T in years. */
+double BlackScholesCall(double S, double K, double T, double sigma, double r)
+{
+    double sqrt_T = std::sqrt(T);
+    double d1 = (std::log(S / K) + (r + sigma * sigma / 2.0) * T) / (sigma * sqrt_T);
+    double d2 = d1 - sigma * sqrt_T;
+    return S * normal_cdf(d1) - K * std::exp(-r * T) * normal_cdf(d2);
+}
+
+void BlackScholesCallBatch(double const* options, size_t n, double* prices)
+{
+    for(size_t i = 0; i < n; i++, options += BatchStride)
+        prices[i] = BlackScholesCall(options[0], options[1], options[2], options[3], options[4]);
+}
+
+double BlackScholesCall(OptionInputs const& in)
+{
+    return BlackScholesCall(in.S, in.K, in.T, in.sigma / 100.0, in.r / 100.0);
+}
+
+/** @brief Normal Probability Density Function (mean = 0) and standard deviation = 1  */
+double normal_pdf(double x)
+{
+    return 1/(std::sqrt(2.0 * M_PI)) * std::exp(- x * x / 2);
+}
+
+/** @brief Cumulative normal distribution approximation  (with mean = 0 and standard deviation = 1)
+ */
+double normal_cdf(double d)
+{
+    constexpr double A [] =
+    {
+        0.31938153,
+       -0.356563782,
+        1.781477937,
+       -1.821255978,
+        1.330274429
+    };
+    constexpr double RSQRT2PI = 0.39894228040143267793994605993438;
+    double K = 1.0 / (1.0 + 0.2316419 * std::fabs(d));
+    double c = RSQRT2PI * std::exp(- 0.5 * d * d) *
+            (K * (A[0] + K * (A[1] + K * (A[2] + K * (A[3] + K * A[4])))));
+    if(d > 0) return 1.0 - c;
+    return c;
+}
+
@@ -0,0 +1,38 @@
+#ifndef BLACKSCHOLES_H
+#define BLACKSCHOLES_H
+
+#include <cstddef>
+
+/** @brief Normal Probability Density Function (mean = 0) and standard deviation = 1  */
+double normal_pdf(double x);
+
+/** @brief Cumulative normal distribution approximation  (with mean = 0 and standard deviation = 1) */
+double normal_cdf(double x);
+
+/** @brief Black-Scholes price of an European call option without dividends.
+ *  sigma and r are fractions, T in years. */
+double BlackScholesCall(double S, double K, double T, double sigma, double r);
+
+/** Number of doubles per option in a batch: S, K, T, sigma, r */
+constexpr int BatchStride = 5;
+
+/** @brief Call prices of n options stored contiguously, BatchStride doubles
+ *  each, in the units of BlackScholesCall(). Used by the script bridges to
+ *  price a whole chain per call. */
+void BlackScholesCallBatch(double const* options, size_t n, double* prices);
+
+/** Inputs of the Black-Scholes formula in the units displayed by the
+ *  form: volatility and rate in percent, T in years. */
+struct OptionInputs
+{
+    double S     = 50.0;
+    double K     = 50.0;
+    double T     = 0.5;
+    double sigma = 30.0;
+    double r     = 5.0;
+};
+
+/** @brief Call price for the inputs displayed by the form */
+double BlackScholesCall(OptionInputs const& in);
+
+#endif // BLACKSCHOLES_H
@@ -0,0 +1,584 @@
+#include "chainpanel.h"
+
+#include <cmath>
+#include <cctype>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+
+#include <QAbstractTableModel>
+#include <QTableView>
+#include <QHeaderView>
+#include <QLineEdit>
+#include <QLabel>
+#include <QPushButton>
+#include <QHBoxLayout>
+#include <QVBoxLayout>
+
+#include "../common/instrument.h"
+
+namespace {
+
+// Longest line or object accepted, guards against a binary body
+constexpr int MaxRecordSize = 64 * 1024;
+// Data waiting for the parser thread before the download is throttled
+constexpr qint64 MaxQueued  = 4 << 20;
+
+bool IsBlank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+/** Trims blanks and double quotes */
+void Trim(const char*& p, const char*& end)
+{
+    while(p < end && (IsBlank(*p) || *p == '"'))
+        p++;
+    while(end > p && (IsBlank(end[-1]) || end[-1] == '"'))
+        end--;
+}
+
+/** Decimal number filling [p, end) once trimmed. Up to 19 significant
+ *  digits, exact for the usual prices and rates. */
+bool ParseNumber(const char* p, const char* end, double& value)
+{
+    static const double Pow10[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    Trim(p, end);
+    bool negative = false;
+    if(p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+    uint64_t mantissa = 0;
+    int      digits   = 0;
+    int      exponent = 0;
+    bool     any      = false;
+    for(; p < end && *p >= '0' && *p <= '9'; p++, any = true)
+    {
+        if(digits < 19)
+        {
+            mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+            digits += mantissa != 0;
+        }
+        else
+            exponent++;
+    }
+    if(p < end && *p == '.')
+    {
+        for(p++; p < end && *p >= '0' && *p <= '9'; p++, any = true)
+            if(digits < 19)
+            {
+                mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+                digits += mantissa != 0;
+                exponent--;
+            }
+    }
+    if(!any)
+        return false;
+    if(p < end && (*p == 'e' || *p == 'E'))
+    {
+        p++;
+        bool negExp = false;
+        if(p < end && (*p == '-' || *p == '+'))
+            negExp = *p++ == '-';
+        if(p == end)
+            return false;
+        int e = 0;
+        for(; p < end && *p >= '0' && *p <= '9'; p++)
+            e = std::min(e * 10 + (*p - '0'), 9999);
+        exponent += negExp ? -e : e;
+    }
+    if(p != end)
+        return false;
+    value = static_cast<double>(mantissa);
+    if(exponent < 0 && exponent >= -22)
+        value /= Pow10[-exponent];
+    else if(exponent > 0 && exponent <= 22)
+        value *= Pow10[exponent];
+    else if(exponent != 0)
+        value *= std::pow(10.0, exponent);
+    if(negative)
+        value = -value;
+    return true;
+}
+
+/** Field of a column or key name, -1 if unknown */
+int FieldOf(const char* p, const char* end)
+{
+    static const std::pair<const char*, int> names[] = {
+        {"s", 0}, {"spot", 0},
+        {"k", 1}, {"strike", 1},
+        {"t", 2}, {"expiry", 2}, {"maturity", 2},
+        {"sigma", 3}, {"vol", 3}, {"volatility", 3}, {"iv", 3},
+        {"r", 4}, {"rate", 4}
+    };
+    Trim(p, end);
+    size_t n = static_cast<size_t>(end - p);
+    for(auto const& name: names)
+    {
+        if(std::strlen(name.first) != n)
+            continue;
+        size_t i = 0;
+        while(i < n && std::tolower(static_cast<unsigned char>(p[i])) == name.first[i])
+            i++;
+        if(i == n)
+            return name.second;
+    }
+    return -1;
+}
+
+void SetField(OptionInputs& in, int field, double value)
+{
+    switch(field)
+    {
+    case 0: in.S     = value; break;
+    case 1: in.K     = value; break;
+    case 2: in.T     = value; break;
+    case 3: in.sigma = value; break;
+    case 4: in.r     = value; break;
+    }
+}
+
+} // --- End of namespace --- //
+
+//======= ChainParser Implementation ==========//
+
+ChainParser::ChainParser(OptionInputs defaults, BatchHandler onBatch,
+                         std::function<bool ()> cancelled)
+    : defaults(defaults), onBatch(std::move(onBatch)), cancelled(std::move(cancelled))
+{
+    batch.reserve(BatchSize);
+}
+
+qint64 ChainParser::Consume(const char* data, qint64 size)
+{
+    if(cancelled())
+    {
+        error = "Cancelled";
+        return -1;
+    }
+    const char* p   = data;
+    const char* end = data + size;
+    if(format == Format::Unknown)
+    {
+        while(p < end && IsBlank(*p))
+            p++;
+        if(p == end)
+            return size;
+        format = (*p == '{' || *p == '[') ? Format::Json : Format::Csv;
+    }
+    // Lines for CSV, objects for JSON, the terminator is excluded
+    const char terminator = format == Format::Csv ? '\n' : '}';
+
+    if(!pending.isEmpty())
+    {
+        auto stop = static_cast<const char*>(std::memchr(p, terminator, static_cast<size_t>(end - p)));
+        const char* last = stop ? stop : end;
+        if(pending.size() + (last - p) > MaxRecordSize)
+        {
+            error = QString("Record %1 longer than %2 bytes").arg(records + 1).arg(MaxRecordSize);
+            return -1;
+        }
+        pending.append(p, static_cast<int>(last - p));
+        if(stop == nullptr)
+            return size;
+        bool ok = this->ParseRecord(pending.constData(), pending.constData() + pending.size());
+        pending.clear();
+        if(!ok)
+            return -1;
+        p = stop + 1;
+    }
+
+    // Records entirely in this chunk are parsed in place
+    while(p < end)
+    {
+        const char* start = p;
+        if(format == Format::Json)
+        {
+            // Array brackets and separators between objects are skipped
+            start = static_cast<const char*>(std::memchr(p, '{', static_cast<size_t>(end - p)));
+            if(start == nullptr)
+                break;
+        }
+        auto stop = static_cast<const char*>(std::memchr(start, terminator,
+                                                         static_cast<size_t>(end - start)));
+        if(stop == nullptr)
+        {
+            if(end - start > MaxRecordSize)
+            {
+                error = QString("Record %1 longer than %2 bytes").arg(records + 1).arg(MaxRecordSize);
+                return -1;
+            }
+            pending.append(start, static_cast<int>(end - start));
+            break;
+        }
+        if(!this->ParseRecord(start, stop))
+            return -1;
+        p = stop + 1;
+    }
+    return size;
+}
+
+bool ChainParser::Finish()
+{
+    if(!pending.isEmpty())
+    {
+        if(format == Format::Json)
+        {
+            error = QString("Object %1 is truncated").arg(records + 1);
+            return false;
+        }
+        // Last line without a line feed
+        bool ok = this->ParseRecord(pending.constData(), pending.constData() + pending.size());
+        pending.clear();
+        if(!ok)
+            return false;
+    }
+    this->Flush();
+    return true;
+}
+
+bool ChainParser::ParseRecord(const char* p, const char* end)
+{
+    records++;
+    return format == Format::Csv ? this->ParseCsv(p, end) : this->ParseJson(p, end);
+}
+
+bool ChainParser::ParseCsv(const char* p, const char* end)
+{
+    const char* q = p;
+    const char* e = end;
+    Trim(q, e);
+    if(q == e)
+        return true;
+
+    fields.clear();
+    for(const char* f = p; ; )
+    {
+        auto comma = static_cast<const char*>(std::memchr(f, ',', static_cast<size_t>(end - f)));
+        fields.emplace_back(f, comma ? comma : end);
+        if(comma == nullptr)
+            break;
+        f = comma + 1;
+    }
+
+    // A first line which is not numbers is the header
+    if(firstLine)
+    {
+        firstLine = false;
+        double x;
+        if(!ParseNumber(fields[0].first, fields[0].second, x))
+        {
+            columns.clear();
+            for(auto const& f: fields)
+                columns.push_back(FieldOf(f.first, f.second));
+            if(std::none_of(columns.begin(), columns.end(), [](int c){ return c >= 0; }))
+            {
+                error = "No known column in the header, expected S, K, T, sigma, r";
+                return false;
+            }
+            return true;
+        }
+    }
+
+    OptionInputs in = defaults;
+    size_t n = std::min(fields.size(), columns.size());
+    for(size_t i = 0; i < n; i++)
+    {
+        if(columns[i] < 0)
+            continue;
+        double value;
+        if(!ParseNumber(fields[i].first, fields[i].second, value))
+        {
+            error = QString("Line %1, column %2: invalid number").arg(records).arg(i + 1);
+            return false;
+        }
+        SetField(in, columns[i], value);
+    }
+    this->Add(in);
+    return true;
+}
+
+bool ChainParser::ParseJson(const char* p, const char* end)
+{
+    // p is on '{', end on the matching '}'
+    OptionInputs in = defaults;
+    const char* q = p + 1;
+    auto fail = [&](const char* what){
+        error = QString("Object %1, offset %2: %3").arg(records).arg(q - p).arg(what);
+        return false;
+    };
+    for(;;)
+    {
+        while(q < end && (IsBlank(*q) || *q == ','))
+            q++;
+        if(q == end)
+            break;
+        if(*q != '"')
+            return fail("expected a key");
+        auto keyEnd = static_cast<const char*>(std::memchr(q + 1, '"', static_cast<size_t>(end - q - 1)));
+        if(keyEnd == nullptr)
+            return fail("unterminated key");
+        int field = FieldOf(q + 1, keyEnd);
+        q = keyEnd + 1;
+        while(q < end && IsBlank(*q))
+            q++;
+        if(q == end || *q != ':')
+            return fail("expected ':'");
+        q++;
+        while(q < end && IsBlank(*q))
+            q++;
+
+        // Value: a string, an array or a scalar
+        const char* valueEnd;
+        if(q < end && *q == '"')
+        {
+            auto close = static_cast<const char*>(std::memchr(q + 1, '"', static_cast<size_t>(end - q - 1)));
+            if(close == nullptr)
+                return fail("unterminated string");
+            valueEnd = close + 1;
+        }
+        else if(q < end && *q == '[')
+        {
+            auto close = static_cast<const char*>(std::memchr(q, ']', static_cast<size_t>(end - q)));
+            if(close == nullptr)
+                return fail("unterminated array");
+            valueEnd = close + 1;
+        }
+        else
+        {
+            auto comma = static_cast<const char*>(std::memchr(q, ',', static_cast<size_t>(end - q)));
+            valueEnd = comma ? comma : end;
+        }
+        if(field >= 0)
+        {
+            double value;
+            if(!ParseNumber(q, valueEnd, value))
+                return fail("invalid number");
+            SetField(in, field, value);
+        }
+        q = valueEnd;
+    }
+    this->Add(in);
+    return true;
+}
+
+void ChainParser::Add(OptionInputs const& in)
+{
+    ChainRow row;
+    row.inputs = in;
+    batch.push_back(row);
+    rows++;
+    if(batch.size() >= BatchSize)
+        this->Flush();
+}
+
+void ChainParser::Flush()
+{
+    if(batch.empty())
+        return;
+    INSTRUMENT_SCOPE("ChainParser::Flush");
+    std::vector<double> options(batch.size() * BatchStride);
+    std::vector<double> prices(batch.size());
+    for(size_t i = 0; i < batch.size(); i++)
+    {
+        OptionInputs const& in = batch[i].inputs;
+        double* o = &options[i * BatchStride];
+        o[0] = in.S;
+        o[1] = in.K;
+        o[2] = in.T;
+        o[3] = in.sigma / 100.0;
+        o[4] = in.r / 100.0;
+    }
+    BlackScholesCallBatch(options.data(), batch.size(), prices.data());
+    for(size_t i = 0; i < batch.size(); i++)
+        batch[i].price = prices[i];
+    onBatch(std::move(batch));
+    batch.clear();
+    batch.reserve(BatchSize);
+}
+
+//======= ChainModel Implementation ==========//
+
+/** Rows of the chain, appended batch by batch */
+class ChainModel: public QAbstractTableModel
+{
+public:
+    std::vector<ChainRow> rows;
+
+    using QAbstractTableModel::QAbstractTableModel;
+
+    void Clear()
+    {
+        this->beginResetModel();
+        rows.clear();
+        this->endResetModel();
+    }
+
+    void Append(std::vector<ChainRow> const& batch)
+    {
+        if(batch.empty())
+            return;
+        int first = static_cast<int>(rows.size());
+        this->beginInsertRows(QModelIndex(), first, first + static_cast<int>(batch.size()) - 1);
+        rows.insert(rows.end(), batch.begin(), batch.end());
+        this->endInsertRows();
+    }
+
+    int rowCount(QModelIndex const& parent = QModelIndex()) const override
+    {
+        return parent.isValid() ? 0 : static_cast<int>(rows.size());
+    }
+
+    int columnCount(QModelIndex const& parent = QModelIndex()) const override
+    {
+        return parent.isValid() ? 0 : 6;
+    }
+
+    QVariant data(QModelIndex const& index, int role = Qt::DisplayRole) const override
+    {
+        if(!index.isValid())
+            return QVariant();
+        if(role == Qt::TextAlignmentRole)
+            return int(Qt::AlignRight | Qt::AlignVCenter);
+        if(role != Qt::DisplayRole)
+            return QVariant();
+        ChainRow const& row = rows[static_cast<size_t>(index.row())];
+        switch(index.column())
+        {
+        case 0: return QString::number(row.inputs.S, 'f', 2);
+        case 1: return QString::number(row.inputs.K, 'f', 2);
+        case 2: return QString::number(row.inputs.T, 'f', 3);
+        case 3: return QString::number(row.inputs.sigma, 'f', 2);
+        case 4: return QString::number(row.inputs.r, 'f', 2);
+        case 5: return std::isnan(row.price) ? QString("-") : QString::number(row.price, 'f', 4);
+        }
+        return QVariant();
+    }
+
+    QVariant headerData(int section, Qt::Orientation orientation,
+                        int role = Qt::DisplayRole) const override
+    {
+        static const char* names[] = {"S", "K", "T (years)", "sigma (%)", "r (%)", "Call"};
+        if(role != Qt::DisplayRole)
+            return QVariant();
+        if(orientation == Qt::Vertical)
+            return section + 1;
+        return names[section];
+    }
+};
+
+//======= ChainPanel Implementation ==========//
+
+ChainPanel::ChainPanel(std::function<OptionInputs ()> baseInputs,
+                       std::function<void (OptionInputs const&)> onSelect,
+                       QWidget* parent)
+    : QWidget(parent), baseInputs(std::move(baseInputs)), onSelect(std::move(onSelect))
+{
+    url     = new QLineEdit;
+    url->setPlaceholderText(tr("URL of an option chain, CSV or JSON"));
+    btnLoad = new QPushButton(tr("Load"));
+    status  = new QLabel;
+    model   = new ChainModel(this);
+    table   = new QTableView;
+    table->setModel(model);
+    table->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    table->setSelectionBehavior(QAbstractItemView::SelectRows);
+    // Fixed row height, the view does not measure a million rows
+    table->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    table->horizontalHeader()->setStretchLastSection(true);
+
+    auto top = new QHBoxLayout;
+    top->addWidget(url, 1);
+    top->addWidget(btnLoad);
+    auto vbox = new QVBoxLayout(this);
+    vbox->addLayout(top);
+    vbox->addWidget(table, 1);
+    vbox->addWidget(status);
+
+    QObject::connect(url, &QLineEdit::returnPressed, [this]{ this->Load(); });
+    QObject::connect(btnLoad, &QPushButton::clicked, [this]{
+        if(loading)
+            this->Cancel();
+        else
+            this->Load();
+    });
+    QObject::connect(table, &QTableView::activated, [this](QModelIndex const& index){
+        this->onSelect(model->rows[static_cast<size_t>(index.row())].inputs);
+    });
+}
+
+ChainPanel::~ChainPanel()
+{
+    // The parser thread stops at its next chunk
+    ++*generation;
+}
+
+void ChainPanel::SetUrl(QString const& text)
+{
+    url->setText(text);
+}
+
+void ChainPanel::Load()
+{
+    QUrl source = QUrl::fromUserInput(url->text().trimmed());
+    if(!source.isValid() || url->text().trimmed().isEmpty())
+    {
+        status->setText(tr("Invalid URL"));
+        return;
+    }
+    int gen = ++*generation;
+    model->Clear();
+    loading = true;
+    btnLoad->setText(tr("Cancel"));
+    status->setText(tr("Loading %1").arg(source.toString()));
+    timer.start();
+
+    auto counter = generation;
+    auto parser = std::make_shared<ChainParser>(
+        baseInputs(),
+        [this, gen](std::vector<ChainRow>&& rows){
+            auto batch = std::make_shared<std::vector<ChainRow>>(std::move(rows));
+            // Dropped if the panel is destroyed meanwhile
+            QMetaObject::invokeMethod(this, [this, gen, batch]{ this->OnBatch(gen, batch); },
+                                      Qt::QueuedConnection);
+        },
+        [counter, gen]{ return counter->load() != gen; });
+    engine.Stream(source, std::make_shared<BackgroundConsumer>(parser, MaxQueued),
+                  [this, gen](FetchEngine::Response const& response){
+        // After the batches the parser posted before it finished
+        QMetaObject::invokeMethod(this, [this, gen, response]{ this->OnFinished(gen, response); },
+                                  Qt::QueuedConnection);
+    });
+}
+
+void ChainPanel::Cancel()
+{
+    ++*generation;
+    loading = false;
+    btnLoad->setText(tr("Load"));
+    status->setText(tr("Cancelled, %1 options").arg(model->rowCount()));
+}
+
+void ChainPanel::OnBatch(int gen, std::shared_ptr<std::vector<ChainRow>> rows)
+{
+    if(gen != generation->load())
+        return;
+    model->Append(*rows);
+    status->setText(tr("%1 options, %2 ms").arg(model->rowCount()).arg(timer.elapsed()));
+}
+
+void ChainPanel::OnFinished(int gen, FetchEngine::Response const& response)
+{
+    if(gen != generation->load())
+        return;
+    loading = false;
+    btnLoad->setText(tr("Load"));
+    if(response.Ok() && response.status < 400)
+        status->setText(tr("%1 options in %2 ms, %3 KB")
+                        .arg(model->rowCount()).arg(timer.elapsed()).arg(response.bytes / 1024));
+    else
+        status->setText(tr("Error: %1").arg(response.Ok() ? tr("HTTP status %1").arg(response.status)
+                                                          : response.error));
+}
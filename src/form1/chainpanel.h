@@ -0,0 +1,129 @@
+#ifndef CHAINPANEL_H
+#define CHAINPANEL_H
+
+#include <memory>
+#include <atomic>
+#include <vector>
+#include <utility>
+#include <functional>
+
+#include <QWidget>
+#include <QElapsedTimer>
+
+#include "blackscholes.h"
+#include "../network/fetchengine.h"
+#include "../network/streaming.h"
+
+class QLineEdit;
+class QPushButton;
+class QLabel;
+class QTableView;
+class ChainModel;
+
+/** Option of a chain, inputs in the units of the form, and its call price */
+struct ChainRow
+{
+    OptionInputs inputs;
+    double       price = 0.0;
+};
+
+/** Parses an option chain as it is downloaded and prices it in batches.
+ *
+ *  Two formats are recognized from the first character of the body:
+ *
+ *    CSV   One option per line. An optional header names the columns,
+ *          otherwise they are S, K, T, sigma, r.
+ *    JSON  Flat objects of numbers, e.g. {"K": 55, "T": 0.5, "sigma": 25},
+ *          in an array, one per line or in any layout. Braces must not
+ *          appear in strings.
+ *
+ *  Column and key names: S|spot, K|strike, T|expiry|maturity,
+ *  sigma|vol|volatility|iv, r|rate, case insensitive; other ones are
+ *  ignored. sigma and r are in percent, missing fields are taken from the
+ *  defaults. Numbers are parsed in place by a hand-rolled scanner, without
+ *  copying the fields or going through the C locale.
+ *
+ *  Runs on the thread of BackgroundConsumer; onBatch is called from there.
+ */
+class ChainParser: public BodyConsumer
+{
+public:
+    static constexpr size_t BatchSize = 4096;
+
+    using BatchHandler = std::function<void (std::vector<ChainRow>&& rows)>;
+
+    /** The transfer is aborted once cancelled() returns true */
+    ChainParser(OptionInputs defaults, BatchHandler onBatch, std::function<bool ()> cancelled);
+
+    qint64 Consume(const char* data, qint64 size) override;
+    bool   Finish() override;
+
+    qint64 Rows() const { return rows; }
+
+private:
+    enum class Format { Unknown, Csv, Json };
+    enum Field { FieldS, FieldK, FieldT, FieldSigma, FieldR, FieldCount };
+
+    OptionInputs           defaults;
+    BatchHandler           onBatch;
+    std::function<bool ()> cancelled;
+    Format                 format = Format::Unknown;
+    bool                   firstLine = true;
+    // CSV column to field, -1 for ignored columns
+    std::vector<int>       columns{FieldS, FieldK, FieldT, FieldSigma, FieldR};
+    // Record continued in the next chunk
+    QByteArray             pending;
+    // Fields of the current CSV line, reused
+    std::vector<std::pair<const char*, const char*>> fields;
+    std::vector<ChainRow>  batch;
+    qint64                 records = 0;
+    qint64                 rows    = 0;
+
+    bool        ParseRecord(const char* p, const char* end);
+    bool        ParseCsv(const char* p, const char* end);
+    bool        ParseJson(const char* p, const char* end);
+    void        Add(OptionInputs const& in);
+    void        Flush();
+};
+
+/** Dockable option chain: downloads a chain from a URL, parses and prices
+ *  it on a worker thread, and fills a table as the batches arrive. Double
+ *  clicking a row loads it into the form. */
+class ChainPanel: public QWidget
+{
+public:
+    /** baseInputs returns the current inputs of the form, used for missing
+     *  fields; onSelect receives the inputs of the activated row. */
+    ChainPanel(std::function<OptionInputs ()> baseInputs,
+               std::function<void (OptionInputs const&)> onSelect,
+               QWidget* parent = nullptr);
+    ~ChainPanel() override;
+
+    ChainPanel(ChainPanel const&) = delete;
+    ChainPanel& operator=(ChainPanel const&) = delete;
+
+    void SetUrl(QString const& url);
+    /** Replaces the chain by the one at the URL, in the background */
+    void Load();
+    void Cancel();
+
+private:
+    std::function<OptionInputs ()>            baseInputs;
+    std::function<void (OptionInputs const&)> onSelect;
+    QLineEdit*    url;
+    QPushButton*  btnLoad;
+    QLabel*       status;
+    QTableView*   table;
+    ChainModel*   model;
+
+    FetchEngine   engine;
+    // Incremented by each load, batches of older loads are dropped
+    std::shared_ptr<std::atomic<int>> generation = std::make_shared<std::atomic<int>>(0);
+    bool          loading = false;
+    QElapsedTimer timer;
+
+    void OnBatch(int gen, std::shared_ptr<std::vector<ChainRow>> rows);
+    void OnFinished(int gen, FetchEngine::Response const& response);
+};
+
+#endif // CHAINPANEL_H
@@ -1,16 +1,46 @@
 #include <iostream>
 #include <iomanip>
 #include <functional>
-#include <cassert>
+#include <cstdlib>
 #include <sstream>
+#include <array>
+#include <cmath>
+#include <atomic>
+#include <memory>
 
 #include <QtWidgets>
 #include <QApplication>
-#include <QtUiTools/QtUiTools>
 #include <QSysInfo>
+#include <QElapsedTimer>
+#include <QCommandLineParser>
 
+// Build options, see FORMS1_PRECOMPILED_UI and FORMS1_RUNTIME_UI in CMakeLists.txt
+#if !FORMS1_PRECOMPILED_UI && !FORMS1_RUNTIME_UI
+  #error "Enable FORMS1_PRECOMPILED_UI and/or FORMS1_RUNTIME_UI"
+#endif
 
-#include <QtConcurrent/QtConcurrent>
+#if FORMS1_PRECOMPILED_UI
+  // Generated by uic (AUTOUIC) from form1.ui, defines Ui::MainWindow
+  #include "ui_form1.h"
+#endif
+
+#if FORMS1_RUNTIME_UI
+  #include <QtUiTools/QtUiTools>
+#endif
+
+
+#include <QThread>
+#include <QLocalServer>
+#include <QLocalSocket>
+
+#include "blackscholes.h"
+#include "scenariosweep.h"
+#include "statestore.h"
+#include "livepanel.h"
+#include "chainpanel.h"
+#include "../network/localserver.h"
+#include "../common/tickreplay.h"
+#include "../common/instrument.h"
 
 #define DISP_EXPR(expr) \
   std::cout << " [INFO] " << #expr << " = " << (expr) << std::endl
@@ -19,25 +49,95 @@
   std::cout << " [INFO] " << (msg) << " = " << (expr) << std::endl
 
 
-/** Load from from *.ui file */
-auto LoadForm(QString filePath) -> QWidget*
-{
-    QUiLoader loader;
-    QFile file(filePath);
-    // file.open(QFile::ReadOnly);
-    QWidget* form = loader.load(&file, nullptr);
-    file.close();
-    return form;
-}
-
 /** Makes QString printable */
 auto operator<<(std::ostream& os, QString const& str) -> std::ostream&
 {
     return os << str.toStdString();
 }
 
-double normal_pdf(double x);
-double normal_cdf(double x);
+#if FORMS1_RUNTIME_UI
+
+/** Cache of the forms loaded at runtime from *.ui files.
+ *
+ *  QUiLoader scans the plugin directories for custom widgets when it is
+ *  constructed, so a single loader is shared. The XML of each file is kept
+ *  in memory, keyed by path and modification time, so that instantiating
+ *  the same form again does not touch the disk, while an edited file is
+ *  picked up by the next instantiation. Note that QUiLoader has no public
+ *  API for cloning a parsed form, each instance still parses the XML.
+ *
+ *  Created in main() after QApplication and destroyed before it, since the
+ *  loader holds the widget plugins; Instance() returns that object.
+ */
+class FormCache
+{
+public:
+    FormCache()  { Q_ASSERT(current == nullptr); current = this; }
+    ~FormCache() { current = nullptr; }
+
+    FormCache(FormCache const&) = delete;
+    FormCache& operator=(FormCache const&) = delete;
+
+    static FormCache& Instance()
+    {
+        Q_ASSERT(current != nullptr);
+        return *current;
+    }
+
+    /** Create a new instance of the form, returns nullptr on error */
+    QWidget* Create(QString const& filePath, QWidget* parent = nullptr)
+    {
+        QDateTime mtime = QFileInfo(filePath).lastModified();
+        auto it = forms.find(filePath);
+        if(it == forms.end() || it->mtime != mtime)
+        {
+            QFile file(filePath);
+            if(!file.open(QFile::ReadOnly))
+            {
+                std::cout << " [ERROR] Unable to open form " << filePath << std::endl;
+                return nullptr;
+            }
+            it = forms.insert(filePath, Entry{mtime, file.readAll()});
+            misses++;
+        }
+        else
+            hits++;
+        // Shallow copy, QBuffer only reads it
+        QByteArray xml = it->xml;
+        QBuffer    buffer(&xml);
+        buffer.open(QBuffer::ReadOnly);
+        QWidget* form = loader.load(&buffer, parent);
+        if(form == nullptr)
+            std::cout << " [ERROR] Unable to load form " << filePath
+                      << ": " << loader.errorString() << std::endl;
+        return form;
+    }
+
+    int Hits()   const { return hits; }
+    int Misses() const { return misses; }
+
+private:
+    struct Entry
+    {
+        QDateTime  mtime;
+        QByteArray xml;
+    };
+    static inline FormCache* current = nullptr;
+
+    QUiLoader             loader;
+    QHash<QString, Entry> forms;
+    int                   hits   = 0;
+    int                   misses = 0;
+};
+
+/** Load from from *.ui file */
+auto LoadForm(QString filePath) -> QWidget*
+{
+    return FormCache::Instance().Create(filePath);
+}
+
+#endif // FORMS1_RUNTIME_UI
+
 
 
 bool CreateLinuxDesktopShortcut(
@@ -66,21 +166,410 @@ bool CreateLinuxDesktopShortcut(
     return false;
 }
 
+// ============ Command Channel ================//
+
+/** Latest value of each form input posted by the command channel thread.
+ *  Lock-free: values are atomics and a bit mask tells which fields were
+ *  updated since the GUI thread last read them, so a burst of updates of
+ *  the same field is coalesced into a single update of the form.
+ */
+class InputMailbox
+{
+public:
+    enum Field { FieldK = 0, FieldS, FieldT, FieldSigma, FieldR, FieldCount };
+
+    InputMailbox()
+    {
+        for(auto& v: values)
+            v.store(0.0);
+    }
+
+    /** Returns true if the reader must be notified. Only the first update
+     *  after a Drain() does, so at most one notification is in flight. */
+    bool Post(Field field, double value)
+    {
+        values[field].store(value, std::memory_order_relaxed);
+        return dirty.fetch_or(1u << field, std::memory_order_release) == 0;
+    }
+
+    /** Call fn(field, value) for each field updated since the last call */
+    template<typename Callable>
+    void Drain(Callable&& fn)
+    {
+        unsigned mask = dirty.exchange(0, std::memory_order_acquire);
+        for(int f = 0; f < FieldCount; f++)
+            if(mask & (1u << f))
+                fn(static_cast<Field>(f), values[f].load(std::memory_order_relaxed));
+    }
+
+private:
+    std::array<std::atomic<double>, FieldCount> values;
+    std::atomic<unsigned> dirty{0};
+};
+
+/** Commands for the form received through a local socket (Unix domain
+ *  socket, named pipe on Windows) served by a dedicated thread, so that
+ *  parsing and pricing never block the GUI thread.
+ *
+ *  The protocol is line-delimited text. Clients may pipeline any number of
+ *  commands, the replies are sent in order, one line per command:
+ *
+ *    K | S | T | SIGMA | R <value>    Set a form input, sigma and r in %  -> OK
+ *    PRICE S K T sigma r [S K T sigma r ...]
+ *                                     Price a list of calls -> the prices
+ *    PING                             -> PONG
+ *    EXIT                             Quit the application  -> BYE
+ *
+ *  Errors are replied as "ERR <message>". Example, on Linux:
+ *
+ *    $ printf 'K 55\nPRICE 50 50 0.5 30 5 50 55 1 25 5\n' | socat - UNIX-CONNECT:/tmp/forms1
+ */
+class CommandChannel
+{
+public:
+    /** onInputs is invoked on receiver's thread after new inputs were
+     *  posted to the mailbox. */
+    CommandChannel(InputMailbox& mailbox, QObject* receiver, std::function<void ()> onInputs)
+        : mailbox(mailbox), receiver(receiver), onInputs(std::move(onInputs))
+    {
+        server = new QLocalServer;
+        server->setSocketOptions(QLocalServer::UserAccessOption);
+        server->moveToThread(&thread);
+        QObject::connect(&thread, &QThread::finished, server, &QObject::deleteLater);
+        QObject::connect(server, &QLocalServer::newConnection, server, [this]{
+            this->OnConnection();
+        });
+        thread.setObjectName("CommandChannel");
+        thread.start();
+    }
+
+    ~CommandChannel()
+    {
+        thread.quit();
+        thread.wait();
+    }
+
+    CommandChannel(CommandChannel const&) = delete;
+    CommandChannel& operator=(CommandChannel const&) = delete;
+
+    bool Listen(QString const& name)
+    {
+        bool ok = false;
+        QMetaObject::invokeMethod(server, [&]{
+            ok = server->listen(name);
+            if(!ok && server->serverError() == QAbstractSocket::AddressInUseError)
+            {
+                // Only a socket left behind by a process which crashed is
+                // removed, a running instance answers and keeps it
+                QLocalSocket probe;
+                probe.connectToServer(name);
+                bool alive = probe.waitForConnected(ProbeMs);
+                probe.abort();
+                if(!alive && QLocalServer::removeServer(name))
+                    ok = server->listen(name);
+            }
+            if(ok)
+                serverName = server->fullServerName();
+            else
+                serverName = server->errorString();
+        }, Qt::BlockingQueuedConnection);
+        return ok;
+    }
+
+    /** Path of the socket, or the error if Listen() failed */
+    QString ServerName() const { return serverName; }
+
+    qint64 Commands() const { return commands.load(); }
+
+private:
+    // Limit of the length of a command line
+    static constexpr qint64 MaxLineLength = 1 << 20;
+    // Replies waiting to be sent above which a client is not read further
+    static constexpr qint64 MaxUnsent     = 1 << 20;
+    // Time given to a running instance to accept a connection
+    static constexpr int    ProbeMs       = 500;
+
+    InputMailbox&          mailbox;
+    QObject*               receiver;
+    std::function<void ()> onInputs;
+    QThread                thread;
+    QLocalServer*          server;
+    QString                serverName;
+    std::atomic<qint64>    commands{0};
+
+    void OnConnection()
+    {
+        while(QLocalSocket* socket = server->nextPendingConnection())
+        {
+            // Unread commands stay in the socket, the client blocks
+            socket->setReadBufferSize(2 * MaxLineLength);
+            QObject::connect(socket, &QLocalSocket::readyRead, socket, [this, socket]{
+                this->OnReadyRead(socket);
+            });
+            // Resumes a client stopped while its replies were not read
+            QObject::connect(socket, &QLocalSocket::bytesWritten, socket, [this, socket]{
+                this->OnReadyRead(socket);
+            });
+            QObject::connect(socket, &QLocalSocket::disconnected,
+                             socket, &QObject::deleteLater);
+        }
+    }
+
+    void OnReadyRead(QLocalSocket* socket)
+    {
+        QByteArray replies;
+        // All complete lines received are executed, the replies are sent
+        // back with a single write. A client which does not read its
+        // replies is not served until they drain.
+        while(socket->canReadLine() && socket->bytesToWrite() + replies.size() < MaxUnsent)
+        {
+            QByteArray line = socket->readLine().trimmed();
+            if(line.isEmpty())
+                continue;
+            replies += this->Execute(line);
+            replies += '\n';
+        }
+        if(!replies.isEmpty())
+            socket->write(replies);
+        if(!socket->canReadLine() && socket->bytesAvailable() > MaxLineLength)
+        {
+            socket->write("ERR line too long\n");
+            socket->disconnectFromServer();
+        }
+    }
+
+    QByteArray Execute(QByteArray const& line)
+    {
+        commands++;
+        QList<QByteArray> args = line.simplified().split(' ');
+        QByteArray        cmd  = args[0].toUpper();
+
+        static const std::pair<const char*, InputMailbox::Field> fields[] = {
+            {"K", InputMailbox::FieldK}, {"S", InputMailbox::FieldS},
+            {"T", InputMailbox::FieldT}, {"SIGMA", InputMailbox::FieldSigma},
+            {"R", InputMailbox::FieldR}
+        };
+        for(auto const& f: fields)
+        {
+            if(cmd != f.first)
+                continue;
+            bool   ok    = args.size() == 2;
+            double value = ok ? args[1].toDouble(&ok) : 0.0;
+            if(!ok)
+                return "ERR usage: " + cmd + " <number>";
+            if(mailbox.Post(f.second, value))
+                QMetaObject::invokeMethod(receiver, onInputs, Qt::QueuedConnection);
+            return "OK";
+        }
+        if(cmd == "PRICE")
+        {
+            if(args.size() < 6 || (args.size() - 1) % 5 != 0)
+                return "ERR usage: PRICE S K T sigma r [S K T sigma r ...]";
+            QByteArray prices;
+            prices.reserve((args.size() - 1) / 5 * 12);
+            for(int i = 1; i < args.size(); i += 5)
+            {
+                double p[5];
+                for(int j = 0; j < 5; j++)
+                {
+                    bool ok;
+                    p[j] = args[i + j].toDouble(&ok);
+                    if(!ok)
+                        return "ERR invalid number " + args[i + j];
+                }
+                if(i > 1)
+                    prices += ' ';
+                prices += QByteArray::number(
+                            BlackScholesCall(p[0], p[1], p[2], p[3] / 100.0, p[4] / 100.0), 'f', 6);
+            }
+            return prices;
+        }
+        if(cmd == "PING")
+            return "PONG";
+        if(cmd == "EXIT")
+        {
+            QMetaObject::invokeMethod(qApp, []{ QCoreApplication::exit(0); },
+                                      Qt::QueuedConnection);
+            return "BYE";
+        }
+        return "ERR unknown command " + cmd;
+    }
+};
+
+
+/** Black-Scholes inputs and results displayed as a table. Values are
+ *  stored as numbers and only formatted when the view paints them, and a
+ *  recalculation signals only the cells whose value changed, so updating
+ *  at a high rate does not rebuild the whole display.
+ */
+class OptionResultsModel: public QAbstractTableModel
+{
+public:
+    enum Row { RowK = 0, RowS, RowT, RowSigma, RowR, RowD1, RowD2, RowV, RowCount };
+    enum Column { VariableColumn = 0, ValueColumn, DescriptionColumn, ColumnCount };
+
+    using Values = std::array<double, RowCount>;
+
+    explicit OptionResultsModel(QObject* parent = nullptr)
+        : QAbstractTableModel(parent)
+    {
+        values.fill(0.0);
+    }
+
+    void SetValues(Values const& newValues)
+    {
+        for(int row = 0; row < RowCount; row++)
+        {
+            // Unchanged cells are not repainted, NaN != NaN so
+            // two NaNs are checked separately
+            if(values[row] == newValues[row]
+               || (std::isnan(values[row]) && std::isnan(newValues[row])))
+                continue;
+            values[row] = newValues[row];
+            QModelIndex cell = this->index(row, ValueColumn);
+            emit this->dataChanged(cell, cell, {Qt::DisplayRole});
+        }
+    }
+
+    double Value(Row row) const { return values[row]; }
+
+    int rowCount(QModelIndex const& parent = QModelIndex()) const override
+    {
+        return parent.isValid() ? 0 : RowCount;
+    }
+
+    int columnCount(QModelIndex const& parent = QModelIndex()) const override
+    {
+        return parent.isValid() ? 0 : ColumnCount;
+    }
+
+    QVariant data(QModelIndex const& index, int role = Qt::DisplayRole) const override
+    {
+        if(!index.isValid())
+            return QVariant();
+        if(role == Qt::TextAlignmentRole && index.column() == ValueColumn)
+            return int(Qt::AlignRight | Qt::AlignVCenter);
+        if(role != Qt::DisplayRole)
+            return QVariant();
+        switch(index.column())
+        {
+        case VariableColumn:    return Variable(index.row());
+        case ValueColumn:       return QString::number(values[index.row()], 'f', 4);
+        case DescriptionColumn: return Description(index.row());
+        }
+        return QVariant();
+    }
+
+    QVariant headerData(int section, Qt::Orientation orientation,
+                        int role = Qt::DisplayRole) const override
+    {
+        if(orientation != Qt::Horizontal || role != Qt::DisplayRole)
+            return QVariant();
+        static const char* names[ColumnCount] = {"Variable", "Value", "Description"};
+        return QString(names[section]);
+    }
+
+    /** Render the table as HTML, for exporting the results */
+    QString ToHtml() const
+    {
+        QString html = "<h2>European Call Option Price Parameters</h2>"
+                       " <table>"
+                       "<caption>Results of Black-Scholes formulas for European options</caption>"
+                       " <tr><th>Variable</th><th>Value</th><th>Description</th></tr>";
+        for(int row = 0; row < RowCount; row++)
+            html += QString(" <tr><td>%1</td><td>%2</td><td>%3</td></tr>")
+                    .arg(Variable(row).toHtmlEscaped())
+                    .arg(values[row], 5, 'F', 4)
+                    .arg(Description(row).toHtmlEscaped());
+        return html + " </table>";
+    }
+
+    /** Tab separated values, for pasting into spreadsheets */
+    QString ToText() const
+    {
+        QString text;
+        for(int row = 0; row < RowCount; row++)
+            text += QString("%1\t%2\t%3\n").arg(Variable(row))
+                    .arg(values[row], 0, 'f', 4).arg(Description(row));
+        return text;
+    }
+
+private:
+    Values values;
+
+    static QString Variable(int row)
+    {
+        static const char* names[RowCount] = {"K", "S", "T", "sigma", "r", "d1", "d2", "V"};
+        return QString(names[row]);
+    }
+
+    static QString Description(int row)
+    {
+        static const char* text[RowCount] = {
+            "Strike Price", "Spot Price", "Time to maturity (years)",
+            "Volatility (%)", "Risk-free rate (%)", "d1", "d2", "Option Price (BLS)"
+        };
+        return QString(text[row]);
+    }
+};
+
+/** Main window displaying a form, either created by the code generated by
+ *  uic at build time (SetupForm) or loaded from a *.ui file at runtime
+ *  (LoadForm), which allows replacing the form without recompiling.
+ */
 class FormLoader: public QMainWindow
 {
 private:
     QString  formFile;
-    QWidget* form;
+    QWidget* form = nullptr;
 public:
+    FormLoader() = default;
+
+#if FORMS1_RUNTIME_UI
     FormLoader(QString path)
     {
         this->LoadForm(path);
+    }
+#endif
+
+    virtual ~FormLoader() = default;
+
+    // Forbid copy, aka Deep Copy
+    FormLoader(FormLoader const&) = delete;
+    FormLoader& operator=(FormLoader const&) = delete;
+
+#if FORMS1_RUNTIME_UI
+    void LoadForm(QString filePath)
+    {
+        formFile = filePath;
+        form = FormCache::Instance().Create(filePath);
+        // The cache already reported the reason, such as loader.errorString()
+        if(form == nullptr)
+        {
+            std::cout << " [ERROR] Cannot build the window without form " << filePath << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
         this->setCentralWidget(form);
         this->setWindowTitle(form->windowTitle());
-
         // Set Width and height
         this->resize(form->width(), form->height());
+        this->CenterWindow();
+    }
+#endif
 
+    /** Build the form with a class generated by uic, such as Ui::MainWindow */
+    template<typename UiForm>
+    void SetupForm(UiForm& ui)
+    {
+        formFile.clear();
+        // Sets the central widget, title and size of this window
+        ui.setupUi(this);
+        form = this;
+        this->CenterWindow();
+    }
+
+    void CenterWindow()
+    {
         // Center Window in the screen
         this->setGeometry(
             QStyle::alignedRect(
@@ -92,24 +581,11 @@ public:
         );
     }
 
-    virtual ~FormLoader() = default;
-
-    // Forbid copy, aka Deep Copy
-    FormLoader(FormLoader const&) = delete;
-    FormLoader& operator=(FormLoader const&) = delete;
-
-    void LoadForm(QString filePath)
-    {
-        QUiLoader loader;
-        formFile = filePath;
-        QFile file(filePath);
-       // file.open(QFile::ReadOnly);
-        form = loader.load(&file, nullptr);
-        assert(form != nullptr);
-        file.close();
-    }
-
+    /** Root of the form widgets, for looking them up with findChild */
     QWidget* GetForm() { return form;  }
+
+    /** Empty if the form is compiled */
+    QString GetFormFile() const { return formFile; }
 };
 
 class EuropeanOptionsForm: public FormLoader
@@ -124,15 +600,25 @@ private:
     QPushButton* btnClose;
     QPushButton* btnReset;
     QPushButton* btnShortcut;
-    QTextEdit*   display;
+    QTableView*  display;
+    OptionResultsModel* results = new OptionResultsModel(this);
     QTimer*      timer = new QTimer(this);
     QLabel* DateTimeDisplay;
+    ScenarioSweepPanel* sweep;
+    LivePanel*          live;
+    ChainPanel*         chain;
+    // Toggles the dock widgets
+    QMenu*              menuView;
+    FormStateStore& store;
 public:
 
-    EuropeanOptionsForm()
-        : FormLoader(":/assets/form1.ui")
+    /** formFile: *.ui file loaded at runtime instead of the built-in form
+     *  store:    saves the form state whenever it changes */
+    explicit EuropeanOptionsForm(FormStateStore& store, QString formFile = QString())
         //FormLoader(QCoreApplication::applicationDirPath() + "/form1.ui")
+        : store(store)
     {
+        this->CreateForm(formFile);
         QWidget* form = this->FormLoader::GetForm();
         entryK       = form->findChild<QLineEdit*>("entryK");
         entryS       = form->findChild<QLineEdit*>("entryS");
@@ -142,8 +628,14 @@ public:
         btnClose     = form->findChild<QPushButton*>("btnClose");
         btnReset     = form->findChild<QPushButton*>("btnReset");
         btnShortcut  = form->findChild<QPushButton*>("btnShortcut");
-        display      = form->findChild<QTextEdit*>("OutputDisplay");
+        display      = form->findChild<QTableView*>("ResultsView");
         DateTimeDisplay  = form->findChild<QLabel*>("DateTimeDisplay");
+        this->CheckForm(form);
+        this->SetupResultsView(form);
+        menuView = this->menuBar()->addMenu(tr("&View"));
+        this->SetupScenarioSweep();
+        this->SetupLivePricing();
+        this->SetupChainLoader();
 
         // 1 second interval = 1000 milliseconds
         timer->setInterval(1000);
@@ -177,13 +669,9 @@ public:
            this->focusNextChild();
         };
 
-        // Restore window size and position
-        this->RestoreAppState();
-
-        // Save application state when the main Window is destroyed
-        QObject::connect(this, &QMainWindow::destroyed, [this]{
-           this->SaveAppState();
-        });
+        // State is saved continuously rather than when the window is
+        // destroyed, so a crash does not lose it.
+        store.SetSnapshot([this]{ return this->SaveAppState(); });
 
         QObject::connect(entryK, &QLineEdit::returnPressed, update);
         QObject::connect(entryS, &QLineEdit::returnPressed, update);
@@ -212,6 +700,132 @@ public:
 
     }
 
+    /** Forms given with --form must have the widgets used by the code,
+     *  a missing one is reported instead of dereferencing nullptr later */
+    void CheckForm(QWidget* form)
+    {
+        QStringList missing;
+        std::pair<QObject*, const char*> required[] = {
+            {entryK, "entryK"}, {entryS, "entryS"}, {entryT, "entryT"},
+            {entrySigma, "entrySigma"}, {entryR, "entryR"},
+            {btnClose, "btnClose"}, {btnReset, "btnReset"}, {btnShortcut, "btnShortcut"},
+            {DateTimeDisplay, "DateTimeDisplay"}
+        };
+        for(auto const& w: required)
+            if(w.first == nullptr)
+                missing << w.second;
+        if(display == nullptr && form->findChild<QWidget*>("OutputDisplay") == nullptr)
+            missing << "ResultsView";
+        if(missing.isEmpty())
+            return;
+        std::cout << " [ERROR] Form " << this->GetFormFile() << " has no widget named "
+                  << missing.join(", ") << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    void SetupResultsView(QWidget* form)
+    {
+        // Forms loaded with --form may still have the former text display
+        if(display == nullptr)
+        {
+            // Checked by CheckForm()
+            QWidget* old = form->findChild<QWidget*>("OutputDisplay");
+            display = new QTableView(old->parentWidget());
+            display->setGeometry(old->geometry());
+            display->setContextMenuPolicy(Qt::ActionsContextMenu);
+            display->setEditTriggers(QAbstractItemView::NoEditTriggers);
+            display->verticalHeader()->hide();
+            display->horizontalHeader()->setStretchLastSection(true);
+            old->hide();
+        }
+        display->setModel(results);
+
+        // HTML is only produced on demand, as an export format
+        auto copyAct = new QAction(tr("Copy as HTML"), display);
+        QObject::connect(copyAct, &QAction::triggered, [this]{
+            auto mime = new QMimeData;
+            mime->setHtml(results->ToHtml());
+            mime->setText(results->ToText());
+            QApplication::clipboard()->setMimeData(mime);
+        });
+        auto exportAct = new QAction(tr("Export HTML..."), display);
+        QObject::connect(exportAct, &QAction::triggered, [this]{
+            QString path = QFileDialog::getSaveFileName(this, tr("Export HTML"), "results.html",
+                                                        tr("HTML files (*.html *.htm)"));
+            if(path.isEmpty())
+                return;
+            QSaveFile file(path);
+            if(file.open(QFile::WriteOnly))
+            {
+                file.write("<html><body>" + results->ToHtml().toUtf8() + "</body></html>");
+                if(file.commit())
+                    return;
+            }
+            QMessageBox::warning(this, tr("Export HTML"), tr("Cannot write %1").arg(path));
+        });
+        display->addAction(copyAct);
+        display->addAction(exportAct);
+    }
+
+    /** Dockable what-if panel, restored with the window state */
+    void SetupScenarioSweep()
+    {
+        sweep = new ScenarioSweepPanel([this]{ return this->Inputs(); });
+        auto dock = new QDockWidget(tr("Scenario Sweep"), this);
+        dock->setObjectName("ScenarioSweepDock");
+        dock->setWidget(sweep);
+        this->addDockWidget(Qt::RightDockWidgetArea, dock);
+
+        menuView->addAction(dock->toggleViewAction());
+    }
+
+    /** Dockable live mode, the results follow the spot feed once per frame
+     *  without editing the inputs, so neither the sweep nor the saved state
+     *  change on every frame. */
+    void SetupLivePricing()
+    {
+        live = new LivePanel([this]{ return this->Inputs(); },
+                             [this](Tick const& tick){
+            OptionInputs in = this->Inputs();
+            in.S = tick.spot;
+            this->ShowResults(in);
+        });
+        auto dock = new QDockWidget(tr("Live Pricing"), this);
+        dock->setObjectName("LivePricingDock");
+        dock->setWidget(live);
+        this->addDockWidget(Qt::BottomDockWidgetArea, dock);
+        menuView->addAction(dock->toggleViewAction());
+    }
+
+    /** Dockable option chain downloaded over HTTP, a row is loaded into
+     *  the form by double clicking it. */
+    void SetupChainLoader()
+    {
+        chain = new ChainPanel([this]{ return this->Inputs(); },
+                               [this](OptionInputs const& in){ this->SetInputs(in); });
+        auto dock = new QDockWidget(tr("Option Chain"), this);
+        dock->setObjectName("OptionChainDock");
+        dock->setWidget(chain);
+        this->addDockWidget(Qt::RightDockWidgetArea, dock);
+        menuView->addAction(dock->toggleViewAction());
+    }
+
+    void CreateForm(QString const& formFile)
+    {
+      #if FORMS1_PRECOMPILED_UI
+        if(formFile.isEmpty())
+        {
+            // Widgets are created by compiled code, no XML parsing
+            Ui::MainWindow ui;
+            this->SetupForm(ui);
+            return;
+        }
+      #endif
+      #if FORMS1_RUNTIME_UI
+        this->LoadForm(formFile.isEmpty() ? QString(":/assets/form1.ui") : formFile);
+      #endif
+    }
+
     // Set strike price
     void SetK(double value)
     {
@@ -226,56 +840,96 @@ public:
         this->Recalculate();
     }
 
+    /** Set any input as typed in the form, sigma and r in % */
+    void SetInput(InputMailbox::Field field, double value)
+    {
+        QLineEdit* entries[InputMailbox::FieldCount] = {
+            entryK, entryS, entryT, entrySigma, entryR
+        };
+        entries[field]->setText(QString::number(value));
+        this->Recalculate();
+    }
+
+    /** Set all the inputs, sigma and r in %, recalculating once */
+    void SetInputs(OptionInputs const& in)
+    {
+        entryK->setText(QString::number(in.K));
+        entryS->setText(QString::number(in.S));
+        entryT->setText(QString::number(in.T));
+        entrySigma->setText(QString::number(in.sigma));
+        entryR->setText(QString::number(in.r));
+        this->Recalculate();
+    }
+
+    ChainPanel* ChainLoader() const { return chain; }
+
+    /** Painted when the results change */
+    QWidget* ResultsViewport() const { return display->viewport(); }
+
+    /** Apply the inputs posted by the command channel, recalculating once
+     *  however many fields changed. */
+    void ApplyInputs(InputMailbox& mailbox)
+    {
+        QLineEdit* entries[InputMailbox::FieldCount] = {
+            entryK, entryS, entryT, entrySigma, entryR
+        };
+        bool changed = false;
+        mailbox.Drain([&](InputMailbox::Field field, double value){
+            entries[field]->setText(QString::number(value));
+            changed = true;
+        });
+        if(changed)
+            this->Recalculate();
+    }
+
+    /** Inputs currently entered, sigma and r in % */
+    OptionInputs Inputs() const
+    {
+        OptionInputs in;
+        in.K     = entryK->text().toDouble();
+        in.S     = entryS->text().toDouble();
+        in.T     = entryT->text().toDouble();
+        in.sigma = entrySigma->text().toDouble();
+        in.r     = entryR->text().toDouble();
+        return in;
+    }
+
     void Recalculate()
+    {
+      INSTRUMENT_SCOPE("EuropeanOptionsForm::Recalculate");
+      this->ShowResults(this->Inputs());
+      // The grid is recomputed around the new inputs
+      sweep->Schedule();
+      store.MarkDirty();
+
+      // form->nextInFocusChain()->setFocus();
+      // QApplication::focusWidget()->nextInFocusChain()->setFocus();
+      // Set focus on next child widget
+
+    };
+
+    void ShowResults(OptionInputs const& in)
     {
       int a = 1;
-      double q = 0.0;
 
-      double K   = entryK->text().toDouble();
-      double S   = entryS->text().toDouble();
-      double T   = entryT->text().toDouble();
-      double sigma = entrySigma->text().toDouble() / 100.0;
-      double r   = entryR->text().toDouble() / 100.0;
+      double K   = in.K;
+      double S   = in.S;
+      double T   = in.T;
+      double sigma = in.sigma / 100.0;
+      double r   = in.r / 100.0;
+      // Cost of carry, no dividend, so the spot term is not discounted
       double b   = r;
 
       double d1 = (log(S/K) + (b + sigma * sigma / 2.0) * T) / (sigma * sqrt(T));
       double d2 = d1 - sigma * std::sqrt(T);
       // Helper parameter
-      double exp_brt = std::exp((b - r) * T);
       double exp_rt = std::exp(-r * T);
-      double sqrt_T  = sqrt(T);
       // European option price at t = 0
-      double V = a * S * exp_brt * normal_cdf(a * d1) - a * K * exp_rt * normal_cdf(a * d2);
-
-      auto result = QString(
-                  "<h2>European Call Option Price Parameters</h2>"
-                  " <table>"
-                  "<caption>Results of Black-Scholes formulas for European options</caption>"
-                  " <tr>"
-                  "  <th>Variable</th>"
-                  "  <th>Value</th>"
-                  "  <th>Description</th>"
-                  " </tr>"
-                  " <tr>"
-                  "  <td>K</td>"
-                  "  <td>%1</td>"
-                  "  <td>Strike Price</td>"
-                  " </tr>"
-                  " <tr>"
-                  "  <td>V</td>"
-                  "  <td>%2</td>"
-                  "  <td>Option Price (BLS)</td>"
-                  " </tr>"
-                  " </table>"
-                  ).arg(K, 5, 'F', 3).arg(V, 5, 'F', 3); //.arg(d1).arg(d2).arg(V);
-
-      display->setText(result);
-
-      // form->nextInFocusChain()->setFocus();
-      // QApplication::focusWidget()->nextInFocusChain()->setFocus();
-      // Set focus on next child widget
+      double V = a * S * normal_cdf(a * d1) - a * K * exp_rt * normal_cdf(a * d2);
 
-    };
+      // Only the cells whose value changed are repainted
+      results->SetValues({{K, S, T, sigma * 100.0, r * 100.0, d1, d2, V}});
+    }
 
 
     /** Reseut the UI State to default value from
@@ -299,63 +953,48 @@ public:
 
     }
 
-    void SaveAppState() const
+    /** Current window geometry and inputs, saved by the state store */
+    FormState SaveAppState() const
     {
-        QSettings conf;
-        // Save current window position
-        conf.setValue("pos", this->pos());
-        // Save current window size before closing
-        conf.setValue("size", this->size());
-        // Save current state
-        conf.setValue("state", this->saveState());
-
-        auto saveEntryState = [&](QString name, QLineEdit* entry){
-            conf.setValue(name, entry->text().toDouble());
+        FormState state;
+        state.pos         = this->pos();
+        state.size        = this->size();
+        state.windowState = this->saveState();
+        QLineEdit* entries[FormState::EntryCount] = {
+            entryK, entryS, entryT, entrySigma, entryR
         };
-
-        saveEntryState("entryK", this->entryK);
-        saveEntryState("entryS", this->entryS);
-        saveEntryState("entryT", this->entryT);
-        saveEntryState("entrySigma", this->entrySigma);
-        saveEntryState("entryR", this->entryR);
-
-        qDebug() << " [INFO] Application state saved OK.";
+        for(int i = 0; i < FormState::EntryCount; i++)
+            state.entries[i] = entries[i]->text().toDouble();
+        return state;
     }
 
-    void RestoreAppState()
+    void RestoreAppState(FormState const& state)
     {
-        QSettings conf;
-        // Default window position
-        constexpr int top = 200, left = 200;
-        // Defailt window size
-        constexpr int width = 600, height = 500;
-
-        // Note: QPoint(top, left) is the default value for the setting
-        // if the configuration is not defined.
-        QPoint pos  = conf.value("pos", QPoint(top, left)).toPoint();
-
-        QSize  size = conf.value("size",  QSize(width, height)).toSize();
-        QByteArray state = conf.value("state", QByteArray()).toByteArray();
-        this->restoreState(state);
-        this->resize(size);
-        this->move(pos);
-
-        auto loadEntryState = [&]( QString    name,
-                                   QLineEdit* entry,
-                                   double     default_value )
-        {
-            double value = conf.value(name, default_value).toDouble();
-            entry->setText(QString::number(value));
+        this->restoreState(state.windowState);
+        this->resize(state.size);
+        this->move(state.pos);
+        QLineEdit* entries[FormState::EntryCount] = {
+            entryK, entryS, entryT, entrySigma, entryR
         };
-
-        loadEntryState("entryK",     this->entryK,     50.0);
-        loadEntryState("entryS",     this->entryS,     50.0);
-        loadEntryState("entryT",     this->entryT,     30.0);
-        loadEntryState("entrySigma", this->entrySigma, 30.0);
-        loadEntryState("entryR",     this->entryR,     5.0);
+        for(int i = 0; i < FormState::EntryCount; i++)
+            entries[i]->setText(QString::number(state.entries[i]));
         this->Recalculate();
     }
 
+protected:
+    // Geometry changes are saved as well as inputs
+    void moveEvent(QMoveEvent* event) override
+    {
+        FormLoader::moveEvent(event);
+        store.MarkDirty();
+    }
+
+    void resizeEvent(QResizeEvent* event) override
+    {
+        FormLoader::resizeEvent(event);
+        store.MarkDirty();
+    }
+
 };
 
 
@@ -386,76 +1025,97 @@ int main(int argc, char** argv)
     DISP_EXPR(QSysInfo::productVersion());
     DISP_EXPR(QSysInfo::prettyProductName());
 
-    EuropeanOptionsForm form;
+    QCommandLineParser parser;
+    parser.addHelpOption();
+  #if FORMS1_RUNTIME_UI
+    QCommandLineOption formOption(
+        "form", "Load the form from a *.ui file at runtime, it must have the "
+                "same widget names as form1.ui.", "file");
+    parser.addOption(formOption);
+  #endif
+    QCommandLineOption socketOption(
+        "socket", "Name of the local socket accepting commands.", "name", "forms1");
+    parser.addOption(socketOption);
+    QCommandLineOption chainUrlOption(
+        "chain-url", "Load the option chain at the URL, CSV or JSON.", "url");
+    parser.addOption(chainUrlOption);
+    QCommandLineOption chainServerOption(
+        "chain-server", "Serve a generated chain of <rows> options on a local "
+                        "HTTP server and load it.", "rows");
+    parser.addOption(chainServerOption);
+    TickReplay::AddOptions(parser);
+    Instrument::Session::AddOptions(parser);
+    parser.process(app);
+    Instrument::Session instrument(parser);
+
+    QString formFile;
+  #if FORMS1_RUNTIME_UI
+    formFile = parser.value(formOption);
+    FormCache formCache;
+  #endif
+
+    // The state file is read while the form is built
+    FormStateStore stateStore(FormStateStore::DefaultPath());
+    std::future<FormState> savedState = stateStore.Load();
+
+    QElapsedTimer formTimer;
+    formTimer.start();
+    EuropeanOptionsForm form(stateStore, formFile);
+    std::cout << " [INFO] Form created in " << formTimer.nsecsElapsed() / 1000000.0
+              << " ms from " << (form.GetFormFile().isEmpty() ? QString("compiled code")
+                                                                : form.GetFormFile())
+              << std::endl;
+    form.RestoreAppState(savedState.get());
     form.setWindowIcon(QIcon(":/images/appicon.png"));
     form.showNormal();
 
-    // Background thread for Console/REPL interactive shell where an user
-    // can send commands to user interface form1 object.
-    QtConcurrent::run([&]{
-       std::string line;
-       std::string name;
-       double      value;
-       while(true){
-           std::cout << " COMMAND >> ";
-           std::getline(std::cin, line);
-
-           if(line == "exit"){
-               QCoreApplication::exit(0);
-               return;
-           }
-
-           std::stringstream ss(line);
-           ss >> name >> value;
-           std::cout << " name = " << name
-                     << " ; value = " << value << std::endl;
-
-           if(name == "K")
-           {
-               // Send message to form in main thread
-               QMetaObject::invokeMethod( &form
-                                         , [&]{ form.SetK(value); }
-                                        );
-               continue;
-            }
-           if(name == "S")
-           {
-               QMetaObject::invokeMethod( &form
-                                         , [&]{ form.SetS(value); }
-                                        );
-               continue;
-           }
-       }
+    // Commands sent to the form by other processes, replaces the former
+    // stdin REPL thread.
+    InputMailbox   mailbox;
+    CommandChannel channel(mailbox, &form, [&]{ form.ApplyInputs(mailbox); });
+    if(channel.Listen(parser.value(socketOption)))
+        std::cout << " [INFO] Listening for commands on " << channel.ServerName() << std::endl;
+    else
+        std::cout << " [ERROR] Command channel: " << channel.ServerName() << std::endl;
+
+    // Recorded workload for comparing binding and rendering changes
+    TickReplay replay([&](TickField field, double value){
+        switch(field)
+        {
+        case TickField::K:     form.SetK(value); break;
+        case TickField::S:     form.SetS(value); break;
+        case TickField::T:     form.SetInput(InputMailbox::FieldT, value); break;
+        case TickField::Sigma: form.SetInput(InputMailbox::FieldSigma, value * 100.0); break;
+        case TickField::R:     form.SetInput(InputMailbox::FieldR, value * 100.0); break;
+        default: break;
+        }
     });
+    replay.SetPaintProbe(form.ResultsViewport());
 
-    return app.exec();
-}
-
-// ======= Utility Functions ===========//
-
-/** @brief Normal Probability Density Function (mean = 0) and standard deviation = 1  */
-double normal_pdf(double x)
-{
-    return 1/(std::sqrt(2.0 * M_PI)) * std::exp(- x * x / 2);
-}
-
-/** @brief Cumulative normal distribution approximation  (with mean = 0 and standard deviation = 1)
- */
-double normal_cdf(double d)
-{
-    constexpr double A [] =
+    // Option chain, the local server stands in for a market data service
+    std::unique_ptr<LocalServer> chainServer;
+    QString chainUrl = parser.value(chainUrlOption);
+    if(parser.isSet(chainServerOption))
     {
-        0.31938153,
-       -0.356563782,
-        1.781477937,
-       -1.821255978,
-        1.330274429
-    };
-    constexpr double RSQRT2PI = 0.39894228040143267793994605993438;
-    double K = 1.0 / (1.0 + 0.2316419 * std::fabs(d));
-    double c = RSQRT2PI * std::exp(- 0.5 * d * d) *
-            (K * (A[0] + K * (A[1] + K * (A[2] + K * (A[3] + K * A[4])))));
-    if(d > 0) return 1.0 - c;
-    return c;
+        QString error;
+        chainServer = std::make_unique<LocalServer>();
+        if(chainServer->Listen(0, &error))
+            chainUrl = chainServer->Url("/chain/" + parser.value(chainServerOption)).toString();
+        else
+            std::cout << " [ERROR] Chain server: " << error << std::endl;
+    }
+    if(!chainUrl.isEmpty())
+    {
+        form.ChainLoader()->SetUrl(chainUrl);
+        form.ChainLoader()->Load();
+    }
+    int replayStatus = 0;
+    if(!replay.StartFromCommandLine(parser, &replayStatus))
+        return replayStatus;
+
+    int status = app.exec();
+    stateStore.Flush();
+    DISP_VALUE("Commands received", channel.Commands());
+    DISP_VALUE("State writes", stateStore.Writes());
+    return status;
 }
-
@@ -0,0 +1,172 @@
+#include "livefeed.h"
+
+#include <cmath>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <memory>
+
+#include <QFile>
+#include <QTextStream>
+#include <QStringList>
+#include <QRegExp>
+
+//======= TickQueue Implementation ==========//
+
+TickQueue::TickQueue(size_t capacity)
+{
+    size_t n = 1;
+    while(n < capacity)
+        n <<= 1;
+    buffer.resize(n);
+    mask = n - 1;
+}
+
+bool TickQueue::Push(Tick const& tick)
+{
+    size_t h = head.load(std::memory_order_relaxed);
+    if(h - tail.load(std::memory_order_acquire) == buffer.size())
+        return false;
+    buffer[h & mask] = tick;
+    head.store(h + 1, std::memory_order_release);
+    return true;
+}
+
+//======= SpotFeed Implementation ==========//
+
+SpotFeed::SpotFeed(TickQueue& queue): queue(queue)
+{
+}
+
+SpotFeed::~SpotFeed()
+{
+    this->Stop();
+}
+
+void SpotFeed::SetPricing(OptionInputs const& inputs)
+{
+    K.store(inputs.K, std::memory_order_relaxed);
+    T.store(inputs.T, std::memory_order_relaxed);
+    sigma.store(inputs.sigma, std::memory_order_relaxed);
+    r.store(inputs.r, std::memory_order_relaxed);
+}
+
+void SpotFeed::Stop()
+{
+    if(!thread.joinable())
+        return;
+    stop = true;
+    thread.join();
+    stop = false;
+}
+
+void SpotFeed::Emit(double time, double spot)
+{
+    OptionInputs in;
+    in.S     = spot;
+    in.K     = K.load(std::memory_order_relaxed);
+    in.T     = T.load(std::memory_order_relaxed);
+    in.sigma = sigma.load(std::memory_order_relaxed);
+    in.r     = r.load(std::memory_order_relaxed);
+    ticks.fetch_add(1, std::memory_order_relaxed);
+    if(!queue.Push({time, spot, BlackScholesCall(in)}))
+        dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+template<typename Next>
+void SpotFeed::Run(Next next)
+{
+    using Clock = std::chrono::steady_clock;
+    ticks   = 0;
+    dropped = 0;
+    running = true;
+    thread = std::thread([this, next]() mutable {
+        auto   start = Clock::now();
+        size_t i     = 0;
+        double time = 0.0, spot = 0.0;
+        bool   pending = next(i, &time, &spot);
+        while(pending && !stop.load(std::memory_order_relaxed))
+        {
+            // Sleeping per tick is too coarse above 1 kHz: every tick due
+            // since the last wake-up is emitted in one burst.
+            double now = std::chrono::duration<double>(Clock::now() - start).count();
+            while(pending && time <= now)
+            {
+                this->Emit(time, spot);
+                pending = next(++i, &time, &spot);
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        running = false;
+    });
+}
+
+void SpotFeed::StartSimulation(Simulation const& sim)
+{
+    this->Stop();
+    double rate = std::min(std::max(sim.rate, 1.0), MaxRate);
+    // Time step in years, 252 trading days a year
+    double dt    = sim.daysPerSec / (252.0 * rate);
+    double mu    = (sim.drift - 0.5 * sim.volatility * sim.volatility) * dt;
+    double sd    = sim.volatility * std::sqrt(dt);
+    auto   rng   = std::make_shared<std::mt19937_64>(std::random_device{}());
+    auto   s     = std::make_shared<double>(sim.spot);
+    this->Run([=](size_t i, double* time, double* spot){
+        std::normal_distribution<double> z;
+        if(i > 0)
+            *s *= std::exp(mu + sd * z(*rng));
+        *time = i / rate;
+        *spot = *s;
+        return true;
+    });
+}
+
+bool SpotFeed::StartReplay(QString const& path, QString* error)
+{
+    this->Stop();
+    QFile file(path);
+    if(!file.open(QFile::ReadOnly | QFile::Text))
+    {
+        if(error) *error = file.errorString();
+        return false;
+    }
+    auto quotes = std::make_shared<std::vector<std::pair<double, double>>>();
+    QTextStream in(&file);
+    int lineNumber = 0;
+    while(!in.atEnd())
+    {
+        QString line = in.readLine().trimmed();
+        lineNumber++;
+        if(line.isEmpty() || line.startsWith('#'))
+            continue;
+        QStringList fields = line.split(QRegExp("[\\s,;]+"));
+        bool okTime = false, okSpot = false;
+        double time = fields.value(0).toDouble(&okTime);
+        double spot = fields.value(1).toDouble(&okSpot);
+        if(!okTime || !okSpot)
+        {
+            if(error) *error = QString("Invalid line %1: %2").arg(lineNumber).arg(line);
+            return false;
+        }
+        quotes->emplace_back(time, spot);
+    }
+    if(quotes->empty())
+    {
+        if(error) *error = "No quotes in file";
+        return false;
+    }
+    // The feed emits the quotes in order, merged files may not be sorted
+    std::stable_sort(quotes->begin(), quotes->end(), [](auto const& a, auto const& b){
+        return a.first < b.first;
+    });
+    // Times relative to the first quote
+    double t0 = quotes->front().first;
+    this->Run([=](size_t i, double* time, double* spot){
+        if(i >= quotes->size())
+            return false;
+        *time = (*quotes)[i].first - t0;
+        *spot = (*quotes)[i].second;
+        return true;
+    });
+    return true;
+}
@@ -0,0 +1,110 @@
+#ifndef LIVEFEED_H
+#define LIVEFEED_H
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <cstdint>
+
+#include <QString>
+
+#include "blackscholes.h"
+
+/** Spot quote and the option price computed for it */
+struct Tick
+{
+    double time;   // Seconds since the feed started
+    double spot;
+    double price;
+};
+
+/** Lock-free queue of ticks between one producer and one consumer thread.
+ *  The capacity is a power of two. */
+class TickQueue
+{
+    std::vector<Tick>   buffer;
+    size_t              mask;
+    // Separate cache lines, each index is written by a single thread
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+public:
+    explicit TickQueue(size_t capacity = 1 << 16);
+
+    /** Producer side, false if the queue is full */
+    bool Push(Tick const& tick);
+
+    /** Consumer side, calls fn(Tick const&) for each queued tick */
+    template<typename Callable>
+    size_t Drain(Callable fn)
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        size_t h = head.load(std::memory_order_acquire);
+        for(size_t i = t; i != h; i++)
+            fn(buffer[i & mask]);
+        tail.store(h, std::memory_order_release);
+        return h - t;
+    }
+};
+
+/** Spot price feed running on its own thread.
+ *
+ *  Ticks come from a geometric Brownian motion or from a replay file and
+ *  the option is re-priced for each of them on the feed thread, so the GUI
+ *  only has to consume the queue at its own pace. The pricing inputs other
+ *  than the spot can be changed while the feed runs.
+ */
+class SpotFeed
+{
+public:
+    struct Simulation
+    {
+        double spot       = 50.0;
+        double drift      = 0.05;   // Annual, fraction
+        double volatility = 0.30;   // Annual, fraction
+        double rate       = 1000;   // Ticks per second, up to MaxRate
+        double daysPerSec = 1.0;    // Trading days simulated per second
+    };
+
+    static constexpr double MaxRate = 10000;
+
+    explicit SpotFeed(TickQueue& queue);
+    ~SpotFeed();
+
+    SpotFeed(SpotFeed const&) = delete;
+    SpotFeed& operator=(SpotFeed const&) = delete;
+
+    /** K, T, sigma and r of the inputs are used, S is ignored */
+    void SetPricing(OptionInputs const& inputs);
+
+    void StartSimulation(Simulation const& sim);
+
+    /** Replay a text file of "<seconds> <spot>" lines at the recorded times.
+     *  Returns false and sets error if the file cannot be read. */
+    bool StartReplay(QString const& path, QString* error = nullptr);
+
+    void Stop();
+    /** False once a replay reaches the end of the file */
+    bool Running() const { return running.load(); }
+
+    uint64_t Ticks()   const { return ticks.load(std::memory_order_relaxed); }
+    /** Ticks lost because the consumer was too slow */
+    uint64_t Dropped() const { return dropped.load(std::memory_order_relaxed); }
+
+private:
+    TickQueue&          queue;
+    std::thread         thread;
+    std::atomic<bool>   stop{false};
+    std::atomic<bool>   running{false};
+    std::atomic<uint64_t> ticks{0};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<double> K{50.0}, T{0.5}, sigma{30.0}, r{5.0};
+
+    void Emit(double time, double spot);
+
+    /** Runs on the feed thread, calls next(i, &time, &spot) for the i-th
+     *  tick and emits it once its time is reached. */
+    template<typename Next>
+    void Run(Next next);
+};
+
+#endif // LIVEFEED_H
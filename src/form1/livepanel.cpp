@@ -0,0 +1,335 @@
+#include "livepanel.h"
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include <algorithm>
+
+#include <QComboBox>
+#include <QDoubleSpinBox>
+#include <QSpinBox>
+#include <QPushButton>
+#include <QLabel>
+#include <QTimer>
+#include <QPainter>
+#include <QFileDialog>
+#include <QMessageBox>
+#include <QFormLayout>
+#include <QHBoxLayout>
+#include <QVBoxLayout>
+#include <QGuiApplication>
+#include <QScreen>
+
+#include "../common/instrument.h"
+
+/** Ticks of the history window reduced on arrival to the min-max range of
+ *  spot and price per time bucket. Memory and the cost of a repaint depend
+ *  on the number of buckets, not on the tick rate nor the window length.
+ *  Buckets older than the window are reused for the new ones. */
+class TickHistory
+{
+public:
+    // Fewest buckets, Reset() uses more on screens wider than that
+    static constexpr int64_t MinBuckets = 4096;
+
+    struct Bucket
+    {
+        float spotLo  =  1e30f, spotHi  = -1e30f;
+        float priceLo =  1e30f, priceHi = -1e30f;
+        bool  Empty() const { return spotLo > spotHi; }
+    };
+
+    /** At least one bucket per pixel column of the widest screen, so that
+     *  a maximized chart shows every column */
+    void Reset(double window)
+    {
+        count = MinBuckets;
+        for(QScreen* screen: QGuiApplication::screens())
+            count = std::max<int64_t>(count, screen->geometry().width());
+        buckets.assign(static_cast<size_t>(count), Bucket());
+        width = std::max(window, 1e-3) / count;
+        head  = std::numeric_limits<int64_t>::min();
+    }
+
+    /** Ticks may arrive out of order, those older than the window are dropped */
+    void Append(Tick const& tick)
+    {
+        auto index = static_cast<int64_t>(std::floor(tick.time / width));
+        if(head == std::numeric_limits<int64_t>::min())
+            head = index;
+        if(index > head)
+        {
+            // Buckets between the previous and the new head are emptied
+            int64_t first = std::max(head + 1, index - count + 1);
+            for(int64_t i = first; i <= index; i++)
+                buckets[static_cast<size_t>(Slot(i))] = Bucket();
+            head = index;
+        }
+        else if(index <= head - count)
+            return;
+        Bucket& b = buckets[static_cast<size_t>(Slot(index))];
+        b.spotLo  = std::min(b.spotLo,  float(tick.spot));
+        b.spotHi  = std::max(b.spotHi,  float(tick.spot));
+        b.priceLo = std::min(b.priceLo, float(tick.price));
+        b.priceHi = std::max(b.priceHi, float(tick.price));
+    }
+
+    bool Empty() const { return head == std::numeric_limits<int64_t>::min(); }
+
+    /** End of the latest bucket */
+    double LatestTime() const { return Empty() ? 0.0 : (head + 1) * width; }
+
+    /** fn(time, bucket) for the non empty buckets, from the oldest */
+    template<typename Callable>
+    void ForEach(Callable fn) const
+    {
+        if(this->Empty())
+            return;
+        for(int64_t i = head - count + 1; i <= head; i++)
+        {
+            Bucket const& b = buckets[static_cast<size_t>(Slot(i))];
+            if(!b.Empty())
+                fn(i * width, b);
+        }
+    }
+
+private:
+    std::vector<Bucket> buckets;
+    int64_t             count = MinBuckets;
+    double              width = 1.0;    // Seconds per bucket
+    int64_t             head  = std::numeric_limits<int64_t>::min();
+
+    int64_t Slot(int64_t index) const { return ((index % count) + count) % count; }
+};
+
+/** Spot (top) and option price (bottom) over the history window. Buckets of
+ *  the history are merged into pixel columns, each drawn as its min-max
+ *  range, so a repaint costs the same at 10 ticks/s or 10k ticks/s. */
+class LiveChart: public QWidget
+{
+public:
+    TickHistory history;
+    double      window = 120.0;    // Seconds displayed
+
+    explicit LiveChart(QWidget* parent = nullptr): QWidget(parent)
+    {
+        this->setMinimumSize(300, 200);
+        this->setAttribute(Qt::WA_OpaquePaintEvent);
+    }
+
+protected:
+    void paintEvent(QPaintEvent*) override
+    {
+        INSTRUMENT_SCOPE("LiveChart::paintEvent");
+        QPainter painter(this);
+        painter.fillRect(this->rect(), Qt::black);
+        int width = this->width();
+        if(history.Empty() || width < 2)
+            return;
+
+        struct Column { float lo = 1e30f, hi = -1e30f; };
+        std::vector<Column> spot(width), price(width);
+        double t1 = history.LatestTime();
+        double t0 = t1 - window;
+        double scale = (width - 1) / window;
+        history.ForEach([&](double time, TickHistory::Bucket const& b){
+            int x = static_cast<int>((time - t0) * scale);
+            x = std::min(std::max(x, 0), width - 1);
+            spot[x].lo  = std::min(spot[x].lo,  b.spotLo);
+            spot[x].hi  = std::max(spot[x].hi,  b.spotHi);
+            price[x].lo = std::min(price[x].lo, b.priceLo);
+            price[x].hi = std::max(price[x].hi, b.priceHi);
+        });
+
+        int half = this->height() / 2;
+        this->DrawSeries(painter, spot,  QRect(0, 0, width, half - 2), Qt::green, "S");
+        this->DrawSeries(painter, price, QRect(0, half + 2, width, half - 2), Qt::yellow, "V");
+    }
+
+private:
+    template<typename Column>
+    void DrawSeries(QPainter& painter, std::vector<Column> const& columns,
+                    QRect area, QColor color, QString const& name)
+    {
+        float lo = 1e30f, hi = -1e30f;
+        for(Column const& c: columns)
+            if(c.lo <= c.hi)
+            {
+                lo = std::min(lo, c.lo);
+                hi = std::max(hi, c.hi);
+            }
+        if(lo > hi)
+            return;
+        float range = std::max(hi - lo, 1e-6f);
+        auto y = [&](float v){
+            return area.bottom() - static_cast<int>((v - lo) / range * (area.height() - 1));
+        };
+        painter.setPen(color);
+        for(int x = 0; x < static_cast<int>(columns.size()); x++)
+            if(columns[x].lo <= columns[x].hi)
+                painter.drawLine(x, y(columns[x].lo), x, y(columns[x].hi));
+        painter.setPen(Qt::white);
+        painter.drawText(area.adjusted(4, 2, -4, -2), Qt::AlignLeft | Qt::AlignTop,
+                         QString("%1  %2").arg(name).arg(hi, 0, 'f', 4));
+        painter.drawText(area.adjusted(4, 2, -4, -2), Qt::AlignLeft | Qt::AlignBottom,
+                         QString::number(lo, 'f', 4));
+    }
+};
+
+//======= LivePanel Implementation ==========//
+
+LivePanel::LivePanel(std::function<OptionInputs ()> baseInputs,
+                     std::function<void (Tick const&)> onFrame,
+                     QWidget* parent)
+    : QWidget(parent), baseInputs(std::move(baseInputs)), onFrame(std::move(onFrame)),
+      feed(queue)
+{
+    chart  = new LiveChart;
+    status = new QLabel;
+
+    source = new QComboBox;
+    source->addItem(tr("Simulated (GBM)"));
+    source->addItem(tr("Replay file..."));
+    rate = new QSpinBox;
+    rate->setRange(1, static_cast<int>(SpotFeed::MaxRate));
+    rate->setValue(1000);
+    rate->setSuffix(" Hz");
+    drift = new QDoubleSpinBox;
+    drift->setRange(-100.0, 100.0);
+    drift->setValue(5.0);
+    drift->setSuffix(" %");
+    volatility = new QDoubleSpinBox;
+    volatility->setRange(0.0, 300.0);
+    volatility->setValue(30.0);
+    volatility->setSuffix(" %");
+    minutes = new QSpinBox;
+    minutes->setRange(1, 30);
+    minutes->setValue(2);
+    minutes->setSuffix(" min");
+    btnStart = new QPushButton(tr("Start"));
+
+    auto form = new QFormLayout;
+    form->addRow(tr("Source"),     source);
+    form->addRow(tr("Tick rate"),  rate);
+    form->addRow(tr("Drift"),      drift);
+    form->addRow(tr("Volatility"), volatility);
+    form->addRow(tr("History"),    minutes);
+
+    auto buttons = new QHBoxLayout;
+    buttons->addWidget(btnStart);
+    buttons->addWidget(status, 1);
+
+    auto vbox = new QVBoxLayout(this);
+    vbox->addLayout(form);
+    vbox->addLayout(buttons);
+    vbox->addWidget(chart, 1);
+
+    // Simulation parameters do not apply to replays
+    QObject::connect(source, QOverload<int>::of(&QComboBox::currentIndexChanged), [this](int index){
+        for(QWidget* w: std::initializer_list<QWidget*>{rate, drift, volatility})
+            w->setEnabled(index == 0);
+    });
+    QObject::connect(btnStart, &QPushButton::clicked, [this]{
+        if(this->Running())
+            this->Stop();
+        else
+            this->Start();
+    });
+
+    // Consume the ticks at the display refresh rate at most
+    frameTimer = new QTimer(this);
+    qreal hz = QGuiApplication::primaryScreen() ? QGuiApplication::primaryScreen()->refreshRate()
+                                                : 60.0;
+    frameTimer->setInterval(static_cast<int>(1000.0 / std::max<qreal>(hz, 1.0)));
+    frameTimer->setTimerType(Qt::PreciseTimer);
+    QObject::connect(frameTimer, &QTimer::timeout, [this]{ this->OnFrame(); });
+}
+
+LivePanel::~LivePanel()
+{
+    feed.Stop();
+}
+
+bool LivePanel::Running() const
+{
+    return frameTimer->isActive();
+}
+
+void LivePanel::Start()
+{
+    OptionInputs inputs = baseInputs();
+    feed.SetPricing(inputs);
+    // Ticks left from the previous run
+    queue.Drain([](Tick const&){ });
+
+    if(source->currentIndex() == 0)
+    {
+        SpotFeed::Simulation sim;
+        sim.spot       = inputs.S;
+        sim.drift      = drift->value() / 100.0;
+        sim.volatility = volatility->value() / 100.0;
+        sim.rate       = rate->value();
+        feed.StartSimulation(sim);
+    }
+    else
+    {
+        QString path = QFileDialog::getOpenFileName(this, tr("Replay spot quotes"), replayFile,
+                                                    tr("Quotes (*.txt *.csv);;All files (*)"));
+        if(path.isEmpty())
+            return;
+        replayFile = path;
+        QString error;
+        if(!feed.StartReplay(path, &error))
+        {
+            QMessageBox::warning(this, tr("Replay"), tr("Cannot replay %1\n%2").arg(path, error));
+            return;
+        }
+    }
+
+    // Buckets span the whole window, whatever the tick rate
+    chart->window = minutes->value() * 60.0;
+    chart->history.Reset(chart->window);
+    rateTicks = 0;
+    rateTimer.start();
+    btnStart->setText(tr("Stop"));
+    frameTimer->start();
+}
+
+void LivePanel::Stop()
+{
+    feed.Stop();
+    frameTimer->stop();
+    btnStart->setText(tr("Start"));
+    this->OnFrame();
+}
+
+void LivePanel::OnFrame()
+{
+    INSTRUMENT_SCOPE("LivePanel::OnFrame");
+    // Inputs edited on the form apply from the next tick
+    feed.SetPricing(baseInputs());
+
+    Tick latest{};
+    size_t n = queue.Drain([&](Tick const& tick){
+        chart->history.Append(tick);
+        latest = tick;
+    });
+    if(n > 0)
+    {
+        onFrame(latest);
+        chart->update();
+    }
+
+    if(rateTimer.elapsed() >= 1000)
+    {
+        uint64_t ticks = feed.Ticks();
+        status->setText(tr("%1 ticks/s, %2 dropped")
+                        .arg(std::llround((ticks - rateTicks) * 1000.0 / rateTimer.restart()))
+                        .arg(feed.Dropped()));
+        rateTicks = ticks;
+    }
+    // End of a replay
+    if(frameTimer->isActive() && !feed.Running() && n == 0)
+        this->Stop();
+}
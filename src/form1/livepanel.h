@@ -0,0 +1,66 @@
+#ifndef LIVEPANEL_H
+#define LIVEPANEL_H
+
+#include <functional>
+
+#include <QWidget>
+#include <QElapsedTimer>
+
+#include "livefeed.h"
+
+class QComboBox;
+class QDoubleSpinBox;
+class QSpinBox;
+class QPushButton;
+class QLabel;
+class QTimer;
+class LiveChart;
+
+/** Live pricing: spot ticks of a SpotFeed re-priced on the feed thread,
+ *  consumed once per display frame and charted over the last minutes.
+ *
+ *  The feed may tick much faster than the screen refreshes, so ticks are
+ *  queued and the GUI drains the queue, appends the ticks to the chart
+ *  history and repaints once per frame.
+ */
+class LivePanel: public QWidget
+{
+public:
+    /** baseInputs: current inputs of the form, read once per frame
+     *  onFrame:    called once per frame with the latest tick */
+    LivePanel(std::function<OptionInputs ()> baseInputs,
+              std::function<void (Tick const&)> onFrame,
+              QWidget* parent = nullptr);
+    ~LivePanel() override;
+
+    LivePanel(LivePanel const&) = delete;
+    LivePanel& operator=(LivePanel const&) = delete;
+
+    void Start();
+    void Stop();
+    bool Running() const;
+
+private:
+    std::function<OptionInputs ()>    baseInputs;
+    std::function<void (Tick const&)> onFrame;
+
+    TickQueue       queue;
+    SpotFeed        feed;
+    LiveChart*      chart;
+    QTimer*         frameTimer;
+    QComboBox*      source;
+    QSpinBox*       rate;
+    QDoubleSpinBox* drift;
+    QDoubleSpinBox* volatility;
+    QSpinBox*       minutes;
+    QPushButton*    btnStart;
+    QLabel*         status;
+    QString         replayFile;
+    // Tick rate measurement
+    QElapsedTimer   rateTimer;
+    uint64_t        rateTicks = 0;
+
+    void OnFrame();
+};
+
+#endif // LIVEPANEL_H
@@ -0,0 +1,424 @@
+#include "scenariosweep.h"
+#include "blackscholes.h"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#include <QAbstractTableModel>
+#include <QTableView>
+#include <QHeaderView>
+#include <QTabWidget>
+#include <QComboBox>
+#include <QStandardItemModel>
+#include <QDoubleSpinBox>
+#include <QSpinBox>
+#include <QLabel>
+#include <QPushButton>
+#include <QTimer>
+#include <QPainter>
+#include <QGridLayout>
+#include <QVBoxLayout>
+#include <QHBoxLayout>
+
+#include "../common/instrument.h"
+#include "../common/task.h"
+
+namespace {
+
+// Scenarios evaluated by each task
+constexpr int ChunkSize = 4096;
+
+const char* ParameterName(int parameter)
+{
+    static const char* names[] = {"S", "sigma (%)", "r (%)", "T (years)"};
+    return parameter < 0 ? "" : names[parameter];
+}
+
+void SetParameter(OptionInputs& in, int parameter, double value)
+{
+    switch(parameter)
+    {
+    case ScenarioSweepPanel::Spot:       in.S     = value; break;
+    case ScenarioSweepPanel::Volatility: in.sigma = value; break;
+    case ScenarioSweepPanel::Rate:       in.r     = value; break;
+    case ScenarioSweepPanel::Maturity:   in.T     = value; break;
+    }
+}
+
+auto Linspace(double from, double to, int steps) -> std::vector<double>
+{
+    std::vector<double> xs(steps);
+    for(int i = 0; i < steps; i++)
+        xs[i] = steps == 1 ? from : from + (to - from) * i / (steps - 1);
+    return xs;
+}
+
+} // --- End of namespace --- //
+
+/** Prices of the scenario grid, columns are the values of the X axis and
+ *  rows those of the Y axis. Cells not computed yet are NaN and empty. */
+class SweepModel: public QAbstractTableModel
+{
+public:
+    std::vector<double> xs, ys, prices;
+    QString             xName, yName;
+    double              basePrice = 0.0;
+
+    using QAbstractTableModel::QAbstractTableModel;
+
+    void Reset(std::vector<double> x, std::vector<double> y,
+               QString xLabel, QString yLabel, double base)
+    {
+        this->beginResetModel();
+        xs        = std::move(x);
+        ys        = std::move(y);
+        xName     = std::move(xLabel);
+        yName     = std::move(yLabel);
+        basePrice = base;
+        prices.assign(xs.size() * ys.size(), std::numeric_limits<double>::quiet_NaN());
+        this->endResetModel();
+    }
+
+    void SetPrices(int first, std::vector<double> const& values)
+    {
+        std::copy(values.begin(), values.end(), prices.begin() + first);
+        int nx    = static_cast<int>(xs.size());
+        int last  = first + static_cast<int>(values.size()) - 1;
+        int row0  = first / nx, row1 = last / nx;
+        // A chunk spanning several rows covers whole rows in between
+        int col0  = row0 == row1 ? first % nx : 0;
+        int col1  = row0 == row1 ? last % nx  : nx - 1;
+        emit this->dataChanged(this->index(row0, col0), this->index(row1, col1),
+                               {Qt::DisplayRole});
+    }
+
+    int rowCount(QModelIndex const& parent = QModelIndex()) const override
+    {
+        return parent.isValid() ? 0 : static_cast<int>(ys.size());
+    }
+
+    int columnCount(QModelIndex const& parent = QModelIndex()) const override
+    {
+        return parent.isValid() ? 0 : static_cast<int>(xs.size());
+    }
+
+    QVariant data(QModelIndex const& index, int role = Qt::DisplayRole) const override
+    {
+        if(!index.isValid())
+            return QVariant();
+        double price = prices[size_t(index.row()) * xs.size() + index.column()];
+        if(std::isnan(price))
+            return QVariant();
+        if(role == Qt::DisplayRole)
+            return QString::number(price, 'f', 4);
+        if(role == Qt::ToolTipRole)
+            return QString("P&L %1").arg(price - basePrice, 0, 'f', 4);
+        if(role == Qt::TextAlignmentRole)
+            return int(Qt::AlignRight | Qt::AlignVCenter);
+        return QVariant();
+    }
+
+    QVariant headerData(int section, Qt::Orientation orientation,
+                        int role = Qt::DisplayRole) const override
+    {
+        if(role == Qt::ToolTipRole)
+            return orientation == Qt::Horizontal ? xName : yName;
+        if(role != Qt::DisplayRole)
+            return QVariant();
+        if(orientation == Qt::Horizontal)
+            return QString::number(xs[section], 'g', 5);
+        // 1D sweeps have a single row
+        return yName.isEmpty() ? QString("Price") : QString::number(ys[section], 'g', 5);
+    }
+};
+
+/** P&L of the scenarios against the base price: green for gains, red for
+ *  losses, gray for cells not computed yet. The image is rebuilt at most
+ *  once per repaint, however many chunks completed meanwhile. */
+class SweepHeatmap: public QWidget
+{
+    SweepModel const* model;
+    QImage            image;
+    bool              dirty = true;
+public:
+    explicit SweepHeatmap(SweepModel const* model, QWidget* parent = nullptr)
+        : QWidget(parent), model(model)
+    {
+        this->setMinimumSize(200, 150);
+    }
+
+    void Invalidate()
+    {
+        dirty = true;
+        this->update();
+    }
+
+protected:
+    void paintEvent(QPaintEvent*) override
+    {
+        INSTRUMENT_SCOPE("SweepHeatmap::paintEvent");
+        QPainter painter(this);
+        painter.fillRect(this->rect(), this->palette().window());
+        int nx = static_cast<int>(model->xs.size());
+        int ny = static_cast<int>(model->ys.size());
+        if(nx == 0 || ny == 0)
+            return;
+        if(dirty)
+            this->Rebuild(nx, ny);
+
+        QRect area = this->rect().adjusted(50, 10, -10, -30);
+        painter.drawImage(area, image);
+        painter.setPen(this->palette().text().color());
+        auto label = [](double v){ return QString::number(v, 'g', 4); };
+        painter.drawText(QRect(area.left(), area.bottom() + 4, area.width(), 20),
+                         Qt::AlignLeft, label(model->xs.front()));
+        painter.drawText(QRect(area.left(), area.bottom() + 4, area.width(), 20),
+                         Qt::AlignHCenter, model->xName);
+        painter.drawText(QRect(area.left(), area.bottom() + 4, area.width(), 20),
+                         Qt::AlignRight, label(model->xs.back()));
+        if(!model->yName.isEmpty())
+        {
+            // Y values grow upwards
+            painter.drawText(QRect(0, area.bottom() - 20, 46, 20), Qt::AlignRight,
+                             label(model->ys.front()));
+            painter.drawText(QRect(0, area.top(), 46, 20), Qt::AlignRight,
+                             label(model->ys.back()));
+            painter.drawText(QRect(0, area.center().y() - 10, 46, 20), Qt::AlignRight,
+                             model->yName);
+        }
+    }
+
+private:
+    void Rebuild(int nx, int ny)
+    {
+        dirty = false;
+        double maxAbs = 1e-12;
+        for(double p: model->prices)
+            if(!std::isnan(p))
+                maxAbs = std::max(maxAbs, std::fabs(p - model->basePrice));
+
+        image = QImage(nx, ny, QImage::Format_RGB32);
+        for(int iy = 0; iy < ny; iy++)
+        {
+            auto line = reinterpret_cast<QRgb*>(image.scanLine(ny - 1 - iy));
+            double const* row = &model->prices[size_t(iy) * nx];
+            for(int ix = 0; ix < nx; ix++)
+            {
+                if(std::isnan(row[ix]))
+                {
+                    line[ix] = qRgb(64, 64, 64);
+                    continue;
+                }
+                double t = (row[ix] - model->basePrice) / maxAbs;
+                int    c = static_cast<int>(255 * (1.0 - std::fabs(t)));
+                line[ix] = t >= 0 ? qRgb(c, 255, c) : qRgb(255, c, c);
+            }
+        }
+    }
+};
+
+//======= ScenarioSweepPanel Implementation ==========//
+
+ScenarioSweepPanel::ScenarioSweepPanel(std::function<OptionInputs ()> baseInputs,
+                                       QWidget* parent)
+    : QWidget(parent), baseInputs(std::move(baseInputs))
+{
+    model   = new SweepModel(this);
+    heatmap = new SweepHeatmap(model);
+    status  = new QLabel;
+
+    axisX = this->CreateAxis(Spot, false);
+    axisY = this->CreateAxis(Volatility, true);
+    this->ExcludeXFromY();
+    QObject::connect(axisX.parameter, QOverload<int>::of(&QComboBox::currentIndexChanged),
+                     [this]{ this->ExcludeXFromY(); });
+
+    auto grid = new QGridLayout;
+    grid->addWidget(new QLabel(tr("Axis")),  0, 1);
+    grid->addWidget(new QLabel(tr("From")),  0, 2);
+    grid->addWidget(new QLabel(tr("To")),    0, 3);
+    grid->addWidget(new QLabel(tr("Steps")), 0, 4);
+    int row = 1;
+    for(Axis* axis: {&axisX, &axisY})
+    {
+        grid->addWidget(new QLabel(row == 1 ? "X" : "Y"), row, 0);
+        grid->addWidget(axis->parameter, row, 1);
+        grid->addWidget(axis->from,      row, 2);
+        grid->addWidget(axis->to,        row, 3);
+        grid->addWidget(axis->steps,     row, 4);
+        row++;
+    }
+
+    auto table = new QTableView;
+    table->setModel(model);
+    table->horizontalHeader()->setDefaultSectionSize(70);
+    table->setEditTriggers(QAbstractItemView::NoEditTriggers);
+
+    auto tabs = new QTabWidget;
+    tabs->addTab(heatmap, tr("P&&L Heatmap"));
+    tabs->addTab(table,   tr("Table"));
+
+    auto btnRun    = new QPushButton(tr("Run"));
+    auto btnCancel = new QPushButton(tr("Cancel"));
+    auto buttons   = new QHBoxLayout;
+    buttons->addWidget(btnRun);
+    buttons->addWidget(btnCancel);
+    buttons->addWidget(status, 1);
+
+    auto vbox = new QVBoxLayout(this);
+    vbox->addLayout(grid);
+    vbox->addLayout(buttons);
+    vbox->addWidget(tabs, 1);
+
+    debounce = new QTimer(this);
+    debounce->setSingleShot(true);
+    debounce->setInterval(150);
+
+    QObject::connect(debounce, &QTimer::timeout, [this]{ this->Run(); });
+    QObject::connect(btnRun,    &QPushButton::clicked, [this]{ this->Run(); });
+    QObject::connect(btnCancel, &QPushButton::clicked, [this]{ this->Cancel(); });
+}
+
+ScenarioSweepPanel::~ScenarioSweepPanel()
+{
+    // Tasks post their results to this object
+    this->Cancel();
+    pool.waitForDone();
+}
+
+ScenarioSweepPanel::Axis ScenarioSweepPanel::CreateAxis(Parameter parameter, bool optional)
+{
+    // Default range of each parameter: from, to, steps
+    static const double defaults[][3] = {
+        {25.0, 75.0, 51}, {10.0, 60.0, 11}, {0.0, 10.0, 11}, {0.05, 2.0, 40}
+    };
+    Axis axis;
+    axis.parameter = new QComboBox;
+    if(optional)
+        axis.parameter->addItem(tr("(none)"), int(None));
+    for(int p = Spot; p <= Maturity; p++)
+        axis.parameter->addItem(QString::fromLatin1(ParameterName(p)), p);
+    axis.from  = new QDoubleSpinBox;
+    axis.to    = new QDoubleSpinBox;
+    for(QDoubleSpinBox* spin: {axis.from, axis.to})
+    {
+        spin->setRange(0.0, 1e6);
+        spin->setDecimals(3);
+    }
+    axis.steps = new QSpinBox;
+    axis.steps->setRange(1, 2000);
+
+    auto applyDefaults = [axis]{
+        int p = axis.parameter->currentData().toInt();
+        bool enabled = p != None;
+        for(QWidget* w: std::initializer_list<QWidget*>{axis.from, axis.to, axis.steps})
+            w->setEnabled(enabled);
+        if(!enabled)
+            return;
+        axis.from->setValue(defaults[p][0]);
+        axis.to->setValue(defaults[p][1]);
+        axis.steps->setValue(static_cast<int>(defaults[p][2]));
+    };
+    axis.parameter->setCurrentIndex(axis.parameter->findData(int(parameter)));
+    applyDefaults();
+
+    QObject::connect(axis.parameter, QOverload<int>::of(&QComboBox::currentIndexChanged),
+                     [this, applyDefaults]{
+        applyDefaults();
+        this->Schedule();
+    });
+    for(QDoubleSpinBox* spin: {axis.from, axis.to})
+        QObject::connect(spin, QOverload<double>::of(&QDoubleSpinBox::valueChanged),
+                         [this]{ this->Schedule(); });
+    QObject::connect(axis.steps, QOverload<int>::of(&QSpinBox::valueChanged),
+                     [this]{ this->Schedule(); });
+    return axis;
+}
+
+void ScenarioSweepPanel::ExcludeXFromY()
+{
+    int px = axisX.parameter->currentData().toInt();
+    // QComboBox always uses a QStandardItemModel unless replaced
+    auto items = static_cast<QStandardItemModel*>(axisY.parameter->model());
+    for(int i = 0; i < axisY.parameter->count(); i++)
+        items->item(i)->setEnabled(axisY.parameter->itemData(i).toInt() != px);
+    if(axisY.parameter->currentData().toInt() == px)
+        axisY.parameter->setCurrentIndex(axisY.parameter->findData(int(None)));
+}
+
+void ScenarioSweepPanel::Schedule()
+{
+    debounce->start();
+}
+
+void ScenarioSweepPanel::Cancel()
+{
+    generation->fetch_add(1);
+    pool.clear();
+    if(chunksPending > 0)
+        status->setText(tr("Cancelled"));
+    chunksPending = 0;
+}
+
+void ScenarioSweepPanel::Run()
+{
+    this->Cancel();
+    debounce->stop();
+
+    int px = axisX.parameter->currentData().toInt();
+    int py = axisY.parameter->currentData().toInt();
+    auto xs = std::make_shared<std::vector<double>>(
+                Linspace(axisX.from->value(), axisX.to->value(), axisX.steps->value()));
+    auto ys = std::make_shared<std::vector<double>>(
+                py == None ? std::vector<double>{0.0}
+                           : Linspace(axisY.from->value(), axisY.to->value(), axisY.steps->value()));
+
+    OptionInputs base = baseInputs();
+    model->Reset(*xs, *ys, QString::fromLatin1(ParameterName(px)),
+                 QString::fromLatin1(ParameterName(py)), BlackScholesCall(base));
+    heatmap->Invalidate();
+
+    int nx    = static_cast<int>(xs->size());
+    int total = nx * static_cast<int>(ys->size());
+    int gen   = generation->load();
+    auto sharedGen = generation;
+    scenarios = total;
+    timer.start();
+
+    for(int first = 0; first < total; first += ChunkSize)
+    {
+        int count = std::min(ChunkSize, total - first);
+        chunksPending++;
+        pool.start(MakeTask([=]{
+            // Skip chunks of a cancelled sweep still waiting in the queue
+            if(sharedGen->load() != gen)
+                return;
+            INSTRUMENT_SCOPE("ScenarioSweep chunk");
+            std::vector<double> prices(count);
+            for(int i = 0; i < count; i++)
+            {
+                int idx = first + i;
+                OptionInputs in = base;
+                SetParameter(in, px, (*xs)[idx % nx]);
+                if(py != None)
+                    SetParameter(in, py, (*ys)[idx / nx]);
+                prices[i] = BlackScholesCall(in);
+            }
+            QMetaObject::invokeMethod(this, [=]{
+                this->OnChunk(gen, first, prices);
+            }, Qt::QueuedConnection);
+        }));
+    }
+    status->setText(tr("Computing %1 scenarios...").arg(total));
+}
+
+void ScenarioSweepPanel::OnChunk(int gen, int first, std::vector<double> const& prices)
+{
+    if(gen != generation->load())
+        return;
+    model->SetPrices(first, prices);
+    heatmap->Invalidate();
+    if(--chunksPending == 0)
+        status->setText(tr("%1 scenarios in %2 ms").arg(scenarios).arg(timer.elapsed()));
+}
@@ -0,0 +1,82 @@
+#ifndef SCENARIOSWEEP_H
+#define SCENARIOSWEEP_H
+
+#include <memory>
+#include <atomic>
+#include <vector>
+#include <functional>
+
+#include <QWidget>
+#include <QThreadPool>
+#include <QElapsedTimer>
+
+#include "blackscholes.h"
+
+class QComboBox;
+class QDoubleSpinBox;
+class QSpinBox;
+class QLabel;
+class QTimer;
+class SweepModel;
+class SweepHeatmap;
+
+/** What-if analysis: evaluates the call price over a 1D or 2D grid of
+ *  values of S, sigma, r or T, the other inputs being taken from the form.
+ *
+ *  The grid is split into chunks evaluated on a thread pool and displayed
+ *  as they complete, as a table and as a heatmap of the P&L against the
+ *  price at the current inputs. Changing a range or an input of the form
+ *  cancels the running sweep and starts a new one.
+ */
+class ScenarioSweepPanel: public QWidget
+{
+public:
+    enum Parameter { None = -1, Spot = 0, Volatility, Rate, Maturity };
+
+    /** baseInputs returns the current inputs of the form */
+    explicit ScenarioSweepPanel(std::function<OptionInputs ()> baseInputs,
+                                QWidget* parent = nullptr);
+    ~ScenarioSweepPanel() override;
+
+    ScenarioSweepPanel(ScenarioSweepPanel const&) = delete;
+    ScenarioSweepPanel& operator=(ScenarioSweepPanel const&) = delete;
+
+    /** Run a new sweep after a short delay, so that a burst of changes
+     *  starts a single sweep. */
+    void Schedule();
+    /** Start a new sweep now, cancelling the current one */
+    void Run();
+    void Cancel();
+
+private:
+    struct Axis
+    {
+        QComboBox*      parameter;
+        QDoubleSpinBox* from;
+        QDoubleSpinBox* to;
+        QSpinBox*       steps;
+    };
+
+    std::function<OptionInputs ()> baseInputs;
+    Axis          axisX;
+    Axis          axisY;
+    SweepModel*   model;
+    SweepHeatmap* heatmap;
+    QLabel*       status;
+    QTimer*       debounce;
+
+    QThreadPool   pool;
+    // Incremented by each new sweep, chunks of older sweeps are dropped
+    std::shared_ptr<std::atomic<int>> generation = std::make_shared<std::atomic<int>>(0);
+    int           chunksPending = 0;
+    qint64        scenarios     = 0;
+    QElapsedTimer timer;
+
+    Axis CreateAxis(Parameter parameter, bool optional);
+    /** The parameter of the X axis cannot be chosen for the Y axis, a
+     *  Y axis set to it is cleared. */
+    void ExcludeXFromY();
+    void OnChunk(int gen, int first, std::vector<double> const& prices);
+};
+
+#endif // SCENARIOSWEEP_H
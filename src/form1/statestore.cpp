@@ -0,0 +1,150 @@
+#include "statestore.h"
+
+#include <iostream>
+#include <memory>
+#include <algorithm>
+
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QSettings>
+#include <QDataStream>
+#include <QFileInfo>
+#include <QStandardPaths>
+#include <QTimer>
+
+#include "../common/task.h"
+
+namespace {
+
+// File header, 'FRMS'
+constexpr quint32 Magic   = 0x46524D53;
+constexpr quint16 Version = 1;
+
+const char* EntryNames[FormState::EntryCount] = {
+    "entryK", "entryS", "entryT", "entrySigma", "entryR"
+};
+
+QByteArray Serialize(FormState const& state)
+{
+    QByteArray data;
+    QDataStream out(&data, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_12);
+    out << Magic << Version << state.pos << state.size << state.windowState;
+    for(double value: state.entries)
+        out << value;
+    return data;
+}
+
+bool Deserialize(QByteArray const& data, FormState& state)
+{
+    QDataStream in(data);
+    in.setVersion(QDataStream::Qt_5_12);
+    quint32 magic   = 0;
+    quint16 version = 0;
+    in >> magic >> version;
+    if(magic != Magic || version != Version)
+        return false;
+    FormState result;
+    in >> result.pos >> result.size >> result.windowState;
+    for(double& value: result.entries)
+        in >> value;
+    if(in.status() != QDataStream::Ok)
+        return false;
+    state = result;
+    return true;
+}
+
+/** Settings written by SaveAppState() before the binary file existed */
+FormState ReadLegacySettings()
+{
+    FormState state;
+    QSettings conf;
+    state.pos         = conf.value("pos", state.pos).toPoint();
+    state.size        = conf.value("size", state.size).toSize();
+    state.windowState = conf.value("state", QByteArray()).toByteArray();
+    for(int i = 0; i < FormState::EntryCount; i++)
+        state.entries[i] = conf.value(EntryNames[i], state.entries[i]).toDouble();
+    return state;
+}
+
+} // --- End of namespace --- //
+
+FormStateStore::FormStateStore(QString path, std::function<FormState ()> snapshot)
+    : path(std::move(path)), snapshot(std::move(snapshot)), timer(new QTimer)
+{
+    worker.setMaxThreadCount(1);
+    timer->setSingleShot(true);
+    timer->setInterval(DebounceMs);
+    QObject::connect(timer, &QTimer::timeout, [this]{ this->Write(); });
+}
+
+FormStateStore::~FormStateStore()
+{
+    worker.waitForDone();
+    delete timer;
+}
+
+QString FormStateStore::DefaultPath()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::AppConfigLocation)
+            + "/formstate.bin";
+}
+
+void FormStateStore::SetSnapshot(std::function<FormState ()> snapshot)
+{
+    this->snapshot = std::move(snapshot);
+}
+
+std::future<FormState> FormStateStore::Load()
+{
+    auto promise = std::make_shared<std::promise<FormState>>();
+    std::future<FormState> result = promise->get_future();
+    worker.start(MakeTask([promise, path = path]{
+        FormState state;
+        QFile file(path);
+        if(!file.exists())
+            state = ReadLegacySettings();
+        else if(!file.open(QFile::ReadOnly) || !Deserialize(file.readAll(), state))
+            std::cout << " [WARNING] Ignoring invalid state file " << path.toStdString()
+                      << std::endl;
+        promise->set_value(state);
+    }));
+    return result;
+}
+
+void FormStateStore::MarkDirty()
+{
+    if(!dirty)
+        pendingSince.start();
+    dirty = true;
+    // Continuous changes cannot postpone the write beyond MaxDelayMs
+    qint64 left = MaxDelayMs - pendingSince.elapsed();
+    timer->start(static_cast<int>(std::max<qint64>(0, std::min<qint64>(DebounceMs, left))));
+}
+
+void FormStateStore::Flush()
+{
+    timer->stop();
+    if(dirty)
+        this->Write();
+    worker.waitForDone();
+}
+
+void FormStateStore::Write()
+{
+    if(!snapshot)
+        return;
+    dirty = false;
+    writes++;
+    // Widgets are only read on the GUI thread, the rest is done in background
+    FormState state = snapshot();
+    worker.start(MakeTask([state, path = path]{
+        QDir().mkpath(QFileInfo(path).absolutePath());
+        QSaveFile file(path);
+        if(file.open(QFile::WriteOnly) && file.write(Serialize(state)) >= 0 && file.commit())
+            return;
+        std::cout << " [ERROR] Cannot write state file " << path.toStdString()
+                  << ": " << file.errorString().toStdString() << std::endl;
+    }));
+}
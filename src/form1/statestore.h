@@ -0,0 +1,87 @@
+#ifndef STATESTORE_H
+#define STATESTORE_H
+
+#include <array>
+#include <future>
+#include <functional>
+
+#include <QPoint>
+#include <QSize>
+#include <QString>
+#include <QByteArray>
+#include <QThreadPool>
+#include <QElapsedTimer>
+
+class QTimer;
+
+/** Persistent state of the options form */
+struct FormState
+{
+    enum Entry { K, S, T, Sigma, R, EntryCount };
+
+    QPoint     pos   = QPoint(200, 200);
+    QSize      size  = QSize(600, 500);
+    // QMainWindow::saveState(), toolbars and docks
+    QByteArray windowState;
+    // Same defaults as EuropeanOptionsForm::Reset()
+    std::array<double, EntryCount> entries = {{50.0, 50.0, 0.5, 30.0, 5.0}};
+};
+
+/** Stores the form state in a small binary file, written in the background.
+ *
+ *  MarkDirty() is cheap and can be called on every change: the state is
+ *  only snapshotted once the changes settle, or MaxDelayMs after the first
+ *  unsaved change when they never settle (live feed, replay), then
+ *  serialized and written on a worker thread. The file is replaced by an atomic rename, so a crash
+ *  leaves either the previous or the new state, never a truncated file.
+ *
+ *  Load() reads the file on the worker thread while the form is built.
+ *  Settings saved by former versions with QSettings are used when the file
+ *  does not exist yet.
+ */
+class FormStateStore
+{
+public:
+    /** snapshot is called on the GUI thread */
+    FormStateStore(QString path, std::function<FormState ()> snapshot = nullptr);
+    ~FormStateStore();
+
+    FormStateStore(FormStateStore const&) = delete;
+    FormStateStore& operator=(FormStateStore const&) = delete;
+
+    /** formstate.bin in the application configuration directory */
+    static QString DefaultPath();
+
+    void SetSnapshot(std::function<FormState ()> snapshot);
+
+    /** Start reading the state, get() blocks until it is read */
+    std::future<FormState> Load();
+
+    /** Save the state after it has not changed for DebounceMs, at most
+     *  MaxDelayMs after the first unsaved change */
+    void MarkDirty();
+
+    /** Write the pending state now and wait for the writes to complete */
+    void Flush();
+
+    int Writes() const { return writes; }
+    QString Path() const { return path; }
+
+    static constexpr int DebounceMs = 500;
+    static constexpr int MaxDelayMs = 2000;
+
+private:
+    QString     path;
+    std::function<FormState ()> snapshot;
+    QTimer*     timer;
+    // Since the first change not written yet
+    QElapsedTimer pendingSince;
+    // Single thread, so writes complete in order
+    QThreadPool worker;
+    bool        dirty  = false;
+    int         writes = 0;
+
+    void Write();
+};
+
+#endif // STATESTORE_H
@@ -10,6 +10,8 @@
 #include <QCommandLineOption>
 #include <QLabel>
 
+#include "../imageview2/imageops.h"
+
 /** Makes QString printable */
 auto operator<<(std::ostream& os, QString const& str) -> std::ostream&
 {
@@ -76,10 +78,11 @@ int main(int argc, char *argv[])
        std::cout << "Selection changed => File = " << index.data() << std::endl;
        std::cout << "Full path to file = " << filePath << std::endl;
        currentFile.setText(filePath);
-       QPixmap pm(filePath); // Open image
+       QImage img(filePath); // Open image
        // Scale image to fit in the label
-       if(!pm.isNull())
-        ImagePanel.setPixmap(pm.scaled(ImagePanel.width(), ImagePanel.height(), Qt::KeepAspectRatio));
+       if(!img.isNull())
+        ImagePanel.setPixmap(QPixmap::fromImage(
+            ImageOps::ResizeToFit(img, ImagePanel.size(), ImageOps::Filter::Lanczos3)));
     });
 
 
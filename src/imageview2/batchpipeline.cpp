@@ -0,0 +1,367 @@
+#include "batchpipeline.h"
+#include "imageops.h"
+#include "mappedimage.h"
+#include "../common/task.h"
+
+#include <chrono>
+#include <iostream>
+
+#include <QDir>
+#include <QSet>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QBuffer>
+#include <QImageWriter>
+#include <QFileDialog>
+#include <QFormLayout>
+#include <QHBoxLayout>
+#include <QVBoxLayout>
+#include <QLineEdit>
+#include <QSpinBox>
+#include <QComboBox>
+#include <QProgressBar>
+#include <QLabel>
+#include <QPushButton>
+#include <QTimer>
+#include <QThread>
+#include <QThreadPool>
+#include <QMessageBox>
+
+//======= BatchPipeline Implementation ==========//
+
+const char* BatchPipeline::StageName(int stage)
+{
+    static const char* names[StageCount] = {"Read", "Decode", "Resize", "Encode", "Write"};
+    return names[stage];
+}
+
+BatchPipeline::BatchPipeline(QStringList files, BatchOptions options)
+    : files(std::move(files)), options(std::move(options))
+{
+    for(auto& q: queues)
+        q.SetCapacity(static_cast<size_t>(std::max(1, this->options.queueCapacity)));
+
+    // Files differing only by extension (a.png, a.jpg) would be written to
+    // the same output, and files already in the output directory would be
+    // replaced: the later ones get a numeric suffix, a.jpg, a-2.jpg
+    QString ext = "." + QString::fromLatin1(this->options.format);
+    QDir outputDir(this->options.outputDir);
+    QSet<QString> used;
+    auto taken = [&](QString const& name){
+        return used.contains(name.toCaseFolded()) || QFileInfo::exists(outputDir.filePath(name));
+    };
+    for(QString const& path: this->files)
+    {
+        QString base = QFileInfo(path).completeBaseName();
+        QString name = base + ext;
+        for(int n = 2; taken(name); n++)
+            name = base + "-" + QString::number(n) + ext;
+        used.insert(name.toCaseFolded());
+        outputs << name;
+    }
+}
+
+BatchPipeline::~BatchPipeline()
+{
+    this->Cancel();
+    for(std::thread& th: threads)
+        th.join();
+}
+
+void BatchPipeline::Start()
+{
+    timer.start();
+    std::array<int, StageCount> counts;
+    for(int stage = 0; stage < StageCount; stage++)
+    {
+        counts[stage]    = std::max(1, options.threads[stage]);
+        remaining[stage] = counts[stage];
+        running         += counts[stage];
+    }
+    for(int stage = 0; stage < StageCount; stage++)
+        for(int i = 0; i < counts[stage]; i++)
+            threads.emplace_back([this, stage]{ this->RunStage(stage); });
+}
+
+void BatchPipeline::Cancel()
+{
+    cancelled = true;
+    for(auto& q: queues)
+        q.Abort();
+}
+
+qint64 BatchPipeline::Done() const
+{
+    return stats[StageCount - 1].processed.load() + this->Failed();
+}
+
+qint64 BatchPipeline::Failed() const
+{
+    qint64 n = 0;
+    for(StageStats const& s: stats)
+        n += s.failed.load();
+    return n;
+}
+
+size_t BatchPipeline::QueueDepth(int stage) const
+{
+    return stage == 0 ? 0 : queues[stage - 1].Size();
+}
+
+bool BatchPipeline::Process(int stage, Item& item)
+{
+    switch(stage)
+    {
+    case 0:
+    {
+        // Uncompressed BMP/TIFF are mapped instead of read, there is
+        // nothing left to decode
+        item.image = MapImageFile(item.path);
+        if(!item.image.isNull())
+        {
+            bytesIn += QFileInfo(item.path).size();
+            return true;
+        }
+        QFile file(item.path);
+        if(!file.open(QFile::ReadOnly))
+            return false;
+        item.data = file.readAll();
+        bytesIn += item.data.size();
+        return !item.data.isEmpty();
+    }
+    case 1:
+        if(!item.image.isNull())
+            return true;
+        item.image = QImage::fromData(item.data);
+        item.data.clear();
+        return !item.image.isNull();
+    case 2:
+        item.image = ImageOps::ResizeToFit(item.image, QSize(options.maxSize, options.maxSize),
+                                           ImageOps::Filter::Lanczos3);
+        return !item.image.isNull();
+    case 3:
+    {
+        QBuffer buffer(&item.data);
+        buffer.open(QBuffer::WriteOnly);
+        QImageWriter writer(&buffer, options.format);
+        writer.setQuality(options.quality);
+        bool ok = writer.write(item.image);
+        item.image = QImage();
+        return ok;
+    }
+    case 4:
+    {
+        // Written to a temporary file and renamed on commit
+        QSaveFile file(QDir(options.outputDir).filePath(item.output));
+        if(!file.open(QFile::WriteOnly))
+            return false;
+        file.write(item.data);
+        if(!file.commit())
+            return false;
+        bytesOut += item.data.size();
+        return true;
+    }
+    }
+    return false;
+}
+
+void BatchPipeline::RunStage(int stage)
+{
+    using Clock = std::chrono::steady_clock;
+    StageStats& st = stats[stage];
+
+    auto next = [&]() -> std::optional<Item> {
+        if(stage > 0)
+            return queues[stage - 1].Pop();
+        int i = nextFile++;
+        if(cancelled || i >= files.size())
+            return std::nullopt;
+        Item item;
+        item.path   = files.at(i);
+        item.output = outputs.at(i);
+        return item;
+    };
+
+    while(auto item = next())
+    {
+        auto start = Clock::now();
+        bool ok = this->Process(stage, *item);
+        st.busyNs += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         Clock::now() - start).count();
+        if(!ok)
+        {
+            st.failed++;
+            continue;
+        }
+        st.processed++;
+        // Blocks while the downstream queue is full
+        if(stage < StageCount - 1 && !queues[stage].Push(std::move(*item)))
+            break;
+    }
+    // The last thread of a stage tells the next stage there is no more input
+    if(--remaining[stage] == 0 && stage < StageCount - 1)
+        queues[stage].Close();
+    running--;
+}
+
+//======= BatchDialog Implementation ==========//
+
+BatchDialog::BatchDialog(QStringList files, QWidget* parent)
+    : QDialog(parent), files(std::move(files))
+{
+    this->setWindowTitle(tr("Batch Export - %1 images").arg(this->files.size()));
+
+    entryOutput = new QLineEdit(QDir::homePath() + "/export");
+    auto btnBrowse = new QPushButton(tr("..."));
+    auto outputRow = new QHBoxLayout;
+    outputRow->addWidget(entryOutput);
+    outputRow->addWidget(btnBrowse);
+
+    spinMaxSize = new QSpinBox;
+    spinMaxSize->setRange(16, 16384);
+    spinMaxSize->setValue(1600);
+    spinMaxSize->setSuffix(" px");
+
+    comboFormat = new QComboBox;
+    for(QByteArray const& fmt: QImageWriter::supportedImageFormats())
+        comboFormat->addItem(QString::fromLatin1(fmt));
+    comboFormat->setCurrentText("jpg");
+
+    spinQuality = new QSpinBox;
+    spinQuality->setRange(0, 100);
+    spinQuality->setValue(85);
+
+    auto form = new QFormLayout;
+    form->addRow(tr("Output directory"), outputRow);
+    form->addRow(tr("Maximum width/height"), spinMaxSize);
+    form->addRow(tr("Format"), comboFormat);
+    form->addRow(tr("Quality"), spinQuality);
+
+    BatchOptions defaults;
+    int cores = QThread::idealThreadCount();
+    for(int stage = 0; stage < BatchPipeline::StageCount; stage++)
+    {
+        spinThreads[stage] = new QSpinBox;
+        spinThreads[stage]->setRange(1, 64);
+        // CPU bound stages default to one thread per core
+        bool cpuBound = stage >= 1 && stage <= 3;
+        spinThreads[stage]->setValue(cpuBound ? std::max(1, cores) : defaults.threads[stage]);
+        form->addRow(tr("%1 threads").arg(QString::fromLatin1(BatchPipeline::StageName(stage))),
+                     spinThreads[stage]);
+    }
+
+    progress     = new QProgressBar;
+    progress->setRange(0, std::max(1, this->files.size()));
+    progress->setValue(0);
+    statsDisplay = new QLabel;
+    statsDisplay->setTextFormat(Qt::PlainText);
+    statsDisplay->setFont(QFont("Monospace"));
+
+    btnStart  = new QPushButton(tr("Start"));
+    btnCancel = new QPushButton(tr("Cancel"));
+    btnCancel->setEnabled(false);
+    auto btnClose = new QPushButton(tr("Close"));
+    auto buttons = new QHBoxLayout;
+    buttons->addWidget(btnStart);
+    buttons->addWidget(btnCancel);
+    buttons->addWidget(btnClose);
+
+    auto vbox = new QVBoxLayout(this);
+    vbox->addLayout(form);
+    vbox->addWidget(progress);
+    vbox->addWidget(statsDisplay);
+    vbox->addLayout(buttons);
+
+    timer = new QTimer(this);
+    timer->setInterval(250);
+
+    QObject::connect(btnBrowse, &QPushButton::clicked, [this]{
+        QString dir = QFileDialog::getExistingDirectory(this, tr("Output Directory"),
+                                                        entryOutput->text());
+        if(!dir.isEmpty())
+            entryOutput->setText(dir);
+    });
+    QObject::connect(btnStart,  &QPushButton::clicked, [this]{ this->Start(); });
+    QObject::connect(btnCancel, &QPushButton::clicked, [this]{
+        if(pipeline)
+            pipeline->Cancel();
+    });
+    QObject::connect(btnClose,  &QPushButton::clicked, [this]{ this->close(); });
+    QObject::connect(timer, &QTimer::timeout, [this]{ this->UpdateProgress(); });
+}
+
+BatchDialog::~BatchDialog()
+{
+    if(!pipeline)
+        return;
+    pipeline->Cancel();
+    if(pipeline->IsFinished())
+        return;
+    // The stages stop after their current image, they are joined on the
+    // global pool rather than on the GUI thread. The pool waits for it
+    // when the application exits.
+    std::shared_ptr<BatchPipeline> cancelled(std::move(pipeline));
+    QThreadPool::globalInstance()->start(MakeTask([cancelled]() mutable { cancelled.reset(); }));
+}
+
+void BatchDialog::Start()
+{
+    BatchOptions options;
+    options.outputDir = entryOutput->text();
+    options.format    = comboFormat->currentText().toLatin1();
+    options.quality   = spinQuality->value();
+    options.maxSize   = spinMaxSize->value();
+    for(int stage = 0; stage < BatchPipeline::StageCount; stage++)
+        options.threads[stage] = spinThreads[stage]->value();
+
+    if(!QDir().mkpath(options.outputDir))
+    {
+        QMessageBox::warning(this, tr("Batch Export"),
+                             tr("Cannot create directory %1").arg(options.outputDir));
+        return;
+    }
+
+    pipeline = std::make_unique<BatchPipeline>(files, options);
+    pipeline->Start();
+    btnStart->setEnabled(false);
+    btnCancel->setEnabled(true);
+    timer->start();
+}
+
+void BatchDialog::UpdateProgress()
+{
+    if(!pipeline)
+        return;
+    BatchPipeline& p = *pipeline;
+    double seconds = std::max<qint64>(p.ElapsedMs(), 1) / 1000.0;
+
+    QString text = tr("Done %1 / %2   failed %3   %4 images/s   in %5 MB/s   out %6 MB/s\n")
+            .arg(p.Done()).arg(p.Total()).arg(p.Failed())
+            .arg(p.Done() / seconds, 0, 'f', 1)
+            .arg(p.BytesIn()  / seconds / 1e6, 0, 'f', 1)
+            .arg(p.BytesOut() / seconds / 1e6, 0, 'f', 1);
+    for(int stage = 0; stage < BatchPipeline::StageCount; stage++)
+    {
+        auto const& st = p.Stats(stage);
+        qint64 n = st.processed.load();
+        // Average time per image spent in the stage, by any of its threads
+        double avgMs = n == 0 ? 0.0 : st.busyNs.load() / 1e6 / n;
+        text += tr("\n%1 queued %2  processed %3  failed %4  avg %5 ms")
+                .arg(QString::fromLatin1(BatchPipeline::StageName(stage)), -7)
+                .arg(p.QueueDepth(stage), 3)
+                .arg(n, 6).arg(st.failed.load(), 4)
+                .arg(avgMs, 7, 'f', 2);
+    }
+    statsDisplay->setText(text);
+    progress->setValue(static_cast<int>(p.Done()));
+
+    if(p.IsFinished())
+    {
+        timer->stop();
+        btnStart->setEnabled(true);
+        btnCancel->setEnabled(false);
+        std::cout << " [INFO] Batch export finished: " << p.Done()
+                  << " images in " << seconds << " s" << std::endl;
+    }
+}
@@ -0,0 +1,207 @@
+#ifndef BATCHPIPELINE_H
+#define BATCHPIPELINE_H
+
+#include <array>
+#include <memory>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <optional>
+#include <condition_variable>
+
+#include <QImage>
+#include <QDialog>
+#include <QStringList>
+#include <QElapsedTimer>
+
+class QLineEdit;
+class QSpinBox;
+class QComboBox;
+class QProgressBar;
+class QLabel;
+class QPushButton;
+class QTimer;
+
+/** Blocking FIFO queue with fixed capacity. Push() blocks while the queue
+ *  is full, which propagates back-pressure to the upstream stage. After
+ *  Close(), Pop() drains the remaining items and then returns nullopt.
+ */
+template<typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t capacity = 16): capacity(capacity) { }
+
+    /** Returns false if the queue was closed */
+    bool Push(T item)
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        notFull.wait(lock, [&]{ return closed || items.size() < capacity; });
+        if(closed)
+            return false;
+        items.push_back(std::move(item));
+        notEmpty.notify_one();
+        return true;
+    }
+
+    std::optional<T> Pop()
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        notEmpty.wait(lock, [&]{ return closed || !items.empty(); });
+        if(items.empty())
+            return std::nullopt;
+        T item = std::move(items.front());
+        items.pop_front();
+        notFull.notify_one();
+        return item;
+    }
+
+    /** No more items will be pushed, wakes up all waiting threads */
+    void Close()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        closed = true;
+        notFull.notify_all();
+        notEmpty.notify_all();
+    }
+
+    /** Close and drop the queued items */
+    void Abort()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        closed = true;
+        items.clear();
+        notFull.notify_all();
+        notEmpty.notify_all();
+    }
+
+    size_t Size() const
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        return items.size();
+    }
+
+    void SetCapacity(size_t n) { capacity = n; }
+
+private:
+    mutable std::mutex      mtx;
+    std::condition_variable notFull;
+    std::condition_variable notEmpty;
+    std::deque<T>           items;
+    size_t                  capacity;
+    bool                    closed = false;
+};
+
+
+struct BatchOptions
+{
+    QString    outputDir;
+    QByteArray format     = "jpg";
+    int        quality    = 85;
+    // Bounding box of the output images, smaller images are not enlarged
+    int        maxSize    = 1600;
+    // Threads of each stage: read, decode, resize, encode, write
+    std::array<int, 5> threads = {{2, 4, 4, 4, 2}};
+    // Capacity of the queues between stages
+    int        queueCapacity = 16;
+};
+
+/** Multi-stage pipeline read -> decode -> resize -> encode -> write.
+ *  Each stage runs on its own threads, stages are connected by bounded
+ *  queues, so a slow stage stalls the upstream ones instead of piling up
+ *  decoded images in memory.
+ */
+class BatchPipeline
+{
+public:
+    static constexpr int StageCount = 5;
+    static const char* StageName(int stage);
+
+    struct Item
+    {
+        QString    path;
+        QString    output;  // File name in the output directory
+        QByteArray data;    // File contents or encoded image
+        QImage     image;
+    };
+
+    struct StageStats
+    {
+        std::atomic<qint64> processed{0};
+        std::atomic<qint64> failed{0};
+        std::atomic<qint64> busyNs{0};
+    };
+
+    BatchPipeline(QStringList files, BatchOptions options);
+    ~BatchPipeline();
+
+    BatchPipeline(BatchPipeline const&) = delete;
+    BatchPipeline& operator=(BatchPipeline const&) = delete;
+
+    void Start();
+    /** Stop all stages, images in flight are dropped */
+    void Cancel();
+    bool IsFinished() const { return running.load() == 0; }
+
+    int    Total()     const { return files.size(); }
+    /** Images written or failed in any stage */
+    qint64 Done()      const;
+    qint64 Failed()    const;
+    qint64 BytesIn()   const { return bytesIn.load(); }
+    qint64 BytesOut()  const { return bytesOut.load(); }
+    qint64 ElapsedMs() const { return timer.elapsed(); }
+
+    StageStats const& Stats(int stage) const { return stats[stage]; }
+    /** Items waiting in the input queue of the stage */
+    size_t QueueDepth(int stage) const;
+
+private:
+    QStringList  files;
+    QStringList  outputs;   // Output file name of each file
+    BatchOptions options;
+
+    std::array<BoundedQueue<Item>, StageCount - 1> queues;
+    std::array<StageStats, StageCount>             stats;
+    std::array<std::atomic<int>, StageCount>       remaining;
+    std::vector<std::thread> threads;
+    std::atomic<int>    nextFile{0};
+    std::atomic<int>    running{0};
+    std::atomic<bool>   cancelled{false};
+    std::atomic<qint64> bytesIn{0};
+    std::atomic<qint64> bytesOut{0};
+    QElapsedTimer       timer;
+
+    bool Process(int stage, Item& item);
+    void RunStage(int stage);
+};
+
+
+/** Dialog configuring a batch export and displaying its progress */
+class BatchDialog: public QDialog
+{
+public:
+    explicit BatchDialog(QStringList files, QWidget* parent = nullptr);
+    ~BatchDialog() override;
+
+private:
+    QStringList   files;
+    std::unique_ptr<BatchPipeline> pipeline;
+
+    QLineEdit*    entryOutput;
+    QSpinBox*     spinMaxSize;
+    QComboBox*    comboFormat;
+    QSpinBox*     spinQuality;
+    std::array<QSpinBox*, BatchPipeline::StageCount> spinThreads;
+    QProgressBar* progress;
+    QLabel*       statsDisplay;
+    QPushButton*  btnStart;
+    QPushButton*  btnCancel;
+    QTimer*       timer;
+
+    void Start();
+    void UpdateProgress();
+};
+
+#endif // BATCHPIPELINE_H
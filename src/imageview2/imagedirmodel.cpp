@@ -0,0 +1,657 @@
+#include "imagedirmodel.h"
+
+#include <cctype>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+
+#include <QDir>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QLocale>
+#include <QThread>
+#include <QSocketNotifier>
+#include <QEvent>
+
+#include "../common/task.h"
+
+#ifdef Q_OS_LINUX
+  #include <fcntl.h>
+  #include <unistd.h>
+  #include <dirent.h>
+  #include <sys/stat.h>
+  #include <sys/syscall.h>
+  #include <sys/inotify.h>
+#endif
+
+using Entry      = ImageDirModel::Entry;
+using Extensions = std::unordered_set<std::string>;
+
+struct ImageDirModel::ScanJob
+{
+    std::atomic<bool> cancelled{false};
+    QElapsedTimer     timer;
+    int               dirfd = -1;
+
+    ~ScanJob()
+    {
+#ifdef Q_OS_LINUX
+        if(dirfd >= 0)
+            ::close(dirfd);
+#endif
+    }
+};
+
+namespace {
+
+/** Calls handler when the file descriptor is readable. Overriding event()
+ *  avoids connecting to QSocketNotifier::activated, whose signature
+ *  changed in Qt 5.15. */
+class DescriptorNotifier: public QSocketNotifier
+{
+    std::function<void ()> handler;
+public:
+    DescriptorNotifier(int fd, std::function<void ()> handler, QObject* parent)
+        : QSocketNotifier(fd, QSocketNotifier::Read, parent)
+        , handler(std::move(handler))
+    { }
+
+    bool event(QEvent* event) override
+    {
+        if(event->type() != QEvent::SockAct)
+            return QSocketNotifier::event(event);
+        handler();
+        return true;
+    }
+};
+
+constexpr size_t BatchSize = 1024;
+
+bool MatchesExtension(const char* name, Extensions const& extensions)
+{
+    const char* dot = std::strrchr(name, '.');
+    if(dot == nullptr || dot[1] == '\0')
+        return false;
+    std::string ext(dot + 1);
+    for(char& c: ext)
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    return extensions.count(ext) != 0;
+}
+
+/** Checks the signature of the most common image formats */
+bool HasImageMagic(const unsigned char* h, qint64 n)
+{
+    if(n >= 4 && h[0] == 0x89 && h[1] == 'P' && h[2] == 'N' && h[3] == 'G')
+        return true;
+    if(n >= 3 && h[0] == 0xFF && h[1] == 0xD8 && h[2] == 0xFF)
+        return true;
+    if(n >= 2 && h[0] == 'B' && h[1] == 'M')
+        return true;
+    if(n >= 4 && ((h[0] == 'I' && h[1] == 'I' && h[2] == 42 && h[3] == 0)
+               || (h[0] == 'M' && h[1] == 'M' && h[2] == 0 && h[3] == 42)))
+        return true;
+    if(n >= 4 && std::memcmp(h, "GIF8", 4) == 0)
+        return true;
+    if(n >= 12 && std::memcmp(h, "RIFF", 4) == 0 && std::memcmp(h + 8, "WEBP", 4) == 0)
+        return true;
+    return false;
+}
+
+auto MakeEntry(QString name, qint64 size, qint64 mtime, bool isDir) -> Entry
+{
+    Entry e;
+    int dot  = name.lastIndexOf('.');
+    e.key    = name.toCaseFolded();
+    e.suffix = isDir || dot < 0 ? QString() : name.mid(dot + 1).toLower();
+    e.name   = std::move(name);
+    e.size   = size;
+    e.mtime  = mtime;
+    e.isDir  = isDir;
+    return e;
+}
+
+/** Sort order of the batches produced by the workers */
+bool NameLess(Entry const& a, Entry const& b)
+{
+    if(a.isDir != b.isDir)
+        return a.isDir;
+    int c = a.key.compare(b.key);
+    return c != 0 ? c < 0 : a.name < b.name;
+}
+
+using Deliver = std::function<void (std::vector<Entry>)>;
+using Done    = std::function<void (int batches)>;
+
+#ifdef Q_OS_LINUX
+
+struct RawEntry
+{
+    std::string   name;
+    unsigned char type;
+};
+
+/** Stat a batch of names relative to the directory descriptor */
+void StatBatch(std::vector<RawEntry> const& batch,
+               std::shared_ptr<ImageDirModel::ScanJob> const& job,
+               Extensions const& extensions, bool verifyMagic,
+               Deliver const& deliver)
+{
+    std::vector<Entry> out;
+    out.reserve(batch.size());
+    for(RawEntry const& raw: batch)
+    {
+        if(job->cancelled)
+            return;
+        const char* name = raw.name.c_str();
+        qint64 size = 0, mtime = 0;
+        bool   isDir = false, isFile = false;
+#if defined(STATX_SIZE)
+        // Cached attributes are fine, do not force a round trip to the server
+        struct statx stx;
+        if(::statx(job->dirfd, name, AT_STATX_DONT_SYNC,
+                   STATX_TYPE | STATX_SIZE | STATX_MTIME, &stx) != 0)
+            continue;
+        isDir  = S_ISDIR(stx.stx_mode);
+        isFile = S_ISREG(stx.stx_mode);
+        size   = static_cast<qint64>(stx.stx_size);
+        mtime  = stx.stx_mtime.tv_sec;
+#else
+        struct stat st;
+        if(::fstatat(job->dirfd, name, &st, 0) != 0)
+            continue;
+        isDir  = S_ISDIR(st.st_mode);
+        isFile = S_ISREG(st.st_mode);
+        size   = st.st_size;
+        mtime  = st.st_mtime;
+#endif
+        if(!isDir && !isFile)
+            continue;
+        // Entries of unknown type and symbolic links were not filtered by
+        // the scanner, statx follows the links to their target
+        if(isFile && (raw.type == DT_UNKNOWN || raw.type == DT_LNK)
+           && !MatchesExtension(name, extensions))
+            continue;
+        if(isFile && verifyMagic)
+        {
+            unsigned char header[12];
+            int fd = ::openat(job->dirfd, name, O_RDONLY | O_CLOEXEC);
+            if(fd < 0)
+                continue;
+            ssize_t n = ::read(fd, header, sizeof(header));
+            ::close(fd);
+            if(!HasImageMagic(header, n))
+                continue;
+        }
+        out.push_back(MakeEntry(QFile::decodeName(name), size, mtime, isDir));
+    }
+    std::sort(out.begin(), out.end(), NameLess);
+    deliver(std::move(out));
+}
+
+/** Read the directory with getdents64, which returns the file type of
+ *  each entry, so that files can be filtered without a stat call. */
+void ScanDirectory(QString const& path,
+                   std::shared_ptr<ImageDirModel::ScanJob> const& job,
+                   Extensions const& extensions, bool verifyMagic,
+                   QThreadPool* pool, Deliver const& deliver, Done const& done)
+{
+    job->dirfd = ::open(QFile::encodeName(path).constData(),
+                        O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(job->dirfd < 0)
+        return done(0);
+
+    int batches = 0;
+    std::vector<RawEntry> batch;
+    batch.reserve(BatchSize);
+    auto flush = [&]{
+        if(batch.empty())
+            return;
+        batches++;
+        pool->start(MakeTask([=, batch = std::move(batch)]{
+            StatBatch(batch, job, extensions, verifyMagic, deliver);
+        }));
+        batch.clear();
+        batch.reserve(BatchSize);
+    };
+
+    std::vector<char> buffer(1 << 16);
+    while(!job->cancelled)
+    {
+        long n = ::syscall(SYS_getdents64, job->dirfd, buffer.data(), buffer.size());
+        if(n <= 0)
+            break;
+        for(long offset = 0; offset < n; )
+        {
+            auto d = reinterpret_cast<struct dirent64*>(buffer.data() + offset);
+            offset += d->d_reclen;
+            // Skip hidden files, "." and ".."
+            if(d->d_name[0] == '.')
+                continue;
+            // Links may point to directories, the batch stats their target
+            bool keep = d->d_type == DT_DIR || d->d_type == DT_UNKNOWN
+                     || d->d_type == DT_LNK || MatchesExtension(d->d_name, extensions);
+            if(!keep || (d->d_type != DT_DIR && d->d_type != DT_REG
+                         && d->d_type != DT_LNK && d->d_type != DT_UNKNOWN))
+                continue;
+            batch.push_back(RawEntry{d->d_name, d->d_type});
+            if(batch.size() == BatchSize)
+                flush();
+        }
+    }
+    flush();
+    done(batches);
+}
+
+#else
+
+void ScanDirectory(QString const& path,
+                   std::shared_ptr<ImageDirModel::ScanJob> const& job,
+                   Extensions const& extensions, bool verifyMagic,
+                   QThreadPool*, Deliver const& deliver, Done const& done)
+{
+    int batches = 0;
+    std::vector<Entry> batch;
+    QDirIterator it(path, QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot);
+    while(it.hasNext() && !job->cancelled)
+    {
+        it.next();
+        QFileInfo info = it.fileInfo();
+        if(!info.isDir() && !MatchesExtension(info.fileName().toUtf8().constData(), extensions))
+            continue;
+        if(!info.isDir() && verifyMagic)
+        {
+            QFile file(info.filePath());
+            if(!file.open(QFile::ReadOnly))
+                continue;
+            QByteArray header = file.read(12);
+            if(!HasImageMagic(reinterpret_cast<const unsigned char*>(header.constData()),
+                              header.size()))
+                continue;
+        }
+        batch.push_back(MakeEntry(info.fileName(), info.size(),
+                                  info.lastModified().toSecsSinceEpoch(), info.isDir()));
+        if(batch.size() == BatchSize)
+        {
+            batches++;
+            std::sort(batch.begin(), batch.end(), NameLess);
+            deliver(std::move(batch));
+            batch.clear();
+        }
+    }
+    if(!batch.empty())
+    {
+        batches++;
+        std::sort(batch.begin(), batch.end(), NameLess);
+        deliver(std::move(batch));
+    }
+    done(batches);
+}
+
+#endif
+
+} // --- End of namespace --- //
+
+
+//======= ImageDirModel Implementation ==========//
+
+ImageDirModel::ImageDirModel(QObject* parent)
+    : QAbstractTableModel(parent)
+{
+    // Network file systems are latency bound, more requests in flight
+    // than cores pay off.
+    pool.setMaxThreadCount(std::max(8, QThread::idealThreadCount()));
+}
+
+ImageDirModel::~ImageDirModel()
+{
+    if(job)
+        job->cancelled = true;
+    pool.clear();
+    pool.waitForDone();
+#ifdef Q_OS_LINUX
+    delete notifier;
+    if(inotifyFd >= 0)
+        ::close(inotifyFd);
+#endif
+}
+
+void ImageDirModel::SetNameFilters(QStringList const& filters)
+{
+    extensions.clear();
+    for(QString ext: filters)
+    {
+        if(ext.startsWith("*."))
+            ext = ext.mid(2);
+        extensions.insert(ext.toLower().toStdString());
+    }
+}
+
+void ImageDirModel::SetRootPath(QString const& path)
+{
+    if(job)
+        job->cancelled = true;
+    // Drop the batches of the previous directory still waiting in the queue
+    pool.clear();
+
+    this->beginResetModel();
+    entries.clear();
+    names.clear();
+    deleted.clear();
+    rootPath = QDir(path).absolutePath();
+    this->endResetModel();
+
+    job = std::make_shared<ScanJob>();
+    job->timer.start();
+    scanning       = true;
+    listingDone    = false;
+    batchesPending = 0;
+
+    if(!QDir(rootPath).isRoot())
+        this->InsertEntry(MakeEntry("..", 0, 0, true));
+    this->WatchDirectory();
+
+    auto current = job;
+    // Results are posted to the GUI thread, those of an older scan dropped
+    Deliver deliver = [this, current](std::vector<Entry> batch){
+        QMetaObject::invokeMethod(this, [this, current, batch]{
+            if(this->job != current)
+                return;
+            this->MergeBatch(batch);
+        }, Qt::QueuedConnection);
+    };
+    Done done = [this, current](int batches){
+        QMetaObject::invokeMethod(this, [this, current, batches]{
+            if(this->job != current)
+                return;
+            this->ListingDone(batches);
+        }, Qt::QueuedConnection);
+    };
+
+    QString    root    = rootPath;
+    Extensions exts    = extensions;
+    bool       verify  = verifyMagic;
+    QThreadPool* tasks = &pool;
+    pool.start(MakeTask([=]{
+        ScanDirectory(root, current, exts, verify, tasks, deliver, done);
+    }));
+}
+
+QString ImageDirModel::FilePath(QModelIndex const& index) const
+{
+    if(!index.isValid() || index.row() >= static_cast<int>(entries.size()))
+        return QString();
+    return QDir::cleanPath(rootPath + "/" + entries[index.row()].name);
+}
+
+bool ImageDirModel::IsDir(QModelIndex const& index) const
+{
+    if(!index.isValid() || index.row() >= static_cast<int>(entries.size()))
+        return false;
+    return entries[index.row()].isDir;
+}
+
+auto ImageDirModel::Comparator() const -> std::function<bool (Entry const&, Entry const&)>
+{
+    int  column = sortColumn;
+    bool desc   = sortOrder == Qt::DescendingOrder;
+    return [column, desc](Entry const& a, Entry const& b)
+    {
+        // Directories always come first, sorted by name
+        if(a.isDir || b.isDir)
+            return NameLess(a, b);
+        int c = 0;
+        switch(column)
+        {
+        case SizeColumn: c = a.size  < b.size  ? -1 : a.size  > b.size;  break;
+        case DateColumn: c = a.mtime < b.mtime ? -1 : a.mtime > b.mtime; break;
+        case TypeColumn: c = a.suffix.compare(b.suffix);                 break;
+        }
+        if(c == 0)
+            c = a.key.compare(b.key);
+        if(c == 0)
+            c = a.name.compare(b.name);
+        return desc ? c > 0 : c < 0;
+    };
+}
+
+void ImageDirModel::MergeBatch(std::vector<Entry> batch)
+{
+    batchesPending--;
+    // Files may have been added already by inotify events, or deleted
+    // after the batch was stat'ed
+    batch.erase(std::remove_if(batch.begin(), batch.end(), [this](Entry const& e){
+        return names.contains(e.name) || deleted.contains(e.name);
+    }), batch.end());
+
+    auto less = this->Comparator();
+    if(!std::is_sorted(batch.begin(), batch.end(), less))
+        std::sort(batch.begin(), batch.end(), less);
+
+    if(!batch.empty())
+    {
+        int first = static_cast<int>(entries.size());
+        this->beginInsertRows(QModelIndex(), first, first + static_cast<int>(batch.size()) - 1);
+        for(Entry& e: batch)
+        {
+            names.insert(e.name);
+            entries.push_back(std::move(e));
+        }
+        this->endInsertRows();
+
+        // Merge the sorted rows with the new sorted tail, O(n) per batch
+        if(first > 0 && less(entries[first], entries[first - 1]))
+        {
+            emit this->layoutAboutToBeChanged({}, QAbstractItemModel::VerticalSortHint);
+            QModelIndexList from = this->persistentIndexList();
+            std::vector<Entry> tracked;
+            for(QModelIndex const& idx: from)
+                tracked.push_back(entries[idx.row()]);
+
+            std::inplace_merge(entries.begin(), entries.begin() + first, entries.end(), less);
+
+            QModelIndexList to;
+            for(int i = 0; i < from.size(); i++)
+            {
+                auto it = std::lower_bound(entries.begin(), entries.end(), tracked[i], less);
+                to << this->index(static_cast<int>(it - entries.begin()), from[i].column());
+            }
+            this->changePersistentIndexList(from, to);
+            emit this->layoutChanged({}, QAbstractItemModel::VerticalSortHint);
+        }
+    }
+    this->CheckFinished();
+}
+
+void ImageDirModel::ListingDone(int batches)
+{
+    listingDone     = true;
+    batchesPending += batches;
+    this->CheckFinished();
+}
+
+void ImageDirModel::CheckFinished()
+{
+    if(!scanning || !listingDone || batchesPending != 0)
+        return;
+    scanning = false;
+    // No batch is left that could bring them back
+    deleted.clear();
+    if(scanFinished)
+        scanFinished(static_cast<int>(entries.size()), job->timer.elapsed());
+}
+
+void ImageDirModel::sort(int column, Qt::SortOrder order)
+{
+    sortColumn = column;
+    sortOrder  = order;
+
+    emit this->layoutAboutToBeChanged({}, QAbstractItemModel::VerticalSortHint);
+    QModelIndexList from = this->persistentIndexList();
+    std::vector<Entry> tracked;
+    for(QModelIndex const& idx: from)
+        tracked.push_back(entries[idx.row()]);
+
+    // Only the cached attributes are compared, no file is stat'ed again
+    auto less = this->Comparator();
+    std::sort(entries.begin(), entries.end(), less);
+
+    QModelIndexList to;
+    for(int i = 0; i < from.size(); i++)
+    {
+        auto it = std::lower_bound(entries.begin(), entries.end(), tracked[i], less);
+        to << this->index(static_cast<int>(it - entries.begin()), from[i].column());
+    }
+    this->changePersistentIndexList(from, to);
+    emit this->layoutChanged({}, QAbstractItemModel::VerticalSortHint);
+}
+
+void ImageDirModel::InsertEntry(Entry entry)
+{
+    auto it  = std::lower_bound(entries.begin(), entries.end(), entry, this->Comparator());
+    int  row = static_cast<int>(it - entries.begin());
+    this->beginInsertRows(QModelIndex(), row, row);
+    names.insert(entry.name);
+    entries.insert(it, std::move(entry));
+    this->endInsertRows();
+}
+
+void ImageDirModel::RemoveEntry(QString const& name)
+{
+    if(!names.contains(name))
+        return;
+    auto it = std::find_if(entries.begin(), entries.end(), [&](Entry const& e){
+        return e.name == name;
+    });
+    if(it == entries.end())
+        return;
+    int row = static_cast<int>(it - entries.begin());
+    this->beginRemoveRows(QModelIndex(), row, row);
+    names.remove(name);
+    entries.erase(it);
+    this->endRemoveRows();
+}
+
+void ImageDirModel::WatchDirectory()
+{
+#ifdef Q_OS_LINUX
+    if(inotifyFd < 0)
+    {
+        inotifyFd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if(inotifyFd < 0)
+            return;
+        notifier = new DescriptorNotifier(inotifyFd, [this]{
+            this->ReadInotifyEvents();
+        }, this);
+    }
+    if(watchDescriptor >= 0)
+        ::inotify_rm_watch(inotifyFd, watchDescriptor);
+    watchDescriptor = ::inotify_add_watch(
+                inotifyFd, QFile::encodeName(rootPath).constData(),
+                IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE);
+#endif
+}
+
+void ImageDirModel::ReadInotifyEvents()
+{
+#ifdef Q_OS_LINUX
+    alignas(struct inotify_event) char buffer[16 * 1024];
+    bool overflow = false;
+    for(;;)
+    {
+        ssize_t n = ::read(inotifyFd, buffer, sizeof(buffer));
+        if(n <= 0)
+            break;
+        for(char* p = buffer; p < buffer + n; )
+        {
+            auto ev = reinterpret_cast<struct inotify_event*>(p);
+            p += sizeof(struct inotify_event) + ev->len;
+            // Events were dropped by the kernel, the model no longer
+            // matches the directory
+            if(ev->mask & IN_Q_OVERFLOW)
+                overflow = true;
+            if(overflow || ev->wd != watchDescriptor || ev->len == 0 || ev->name[0] == '.')
+                continue;
+            QString name = QFile::decodeName(ev->name);
+            if(ev->mask & (IN_DELETE | IN_MOVED_FROM))
+            {
+                this->RemoveEntry(name);
+                // Batches of a running scan must not add it back
+                if(scanning)
+                    deleted.insert(name);
+                continue;
+            }
+            deleted.remove(name);
+            // A single file is stat'ed on the GUI thread
+            QFileInfo info(rootPath + "/" + name);
+            if(!info.exists())
+                continue;
+            if(!info.isDir() && !MatchesExtension(ev->name, extensions))
+                continue;
+            this->RemoveEntry(name);
+            this->InsertEntry(MakeEntry(name, info.size(),
+                                        info.lastModified().toSecsSinceEpoch(),
+                                        info.isDir()));
+        }
+    }
+    if(overflow)
+    {
+        std::cout << " [INFO] inotify queue overflow, rescanning " << rootPath.toStdString() << std::endl;
+        this->SetRootPath(rootPath);
+    }
+#endif
+}
+
+int ImageDirModel::rowCount(QModelIndex const& parent) const
+{
+    return parent.isValid() ? 0 : static_cast<int>(entries.size());
+}
+
+int ImageDirModel::columnCount(QModelIndex const& parent) const
+{
+    return parent.isValid() ? 0 : ColumnCount;
+}
+
+QVariant ImageDirModel::data(QModelIndex const& index, int role) const
+{
+    if(!index.isValid() || index.row() >= static_cast<int>(entries.size()))
+        return QVariant();
+    Entry const& e = entries[index.row()];
+
+    if(role == Qt::DisplayRole)
+    {
+        switch(index.column())
+        {
+        case NameColumn:
+            return e.name;
+        case SizeColumn:
+            return e.isDir ? QVariant() : QLocale().formattedDataSize(e.size);
+        case TypeColumn:
+            return e.isDir ? QObject::tr("Folder") : e.suffix.toUpper() + QObject::tr(" File");
+        case DateColumn:
+            return e.mtime == 0 ? QVariant()
+                                : QDateTime::fromSecsSinceEpoch(e.mtime)
+                                  .toString(Qt::SystemLocaleShortDate);
+        }
+    }
+    if(role == Qt::DecorationRole && index.column() == NameColumn)
+        return icons.icon(e.isDir ? QFileIconProvider::Folder : QFileIconProvider::File);
+    if(role == Qt::TextAlignmentRole && index.column() == SizeColumn)
+        return int(Qt::AlignRight | Qt::AlignVCenter);
+    return QVariant();
+}
+
+QVariant ImageDirModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if(orientation != Qt::Horizontal || role != Qt::DisplayRole)
+        return QAbstractTableModel::headerData(section, orientation, role);
+    switch(section)
+    {
+    case NameColumn: return QObject::tr("Name");
+    case SizeColumn: return QObject::tr("Size");
+    case TypeColumn: return QObject::tr("Type");
+    case DateColumn: return QObject::tr("Date Modified");
+    }
+    return QVariant();
+}
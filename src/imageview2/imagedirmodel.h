@@ -0,0 +1,117 @@
+#ifndef IMAGEDIRMODEL_H
+#define IMAGEDIRMODEL_H
+
+#include <memory>
+#include <atomic>
+#include <vector>
+#include <functional>
+#include <unordered_set>
+#include <string>
+
+#include <QAbstractTableModel>
+#include <QSet>
+#include <QThreadPool>
+#include <QFileIconProvider>
+
+class QSocketNotifier;
+
+/** Flat listing of the image files and subdirectories of a single
+ *  directory, designed for folders with hundreds of thousands of files.
+ *
+ *  - The directory is read with getdents64 on a worker thread, files are
+ *    filtered by extension through a hash set without any stat call.
+ *  - Size and modification time are read with statx in parallel batches,
+ *    since on network file systems each call is latency bound.
+ *  - Rows are streamed into the model in batches, each batch is sorted on
+ *    the worker and merged into the already sorted rows.
+ *  - Changes are tracked with inotify instead of rescanning. Note that
+ *    inotify does not see changes made by other NFS clients. The directory
+ *    is scanned again when the kernel reports an event queue overflow.
+ *
+ *  On non-Linux systems a QDirIterator scan is used instead.
+ */
+class ImageDirModel: public QAbstractTableModel
+{
+public:
+    enum Column { NameColumn = 0, SizeColumn, TypeColumn, DateColumn, ColumnCount };
+
+    struct Entry
+    {
+        QString name;
+        QString key;        // Case folded name, used for sorting
+        QString suffix;     // Lower case extension
+        qint64  size  = 0;
+        qint64  mtime = 0;  // Seconds since epoch
+        bool    isDir = false;
+    };
+
+    /** State of a directory scan shared with the worker threads */
+    struct ScanJob;
+
+    explicit ImageDirModel(QObject* parent = nullptr);
+    ~ImageDirModel() override;
+
+    ImageDirModel(ImageDirModel const&) = delete;
+    ImageDirModel& operator=(ImageDirModel const&) = delete;
+
+    /** Accepts plain extensions ("png") or glob patterns ("*.png") */
+    void SetNameFilters(QStringList const& filters);
+
+    /** Also check the file signature (magic bytes), costs one read per file */
+    void SetVerifyMagic(bool flag) { verifyMagic = flag; }
+
+    void    SetRootPath(QString const& path);
+    QString RootPath() const { return rootPath; }
+
+    QString FilePath(QModelIndex const& index) const;
+    bool    IsDir(QModelIndex const& index) const;
+    bool    IsScanning() const { return scanning; }
+
+    /** Callback called on the GUI thread when a scan completes */
+    void OnScanFinished(std::function<void (int rows, qint64 elapsedMs)> callback)
+    {
+        scanFinished = std::move(callback);
+    }
+
+    int      rowCount(QModelIndex const& parent = QModelIndex()) const override;
+    int      columnCount(QModelIndex const& parent = QModelIndex()) const override;
+    QVariant data(QModelIndex const& index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation,
+                        int role = Qt::DisplayRole) const override;
+    void     sort(int column, Qt::SortOrder order = Qt::AscendingOrder) override;
+
+private:
+    std::vector<Entry>  entries;
+    QSet<QString>       names;
+    // Removed by inotify events during a scan
+    QSet<QString>       deleted;
+    QString             rootPath;
+    std::unordered_set<std::string> extensions;
+    bool                verifyMagic = false;
+
+    int                 sortColumn = NameColumn;
+    Qt::SortOrder       sortOrder  = Qt::AscendingOrder;
+
+    std::shared_ptr<ScanJob> job;
+    QThreadPool         pool;
+    bool                scanning   = false;
+    int                 batchesPending = 0;
+    bool                listingDone    = false;
+    std::function<void (int, qint64)> scanFinished;
+
+    int                 inotifyFd  = -1;
+    int                 watchDescriptor = -1;
+    QSocketNotifier*    notifier   = nullptr;
+    QFileIconProvider   icons;
+
+    auto Comparator() const -> std::function<bool (Entry const&, Entry const&)>;
+    void MergeBatch(std::vector<Entry> batch);
+    void ListingDone(int batches);
+    void CheckFinished();
+    void InsertEntry(Entry entry);
+    void RemoveEntry(QString const& name);
+    void WatchDirectory();
+    void ReadInotifyEvents();
+};
+
+#endif // IMAGEDIRMODEL_H
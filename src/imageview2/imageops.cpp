@@ -0,0 +1,495 @@
+#include "imageops.h"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+#include <QThreadPool>
+
+#include "../common/task.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  #define IMAGEOPS_X86_SIMD 1
+  #include <immintrin.h>
+#endif
+
+using std::uint8_t;
+
+namespace
+{
+
+/** Split rows [0, rows) into bands and run fn(y0, y1) for each band, one on
+ *  the calling thread and the others on the global thread pool. Small jobs
+ *  are not split since waking up threads costs more than the work.
+ *  workPerRow is a rough operation count, used only for this decision. */
+template<typename Fn>
+void ParallelBands(int rows, qint64 workPerRow, Fn const& fn)
+{
+    constexpr qint64 minWorkPerBand = 1 << 18;
+    QThreadPool* pool = QThreadPool::globalInstance();
+    qint64 work  = std::max<qint64>(1, workPerRow) * rows;
+    int    bands = static_cast<int>(std::min<qint64>(
+                        {work / minWorkPerBand, rows, std::max(1, pool->maxThreadCount())}));
+    if(bands <= 1)
+    {
+        fn(0, rows);
+        return;
+    }
+    std::mutex              mtx;
+    std::condition_variable cv;
+    int                     left = bands - 1;
+    auto bandStart = [&](int b){ return static_cast<int>(qint64(rows) * b / bands); };
+
+    for(int b = 1; b < bands; b++)
+        pool->start(MakeTask([&, b]{
+            fn(bandStart(b), bandStart(b + 1));
+            std::lock_guard<std::mutex> lock(mtx);
+            if(--left == 0)
+                cv.notify_all();
+        }));
+    fn(0, bandStart(1));
+    std::unique_lock<std::mutex> lock(mtx);
+    cv.wait(lock, [&]{ return left == 0; });
+}
+
+inline auto ClampByte(int x) -> uint8_t
+{
+    return static_cast<uint8_t>(x < 0 ? 0 : (x > 255 ? 255 : x));
+}
+
+// ============ Resampling coefficients ================//
+
+double FilterSupport(ImageOps::Filter filter)
+{
+    switch(filter)
+    {
+    case ImageOps::Filter::Area:     return 0.5;
+    case ImageOps::Filter::Bilinear: return 1.0;
+    case ImageOps::Filter::Lanczos3: return 3.0;
+    }
+    return 1.0;
+}
+
+double Sinc(double x)
+{
+    if(x == 0.0)
+        return 1.0;
+    x *= 3.14159265358979323846;
+    return std::sin(x) / x;
+}
+
+double FilterWeight(ImageOps::Filter filter, double x)
+{
+    switch(filter)
+    {
+    case ImageOps::Filter::Area:
+        return (x > -0.5 && x <= 0.5) ? 1.0 : 0.0;
+    case ImageOps::Filter::Bilinear:
+        x = std::fabs(x);
+        return x < 1.0 ? 1.0 - x : 0.0;
+    case ImageOps::Filter::Lanczos3:
+        return (x > -3.0 && x < 3.0) ? Sinc(x) * Sinc(x / 3.0) : 0.0;
+    }
+    return 0.0;
+}
+
+/** Normalized weights of the source pixels contributing to each output
+ *  pixel along one axis. When downscaling, the filter is stretched by the
+ *  scale factor so that every source pixel contributes. */
+struct Coefficients
+{
+    int taps = 0;                 // Maximum number of weights per output pixel
+    std::vector<int>   first;     // First source pixel of each output pixel
+    std::vector<int>   count;     // Number of source pixels
+    std::vector<float> weights;   // taps weights per output pixel
+};
+
+Coefficients Precompute(int inSize, int outSize, ImageOps::Filter filter)
+{
+    double scale   = double(inSize) / outSize;
+    double fscale  = std::max(scale, 1.0);
+    double support = FilterSupport(filter) * fscale;
+
+    Coefficients c;
+    c.taps = static_cast<int>(std::ceil(support)) * 2 + 1;
+    c.first.resize(outSize);
+    c.count.resize(outSize);
+    c.weights.assign(size_t(outSize) * c.taps, 0.0f);
+
+    std::vector<double> w(c.taps);
+    for(int x = 0; x < outSize; x++)
+    {
+        double center = (x + 0.5) * scale;
+        int xmin = std::max(static_cast<int>(center - support + 0.5), 0);
+        int xmax = std::min(static_cast<int>(center + support + 0.5), inSize);
+        int n    = std::min(std::max(xmax - xmin, 1), c.taps);
+        xmin     = std::min(xmin, inSize - n);
+
+        double total = 0.0;
+        for(int i = 0; i < n; i++)
+        {
+            w[i]   = FilterWeight(filter, (xmin + i - center + 0.5) / fscale);
+            total += w[i];
+        }
+        float* out = &c.weights[size_t(x) * c.taps];
+        if(total == 0.0)
+        {
+            // Degenerate case, take the nearest pixel
+            xmin   = std::min(static_cast<int>(center), inSize - 1);
+            n      = 1;
+            out[0] = 1.0f;
+        }
+        else
+        {
+            for(int i = 0; i < n; i++)
+                out[i] = static_cast<float>(w[i] / total);
+        }
+        c.first[x] = xmin;
+        c.count[x] = n;
+    }
+    return c;
+}
+
+// ============ Kernels ================//
+//
+// Horizontal pass: one row of 32 bits pixels -> 4 floats per output pixel.
+// Vertical pass: weighted sum of horizontally resampled rows -> bytes.
+
+using HorizontalFn = void (*)(uint8_t const* src, float* dst, int outWidth,
+                              Coefficients const& c);
+using VerticalFn   = void (*)(float const* const* rows, float const* weights, int count,
+                              int start, int n, uint8_t* dst);
+
+void HorizontalScalar(uint8_t const* src, float* dst, int outWidth, Coefficients const& c)
+{
+    for(int x = 0; x < outWidth; x++)
+    {
+        float const*   w = &c.weights[size_t(x) * c.taps];
+        uint8_t const* p = src + 4 * c.first[x];
+        float a0 = 0, a1 = 0, a2 = 0, a3 = 0;
+        for(int k = 0; k < c.count[x]; k++, p += 4)
+        {
+            a0 += w[k] * p[0];
+            a1 += w[k] * p[1];
+            a2 += w[k] * p[2];
+            a3 += w[k] * p[3];
+        }
+        dst[4 * x + 0] = a0;
+        dst[4 * x + 1] = a1;
+        dst[4 * x + 2] = a2;
+        dst[4 * x + 3] = a3;
+    }
+}
+
+void VerticalScalar(float const* const* rows, float const* weights, int count,
+                    int start, int n, uint8_t* dst)
+{
+    for(int i = start; i < n; i++)
+    {
+        float a = 0;
+        for(int k = 0; k < count; k++)
+            a += weights[k] * rows[k][i];
+        dst[i] = ClampByte(static_cast<int>(std::lrint(a)));
+    }
+}
+
+#if IMAGEOPS_X86_SIMD
+
+__attribute__((target("sse4.1")))
+void HorizontalSSE41(uint8_t const* src, float* dst, int outWidth, Coefficients const& c)
+{
+    for(int x = 0; x < outWidth; x++)
+    {
+        float const*   w = &c.weights[size_t(x) * c.taps];
+        uint8_t const* p = src + 4 * c.first[x];
+        __m128 acc = _mm_setzero_ps();
+        for(int k = 0; k < c.count[x]; k++, p += 4)
+        {
+            std::int32_t px;
+            std::memcpy(&px, p, 4);
+            // 4 x u8 -> 4 x i32 -> 4 x float, one pixel per register
+            __m128 f = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(px)));
+            acc = _mm_add_ps(acc, _mm_mul_ps(f, _mm_set1_ps(w[k])));
+        }
+        _mm_storeu_ps(dst + 4 * x, acc);
+    }
+}
+
+__attribute__((target("sse4.1")))
+void VerticalSSE41(float const* const* rows, float const* weights, int count,
+                   int start, int n, uint8_t* dst)
+{
+    int i = start;
+    for(; i + 16 <= n; i += 16)
+    {
+        __m128 a0 = _mm_setzero_ps(), a1 = _mm_setzero_ps();
+        __m128 a2 = _mm_setzero_ps(), a3 = _mm_setzero_ps();
+        for(int k = 0; k < count; k++)
+        {
+            __m128 w = _mm_set1_ps(weights[k]);
+            float const* r = rows[k] + i;
+            a0 = _mm_add_ps(a0, _mm_mul_ps(_mm_loadu_ps(r +  0), w));
+            a1 = _mm_add_ps(a1, _mm_mul_ps(_mm_loadu_ps(r +  4), w));
+            a2 = _mm_add_ps(a2, _mm_mul_ps(_mm_loadu_ps(r +  8), w));
+            a3 = _mm_add_ps(a3, _mm_mul_ps(_mm_loadu_ps(r + 12), w));
+        }
+        // Round, then saturate to [0, 255] while narrowing
+        __m128i s01 = _mm_packs_epi32(_mm_cvtps_epi32(a0), _mm_cvtps_epi32(a1));
+        __m128i s23 = _mm_packs_epi32(_mm_cvtps_epi32(a2), _mm_cvtps_epi32(a3));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(s01, s23));
+    }
+    VerticalScalar(rows, weights, count, i, n, dst);
+}
+
+__attribute__((target("avx2")))
+void VerticalAVX2(float const* const* rows, float const* weights, int count,
+                  int start, int n, uint8_t* dst)
+{
+    int i = start;
+    for(; i + 32 <= n; i += 32)
+    {
+        __m256 a0 = _mm256_setzero_ps(), a1 = _mm256_setzero_ps();
+        __m256 a2 = _mm256_setzero_ps(), a3 = _mm256_setzero_ps();
+        for(int k = 0; k < count; k++)
+        {
+            __m256 w = _mm256_set1_ps(weights[k]);
+            float const* r = rows[k] + i;
+            a0 = _mm256_add_ps(a0, _mm256_mul_ps(_mm256_loadu_ps(r +  0), w));
+            a1 = _mm256_add_ps(a1, _mm256_mul_ps(_mm256_loadu_ps(r +  8), w));
+            a2 = _mm256_add_ps(a2, _mm256_mul_ps(_mm256_loadu_ps(r + 16), w));
+            a3 = _mm256_add_ps(a3, _mm256_mul_ps(_mm256_loadu_ps(r + 24), w));
+        }
+        __m256i s01 = _mm256_packs_epi32(_mm256_cvtps_epi32(a0), _mm256_cvtps_epi32(a1));
+        __m256i s23 = _mm256_packs_epi32(_mm256_cvtps_epi32(a2), _mm256_cvtps_epi32(a3));
+        __m256i b   = _mm256_packus_epi16(s01, s23);
+        // Packing works within 128 bits lanes, restore the order of the
+        // groups of 4 bytes: a0.lo a1.lo a2.lo a3.lo | a0.hi a1.hi a2.hi a3.hi
+        b = _mm256_permutevar8x32_epi32(b, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), b);
+    }
+    VerticalSSE41(rows, weights, count, i, n, dst);
+}
+
+#endif // IMAGEOPS_X86_SIMD
+
+struct Kernels
+{
+    const char*  name;
+    HorizontalFn horizontal;
+    VerticalFn   vertical;
+};
+
+Kernels const& SelectKernels()
+{
+    static Kernels const kernels = []{
+#if IMAGEOPS_X86_SIMD
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("avx2"))
+            return Kernels{"AVX2", HorizontalSSE41, VerticalAVX2};
+        if(__builtin_cpu_supports("sse4.1"))
+            return Kernels{"SSE4.1", HorizontalSSE41, VerticalSSE41};
+#endif
+        return Kernels{"Scalar", HorizontalScalar, VerticalScalar};
+    }();
+    return kernels;
+}
+
+/** 32 bits version of the image, the histogram and levels read 4 bytes per pixel */
+QImage ToRGB32(QImage const& image)
+{
+    return image.convertToFormat(image.hasAlphaChannel() ? QImage::Format_ARGB32
+                                                         : QImage::Format_RGB32);
+}
+
+} // namespace
+
+// ============ Resize ================//
+
+QImage ImageOps::Resize(QImage const& image, QSize const& size, Filter filter)
+{
+    if(image.isNull() || size.isEmpty())
+        return QImage();
+    bool alpha = image.hasAlphaChannel();
+    // Premultiplied alpha keeps transparent pixels from bleeding their color
+    QImage src = image.convertToFormat(alpha ? QImage::Format_ARGB32_Premultiplied
+                                             : QImage::Format_RGB32);
+    if(src.size() == size)
+        return src;
+    QImage dst(size, src.format());
+    if(dst.isNull())
+        return dst;
+
+    Coefficients const cx = Precompute(src.width(),  size.width(),  filter);
+    Coefficients const cy = Precompute(src.height(), size.height(), filter);
+    Kernels const& k = SelectKernels();
+
+    int const      outWidth  = size.width();
+    uint8_t const* srcBits   = src.constBits();
+    qint64 const   srcStride = src.bytesPerLine();
+    // bits() detaches, call it once before sharing the image with the bands
+    uint8_t*       dstBits   = dst.bits();
+    qint64 const   dstStride = dst.bytesPerLine();
+
+    ParallelBands(size.height(), qint64(outWidth) * (cx.taps + cy.taps),
+                  [&](int y0, int y1)
+    {
+        // Ring of horizontally resampled rows. Windows of consecutive output
+        // rows overlap, each source row of the band is resampled only once.
+        int const ring = cy.taps;
+        std::vector<float> buffer(size_t(ring) * outWidth * 4);
+        std::vector<int>   slotRow(ring, -1);
+        std::vector<float const*> rows(ring);
+
+        for(int y = y0; y < y1; y++)
+        {
+            for(int j = 0; j < cy.count[y]; j++)
+            {
+                int    row  = cy.first[y] + j;
+                int    slot = row % ring;
+                float* buf  = buffer.data() + size_t(slot) * outWidth * 4;
+                if(slotRow[slot] != row)
+                {
+                    k.horizontal(srcBits + row * srcStride, buf, outWidth, cx);
+                    slotRow[slot] = row;
+                }
+                rows[j] = buf;
+            }
+            uint8_t* line = dstBits + y * dstStride;
+            k.vertical(rows.data(), &cy.weights[size_t(y) * cy.taps], cy.count[y],
+                       0, outWidth * 4, line);
+            if(alpha)
+            {
+                // Lanczos overshoot can produce color > alpha
+                for(int x = 0; x < outWidth; x++, line += 4)
+                    for(int c = 0; c < 3; c++)
+                        line[c] = std::min(line[c], line[3]);
+            }
+        }
+    });
+    return dst;
+}
+
+QImage ImageOps::ResizeToFit(QImage const& image, QSize const& bounds, Filter filter)
+{
+    if(image.width() <= bounds.width() && image.height() <= bounds.height())
+        return image;
+    return Resize(image, image.size().scaled(bounds, Qt::KeepAspectRatio)
+                                     .expandedTo(QSize(1, 1)), filter);
+}
+
+// ============ Histogram and levels ================//
+
+ImageOps::Histogram ImageOps::ComputeHistogram(QImage const& image)
+{
+    Histogram hist;
+    if(image.isNull())
+        return hist;
+    QImage src = ToRGB32(image);
+    int const width = src.width();
+    std::mutex mtx;
+
+    ParallelBands(src.height(), 4 * width, [&](int y0, int y1){
+        // Two interleaved sub-histograms per channel, so that runs of equal
+        // pixels do not serialize on the same counter
+        std::array<std::array<quint32, 256>, 8> local{};
+        for(int y = y0; y < y1; y++)
+        {
+            uint8_t const* p = src.constScanLine(y);
+            int x = 0;
+            for(; x + 2 <= width; x += 2, p += 8)
+            {
+                local[0][p[2]]++; local[1][p[1]]++; local[2][p[0]]++;
+                local[3][(p[2] * 77 + p[1] * 150 + p[0] * 29 + 128) >> 8]++;
+                local[4][p[6]]++; local[5][p[5]]++; local[6][p[4]]++;
+                local[7][(p[6] * 77 + p[5] * 150 + p[4] * 29 + 128) >> 8]++;
+            }
+            for(; x < width; x++, p += 4)
+            {
+                local[0][p[2]]++; local[1][p[1]]++; local[2][p[0]]++;
+                local[3][(p[2] * 77 + p[1] * 150 + p[0] * 29 + 128) >> 8]++;
+            }
+        }
+        std::lock_guard<std::mutex> lock(mtx);
+        for(int i = 0; i < 256; i++)
+        {
+            hist.red[i]   += local[0][i] + local[4][i];
+            hist.green[i] += local[1][i] + local[5][i];
+            hist.blue[i]  += local[2][i] + local[6][i];
+            hist.luma[i]  += local[3][i] + local[7][i];
+        }
+    });
+    hist.pixels = quint64(src.width()) * src.height();
+    return hist;
+}
+
+std::array<ImageOps::Levels, 3> ImageOps::AutoLevels(Histogram const& hist, double clip)
+{
+    std::array<Levels, 3> levels;
+    std::array<std::array<quint32, 256> const*, 3> channels = {{&hist.red, &hist.green, &hist.blue}};
+    auto limit = static_cast<quint64>(hist.pixels * std::max(0.0, clip));
+
+    for(int c = 0; c < 3; c++)
+    {
+        auto const& h = *channels[c];
+        quint64 sum = 0;
+        int lo = 0;
+        while(lo < 255 && (sum += h[lo]) <= limit)
+            lo++;
+        sum = 0;
+        int hi = 255;
+        while(hi > 0 && (sum += h[hi]) <= limit)
+            hi--;
+        // Leave flat channels alone
+        if(hi > lo)
+        {
+            levels[c].black = lo;
+            levels[c].white = hi;
+        }
+    }
+    return levels;
+}
+
+QImage ImageOps::ApplyLevels(QImage const& image, std::array<Levels, 3> const& levels)
+{
+    if(image.isNull())
+        return QImage();
+    QImage dst = ToRGB32(image);
+    // Tables indexed by the byte offset of the channel in the pixel: B, G, R
+    std::array<std::array<uint8_t, 256>, 3> lut;
+    for(int c = 0; c < 3; c++)
+    {
+        Levels const& lv = levels[2 - c];
+        double range = std::max(1, lv.white - lv.black);
+        double exponent = 1.0 / std::max(lv.gamma, 0.01);
+        for(int i = 0; i < 256; i++)
+        {
+            double t = std::min(std::max((i - lv.black) / range, 0.0), 1.0);
+            lut[c][i] = static_cast<uint8_t>(std::lrint(255.0 * std::pow(t, exponent)));
+        }
+    }
+    uint8_t*     bits   = dst.bits();
+    qint64 const stride = dst.bytesPerLine();
+    int const    width  = dst.width();
+
+    ParallelBands(dst.height(), 3 * width, [&](int y0, int y1){
+        for(int y = y0; y < y1; y++)
+        {
+            uint8_t* p = bits + y * stride;
+            for(int x = 0; x < width; x++, p += 4)
+            {
+                p[0] = lut[0][p[0]];
+                p[1] = lut[1][p[1]];
+                p[2] = lut[2][p[2]];
+            }
+        }
+    });
+    return dst;
+}
+
+const char* ImageOps::KernelName()
+{
+    return SelectKernels().name;
+}
@@ -0,0 +1,60 @@
+#ifndef IMAGEOPS_H
+#define IMAGEOPS_H
+
+#include <array>
+
+#include <QImage>
+
+/** Image processing kernels used by the viewers.
+ *
+ *  The hot loops have AVX2 and SSE4.1 versions selected at runtime from the
+ *  CPU features, with a portable fallback. Work is split into bands of rows
+ *  executed on QThreadPool::globalInstance(), so these functions must not be
+ *  called from a task running on the global pool.
+ */
+namespace ImageOps
+{
+    enum class Filter
+    {
+        Area,       // Box filter, averages the covered source pixels
+        Bilinear,   // Triangle filter
+        Lanczos3    // Windowed sinc with 3 lobes, the sharpest
+    };
+
+    /** Resample to exactly size. Images with alpha are resampled as
+     *  premultiplied ARGB32, the others as RGB32. */
+    QImage Resize(QImage const& image, QSize const& size, Filter filter = Filter::Lanczos3);
+
+    /** Resample to the largest size fitting in bounds keeping the aspect
+     *  ratio. Images already fitting are returned unchanged. */
+    QImage ResizeToFit(QImage const& image, QSize const& bounds,
+                       Filter filter = Filter::Lanczos3);
+
+    struct Histogram
+    {
+        std::array<quint32, 256> red{}, green{}, blue{}, luma{};
+        quint64 pixels = 0;
+    };
+
+    Histogram ComputeHistogram(QImage const& image);
+
+    /** Maps input range [black, white] to [0, 255] with a gamma curve */
+    struct Levels
+    {
+        int    black = 0;
+        int    white = 255;
+        double gamma = 1.0;
+    };
+
+    /** Levels stretching each channel so that a fraction clip of the
+     *  pixels is saturated at each end of the range. */
+    std::array<Levels, 3> AutoLevels(Histogram const& hist, double clip = 0.005);
+
+    /** Apply levels to the red, green and blue channels */
+    QImage ApplyLevels(QImage const& image, std::array<Levels, 3> const& levels);
+
+    /** Instruction set of the selected kernels: "AVX2", "SSE4.1" or "Scalar" */
+    const char* KernelName();
+}
+
+#endif // IMAGEOPS_H
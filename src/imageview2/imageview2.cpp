@@ -1,5 +1,7 @@
 #include <iostream>
 #include <functional>
+#include <array>
+#include <cmath>
 
 #include <QtWidgets>
 #include <QApplication>
@@ -10,8 +12,14 @@
 #include <QCommandLineParser>
 #include <QCommandLineOption>
 #include <QLabel>
+#include <QTimer>
+#include <QElapsedTimer>
 
-
+#include "tiledimageview.h"
+#include "imagedirmodel.h"
+#include "batchpipeline.h"
+#include "imageops.h"
+#include "../common/instrument.h"
 
 /** Makes QString printable */
 auto operator<<(std::ostream& os, QString const& str) -> std::ostream&
@@ -48,29 +56,127 @@ void OnSelectionChange(Selectable* object, Callable&& action)
 }
 
 
+/** Displays the red, green, blue and luma histograms of an image */
+class HistogramPanel: public QWidget
+{
+    ImageOps::Histogram hist;
+    bool                empty = true;
+public:
+    explicit HistogramPanel(QWidget* parent = nullptr): QWidget(parent)
+    {
+        this->setMinimumHeight(100);
+        this->setSizePolicy(QSizePolicy::Preferred, QSizePolicy::Fixed);
+    }
+
+    void SetHistogram(ImageOps::Histogram const& h)
+    {
+        hist  = h;
+        empty = h.pixels == 0;
+        this->update();
+    }
+
+    void Clear()
+    {
+        empty = true;
+        this->update();
+    }
+
+protected:
+    void paintEvent(QPaintEvent*) override
+    {
+        INSTRUMENT_SCOPE("HistogramPanel::paintEvent");
+        QPainter painter(this);
+        painter.fillRect(this->rect(), Qt::black);
+        if(empty)
+            return;
+        // Square root scale, so that a dominant background color does not
+        // flatten the rest of the histogram
+        double peak = 1.0;
+        for(auto const* h: {&hist.red, &hist.green, &hist.blue, &hist.luma})
+            for(quint32 n: *h)
+                peak = std::max(peak, std::sqrt(double(n)));
+        double w = this->width(), hgt = this->height();
+
+        auto curve = [&](std::array<quint32, 256> const& h) {
+            QPainterPath path;
+            path.moveTo(0, hgt);
+            for(int i = 0; i < 256; i++)
+                path.lineTo(i * w / 255.0, hgt - std::sqrt(double(h[i])) / peak * hgt);
+            path.lineTo(w, hgt);
+            return path;
+        };
+        painter.setRenderHint(QPainter::Antialiasing);
+        painter.fillPath(curve(hist.luma), QColor(128, 128, 128));
+        // Additive blending shows overlapping channels as mixed colors
+        painter.setCompositionMode(QPainter::CompositionMode_Plus);
+        painter.fillPath(curve(hist.red),   QColor(160, 0, 0));
+        painter.fillPath(curve(hist.green), QColor(0, 160, 0));
+        painter.fillPath(curve(hist.blue),  QColor(0, 0, 160));
+    }
+};
+
+
+// ============ Startup trace ================//
+
+/** Time to first frame above which a warning is printed */
+constexpr qint64 StartupBudgetMs = 150;
+
+/** Started at the beginning of main() */
+QElapsedTimer startupTimer;
+
+/** Set when the instrumentation is enabled (--trace or --timings) */
+bool startupTrace = false;
+
+/** Print the time elapsed since the start of main() when a startup
+ *  phase completes, ns is the elapsed time if recorded earlier. */
+void TraceStartup(const char* phase, qint64 ns = -1)
+{
+    if(!startupTrace)
+        return;
+    if(ns < 0)
+        ns = startupTimer.nsecsElapsed();
+    std::cout << " [TRACE] Startup " << phase << " at "
+              << ns / 1000000.0 << " ms" << std::endl;
+}
+
+
 class ImageViewer: public QMainWindow
 {
 private:
-    QFileSystemModel*  model         = new QFileSystemModel;
+    ImageDirModel*     model         = new ImageDirModel(this);
     QTreeView*         tree          = new QTreeView;
     QPushButton*       btnSelectDir  = new QPushButton("Open");
     QPushButton*       btnClose      = new QPushButton("Close");
     QPushButton*       btnAbout      = new QPushButton("About");
+    QPushButton*       btnBatch      = new QPushButton("Batch Export");
 
     QLabel*            currentFile   = new QLabel;
-    QLabel*            ImagePanel    = new QLabel;
+    TiledImageView*    ImagePanel    = new TiledImageView;
+    HistogramPanel*    histogram     = new HistogramPanel;
+    QCheckBox*         chkAutoLevels = new QCheckBox("Auto Levels");
+    // Histogram of the preview of the displayed image
+    ImageOps::Histogram previewHist;
+    std::array<ImageOps::Levels, 3> appliedLevels;
+    bool               levelsApplied = false;
 
     QMenu*             fileMenu      = new QMenu(this);
-    QSystemTrayIcon*   trayIcon      = new QSystemTrayIcon(this);
-    // QString            root_path     = "/";
+    // Created after the first frame, see DeferredInit()
+    QSystemTrayIcon*   trayIcon      = nullptr;
+    QString            rootPath;
+    bool               initialized   = false;
 
     void SetLayout()
     {
         // View only image files
         QStringList  filters;
         filters << "*.png" << "*.jpeg" << "*.jpg" << "*.bmp" << "*.tiff";
-        model->setNameFilters(filters);
+        model->SetNameFilters(filters);
         tree->setModel(model);
+        // Flat listing of a single directory
+        tree->setRootIsDecorated(false);
+        tree->setUniformRowHeights(true);
+        // Several images can be selected for batch export
+        tree->setSelectionMode(QAbstractItemView::ExtendedSelection);
 
         currentFile->setBackgroundRole(QPalette::Base);
 
@@ -83,18 +189,23 @@ private:
         tree->setColumnWidth(0, tree->width() / 3);
         tree->setWindowTitle(QObject::tr("Dir View"));
 
-        ImagePanel->setScaledContents(false);
         // ImagePanel.setSizePolicy( QSizePolicy::Ignored, QSizePolicy::Ignored );
         ImagePanel->setSizePolicy(QSizePolicy::MinimumExpanding, QSizePolicy::Preferred);
         ImagePanel->setWindowTitle("Image Panel");
 
         auto buttonPanel = new QHBoxLayout;
         buttonPanel->addWidget(btnSelectDir);
+        buttonPanel->addWidget(btnBatch);
         buttonPanel->addWidget(btnAbout);
         buttonPanel->addWidget(btnClose);
 
+        auto sidePanel = new QVBoxLayout;
+        sidePanel->addWidget(tree);
+        sidePanel->addWidget(histogram);
+        sidePanel->addWidget(chkAutoLevels);
+
         auto hbox = new QHBoxLayout ;
-        hbox->addWidget(tree);
+        hbox->addLayout(sidePanel);
         hbox->addWidget(ImagePanel);
 
         auto vbox = new QVBoxLayout;
@@ -116,6 +227,12 @@ private:
         openAct->setShortcut(tr("Ctrl+O"));
         fileMenu->addAction(openAct);
 
+        auto batchAct = new QAction(tr("&Batch Export..."), this);
+        batchAct->setShortcut(tr("Ctrl+B"));
+        QObject::connect(batchAct, &QAction::triggered,
+                         std::bind(&ImageViewer::BatchExport, this));
+        fileMenu->addAction(batchAct);
+
         QMenuBar* bar = new QMenuBar;
         vbox->setMenuBar(bar);
         bar->addMenu(fileMenu);
@@ -152,11 +269,43 @@ private:
     void SetEvents()
     {
         OnSelectionChange(tree, [&]{
+           if(model->IsDir(this->GetSelectedItem()))
+               return;
            auto file = this->GetSelectedFile();
            std::cout << " [INFO] Display image = " << file << std::endl;
            this->DisplayImage(file);
         });
 
+        // Navigate into subdirectories, the first row ".." goes up
+        QObject::connect(tree, &QTreeView::activated, [&](QModelIndex const& index){
+           if(model->IsDir(index))
+               this->SetRootDirectory(model->FilePath(index));
+        });
+
+        // The preview is at most 256 pixels wide, cheap enough for the GUI thread
+        ImagePanel->OnPreviewDecoded([&](QImage const& preview){
+           previewHist = ImageOps::ComputeHistogram(preview);
+           histogram->SetHistogram(previewHist);
+           if(chkAutoLevels->isChecked())
+               this->UpdateLevels();
+        });
+
+        QObject::connect(chkAutoLevels, &QCheckBox::toggled, [&](bool checked){
+           if(checked)
+               this->UpdateLevels();
+           else
+               this->ResetLevels();
+        });
+
+        model->OnScanFinished([](int rows, qint64 elapsed){
+           static bool first = true;
+           if(first)
+               TraceStartup("directory listed");
+           first = false;
+           std::cout << " [INFO] Indexed " << rows << " entries in "
+                     << elapsed << " ms" << std::endl;
+        });
+
         // QObject::connect(&btnClose, &QPushButton::clicked, []{ std::exit(0); });
         OnClick(btnClose, []{
            std::cout << " [INFO] Exiting application OK." << std::endl;
@@ -165,13 +314,19 @@ private:
 
         OnClick(btnSelectDir, std::bind(&ImageViewer::OpenDirectory, this));
         OnClick(btnAbout, std::bind(&ImageViewer::about, this));
+        OnClick(btnBatch, std::bind(&ImageViewer::BatchExport, this));
     }
 
 public:
 
+    /** Only the widgets are built here. Listing the directory and the
+     *  tray icon may block for seconds (network home directories, D-Bus),
+     *  they are set up by DeferredInit() once the window is on screen. */
     explicit ImageViewer(QString path = QDir::homePath())
+        : rootPath(std::move(path))
     {
         this->setWindowTitle("Sample QT5 Image Viewer");
+        std::cout << " [INFO] Image kernels: " << ImageOps::KernelName() << std::endl;
 
         // Make this Window always on Top
         this->setWindowFlags(Qt::WindowStaysOnTopHint);
@@ -179,37 +334,69 @@ public:
         // this->SetMenus();
         // Set up user interface layout
         this->SetLayout();
+        TraceStartup("layout");
         // Install events (signlas and slots)
         this->SetEvents();
-        this->SetRootDirectory(path);
-
-        // ====== Tray Icon =========//
-
-        auto openAct = new QAction(tr("&Open..."), this);
-        openAct->setShortcut(tr("Ctrl+O"));
-        auto trayMenu = new QMenu(this);
-        trayMenu->addAction(openAct);
-        trayIcon->setContextMenu(trayMenu);
-        trayIcon->setToolTip("Image Viewer Application Control");
+        TraceStartup("events");
 
         // Load Icon added by resource file imageView2.qrc
         // that points to the image /images/appicon.png
         static QIcon appIcon = QIcon(":/icons/appicon.png");
         // QIcon appIcon = QIcon("/home/archbox/projects/qtwidgets/images/appicon.png");
         this->setWindowIcon(appIcon);
-        trayMenu->setIcon(appIcon);
-        //trayMenu->add
-        this->trayIcon->show();
 
         // Enable Drag and Drop Event
         this->setAcceptDrops(true);
     }
 
+    bool event(QEvent* event) override
+    {
+        bool result = QMainWindow::event(event);
+        if(event->type() == QEvent::Paint && !initialized)
+        {
+            initialized = true;
+            qint64 elapsed = startupTimer.elapsed();
+            TraceStartup("first frame");
+            if(elapsed > StartupBudgetMs)
+                std::cout << " [WARNING] Time to first frame " << elapsed
+                          << " ms exceeds the budget of " << StartupBudgetMs
+                          << " ms" << std::endl;
+            // Runs after the frame is flushed to the screen
+            QTimer::singleShot(0, this, [this]{ this->DeferredInit(); });
+        }
+        return result;
+    }
+
+    void DeferredInit()
+    {
+        // The scan itself runs on worker threads
+        this->SetRootDirectory(rootPath);
+        TraceStartup("directory scan started");
+        this->CreateTrayIcon();
+        TraceStartup("tray icon");
+    }
+
+    void CreateTrayIcon()
+    {
+        auto openAct = new QAction(tr("&Open..."), this);
+        openAct->setShortcut(tr("Ctrl+O"));
+        QObject::connect(openAct, &QAction::triggered,
+                         std::bind(&ImageViewer::OpenDirectory, this));
+        auto trayMenu = new QMenu(this);
+        trayMenu->addAction(openAct);
+        trayMenu->setIcon(this->windowIcon());
+
+        trayIcon = new QSystemTrayIcon(this->windowIcon(), this);
+        trayIcon->setContextMenu(trayMenu);
+        trayIcon->setToolTip("Image Viewer Application Control");
+        trayIcon->show();
+    }
+
     ImageViewer&
     SetRootDirectory(QString path)
     {
-        model->setRootPath(path);
-        tree->setRootIndex(model->index(path));
+        rootPath = path;
+        model->SetRootPath(path);
         return *this;
     }
 
@@ -220,25 +407,58 @@ public:
                         QFileDialog::ShowDirsOnly
                       | QFileDialog::DontResolveSymlinks
                     );
-        this->SetRootDirectory(dir);
+        if(!dir.isEmpty())
+            this->SetRootDirectory(dir);
     }
 
     void DisplayImage(QString file)
     {
+        INSTRUMENT_SCOPE("ImageViewer::DisplayImage");
         currentFile->setText(file);
-        QPixmap pm(file); // Open image
-        // Scale image to fit in the label
-        if(!pm.isNull())
-         ImagePanel->setPixmap(pm.scaled(
-                                  ImagePanel->width(),
-                                  ImagePanel->height(),
-                                  Qt::KeepAspectRatio));
+        histogram->Clear();
+        previewHist = ImageOps::Histogram();
+        // Levels of the previous image do not apply, new ones are computed
+        // when the preview of this image is decoded.
+        ImagePanel->Clear();
+        this->ResetLevels();
+        // Only the header is read here, tiles are decoded on demand
+        // by worker threads as they become visible.
+        if(!ImagePanel->Open(file) && QFileInfo(file).isFile())
+            std::cout << " [ERROR] Unable to open image = " << file << std::endl;
+    }
+
+    /** Stretch the levels of the displayed image from its histogram */
+    void UpdateLevels()
+    {
+        if(previewHist.pixels == 0)
+            return;
+        auto levels = ImageOps::AutoLevels(previewHist);
+        auto same = [](ImageOps::Levels const& a, ImageOps::Levels const& b){
+            return a.black == b.black && a.white == b.white && a.gamma == b.gamma;
+        };
+        // Changing the filter decodes the preview again, which calls back here
+        if(levelsApplied && std::equal(levels.begin(), levels.end(),
+                                       appliedLevels.begin(), same))
+            return;
+        appliedLevels = levels;
+        levelsApplied = true;
+        ImagePanel->SetTileFilter([levels](QImage const& tile){
+            return ImageOps::ApplyLevels(tile, levels);
+        });
+    }
+
+    void ResetLevels()
+    {
+        if(!levelsApplied)
+            return;
+        levelsApplied = false;
+        ImagePanel->SetTileFilter(nullptr);
     }
 
     QString GetSelectedFile() const
     {
         QModelIndex index = tree->selectionModel()->currentIndex();
-        return  model->filePath(index);
+        return  model->FilePath(index);
     }
 
     QModelIndex GetSelectedItem() const
@@ -246,6 +466,39 @@ public:
         return tree->selectionModel()->currentIndex();
     }
 
+    /** Selected image files, or all images of the directory if at most
+     *  one file is selected. */
+    QStringList GetBatchFiles() const
+    {
+        QStringList files;
+        for(QModelIndex const& index: tree->selectionModel()->selectedRows())
+            if(!model->IsDir(index))
+                files << model->FilePath(index);
+        if(files.size() > 1)
+            return files;
+        files.clear();
+        for(int row = 0; row < model->rowCount(); row++)
+        {
+            QModelIndex index = model->index(row, 0);
+            if(!model->IsDir(index))
+                files << model->FilePath(index);
+        }
+        return files;
+    }
+
+    void BatchExport()
+    {
+        QStringList files = this->GetBatchFiles();
+        if(files.isEmpty())
+        {
+            QMessageBox::information(this, tr("Batch Export"), tr("No images to export."));
+            return;
+        }
+        auto dialog = new BatchDialog(files, this);
+        dialog->setAttribute(Qt::WA_DeleteOnClose);
+        dialog->show();
+    }
+
     void about()
     {
         QMessageBox::about(this, tr("About this Application"),
@@ -272,13 +525,24 @@ public:
 
 int main(int argc, char *argv[])
 {    
+    startupTimer.start();
     QApplication app(argc, argv);
+    qint64 appCreated = startupTimer.nsecsElapsed();
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    Instrument::Session::AddOptions(parser);
+    parser.process(app);
+    Instrument::Session instrument(parser);
+    startupTrace = instrument.Enabled();
+    TraceStartup("QApplication", appCreated);
 
     qDebug() << " [INFO] Application path = " << QCoreApplication::applicationFilePath();
     qDebug() << " [INFO] Application PID  = " << QCoreApplication::applicationPid();
     // QCoreApplication::setAttribute(Qt::AA_DontUseNativeMenuBar);
 
     ImageViewer imageViewer;
+    TraceStartup("main window");
     imageViewer.showNormal();
 
 
@@ -0,0 +1,362 @@
+#include "mappedimage.h"
+
+#include <vector>
+#include <algorithm>
+#include <functional>
+
+namespace {
+
+/** Reads unsigned integers of the file byte order */
+struct ByteReader
+{
+    const uchar* data;
+    qint64       size;
+    bool         bigEndian;
+
+    bool Has(qint64 offset, qint64 n) const
+    {
+        return offset >= 0 && n >= 0 && offset + n <= size;
+    }
+    quint32 U16(qint64 offset) const
+    {
+        const uchar* p = data + offset;
+        return bigEndian ? (quint32(p[0]) << 8) | p[1]
+                         : (quint32(p[1]) << 8) | p[0];
+    }
+    quint32 U32(qint64 offset) const
+    {
+        const uchar* p = data + offset;
+        return bigEndian
+                ? (quint32(p[0]) << 24) | (quint32(p[1]) << 16) | (quint32(p[2]) << 8) | p[3]
+                : (quint32(p[3]) << 24) | (quint32(p[2]) << 16) | (quint32(p[1]) << 8) | p[0];
+    }
+};
+
+int BytesPerPixel(MappedImage::Layout layout)
+{
+    switch(layout)
+    {
+    case MappedImage::Layout::Gray8:  return 1;
+    case MappedImage::Layout::BGR24:
+    case MappedImage::Layout::RGB24:  return 3;
+    default:                          return 4;
+    }
+}
+
+/** Point sample rows of the mapped image into a 32 bits image */
+template<typename Fetch>
+void SampleRegion(QImage& out, QRect const& rect, int level,
+                  std::function<const uchar* (int)> const& row, int bpp, Fetch fetch)
+{
+    // Sample the center of each 2^level x 2^level block
+    int half = (1 << level) >> 1;
+    std::vector<int> offsets(out.width());
+    for(int x = 0; x < out.width(); x++)
+    {
+        int sx = std::min(rect.x() + (x << level) + half, rect.right());
+        offsets[x] = sx * bpp;
+    }
+    for(int y = 0; y < out.height(); y++)
+    {
+        int sy = std::min(rect.y() + (y << level) + half, rect.bottom());
+        const uchar* src = row(sy);
+        QRgb* dst = reinterpret_cast<QRgb*>(out.scanLine(y));
+        for(int x = 0; x < out.width(); x++)
+            dst[x] = fetch(src + offsets[x]);
+    }
+}
+
+} // --- End of namespace --- //
+
+
+auto MappedImage::Open(QString const& fileName) -> std::shared_ptr<MappedImage>
+{
+    // Constructor is private, std::make_shared cannot be used
+    std::shared_ptr<MappedImage> img(new MappedImage);
+    img->file.setFileName(fileName);
+    if(!img->file.open(QFile::ReadOnly))
+        return nullptr;
+    qint64 size = img->file.size();
+    if(size < 64)
+        return nullptr;
+    img->base = img->file.map(0, size);
+    if(img->base == nullptr)
+        return nullptr;
+    if(img->ParseBMP(size) || img->ParseTIFF(size))
+        return img;
+    return nullptr;
+}
+
+MappedImage::~MappedImage()
+{
+    if(base != nullptr)
+        file.unmap(base);
+}
+
+bool MappedImage::ParseBMP(qint64 size)
+{
+    ByteReader rd{base, size, false};
+    if(base[0] != 'B' || base[1] != 'M' || !rd.Has(14, 40))
+        return false;
+    quint32 dataOffset  = rd.U32(10);
+    quint32 headerSize  = rd.U32(14);
+    qint32  bmpWidth    = static_cast<qint32>(rd.U32(18));
+    qint32  bmpHeight   = static_cast<qint32>(rd.U32(22));
+    quint32 bitCount    = rd.U16(28);
+    quint32 compression = rd.U32(30);
+    if(headerSize < 40 || bmpWidth <= 0 || bmpHeight == 0)
+        return false;
+
+    constexpr quint32 BI_RGB = 0, BI_BITFIELDS = 3;
+    if(bitCount == 8 && compression == BI_RGB)
+    {
+        // Only an identity grayscale palette maps to a QImage format
+        quint32 colors = rd.U32(46);
+        if(colors == 0)
+            colors = 256;
+        qint64 palette = 14 + headerSize;
+        if(colors != 256 || !rd.Has(palette, 4 * 256))
+            return false;
+        for(int i = 0; i < 256; i++)
+        {
+            const uchar* e = base + palette + 4 * i;
+            if(e[0] != i || e[1] != i || e[2] != i)
+                return false;
+        }
+        layout = Layout::Gray8;
+    }
+    else if(bitCount == 24 && compression == BI_RGB)
+        layout = Layout::BGR24;
+    else if(bitCount == 32 && compression == BI_RGB)
+        layout = Layout::BGRX32;
+    else if(bitCount == 32 && compression == BI_BITFIELDS && rd.Has(54, 12))
+    {
+        // Masks follow the 40 bytes header, or are part of V4/V5 headers
+        if(rd.U32(54) != 0x00FF0000 || rd.U32(58) != 0x0000FF00 || rd.U32(62) != 0x000000FF)
+            return false;
+        bool alpha = headerSize >= 56 && rd.U32(66) == 0xFF000000;
+        layout = alpha ? Layout::BGRA32 : Layout::BGRX32;
+    }
+    else
+        return false;
+
+    width    = bmpWidth;
+    height   = bmpHeight < 0 ? -bmpHeight : bmpHeight;
+    bottomUp = bmpHeight > 0;
+    // BMP rows are padded to 4 bytes
+    stride   = ((qint64(width) * bitCount + 31) / 32) * 4;
+    if(!rd.Has(dataOffset, stride * height))
+        return false;
+    pixels   = base + dataOffset;
+    return true;
+}
+
+bool MappedImage::ParseTIFF(qint64 size)
+{
+    bool le = base[0] == 'I' && base[1] == 'I' && base[2] == 42 && base[3] == 0;
+    bool be = base[0] == 'M' && base[1] == 'M' && base[2] == 0  && base[3] == 42;
+    if(!le && !be)
+        return false;
+    ByteReader rd{base, size, be};
+
+    qint64 ifd = rd.U32(4);
+    if(!rd.Has(ifd, 2))
+        return false;
+    quint32 entries = rd.U16(ifd);
+    if(!rd.Has(ifd + 2, qint64(entries) * 12))
+        return false;
+
+    // BitsPerSample defaults to 1 when the tag is missing
+    quint32 tiffWidth = 0, tiffHeight = 0, bits = 1, compression = 1;
+    quint32 photometric = 0, samples = 1, rowsPerStrip = 0xFFFFFFFF;
+    quint32 planar = 1, extra = 0;
+    std::vector<quint32> stripOffsets;
+    bool tiled = false;
+
+    for(quint32 i = 0; i < entries; i++)
+    {
+        qint64  e     = ifd + 2 + 12 * qint64(i);
+        quint32 tag   = rd.U16(e);
+        quint32 type  = rd.U16(e + 2);
+        quint32 count = rd.U32(e + 4);
+        // SHORT = 3, LONG = 4
+        int     unit  = type == 3 ? 2 : 4;
+        if(type != 3 && type != 4)
+            continue;
+        qint64  at    = qint64(count) * unit <= 4 ? e + 8 : rd.U32(e + 8);
+        if(!rd.Has(at, qint64(count) * unit))
+            return false;
+        auto value = [&](quint32 k){
+            return unit == 2 ? rd.U16(at + 2 * k) : rd.U32(at + 4 * k);
+        };
+        switch(tag)
+        {
+        case 256: tiffWidth    = value(0); break;
+        case 257: tiffHeight   = value(0); break;
+        case 258:
+            // All samples must have 8 bits
+            for(quint32 k = 0; k < count; k++)
+                if(value(k) != 8)
+                    return false;
+            bits = 8;
+            break;
+        case 259: compression  = value(0); break;
+        case 262: photometric  = value(0); break;
+        case 273:
+            stripOffsets.resize(count);
+            for(quint32 k = 0; k < count; k++)
+                stripOffsets[k] = value(k);
+            break;
+        case 277: samples      = value(0); break;
+        case 278: rowsPerStrip = value(0); break;
+        case 284: planar       = value(0); break;
+        case 322: tiled        = true;     break;
+        case 338: extra        = value(0); break;
+        }
+    }
+
+    if(tiffWidth == 0 || tiffHeight == 0 || bits != 8 || compression != 1
+       || planar != 1 || tiled || stripOffsets.empty())
+        return false;
+
+    if(samples == 1 && photometric == 1)
+        layout = Layout::Gray8;
+    else if(samples == 3 && photometric == 2)
+        layout = Layout::RGB24;
+    else if(samples == 4 && photometric == 2 && (extra == 1 || extra == 2))
+        layout = extra == 1 ? Layout::RGBA32Premultiplied : Layout::RGBA32;
+    else
+        return false;
+
+    width  = static_cast<int>(tiffWidth);
+    height = static_cast<int>(tiffHeight);
+    // TIFF rows are not padded
+    stride = qint64(width) * samples;
+
+    // Strips must follow each other without gaps to form a single block
+    qint64 rows = std::min<qint64>(rowsPerStrip, height);
+    for(size_t k = 1; k < stripOffsets.size(); k++)
+        if(stripOffsets[k] != stripOffsets[0] + qint64(k) * rows * stride)
+            return false;
+    if(!rd.Has(stripOffsets[0], stride * height))
+        return false;
+    pixels   = base + stripOffsets[0];
+    bottomUp = false;
+    return true;
+}
+
+const uchar* MappedImage::Row(int y) const
+{
+    return pixels + (bottomUp ? height - 1 - y : y) * stride;
+}
+
+QImage MappedImage::View() const
+{
+    if(bottomUp)
+        return QImage();
+#if !defined(Q_PROCESSOR_X86)
+    // QImage reads 32 bits pixels as words, which must be aligned
+    if(BytesPerPixel(layout) == 4 && (quintptr(pixels) % 4 != 0 || stride % 4 != 0))
+        return QImage();
+#endif
+
+    QImage::Format format = QImage::Format_Invalid;
+    switch(layout)
+    {
+    case Layout::Gray8:  format = QImage::Format_Grayscale8; break;
+    case Layout::RGB24:  format = QImage::Format_RGB888;     break;
+    case Layout::RGBA32: format = QImage::Format_RGBA8888;   break;
+    case Layout::RGBA32Premultiplied:
+        format = QImage::Format_RGBA8888_Premultiplied;
+        break;
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+    // Memory order B, G, R, A is the 32 bits word 0xAARRGGBB
+    case Layout::BGRX32: format = QImage::Format_RGB32;      break;
+    case Layout::BGRA32: format = QImage::Format_ARGB32;     break;
+#endif
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+    case Layout::BGR24:  format = QImage::Format_BGR888;     break;
+#endif
+    default:
+        return QImage();
+    }
+
+    // The image owns a reference to the mapping, released by the
+    // cleanup function when the last shallow copy is destroyed.
+    auto ref = new std::shared_ptr<const MappedImage>(this->shared_from_this());
+    auto cleanup = [](void* info){
+        delete static_cast<std::shared_ptr<const MappedImage>*>(info);
+    };
+    return QImage(pixels, width, height, static_cast<int>(stride), format, cleanup, ref);
+}
+
+QImage MappedImage::Region(QRect const& area, int level) const
+{
+    QRect rect = area.intersected(QRect(0, 0, width, height));
+    if(rect.isEmpty())
+        return QImage();
+
+    // The zero-copy view covers the common case at full resolution
+    if(level == 0)
+    {
+        QImage view = this->View();
+        if(!view.isNull())
+            return view.copy(rect);
+    }
+
+    int w = (rect.width()  + (1 << level) - 1) >> level;
+    int h = (rect.height() + (1 << level) - 1) >> level;
+    bool alpha = layout == Layout::BGRA32 || layout == Layout::RGBA32
+              || layout == Layout::RGBA32Premultiplied;
+    QImage out(w, h, layout == Layout::RGBA32Premultiplied
+                     ? QImage::Format_ARGB32_Premultiplied
+                     : alpha ? QImage::Format_ARGB32 : QImage::Format_RGB32);
+    if(out.isNull())
+        return out;
+
+    std::function<const uchar* (int)> row = [this](int y){ return this->Row(y); };
+    int bpp = BytesPerPixel(layout);
+    switch(layout)
+    {
+    case Layout::Gray8:
+        SampleRegion(out, rect, level, row, bpp, [](const uchar* p){
+            return qRgb(p[0], p[0], p[0]);
+        });
+        break;
+    case Layout::BGR24:
+    case Layout::BGRX32:
+        SampleRegion(out, rect, level, row, bpp, [](const uchar* p){
+            return qRgb(p[2], p[1], p[0]);
+        });
+        break;
+    case Layout::BGRA32:
+        SampleRegion(out, rect, level, row, bpp, [](const uchar* p){
+            return qRgba(p[2], p[1], p[0], p[3]);
+        });
+        break;
+    case Layout::RGB24:
+        SampleRegion(out, rect, level, row, bpp, [](const uchar* p){
+            return qRgb(p[0], p[1], p[2]);
+        });
+        break;
+    case Layout::RGBA32:
+    case Layout::RGBA32Premultiplied:
+        SampleRegion(out, rect, level, row, bpp, [](const uchar* p){
+            return qRgba(p[0], p[1], p[2], p[3]);
+        });
+        break;
+    }
+    return out;
+}
+
+auto MapImageFile(QString const& fileName) -> QImage
+{
+    auto mapped = MappedImage::Open(fileName);
+    if(mapped == nullptr)
+        return QImage();
+    QImage view = mapped->View();
+    if(!view.isNull())
+        return view;
+    return mapped->Region(QRect(QPoint(0, 0), mapped->Size()), 0);
+}
+
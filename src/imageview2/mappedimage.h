@@ -0,0 +1,68 @@
+#ifndef MAPPEDIMAGE_H
+#define MAPPEDIMAGE_H
+
+#include <memory>
+
+#include <QFile>
+#include <QImage>
+
+/** Uncompressed image file (BMP or baseline TIFF) mapped into memory.
+ *  Pixels are read straight from the mapping, so only the pages actually
+ *  displayed are loaded from disk and nothing is copied into the heap.
+ *
+ *  Supported layouts: 8 bits grayscale, 24 bits RGB and 32 bits RGB/RGBA
+ *  with 8 bits per sample, uncompressed and stored in a single contiguous
+ *  block. Any other layout makes Open() return nullptr, so that the caller
+ *  falls back to the regular decoders.
+ */
+class MappedImage: public std::enable_shared_from_this<MappedImage>
+{
+public:
+    /** Memory layout of a pixel in the file */
+    enum class Layout
+    {
+        Gray8, BGR24, BGRX32, BGRA32, RGB24, RGBA32, RGBA32Premultiplied
+    };
+
+    static auto Open(QString const& fileName) -> std::shared_ptr<MappedImage>;
+
+    ~MappedImage();
+
+    MappedImage(MappedImage const&) = delete;
+    MappedImage& operator=(MappedImage const&) = delete;
+
+    QSize  Size()   const { return QSize(width, height); }
+    Layout PixelLayout() const { return layout; }
+
+    /** Zero-copy QImage over the mapped pixels. The mapping is kept alive
+     *  while the image or any shallow copy of it exists. Returns a null
+     *  image when the layout has no QImage equivalent (e.g. bottom-up rows).
+     */
+    QImage View() const;
+
+    /** Copy of rect, given in full resolution coordinates, downscaled by
+     *  2^level with point sampling. Works for every supported layout. */
+    QImage Region(QRect const& rect, int level) const;
+
+private:
+    MappedImage() = default;
+
+    QFile        file;
+    uchar*       base      = nullptr;
+    const uchar* pixels    = nullptr;   // First row in memory
+    int          width     = 0;
+    int          height    = 0;
+    qint64       stride    = 0;
+    bool         bottomUp  = false;
+    Layout       layout    = Layout::Gray8;
+
+    bool ParseBMP(qint64 size);
+    bool ParseTIFF(qint64 size);
+    const uchar* Row(int y) const;
+};
+
+/** Image of an uncompressed file over its mapping, without copying when
+ *  the layout allows it. Returns a null image if the file cannot be mapped. */
+auto MapImageFile(QString const& fileName) -> QImage;
+
+#endif // MAPPEDIMAGE_H
@@ -0,0 +1,511 @@
+#include "tiledimageview.h"
+#include "mappedimage.h"
+#include "../common/instrument.h"
+#include "../common/task.h"
+
+#include <cmath>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+
+#include <QTimer>
+#include <QImageReader>
+#include <QPainter>
+#include <QPaintEvent>
+#include <QWheelEvent>
+#include <QMouseEvent>
+#include <QKeyEvent>
+
+namespace {
+
+// Time without tile requests after which the source releases its data
+constexpr int IdleMs = 3000;
+
+auto TileKey(int level, int tx, int ty) -> quint64
+{
+    return (quint64(level) << 56) | (quint64(ty) << 28) | quint64(tx);
+}
+
+auto ScaledSize(QRect const& rect, int level) -> QSize
+{
+    // Round up, so that the last row/column of tiles is never empty
+    int w = (rect.width()  + (1 << level) - 1) >> level;
+    int h = (rect.height() + (1 << level) - 1) >> level;
+    return QSize(std::max(w, 1), std::max(h, 1));
+}
+
+/** Decodes each tile straight from the file with a clip rectangle.
+ *  Only used with formats whose handler supports clipping (e.g. JPEG),
+ *  otherwise every tile would decode the whole file again. */
+class ReaderTileSource: public TileSource
+{
+    QString file;
+    QSize   size;
+public:
+    ReaderTileSource(QString file, QSize size)
+        : file(std::move(file)), size(size)
+    { }
+
+    QSize Size() const override { return size; }
+
+    QImage Decode(QRect const& rect, int level) const override
+    {
+        QImageReader reader(file);
+        // The clip rect is applied before scaling by QImageReader
+        reader.setClipRect(rect);
+        if(level > 0)
+            reader.setScaledSize(ScaledSize(rect, level));
+        return reader.read();
+    }
+};
+
+/** Decodes a whole pyramid level at once, for the formats whose handler
+ *  cannot decode a clip rectangle (e.g. PNG, compressed TIFF): their
+ *  decoder produces every row anyway, a clip rectangle is only applied
+ *  afterwards. The last level decoded is kept and the tiles are copied out
+ *  of it, so the tiles of one zoom level decode the file once. It is
+ *  replaced when another level is needed and dropped by Release() once the
+ *  view stops requesting tiles, so it does not outlive the interaction. */
+class LevelTileSource: public TileSource
+{
+    QString file;
+    QSize   size;
+    // Also serializes decoding, concurrent misses wait for the same level
+    mutable std::mutex mtx;
+    mutable QImage     decoded;
+    mutable int        decodedLevel = -1;
+public:
+    LevelTileSource(QString file, QSize size)
+        : file(std::move(file)), size(size)
+    { }
+
+    QSize Size() const override { return size; }
+
+    QImage Decode(QRect const& rect, int level) const override
+    {
+        std::lock_guard<std::mutex> guard(mtx);
+        if(decodedLevel != level)
+        {
+            // Released before the next level is decoded
+            decoded      = QImage();
+            decodedLevel = -1;
+            QImageReader reader(file);
+            if(level > 0)
+                reader.setScaledSize(ScaledSize(QRect(QPoint(0, 0), size), level));
+            decoded = reader.read();
+            if(decoded.isNull())
+                return QImage();
+            decodedLevel = level;
+        }
+        // Deep copy, cached tiles do not keep the level alive
+        QSize out = ScaledSize(rect, level);
+        return decoded.copy(rect.x() >> level, rect.y() >> level, out.width(), out.height());
+    }
+
+    bool Release() override
+    {
+        std::unique_lock<std::mutex> guard(mtx, std::try_to_lock);
+        if(!guard.owns_lock())
+            return false;
+        decoded      = QImage();
+        decodedLevel = -1;
+        return true;
+    }
+};
+
+/** Reads tiles of uncompressed BMP/TIFF files straight from the memory
+ *  mapped file, touching only the pages of the visible tiles. */
+class MappedTileSource: public TileSource
+{
+    std::shared_ptr<MappedImage> image;
+public:
+    explicit MappedTileSource(std::shared_ptr<MappedImage> image)
+        : image(std::move(image))
+    { }
+
+    QSize Size() const override { return image->Size(); }
+
+    QImage Decode(QRect const& rect, int level) const override
+    {
+        return image->Region(rect, level);
+    }
+};
+
+} // --- End of namespace --- //
+
+
+auto OpenTileSource(QString const& file) -> std::shared_ptr<TileSource>
+{
+    if(auto mapped = MappedImage::Open(file))
+        return std::make_shared<MappedTileSource>(mapped);
+
+    QImageReader reader(file);
+    // Only the header is read here, handlers unable to tell the size
+    // without decoding the image are not supported
+    QSize size = reader.size();
+    if(!size.isValid() || !reader.canRead())
+        return nullptr;
+    if(reader.supportsOption(QImageIOHandler::ClipRect))
+        return std::make_shared<ReaderTileSource>(file, size);
+    return std::make_shared<LevelTileSource>(file, size);
+}
+
+//======= TiledImageView Implementation ==========//
+
+TiledImageView::TiledImageView(QWidget* parent)
+    : QWidget(parent)
+{
+    this->SetCacheLimit(192);
+    idleTimer = new QTimer(this);
+    idleTimer->setSingleShot(true);
+    idleTimer->setInterval(IdleMs);
+    QObject::connect(idleTimer, &QTimer::timeout, [this]{
+        if(source != nullptr && !source->Release())
+            idleTimer->start();
+    });
+    this->setFocusPolicy(Qt::StrongFocus);
+    this->setMouseTracking(false);
+    this->setAttribute(Qt::WA_OpaquePaintEvent);
+}
+
+TiledImageView::~TiledImageView()
+{
+    // Decode tasks hold a pointer to this object
+    epoch->fetch_add(1);
+    pool.clear();
+    pool.waitForDone();
+}
+
+bool TiledImageView::Open(QString const& file)
+{
+    auto src = OpenTileSource(file);
+    if(src == nullptr)
+        return false;
+    this->Clear();
+    source = src;
+    // Request the coarsest level first, so there is always something to
+    // display while the finer tiles are decoded.
+    this->RequestTile(this->MaxLevel(), 0, 0);
+    this->FitToWindow();
+    return true;
+}
+
+void TiledImageView::Clear()
+{
+    imageId++;
+    epoch->fetch_add(1);
+    pool.clear();
+    cache.clear();
+    preview = QImage();
+    // Results of in-flight tasks are discarded by the image id check
+    pending.clear();
+    source = nullptr;
+    this->update();
+}
+
+void TiledImageView::SetTileFilter(TileFilter filter)
+{
+    tileFilter = std::move(filter);
+    // Decode again everything with the new filter
+    imageId++;
+    epoch->fetch_add(1);
+    pool.clear();
+    cache.clear();
+    preview = QImage();
+    pending.clear();
+    if(source != nullptr)
+        this->RequestTile(this->MaxLevel(), 0, 0);
+    this->update();
+}
+
+void TiledImageView::SetCacheLimit(int megabytes)
+{
+    // Cost of a cached tile is measured in kilobytes
+    cache.setMaxCost(megabytes * 1024);
+}
+
+QSize TiledImageView::ImageSize() const
+{
+    return source ? source->Size() : QSize();
+}
+
+void TiledImageView::FitToWindow()
+{
+    fitMode = true;
+    if(source == nullptr)
+        return;
+    QSize img = source->Size();
+    scale = std::min(double(this->width())  / img.width(),
+                     double(this->height()) / img.height());
+    if(scale <= 0.0)
+        scale = 1.0;
+    // Center the image in the widget
+    origin = QPointF((img.width()  - this->width()  / scale) / 2.0,
+                     (img.height() - this->height() / scale) / 2.0);
+    this->ViewChanged();
+}
+
+int TiledImageView::MaxLevel() const
+{
+    if(source == nullptr)
+        return 0;
+    QSize img = source->Size();
+    int side = std::max(img.width(), img.height());
+    int level = 0;
+    while((side >> level) > TileSize)
+        level++;
+    return level;
+}
+
+int TiledImageView::LevelForScale() const
+{
+    // Finest level whose resolution is still at least the screen resolution
+    int level = scale >= 1.0 ? 0 : static_cast<int>(std::floor(std::log2(1.0 / scale)));
+    return std::min(level, this->MaxLevel());
+}
+
+QRect TiledImageView::TileRect(int level, int tx, int ty) const
+{
+    int side = TileSize << level;
+    return QRect(tx * side, ty * side, side, side)
+            .intersected(QRect(QPoint(0, 0), source->Size()));
+}
+
+void TiledImageView::ViewChanged()
+{
+    // Queued requests from the previous view are skipped by the workers
+    epoch->fetch_add(1);
+    this->update();
+}
+
+void TiledImageView::RequestTile(int level, int tx, int ty)
+{
+    quint64 key = TileKey(level, tx, ty);
+    if(pending.contains(key))
+        return;
+    pending.insert(key);
+    idleTimer->start();
+
+    auto src          = source;
+    auto sharedEpoch  = epoch;
+    int  requestEpoch = epoch->load();
+    int  requestImage = imageId;
+    QRect rect        = this->TileRect(level, tx, ty);
+    bool  isPreview   = level == this->MaxLevel();
+    TileFilter filter = tileFilter;
+
+    auto task = [=]{
+        QImage image, unfiltered;
+        // Skip tiles requested for a view that is no longer displayed,
+        // except the preview tile which is always needed.
+        bool decoded = isPreview || sharedEpoch->load() == requestEpoch;
+        if(decoded)
+        {
+            INSTRUMENT_SCOPE("TiledImageView tile decode");
+            image = src->Decode(rect, level);
+            if(isPreview)
+                unfiltered = image;
+            if(!image.isNull() && filter)
+                image = filter(image);
+            if(!image.isNull())
+                image = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+        }
+        QMetaObject::invokeMethod(this, [=]{
+            if(isPreview && decoded && requestImage == imageId && previewDecoded)
+                previewDecoded(unfiltered);
+            this->OnTileDecoded(key, requestImage, decoded, image);
+        }, Qt::QueuedConnection);
+    };
+    // Coarse tiles are cheap and cover large areas, decode them first
+    pool.start(MakeTask(task), level);
+}
+
+void TiledImageView::OnTileDecoded(quint64 key, int requestImage,
+                                   bool decoded, QImage image)
+{
+    // Image was closed while the tile was being decoded
+    if(requestImage != imageId || !pending.remove(key))
+        return;
+    // A tile which failed to decode is cached as a null image, so that it
+    // is not requested over and over again.
+    if(decoded)
+    {
+        // The preview is the last resort of DrawFallback, it is never evicted
+        if(key == TileKey(this->MaxLevel(), 0, 0))
+            preview = image;
+        int cost = std::max<int>(1, static_cast<int>(image.sizeInBytes() / 1024));
+        cache.insert(key, new QImage(std::move(image)), cost);
+    }
+    // Skipped tiles are requested again if they are still visible
+    this->update();
+}
+
+QImage const* TiledImageView::CachedTile(int level, int tx, int ty) const
+{
+    QImage const* tile = cache.object(TileKey(level, tx, ty));
+    if(tile == nullptr && level == this->MaxLevel() && !preview.isNull())
+        return &preview;
+    return tile;
+}
+
+bool TiledImageView::DrawFallback(QPainter& painter, QRectF const& target,
+                                  QRect const& imageRect, int level)
+{
+    for(int coarse = level + 1; coarse <= this->MaxLevel(); coarse++)
+    {
+        int side = TileSize << coarse;
+        int tx = imageRect.x() / side;
+        int ty = imageRect.y() / side;
+        QImage const* img = this->CachedTile(coarse, tx, ty);
+        if(img == nullptr || img->isNull())
+            continue;
+        QRect   coarseRect = this->TileRect(coarse, tx, ty);
+        double  factor     = 1.0 / (1 << coarse);
+        QRectF  sourceRect((imageRect.x() - coarseRect.x()) * factor,
+                           (imageRect.y() - coarseRect.y()) * factor,
+                           imageRect.width() * factor,
+                           imageRect.height() * factor);
+        painter.drawImage(target, *img, sourceRect);
+        return true;
+    }
+    return false;
+}
+
+void TiledImageView::paintEvent(QPaintEvent* event)
+{
+    INSTRUMENT_SCOPE("TiledImageView::paintEvent");
+    QPainter painter(this);
+    painter.fillRect(event->rect(), this->palette().color(QPalette::Window));
+    if(source == nullptr)
+        return;
+    painter.setRenderHint(QPainter::SmoothPixmapTransform, scale < 1.0);
+
+    int level = this->LevelForScale();
+    int side  = TileSize << level;
+    QSize img = source->Size();
+
+    // Visible region in image coordinates
+    QRectF visible(origin.x() + event->rect().x() / scale,
+                   origin.y() + event->rect().y() / scale,
+                   event->rect().width()  / scale,
+                   event->rect().height() / scale);
+    visible = visible.intersected(QRectF(0, 0, img.width(), img.height()));
+    if(visible.isEmpty())
+        return;
+
+    int tx0 = static_cast<int>(visible.left()) / side;
+    int ty0 = static_cast<int>(visible.top())  / side;
+    int tx1 = static_cast<int>(std::ceil(visible.right()))  / side;
+    int ty1 = static_cast<int>(std::ceil(visible.bottom())) / side;
+    tx1 = std::min(tx1, (img.width()  - 1) / side);
+    ty1 = std::min(ty1, (img.height() - 1) / side);
+
+    for(int ty = ty0; ty <= ty1; ty++)
+        for(int tx = tx0; tx <= tx1; tx++)
+        {
+            QRect  rect = this->TileRect(level, tx, ty);
+            QRectF target((rect.x() - origin.x()) * scale,
+                          (rect.y() - origin.y()) * scale,
+                          rect.width()  * scale,
+                          rect.height() * scale);
+            QImage const* tile = this->CachedTile(level, tx, ty);
+            if(tile != nullptr && !tile->isNull())
+            {
+                painter.drawImage(target, *tile);
+                continue;
+            }
+            if(tile == nullptr)
+                this->RequestTile(level, tx, ty);
+            this->DrawFallback(painter, target, rect, level);
+        }
+}
+
+void TiledImageView::resizeEvent(QResizeEvent* event)
+{
+    QWidget::resizeEvent(event);
+    if(fitMode)
+        this->FitToWindow();
+    else
+        this->ViewChanged();
+}
+
+void TiledImageView::ZoomAt(QPointF pos, double factor)
+{
+    if(source == nullptr)
+        return;
+    QSize  img = source->Size();
+    double fit = std::min(double(this->width())  / img.width(),
+                          double(this->height()) / img.height());
+    double newScale = std::min(std::max(scale * factor, fit / 4.0),
+                               std::max(fit * 4.0, 32.0));
+    // Keep the image point under the cursor fixed
+    QPointF point = origin + pos / scale;
+    scale   = newScale;
+    origin  = point - pos / scale;
+    fitMode = false;
+    this->ViewChanged();
+}
+
+void TiledImageView::wheelEvent(QWheelEvent* event)
+{
+    double factor = std::pow(1.0015, event->angleDelta().y());
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+    this->ZoomAt(event->position(), factor);
+#else
+    this->ZoomAt(QPointF(event->pos()), factor);
+#endif
+    event->accept();
+}
+
+void TiledImageView::mousePressEvent(QMouseEvent* event)
+{
+    if(event->button() != Qt::LeftButton)
+        return QWidget::mousePressEvent(event);
+    dragging     = true;
+    lastMousePos = event->pos();
+    this->setCursor(Qt::ClosedHandCursor);
+}
+
+void TiledImageView::mouseMoveEvent(QMouseEvent* event)
+{
+    if(!dragging)
+        return QWidget::mouseMoveEvent(event);
+    QPoint delta = event->pos() - lastMousePos;
+    lastMousePos = event->pos();
+    origin -= QPointF(delta) / scale;
+    fitMode = false;
+    this->ViewChanged();
+}
+
+void TiledImageView::mouseReleaseEvent(QMouseEvent* event)
+{
+    if(event->button() != Qt::LeftButton)
+        return QWidget::mouseReleaseEvent(event);
+    dragging = false;
+    this->unsetCursor();
+}
+
+void TiledImageView::mouseDoubleClickEvent(QMouseEvent*)
+{
+    this->FitToWindow();
+}
+
+void TiledImageView::keyPressEvent(QKeyEvent* event)
+{
+    QPointF center(this->width() / 2.0, this->height() / 2.0);
+    switch(event->key())
+    {
+    case Qt::Key_Plus:
+    case Qt::Key_Equal:
+        this->ZoomAt(center, 1.25);
+        break;
+    case Qt::Key_Minus:
+        this->ZoomAt(center, 0.8);
+        break;
+    case Qt::Key_0:
+        this->FitToWindow();
+        break;
+    default:
+        QWidget::keyPressEvent(event);
+    }
+}
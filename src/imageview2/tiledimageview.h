@@ -0,0 +1,139 @@
+#ifndef TILEDIMAGEVIEW_H
+#define TILEDIMAGEVIEW_H
+
+#include <memory>
+#include <atomic>
+#include <functional>
+
+#include <QWidget>
+#include <QCache>
+#include <QImage>
+#include <QSet>
+#include <QThreadPool>
+
+class QTimer;
+
+/** Provides pixels of an image at pyramid level L, where level L is the
+ *  image downscaled by a factor of 2^L. Decode() is called from worker
+ *  threads, so implementations must be thread-safe.
+ */
+class TileSource
+{
+public:
+    virtual ~TileSource() = default;
+
+    /** Size of the image at full resolution (level 0) */
+    virtual QSize Size() const = 0;
+
+    /** Decode the region rect, given in full resolution coordinates,
+     *  downscaled to the pyramid level. */
+    virtual QImage Decode(QRect const& rect, int level) const = 0;
+
+    /** Called on the GUI thread when the view has not requested tiles for a
+     *  while, sources may release the data they keep to decode faster.
+     *  Returns false without blocking if a decode is running, the view
+     *  tries again later. */
+    virtual bool Release() { return true; }
+};
+
+/** Pick the cheapest tile source able to read the image file.
+ *  Returns nullptr if the file is not a readable image. */
+auto OpenTileSource(QString const& file) -> std::shared_ptr<TileSource>;
+
+
+/** Zoomable and pannable image canvas which decodes only the visible tiles
+ *  at the pyramid level matching the current zoom. Decoded tiles are kept in
+ *  a cache bounded by size, so memory does not grow with the image size.
+ *
+ *  Mouse wheel zooms around the cursor, dragging pans, double click or the
+ *  key '0' fits the image to the widget.
+ */
+class TiledImageView: public QWidget
+{
+public:
+    /** Tile side in pixels at every pyramid level */
+    static constexpr int TileSize = 256;
+
+    explicit TiledImageView(QWidget* parent = nullptr);
+    ~TiledImageView() override;
+
+    TiledImageView(TiledImageView const&) = delete;
+    TiledImageView& operator=(TiledImageView const&) = delete;
+
+    /** Open image file, returns false if it cannot be read. */
+    bool Open(QString const& file);
+    void Clear();
+
+    /** Scale the image to fit into the widget */
+    void FitToWindow();
+
+    using TileFilter = std::function<QImage (QImage const&)>;
+
+    /** Filter applied to each decoded tile on the worker threads, such as a
+     *  color adjustment. Pass nullptr to remove it. Cached tiles are dropped
+     *  and decoded again. */
+    void SetTileFilter(TileFilter filter);
+
+    /** Callback called on the GUI thread with the coarsest pyramid level of
+     *  the image, the whole image in at most TileSize pixels, before the
+     *  tile filter is applied. */
+    void OnPreviewDecoded(std::function<void (QImage const&)> callback)
+    {
+        previewDecoded = std::move(callback);
+    }
+
+    /** Upper bound of memory used by the decoded tiles in megabytes */
+    void SetCacheLimit(int megabytes);
+
+    QSize ImageSize() const;
+    double Scale() const { return scale; }
+
+protected:
+    void paintEvent(QPaintEvent* event) override;
+    void resizeEvent(QResizeEvent* event) override;
+    void wheelEvent(QWheelEvent* event) override;
+    void mousePressEvent(QMouseEvent* event) override;
+    void mouseMoveEvent(QMouseEvent* event) override;
+    void mouseReleaseEvent(QMouseEvent* event) override;
+    void mouseDoubleClickEvent(QMouseEvent* event) override;
+    void keyPressEvent(QKeyEvent* event) override;
+
+private:
+    std::shared_ptr<TileSource> source;
+    // Incremented whenever the visible area changes, so that queued decode
+    // requests for tiles no longer needed can be skipped.
+    std::shared_ptr<std::atomic<int>> epoch = std::make_shared<std::atomic<int>>(0);
+    QCache<quint64, QImage> cache;
+    // Coarsest level, kept out of the cache so it cannot be evicted
+    QImage        preview;
+    QSet<quint64> pending;
+    // Identifies the open image and tile filter, tiles decoded for a closed
+    // image or with a previous filter are dropped
+    int           imageId = 0;
+    TileFilter    tileFilter;
+    std::function<void (QImage const&)> previewDecoded;
+    QThreadPool   pool;
+    QTimer*       idleTimer;
+
+    // Screen pixels per image pixel
+    double  scale   = 1.0;
+    // Image coordinate shown at the widget top-left corner
+    QPointF origin  = {0.0, 0.0};
+    bool    fitMode = true;
+    QPoint  lastMousePos;
+    bool    dragging = false;
+
+    int  MaxLevel() const;
+    int  LevelForScale() const;
+    void ZoomAt(QPointF pos, double factor);
+    void ViewChanged();
+    void RequestTile(int level, int tx, int ty);
+    void OnTileDecoded(quint64 key, int requestImage, bool decoded, QImage image);
+    /** Cached tile, the preview for the coarsest level, nullptr if missing */
+    QImage const* CachedTile(int level, int tx, int ty) const;
+    bool DrawFallback(QPainter& painter, QRectF const& target,
+                      QRect const& imageRect, int level);
+    QRect TileRect(int level, int tx, int ty) const;
+};
+
+#endif // TILEDIMAGEVIEW_H
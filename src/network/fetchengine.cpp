@@ -0,0 +1,287 @@
+#include "fetchengine.h"
+
+#include <memory>
+#include <iostream>
+#include <iomanip>
+#include <limits>
+
+#include <QTimer>
+#include <QPointer>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+
+#include "streaming.h"
+#include "httpcache.h"
+
+namespace {
+
+// Delay before offering a chunk again to a consumer which took part of it
+constexpr int RetryMs = 2;
+
+} // --- End of namespace --- //
+
+//======= FetchEngine Implementation ==========//
+
+FetchEngine::FetchEngine(int maxPerHost): maxPerHost(std::max(maxPerHost, 1))
+{
+}
+
+FetchEngine::~FetchEngine()
+{
+    // Replies in flight are aborted and deleted with the manager, their
+    // callbacks must not run on a half-destroyed engine.
+    for(QNetworkReply* reply: manager.findChildren<QNetworkReply*>())
+    {
+        reply->disconnect();
+        reply->abort();
+    }
+}
+
+/** State of a request in flight */
+struct FetchEngine::Transfer
+{
+    QString        key;
+    QNetworkReply* reply;
+    Request        request;
+    Response       response;
+    qint64         start;
+    // Streamed requests: chunk read from the reply, consumed up to offset
+    QByteArray     chunk;
+    qint64         offset   = 0;
+    qint64         size     = 0;
+    bool           retrying  = false;
+    bool           finished  = false;
+    bool           finishing = false;   // Waiting for the consumer to finish
+    bool           done      = false;
+};
+
+void FetchEngine::EnableCache(QString const& directory, qint64 maxDiskBytes, int maxMemoryBytes)
+{
+    cache = new HttpCache(directory, maxDiskBytes, maxMemoryBytes);
+    manager.setCache(cache);
+}
+
+void FetchEngine::Get(QUrl const& url, Callback done)
+{
+    this->Queue({url, std::move(done), nullptr});
+}
+
+void FetchEngine::Stream(QUrl const& url, std::shared_ptr<BodyConsumer> consumer, Callback done)
+{
+    this->Queue({url, std::move(done), std::move(consumer)});
+}
+
+void FetchEngine::Queue(Request request)
+{
+    if(firstStart == 0)
+        firstStart = Instrument::Now();
+    pending++;
+    // One window per scheme, host and port, as connections are
+    QString key = request.url.adjusted(QUrl::RemovePath | QUrl::RemoveQuery
+                                       | QUrl::RemoveFragment | QUrl::RemoveUserInfo).toString();
+    hosts[key].queue.push_back(std::move(request));
+    this->StartNext(key);
+}
+
+void FetchEngine::StartNext(QString const& key)
+{
+    Host& host = hosts[key];
+    while(host.active < maxPerHost && !host.queue.empty())
+    {
+        Request request = std::move(host.queue.front());
+        host.queue.pop_front();
+        host.active++;
+        this->Start(key, std::move(request));
+    }
+}
+
+void FetchEngine::Start(QString const& key, Request request)
+{
+    QNetworkRequest req(request.url);
+    req.setAttribute(QNetworkRequest::HttpPipeliningAllowedAttribute, pipelining);
+    // Streamed bodies may not fit the cache
+    req.setAttribute(QNetworkRequest::CacheSaveControlAttribute, request.consumer == nullptr);
+    req.setAttribute(QNetworkRequest::RedirectPolicyAttribute,
+                     QNetworkRequest::NoLessSafeRedirectPolicy);
+
+    auto t = std::make_shared<Transfer>();
+    t->key          = key;
+    t->reply        = manager.get(req);
+    t->request      = std::move(request);
+    t->response.url = t->request.url;
+    t->start        = Instrument::Now();
+    QNetworkReply* reply = t->reply;
+    if(t->request.consumer)
+    {
+        // Bounds the data waiting in the reply when the consumer is slow,
+        // the socket is not read meanwhile.
+        reply->setReadBufferSize(readBufferSize);
+        t->chunk.resize(static_cast<int>(readBufferSize));
+    }
+
+    QObject::connect(reply, &QNetworkReply::metaDataChanged, [t]{
+        qint64 length = t->reply->header(QNetworkRequest::ContentLengthHeader).toLongLong();
+        if(t->reply->header(QNetworkRequest::ContentLengthHeader).isNull())
+            length = -1;
+        if(t->request.consumer)
+        {
+            if(!t->request.consumer->Begin(length))
+            {
+                t->response.error = t->request.consumer->Error();
+                t->reply->abort();
+            }
+        }
+        // Preallocates the body once the headers are known
+        else if(length > 0 && length < std::numeric_limits<int>::max())
+            t->response.body.reserve(static_cast<int>(length));
+    });
+    QObject::connect(reply, &QNetworkReply::readyRead, [this, t]{
+        if(t->request.consumer)
+            this->Drain(t);
+        else
+            this->Read(t);
+    });
+    QObject::connect(reply, &QNetworkReply::finished, [this, t]{
+        t->finished = true;
+        // The reply may still hold data the consumer did not take yet
+        if(t->request.consumer && t->response.Ok() && t->reply->error() == QNetworkReply::NoError)
+            this->Drain(t);
+        else
+            this->Complete(t);
+    });
+}
+
+/** Moves the data out of the reply as it arrives */
+void FetchEngine::Read(TransferPtr const& t)
+{
+    QByteArray& body = t->response.body;
+    qint64 available = t->reply->bytesAvailable();
+    qint64 size = body.size() + available;
+    if(size >= std::numeric_limits<int>::max())
+    {
+        t->response.error = "Body too large for a buffer, use Stream()";
+        t->reply->abort();
+        return;
+    }
+    if(size > body.capacity())
+        body.reserve(static_cast<int>(std::max<qint64>(size, 2 * qint64(body.capacity()))));
+    int offset = body.size();
+    body.resize(static_cast<int>(size));
+    qint64 n = t->reply->read(body.data() + offset, available);
+    body.resize(offset + static_cast<int>(std::max<qint64>(n, 0)));
+    t->response.bytes = body.size();
+}
+
+/** Hands the data of the reply to the consumer, chunk by chunk. When the
+ *  consumer takes only part of a chunk, the rest is offered again shortly
+ *  and the reply is not read meanwhile. */
+void FetchEngine::Drain(TransferPtr const& t)
+{
+    // Retry pending: readyRead must not bypass the chunk left over
+    if(t->retrying || t->finishing || t->done)
+        return;
+    BodyConsumer& consumer = *t->request.consumer;
+    for(;;)
+    {
+        if(t->offset == t->size)
+        {
+            qint64 n = t->reply->read(t->chunk.data(), t->chunk.size());
+            if(n <= 0)
+                break;
+            t->offset = 0;
+            t->size   = n;
+        }
+        qint64 used = consumer.Consume(t->chunk.constData() + t->offset, t->size - t->offset);
+        if(used < 0)
+        {
+            t->response.error = consumer.Error();
+            t->reply->abort();
+            return;
+        }
+        t->offset += used;
+        t->response.bytes += used;
+        if(t->offset < t->size)
+        {
+            t->retrying = true;
+            QTimer::singleShot(RetryMs, t->reply, [this, t]{
+                t->retrying = false;
+                this->Drain(t);
+            });
+            return;
+        }
+    }
+    if(t->finished)
+    {
+        // A background consumer may still be parsing, the transfer
+        // completes when it is done instead of waiting for it here
+        t->finishing = true;
+        QPointer<QNetworkReply> reply = t->reply;
+        consumer.FinishAsync([this, t, reply](bool ok){
+            // Deleted with the engine meanwhile
+            if(reply == nullptr)
+                return;
+            if(!ok)
+                t->response.error = t->request.consumer->Error();
+            this->Complete(t);
+        });
+    }
+}
+
+void FetchEngine::Complete(TransferPtr const& t)
+{
+    if(t->done)
+        return;
+    t->done = true;
+    Response& response = t->response;
+    response.latencyNs = Instrument::Now() - t->start;
+    response.status = t->reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    response.fromCache = t->reply->attribute(QNetworkRequest::SourceIsFromCacheAttribute).toBool();
+    if(response.error.isEmpty() && t->reply->error() != QNetworkReply::NoError)
+        response.error = t->reply->errorString();
+    t->reply->deleteLater();
+
+    lastEnd = Instrument::Now();
+    latency.Record(response.latencyNs);
+    bytes += response.bytes;
+    if(response.fromCache)
+        cacheHits++;
+    if(response.Ok())
+        completed++;
+    else
+        failed++;
+    pending--;
+    hosts[t->key].active--;
+    this->StartNext(t->key);
+    t->request.done(response);
+}
+
+void FetchEngine::ResetStats()
+{
+    firstStart = 0;
+    lastEnd    = 0;
+    completed  = 0;
+    failed     = 0;
+    bytes      = 0;
+    cacheHits  = 0;
+    latency.Reset();
+}
+
+void FetchEngine::Report(std::ostream& os) const
+{
+    double seconds = std::max<qint64>(lastEnd - firstStart, 1) / 1e9;
+    os << std::fixed << std::setprecision(1)
+       << " [INFO] " << completed << " requests, " << failed << " failed in "
+       << seconds * 1e3 << " ms" << std::endl
+       << " [INFO] " << (completed + failed) / seconds << " requests/s, "
+       << bytes / seconds / 1e6 << " MB/s" << std::endl
+       << std::setprecision(3)
+       << " [INFO] Latency (ms) p50 = " << latency.Percentile(0.50) / 1e6
+       << "  p90 = " << latency.Percentile(0.90) / 1e6
+       << "  p99 = " << latency.Percentile(0.99) / 1e6
+       << "  max = " << latency.Max() / 1e6 << std::endl;
+    if(cache != nullptr)
+        os << " [INFO] Cache: " << cacheHits << " hits, " << completed + failed - cacheHits
+           << " misses; " << cache->MemoryHits() << " bodies from memory, "
+           << cache->DiskHits() << " from disk, " << cache->Revalidated() << " revalidated, "
+           << cache->cacheSize() / 1024 << " KB on disk" << std::endl;
+}
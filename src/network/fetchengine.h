@@ -0,0 +1,138 @@
+#ifndef FETCHENGINE_H
+#define FETCHENGINE_H
+
+#include <map>
+#include <deque>
+#include <memory>
+#include <iosfwd>
+#include <algorithm>
+#include <functional>
+
+#include <QUrl>
+#include <QString>
+#include <QByteArray>
+#include <QNetworkAccessManager>
+
+#include "../common/instrument.h"
+
+class QNetworkReply;
+class BodyConsumer;
+class HttpCache;
+
+/** Runs many HTTP GET requests concurrently, with a bounded number of
+ *  requests in flight per host.
+ *
+ *  Requests beyond the window wait in a per-host queue, so thousands of
+ *  them can be submitted at once. All requests go through one
+ *  QNetworkAccessManager, which keeps the connections alive and reuses
+ *  them. Bodies are read on readyRead into a buffer preallocated from
+ *  Content-Length, rather than buffered by the reply until the end.
+ *
+ *  Stream() hands the body to a BodyConsumer chunk by chunk instead, for
+ *  bodies too large for memory, see streaming.h.
+ *
+ *  Requests/s, throughput and latency percentiles are collected for
+ *  Report(). Must be used from a single thread, usually the GUI thread.
+ *
+ *  Example:
+ *    FetchEngine engine(16);
+ *    engine.Get(url, [](FetchEngine::Response const& r){ ... });
+ */
+class FetchEngine
+{
+public:
+    struct Response
+    {
+        QUrl       url;
+        int        status    = 0;
+        QString    error;           // Empty on success
+        QByteArray body;            // Empty for streamed requests
+        qint64     bytes     = 0;   // Body size, received or streamed
+        qint64     latencyNs = 0;   // From the start of the request to the end of the body
+        bool       fromCache = false;   // Fresh or revalidated cache entry
+        bool Ok() const { return error.isEmpty(); }
+    };
+
+    using Callback = std::function<void (Response const& response)>;
+
+    /** maxPerHost requests in flight per host. QNetworkAccessManager opens
+     *  at most 6 connections per host for HTTP/1.1, a larger window queues
+     *  the requests on those connections, or pipelines them if enabled. */
+    explicit FetchEngine(int maxPerHost = 6);
+    ~FetchEngine();
+
+    FetchEngine(FetchEngine const&) = delete;
+    FetchEngine& operator=(FetchEngine const&) = delete;
+
+    void SetMaxPerHost(int n) { maxPerHost = std::max(n, 1); }
+    /** Sends up to maxPerHost requests on a connection without waiting for
+     *  the responses. Servers must answer in order; some proxies do not. */
+    void SetPipelining(bool enabled) { pipelining = enabled; }
+
+    /** Queues a request, done is invoked on completion or failure */
+    void Get(QUrl const& url, Callback done);
+
+    /** Queues a request whose body goes to consumer as it arrives */
+    void Stream(QUrl const& url, std::shared_ptr<BodyConsumer> consumer, Callback done);
+
+    /** Size of the chunks handed to consumers, and of the data a reply
+     *  buffers before the transfer waits for a slow consumer */
+    void SetReadBufferSize(qint64 size) { readBufferSize = std::max<qint64>(size, 4096); }
+
+    /** Caches the responses on disk and in memory, see HttpCache. Streamed
+     *  bodies are not cached. */
+    void EnableCache(QString const& directory, qint64 maxDiskBytes, int maxMemoryBytes);
+    HttpCache* Cache() const { return cache; }
+
+    /** Requests not completed yet, queued or in flight */
+    int Pending() const { return pending; }
+
+    QNetworkAccessManager& Manager() { return manager; }
+
+    void ResetStats();
+    /** Requests/s, MB/s, latency percentiles and cache hits since ResetStats() */
+    void Report(std::ostream& os) const;
+
+private:
+    struct Request
+    {
+        QUrl                          url;
+        Callback                      done;
+        std::shared_ptr<BodyConsumer> consumer;
+    };
+
+    struct Transfer;
+    using TransferPtr = std::shared_ptr<Transfer>;
+
+    struct Host
+    {
+        int                 active = 0;
+        std::deque<Request> queue;
+    };
+
+    QNetworkAccessManager      manager;
+    std::map<QString, Host>    hosts;
+    int                        maxPerHost;
+    bool                       pipelining = false;
+    qint64                     readBufferSize = 256 * 1024;
+    HttpCache*                 cache = nullptr;     // Owned by manager
+    int                        pending    = 0;
+
+    // Statistics
+    qint64                     firstStart = 0;
+    qint64                     lastEnd    = 0;
+    qint64                     completed  = 0;
+    qint64                     failed     = 0;
+    qint64                     bytes      = 0;
+    qint64                     cacheHits  = 0;
+    Instrument::Histogram      latency;
+
+    void StartNext(QString const& key);
+    void Start(QString const& key, Request request);
+    void Queue(Request request);
+    void Read(TransferPtr const& t);
+    void Drain(TransferPtr const& t);
+    void Complete(TransferPtr const& t);
+};
+
+#endif // FETCHENGINE_H
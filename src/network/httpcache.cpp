@@ -0,0 +1,79 @@
+#include "httpcache.h"
+
+#include <QBuffer>
+
+//======= HttpCache Implementation ==========//
+
+HttpCache::HttpCache(QString const& directory, qint64 maxDiskBytes, int maxMemoryBytes,
+                     QObject* parent)
+    : QNetworkDiskCache(parent)
+{
+    this->setCacheDirectory(directory);
+    this->setMaximumCacheSize(maxDiskBytes);
+    memory.setMaxCost(maxMemoryBytes);
+}
+
+QNetworkCacheMetaData HttpCache::metaData(QUrl const& url)
+{
+    // Looked up for every request, the disk tier reads the file header
+    if(Entry* e = memory.object(url))
+        return e->meta;
+    return QNetworkDiskCache::metaData(url);
+}
+
+void HttpCache::updateMetaData(QNetworkCacheMetaData const& metaData)
+{
+    // Called with the headers of a 304 response
+    revalidated++;
+    QNetworkDiskCache::updateMetaData(metaData);
+    if(Entry* e = memory.object(metaData.url()))
+        e->meta = metaData;
+}
+
+QIODevice* HttpCache::data(QUrl const& url)
+{
+    if(Entry* e = memory.object(url))
+    {
+        memoryHits++;
+        // Shares the body, the buffer is deleted by the reply
+        auto buffer = new QBuffer;
+        buffer->setData(e->body);
+        buffer->open(QBuffer::ReadOnly);
+        return buffer;
+    }
+    QIODevice* device = QNetworkDiskCache::data(url);
+    if(device == nullptr)
+        return nullptr;
+    diskHits++;
+    // Entries larger than the memory tier stay on disk only
+    if(device->size() > memory.maxCost())
+        return device;
+    auto entry  = new Entry;
+    entry->meta = QNetworkDiskCache::metaData(url);
+    entry->body = device->readAll();
+    delete device;
+    auto buffer = new QBuffer;
+    buffer->setData(entry->body);
+    buffer->open(QBuffer::ReadOnly);
+    memory.insert(url, entry, entry->body.size());
+    return buffer;
+}
+
+bool HttpCache::remove(QUrl const& url)
+{
+    memory.remove(url);
+    return QNetworkDiskCache::remove(url);
+}
+
+QIODevice* HttpCache::prepare(QNetworkCacheMetaData const& metaData)
+{
+    // A new body replaces the entry
+    memory.remove(metaData.url());
+    return QNetworkDiskCache::prepare(metaData);
+}
+
+void HttpCache::clear()
+{
+    memory.clear();
+    QNetworkDiskCache::clear();
+}
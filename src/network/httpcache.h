@@ -0,0 +1,50 @@
+#ifndef HTTPCACHE_H
+#define HTTPCACHE_H
+
+#include <QCache>
+#include <QNetworkDiskCache>
+
+/** HTTP cache of the network client: QNetworkDiskCache, bounded by
+ *  maxDiskBytes, with an in-memory tier of the most recently used entries
+ *  in front of it, bounded by maxMemoryBytes.
+ *
+ *  QNetworkAccessManager does the HTTP side: fresh entries are served
+ *  without a request, stale ones are revalidated with If-None-Match /
+ *  If-Modified-Since and served from the cache on 304 Not Modified.
+ *
+ *  Example:
+ *    manager.setCache(new HttpCache(dir, 50 << 20, 8 << 20));  // Owned by manager
+ */
+class HttpCache: public QNetworkDiskCache
+{
+public:
+    HttpCache(QString const& directory, qint64 maxDiskBytes, int maxMemoryBytes,
+              QObject* parent = nullptr);
+
+    QNetworkCacheMetaData metaData(QUrl const& url) override;
+    void                  updateMetaData(QNetworkCacheMetaData const& metaData) override;
+    QIODevice*            data(QUrl const& url) override;
+    bool                  remove(QUrl const& url) override;
+    QIODevice*            prepare(QNetworkCacheMetaData const& metaData) override;
+    void                  clear() override;
+
+    /** Bodies served from memory, from disk, and entries revalidated (304) */
+    qint64 MemoryHits()  const { return memoryHits; }
+    qint64 DiskHits()    const { return diskHits; }
+    qint64 Revalidated() const { return revalidated; }
+
+private:
+    struct Entry
+    {
+        QNetworkCacheMetaData meta;
+        QByteArray            body;
+    };
+
+    // Cost in bytes of body
+    QCache<QUrl, Entry> memory;
+    qint64              memoryHits  = 0;
+    qint64              diskHits    = 0;
+    qint64              revalidated = 0;
+};
+
+#endif // HTTPCACHE_H
@@ -0,0 +1,252 @@
+#include "localserver.h"
+
+#include <memory>
+#include <algorithm>
+#include <cstdio>
+
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QHostAddress>
+#include <QDateTime>
+#include <QLocale>
+
+namespace {
+
+// Request headers larger than this close the connection
+constexpr int    MaxHeaderSize = 64 * 1024;
+// Payload queued in the socket before waiting for bytesWritten()
+constexpr qint64 WriteBuffer   = 1 << 20;
+
+/** Printable bytes repeated for /bytes/<n>, lines of 64 characters */
+QByteArray const& Payload()
+{
+    static const QByteArray payload = []{
+        QByteArray bytes(64 * 1024, Qt::Uninitialized);
+        for(int i = 0; i < bytes.size(); i++)
+            bytes[i] = (i % 64 == 63) ? '\n' : static_cast<char>('a' + i % 26);
+        return bytes;
+    }();
+    return payload;
+}
+
+// Rows of /chain/<n> have a fixed width so that Content-Length is known
+constexpr int ChainRowSize = 31;
+const QByteArray ChainHeader = "S,K,T,sigma,r\n";
+
+/** Row i of the generated chain: strikes 50 to 149 for eight expiries */
+void AppendChainRow(QByteArray& out, qint64 i)
+{
+    char row[ChainRowSize + 1];
+    std::snprintf(row, sizeof(row), "%6.2f,%6.2f,%5.3f,%5.2f,%4.2f\n",
+                  100.0, 50.0 + static_cast<double>(i % 100),
+                  0.25 * static_cast<double>(1 + (i / 100) % 8),
+                  20.0 + static_cast<double>(i % 7), 5.0);
+    out.append(row, ChainRowSize);
+}
+
+} // --- End of namespace --- //
+
+struct LocalServer::Connection
+{
+    QByteArray input;           // Received and not processed yet
+    qint64     remaining = 0;   // Payload of the current response left to write
+    qint64     chainRows = -1;  // Rows of a /chain/<n> body, -1 for /bytes/<n>
+    bool       close     = false;
+};
+
+//======= LocalServer Implementation ==========//
+
+LocalServer::LocalServer()
+{
+    // The content never changes, it was last modified when the server started
+    lastModified = QLocale::c().toString(QDateTime::currentDateTimeUtc(),
+                                         "ddd, dd MMM yyyy hh:mm:ss 'GMT'").toLatin1();
+    server = new QTcpServer;
+    server->moveToThread(&thread);
+    QObject::connect(&thread, &QThread::finished, server, &QObject::deleteLater);
+    QObject::connect(server, &QTcpServer::newConnection, server, [this]{
+        this->OnConnection();
+    });
+    thread.setObjectName("LocalServer");
+    thread.start();
+}
+
+LocalServer::~LocalServer()
+{
+    thread.quit();
+    thread.wait();
+}
+
+bool LocalServer::Listen(quint16 port, QString* error)
+{
+    bool ok = false;
+    QMetaObject::invokeMethod(server, [&]{
+        ok = server->listen(QHostAddress::LocalHost, port);
+        if(ok)
+            this->port = server->serverPort();
+        else if(error)
+            *error = server->errorString();
+    }, Qt::BlockingQueuedConnection);
+    return ok;
+}
+
+QUrl LocalServer::Url(QString const& path) const
+{
+    return QUrl(QString("http://127.0.0.1:%1%2").arg(port).arg(path));
+}
+
+void LocalServer::OnConnection()
+{
+    while(QTcpSocket* socket = server->nextPendingConnection())
+    {
+        connections++;
+        socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+        auto conn = std::make_shared<Connection>();
+        QObject::connect(socket, &QTcpSocket::readyRead, socket, [this, socket, conn]{
+            conn->input += socket->readAll();
+            this->Process(socket, *conn);
+        });
+        // Continues a large body, then the requests pipelined behind it
+        QObject::connect(socket, &QTcpSocket::bytesWritten, socket, [this, socket, conn]{
+            this->Pump(socket, *conn);
+            this->Process(socket, *conn);
+        });
+        QObject::connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+    }
+}
+
+void LocalServer::Process(QTcpSocket* socket, Connection& conn)
+{
+    // Responses are sent in the order of the requests
+    while(conn.remaining == 0 && !conn.close)
+    {
+        int end = conn.input.indexOf("\r\n\r\n");
+        if(end < 0)
+        {
+            if(conn.input.size() > MaxHeaderSize)
+                socket->abort();
+            return;
+        }
+        QList<QByteArray> lines = conn.input.left(end).split('\n');
+        conn.input.remove(0, end + 4);
+        requests++;
+
+        QList<QByteArray> request = lines[0].trimmed().split(' ');
+        QByteArray method = request.value(0);
+        QByteArray path   = request.value(1);
+        bool keepAlive = request.value(2) != "HTTP/1.0";
+        QByteArray ifNoneMatch, ifModifiedSince;
+        for(QByteArray const& line: lines)
+        {
+            int colon = line.indexOf(':');
+            QByteArray name  = line.left(colon).trimmed().toLower();
+            QByteArray value = line.mid(colon + 1).trimmed();
+            if(name == "connection")
+                keepAlive = value.toLower() != "close";
+            else if(name == "if-none-match")
+                ifNoneMatch = value;
+            else if(name == "if-modified-since")
+                ifModifiedSince = value;
+        }
+        // Payloads and chains: same path, same content
+        QByteArray etag = '"' + QByteArray::number(qHash(path), 16) + '"';
+        QByteArray modified = lastModified;
+
+        QByteArray status = "200 OK";
+        QByteArray type   = "application/json";
+        QByteArray body;
+        qint64     length = -1;
+        conn.chainRows = -1;
+        if(method != "GET")
+        {
+            status = "405 Method Not Allowed";
+        }
+        else if(path.startsWith("/bytes/"))
+        {
+            bool ok;
+            length = path.mid(7).toLongLong(&ok);
+            if(!ok || length < 0)
+            {
+                status = "400 Bad Request";
+                length = -1;
+            }
+            type = "application/octet-stream";
+        }
+        else if(path.startsWith("/chain/"))
+        {
+            bool ok;
+            qint64 rows = path.mid(7).toLongLong(&ok);
+            if(ok && rows >= 0)
+            {
+                type   = "text/csv";
+                body   = ChainHeader;
+                length = body.size() + rows * ChainRowSize;
+                conn.chainRows = rows;
+            }
+            else
+                status = "400 Bad Request";
+        }
+        else
+        {
+            body = "{\"path\": \"" + path + "\", \"request\": "
+                 + QByteArray::number(requests.load()) + "}\n";
+            // Changes on every request, validated by its content only
+            etag = '"' + QByteArray::number(qHash(body), 16) + '"';
+            modified.clear();
+        }
+        if(status == "200 OK"
+                && ((!ifNoneMatch.isEmpty() && ifNoneMatch.contains(etag))
+                    || (ifNoneMatch.isEmpty() && !modified.isEmpty()
+                        && ifModifiedSince == modified)))
+        {
+            status = "304 Not Modified";
+            body.clear();
+            length = 0;
+            conn.chainRows = -1;
+            notModified++;
+        }
+        if(length < 0)
+            length = body.size();
+
+        socket->write("HTTP/1.1 " + status + "\r\n"
+                      "Content-Type: " + type + "\r\n"
+                      "Content-Length: " + QByteArray::number(length) + "\r\n"
+                      "ETag: " + etag + "\r\n"
+                      + (modified.isEmpty() ? QByteArray()
+                                            : "Last-Modified: " + modified + "\r\n") +
+                      "Cache-Control: max-age=" + QByteArray::number(maxAge.load()) + "\r\n"
+                      "Connection: " + (keepAlive ? "keep-alive" : "close") + "\r\n"
+                      "\r\n");
+        socket->write(body);
+        conn.remaining = length - body.size();
+        conn.close = !keepAlive;
+        this->Pump(socket, conn);
+    }
+    if(conn.close && conn.remaining == 0)
+        socket->disconnectFromHost();
+}
+
+void LocalServer::Pump(QTcpSocket* socket, Connection& conn)
+{
+    QByteArray const& payload = Payload();
+    QByteArray rows;
+    while(conn.remaining > 0 && socket->bytesToWrite() < WriteBuffer)
+    {
+        if(conn.chainRows < 0)
+        {
+            qint64 n = std::min<qint64>(conn.remaining, payload.size());
+            socket->write(payload.constData(), n);
+            conn.remaining -= n;
+            continue;
+        }
+        // Generated as written, 64 KB at a time
+        qint64 left  = conn.remaining / ChainRowSize;
+        qint64 first = conn.chainRows - left;
+        qint64 n     = std::min<qint64>(left, payload.size() / ChainRowSize);
+        rows.clear();
+        for(qint64 i = first; i < first + n; i++)
+            AppendChainRow(rows, i);
+        socket->write(rows);
+        conn.remaining -= rows.size();
+    }
+}
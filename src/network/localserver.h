@@ -0,0 +1,72 @@
+#ifndef LOCALSERVER_H
+#define LOCALSERVER_H
+
+#include <atomic>
+
+#include <QUrl>
+#include <QThread>
+
+class QTcpServer;
+class QTcpSocket;
+
+/** Stand-in HTTP/1.1 server on the loopback interface, to benchmark and
+ *  test the network client without depending on a remote host. It is
+ *  served by a dedicated thread so that it does not compete with the
+ *  client for the GUI event loop.
+ *
+ *  Connections are kept alive and pipelined requests are answered in
+ *  order. Only GET is supported:
+ *
+ *    GET /bytes/<n>    n bytes of payload
+ *    GET /chain/<n>    CSV option chain of n rows: S,K,T,sigma,r
+ *    GET <other>       a small JSON document
+ *
+ *  Responses carry an ETag and a Last-Modified date and are cacheable for
+ *  MaxAge() seconds, 0 requires a revalidation on each use. A request with
+ *  a matching If-None-Match or If-Modified-Since gets 304 Not Modified.
+ *  The JSON document changes on every request, its ETag is a hash of the
+ *  body and it has no Last-Modified date, so it is never revalidated.
+ *
+ *  Large bodies are written as the socket drains, so the server memory
+ *  does not depend on the response size.
+ */
+class LocalServer
+{
+public:
+    LocalServer();
+    ~LocalServer();
+
+    LocalServer(LocalServer const&) = delete;
+    LocalServer& operator=(LocalServer const&) = delete;
+
+    /** Listens on 127.0.0.1, port 0 picks a free port */
+    bool Listen(quint16 port = 0, QString* error = nullptr);
+
+    QUrl Url(QString const& path) const;
+
+    void SetMaxAge(int seconds) { maxAge = seconds; }
+    int  MaxAge() const { return maxAge.load(); }
+
+    /** Connections accepted and requests served since Listen() */
+    qint64 Connections() const { return connections.load(); }
+    qint64 Requests()    const { return requests.load(); }
+    qint64 NotModified() const { return notModified.load(); }
+
+private:
+    struct Connection;
+
+    QThread             thread;
+    QTcpServer*         server;
+    quint16             port = 0;
+    std::atomic<qint64> connections{0};
+    std::atomic<qint64> requests{0};
+    std::atomic<qint64> notModified{0};
+    std::atomic<int>    maxAge{0};
+    QByteArray          lastModified;
+
+    void OnConnection();
+    void Process(QTcpSocket* socket, Connection& conn);
+    void Pump(QTcpSocket* socket, Connection& conn);
+};
+
+#endif // LOCALSERVER_H
@@ -0,0 +1,257 @@
+#include "streaming.h"
+
+#include <cstring>
+
+#include <QJsonDocument>
+#include <QJsonParseError>
+
+//======= FileConsumer Implementation ==========//
+
+bool FileConsumer::Begin(qint64)
+{
+    if(file.open(QFile::WriteOnly))
+        return true;
+    error = file.errorString();
+    return false;
+}
+
+qint64 FileConsumer::Consume(const char* data, qint64 size)
+{
+    qint64 n = file.write(data, size);
+    if(n < 0)
+        error = file.errorString();
+    return n;
+}
+
+bool FileConsumer::Finish()
+{
+    if(file.commit())
+        return true;
+    error = file.errorString();
+    return false;
+}
+
+//======= LineConsumer Implementation ==========//
+
+LineConsumer::LineConsumer(LineHandler onLine, int maxLineLength)
+    : onLine(std::move(onLine)), maxLineLength(maxLineLength)
+{
+}
+
+bool LineConsumer::Line(const char* data, int size)
+{
+    if(size > 0 && data[size - 1] == '\r')
+        size--;
+    lines++;
+    if(onLine(data, size))
+        return true;
+    if(error.isEmpty())
+        error = QString("Stopped at line %1").arg(lines);
+    return false;
+}
+
+qint64 LineConsumer::Consume(const char* data, qint64 size)
+{
+    const char* end = data + size;
+    const char* p   = data;
+    // Completes the line started in the previous chunk
+    if(!partial.isEmpty())
+    {
+        auto eol = static_cast<const char*>(std::memchr(p, '\n', static_cast<size_t>(end - p)));
+        const char* stop = eol ? eol : end;
+        if(partial.size() + (stop - p) > maxLineLength)
+        {
+            error = QString("Line %1 longer than %2 bytes").arg(lines + 1).arg(maxLineLength);
+            return -1;
+        }
+        partial.append(p, static_cast<int>(stop - p));
+        if(eol == nullptr)
+            return size;
+        bool ok = this->Line(partial.constData(), partial.size());
+        partial.clear();
+        if(!ok)
+            return -1;
+        p = eol + 1;
+    }
+    // Lines entirely in this chunk are not copied
+    while(p < end)
+    {
+        auto eol = static_cast<const char*>(std::memchr(p, '\n', static_cast<size_t>(end - p)));
+        if(eol == nullptr)
+            break;
+        if(!this->Line(p, static_cast<int>(eol - p)))
+            return -1;
+        p = eol + 1;
+    }
+    if(end - p > maxLineLength)
+    {
+        error = QString("Line %1 longer than %2 bytes").arg(lines + 1).arg(maxLineLength);
+        return -1;
+    }
+    partial.append(p, static_cast<int>(end - p));
+    return size;
+}
+
+bool LineConsumer::Finish()
+{
+    if(partial.isEmpty())
+        return true;
+    bool ok = this->Line(partial.constData(), partial.size());
+    partial.clear();
+    return ok;
+}
+
+//======= CsvConsumer Implementation ==========//
+
+CsvConsumer::CsvConsumer(RecordHandler onRecord, char separator)
+    : LineConsumer([this, onRecord, separator](const char* line, int size){
+          fields.clear();
+          const char* end = line + size;
+          for(const char* p = line; ; )
+          {
+              auto sep = static_cast<const char*>(std::memchr(p, separator,
+                                                              static_cast<size_t>(end - p)));
+              const char* stop = sep ? sep : end;
+              fields.emplace_back(p, static_cast<int>(stop - p));
+              if(sep == nullptr)
+                  break;
+              p = sep + 1;
+          }
+          return onRecord(fields);
+      })
+{
+}
+
+//======= JsonLinesConsumer Implementation ==========//
+
+JsonLinesConsumer::JsonLinesConsumer(ObjectHandler onObject)
+    : LineConsumer([this, onObject](const char* line, int size){
+          if(QByteArray::fromRawData(line, size).trimmed().isEmpty())
+              return true;
+          QJsonParseError parseError;
+          // fromRawData does not copy the line, fromJson copies it once
+          QJsonDocument doc = QJsonDocument::fromJson(QByteArray::fromRawData(line, size),
+                                                      &parseError);
+          if(!doc.isObject())
+          {
+              error = QString("Line %1: %2").arg(this->Lines())
+                      .arg(doc.isNull() ? parseError.errorString() : QString("not an object"));
+              return false;
+          }
+          return onObject(doc.object());
+      })
+{
+}
+
+//======= BackgroundConsumer Implementation ==========//
+
+BackgroundConsumer::BackgroundConsumer(std::shared_ptr<BodyConsumer> consumer, qint64 maxQueued)
+    : consumer(std::move(consumer)), maxQueued(maxQueued)
+{
+    worker = std::thread([this]{ this->Run(); });
+}
+
+BackgroundConsumer::~BackgroundConsumer()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closing = true;
+        queue.clear();
+    }
+    wakeup.notify_all();
+    if(worker.joinable())
+        worker.join();
+}
+
+bool BackgroundConsumer::Begin(qint64 length)
+{
+    if(consumer->Begin(length))
+        return true;
+    error = consumer->Error();
+    return false;
+}
+
+qint64 BackgroundConsumer::Consume(const char* data, qint64 size)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if(failed)
+        return -1;
+    // Accepts a chunk larger than the limit when the queue is empty, the
+    // reply may hand over more than maxQueued at once.
+    if(queued > 0 && queued + size > maxQueued)
+        return 0;
+    queue.emplace_back(data, static_cast<int>(size));
+    queued += size;
+    wakeup.notify_one();
+    return size;
+}
+
+void BackgroundConsumer::FinishAsync(std::function<void (bool ok)> done)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        finished = std::move(done);
+        closing  = true;
+    }
+    wakeup.notify_all();
+}
+
+bool BackgroundConsumer::Finish()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closing = true;
+    }
+    wakeup.notify_all();
+    worker.join();
+    if(!failed && consumer->Finish())
+        return true;
+    error = consumer->Error();
+    return false;
+}
+
+void BackgroundConsumer::Run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    for(;;)
+    {
+        wakeup.wait(lock, [this]{ return closing || !queue.empty(); });
+        if(queue.empty())
+            break;
+        QByteArray chunk = std::move(queue.front());
+        queue.pop_front();
+        lock.unlock();
+        // Consumers running on the worker thread are synchronous, they
+        // consume everything they are given or fail.
+        qint64 done = 0;
+        while(done < chunk.size())
+        {
+            qint64 n = consumer->Consume(chunk.constData() + done, chunk.size() - done);
+            if(n <= 0)
+                break;
+            done += n;
+        }
+        lock.lock();
+        queued -= chunk.size();
+        if(done < chunk.size())
+        {
+            // Consume() refuses the data from now on, the transfer aborts
+            failed = true;
+            error  = consumer->Error();
+            queue.clear();
+        }
+    }
+    // Finish() joins the worker, the destructor drops the result
+    if(!finished)
+        return;
+    auto done = std::move(finished);
+    bool ok = !failed;
+    lock.unlock();
+    // The end of the body is parsed here as well
+    if(ok && !consumer->Finish())
+    {
+        ok    = false;
+        error = consumer->Error();
+    }
+    QMetaObject::invokeMethod(&relay, [done, ok]{ done(ok); }, Qt::QueuedConnection);
+}
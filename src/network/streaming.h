@@ -0,0 +1,146 @@
+#ifndef STREAMING_H
+#define STREAMING_H
+
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <memory>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+#include <QObject>
+#include <QSaveFile>
+#include <QString>
+#include <QByteArray>
+#include <QJsonObject>
+#include <QLatin1String>
+
+/** Receives a response body chunk by chunk, see FetchEngine::Stream().
+ *
+ *  The data passed to Consume() is only valid during the call. Consuming
+ *  less than offered applies back-pressure: the engine stops reading the
+ *  reply, whose buffer is bounded, so the network transfer pauses until
+ *  the consumer catches up, and the rest of the chunk is offered again.
+ */
+class BodyConsumer
+{
+public:
+    virtual ~BodyConsumer() = default;
+
+    /** Headers received, length is -1 if unknown. False aborts. */
+    virtual bool   Begin(qint64 length) { (void) length; return true; }
+    /** Returns the number of bytes consumed, -1 aborts */
+    virtual qint64 Consume(const char* data, qint64 size) = 0;
+    /** End of the body, not called when the transfer failed. False fails it. */
+    virtual bool   Finish() { return true; }
+    /** Same as Finish(), used by FetchEngine: done(ok) may be called later,
+     *  on the thread that created the consumer. */
+    virtual void   FinishAsync(std::function<void (bool ok)> done) { done(this->Finish()); }
+
+    /** Reason of an abort or a failed Finish() */
+    QString Error() const { return error; }
+
+protected:
+    QString error;
+};
+
+/** Writes the body to a file as it arrives. The file is only replaced
+ *  once the whole body was received. */
+class FileConsumer: public BodyConsumer
+{
+public:
+    explicit FileConsumer(QString const& path): file(path) { }
+
+    bool   Begin(qint64 length) override;
+    qint64 Consume(const char* data, qint64 size) override;
+    bool   Finish() override;
+
+private:
+    QSaveFile file;
+};
+
+/** Splits the body into lines, without the line terminator ("\n" or
+ *  "\r\n"). Each line is handed as a view into the received data; only a
+ *  line split across two chunks is copied. The last line does not need a
+ *  terminator. */
+class LineConsumer: public BodyConsumer
+{
+public:
+    /** Returning false aborts the transfer */
+    using LineHandler = std::function<bool (const char* line, int size)>;
+
+    explicit LineConsumer(LineHandler onLine, int maxLineLength = 1 << 20);
+
+    qint64 Consume(const char* data, qint64 size) override;
+    bool   Finish() override;
+
+    qint64 Lines() const { return lines; }
+
+private:
+    LineHandler onLine;
+    int         maxLineLength;
+    QByteArray  partial;        // Start of a line continued in the next chunk
+    qint64      lines = 0;
+
+    bool Line(const char* data, int size);
+};
+
+/** Comma separated values, one record per line. Fields are views into the
+ *  line, quotes are not interpreted. */
+class CsvConsumer: public LineConsumer
+{
+public:
+    using RecordHandler = std::function<bool (std::vector<QLatin1String> const& fields)>;
+
+    explicit CsvConsumer(RecordHandler onRecord, char separator = ',');
+
+private:
+    std::vector<QLatin1String> fields;
+};
+
+/** One JSON object per line (JSON Lines), blank lines are skipped */
+class JsonLinesConsumer: public LineConsumer
+{
+public:
+    using ObjectHandler = std::function<bool (QJsonObject const& object)>;
+
+    explicit JsonLinesConsumer(ObjectHandler onObject);
+};
+
+/** Runs another consumer on a worker thread, so that a slow parser does
+ *  not block the thread of the network transfer. At most maxQueued bytes
+ *  wait for the worker; beyond that Consume() returns 0, which throttles
+ *  the transfer. Finish() blocks until the worker consumed everything,
+ *  FinishAsync() returns at once and the worker posts the result to the
+ *  thread that created the consumer once it is done. */
+class BackgroundConsumer: public BodyConsumer
+{
+public:
+    BackgroundConsumer(std::shared_ptr<BodyConsumer> consumer, qint64 maxQueued = 8 << 20);
+    ~BackgroundConsumer() override;
+
+    bool   Begin(qint64 length) override;
+    qint64 Consume(const char* data, qint64 size) override;
+    bool   Finish() override;
+    void   FinishAsync(std::function<void (bool ok)> done) override;
+
+private:
+    std::shared_ptr<BodyConsumer> consumer;
+    qint64                        maxQueued;
+    std::mutex                    mutex;
+    std::condition_variable       wakeup;
+    std::deque<QByteArray>        queue;
+    qint64                        queued  = 0;
+    bool                          closing = false;
+    bool                          failed  = false;
+    std::function<void (bool ok)> finished;
+    // Lives in the thread of the transfer, the worker posts the result of
+    // FinishAsync() to it, it outlives the worker
+    QObject                       relay;
+    std::thread                   worker;
+
+    void Run();
+};
+
+#endif // STREAMING_H
@@ -0,0 +1,357 @@
+#include "scene.h"
+
+#include <cmath>
+#include <algorithm>
+#include <initializer_list>
+
+#include <QPainter>
+#include <QFontMetricsF>
+
+#include "../common/instrument.h"
+
+//======= Scene Implementation ==========//
+
+Scene::Layer& Scene::AddLayer(bool cached)
+{
+    layers.push_back(std::unique_ptr<Layer>(new Layer(cached)));
+    return *layers.back();
+}
+
+void Scene::SetViewport(QSize const& size, qreal pixelRatio)
+{
+    if(size == viewport && pixelRatio == this->pixelRatio)
+        return;
+    viewport         = size;
+    this->pixelRatio = pixelRatio;
+    this->Invalidate();
+}
+
+void Scene::SetTransform(QTransform const& transform)
+{
+    if(transform == this->transform)
+        return;
+    this->transform = transform;
+    this->Invalidate();
+}
+
+void Scene::SetCaching(bool enabled)
+{
+    caching = enabled;
+    this->Invalidate();
+}
+
+void Scene::Invalidate()
+{
+    // Everything moves, the layers are not compared with their old bounds
+    for(auto& layer: layers)
+    {
+        layer->stale   = true;
+        layer->changed = false;
+        layer->painted = layer->visible ? this->DeviceRect(*layer) : QRect();
+        if(!caching)
+            layer->cache = QImage();
+    }
+    if(onUpdate && !viewport.isEmpty())
+        onUpdate(QRect(QPoint(0, 0), viewport));
+}
+
+void Scene::Update()
+{
+    for(auto& layer: layers)
+    {
+        if(!layer->changed)
+            continue;
+        layer->changed = false;
+        QRect now = layer->visible ? this->DeviceRect(*layer) : QRect();
+        // Reported separately, the widget merges them into a region
+        if(onUpdate && !layer->painted.isEmpty())
+            onUpdate(layer->painted);
+        if(onUpdate && !now.isEmpty() && now != layer->painted)
+            onUpdate(now);
+        layer->painted = now;
+    }
+}
+
+void Scene::Paint(QPainter& painter, QRect const& exposed)
+{
+    for(auto& layer: layers)
+    {
+        if(!layer->visible || layer->Empty())
+            continue;
+        QRect area = this->DeviceRect(*layer) & exposed;
+        if(area.isEmpty())
+            continue;
+        if(layer->cached && caching)
+        {
+            if(layer->stale)
+                this->Render(*layer);
+            area &= layer->cacheRect;
+            if(area.isEmpty())
+                continue;
+            // Source in image pixels
+            QRectF source(QPointF(area.topLeft() - layer->cacheRect.topLeft()) * pixelRatio,
+                          QSizeF(area.size()) * pixelRatio);
+            painter.drawImage(QRectF(area), layer->cache, source);
+        }
+        else
+        {
+            painter.save();
+            painter.setClipRect(area);
+            this->Draw(painter, *layer, QRectF(area));
+            painter.restore();
+        }
+    }
+}
+
+size_t Scene::Primitives() const
+{
+    size_t n = 0;
+    for(auto const& layer: layers)
+        n += layer->Primitives();
+    return n;
+}
+
+qreal Scene::Padding(Layer const& layer) const
+{
+    // Pens are scaled by the transform, text is not
+    qreal scale = std::max(std::hypot(transform.m11(), transform.m12()),
+                           std::hypot(transform.m21(), transform.m22()));
+    return layer.margin * scale + 2.0;
+}
+
+QRect Scene::DeviceRect(Layer const& layer) const
+{
+    if(layer.extent.Empty())
+        return QRect();
+    qreal pad = this->Padding(layer);
+    QRectF r  = transform.mapRect(layer.extent.Rect());
+    return r.adjusted(-pad - layer.textSize.width(), -pad - layer.textSize.height(),
+                      pad + layer.textSize.width(), pad + layer.textSize.height())
+            .toAlignedRect();
+}
+
+void Scene::Render(Layer& layer)
+{
+    INSTRUMENT_SCOPE("Scene::Render");
+    layer.stale     = false;
+    layer.cacheRect = this->DeviceRect(layer) & QRect(QPoint(0, 0), viewport);
+    if(layer.cacheRect.isEmpty())
+    {
+        layer.cache = QImage();
+        return;
+    }
+    QSize pixels = (QSizeF(layer.cacheRect.size()) * pixelRatio).toSize();
+    if(layer.cache.size() != pixels)
+        layer.cache = QImage(pixels, QImage::Format_ARGB32_Premultiplied);
+    layer.cache.setDevicePixelRatio(pixelRatio);
+    layer.cache.fill(Qt::transparent);
+    QPainter painter(&layer.cache);
+    painter.translate(-layer.cacheRect.topLeft());
+    this->Draw(painter, layer, QRectF(layer.cacheRect));
+}
+
+void Scene::Draw(QPainter& painter, Layer const& layer, QRectF const& visible) const
+{
+    painter.setRenderHint(QPainter::Antialiasing, layer.antialiasing);
+    QTransform base  = painter.transform();
+    QTransform world = transform * base;
+    qreal pad = this->Padding(layer);
+    for(Layer::Batch const& batch: layer.batches)
+    {
+        Layer::Style const& style = layer.styles[static_cast<size_t>(batch.style)];
+        painter.setPen(style.pen);
+        painter.setBrush(style.brush);
+        if(batch.kind == Layer::Kind::Texts)
+        {
+            painter.setTransform(base);
+            painter.setFont(style.font);
+            // QStaticText is positioned by its top left corner, not the baseline
+            qreal ascent = QFontMetricsF(style.font).ascent();
+            for(int i = batch.first; i < batch.first + batch.count; i++)
+                painter.drawStaticText(transform.map(layer.textPositions[static_cast<size_t>(i)])
+                                       - QPointF(0, ascent),
+                                       layer.texts[static_cast<size_t>(i)]);
+            continue;
+        }
+        QRectF bounds = transform.mapRect(batch.bounds.Rect()).adjusted(-pad, -pad, pad, pad);
+        if(!bounds.intersects(visible))
+            continue;
+        painter.setTransform(world);
+        switch(batch.kind)
+        {
+        case Layer::Kind::Lines:
+            painter.drawLines(&layer.lines[static_cast<size_t>(batch.first)], batch.count);
+            break;
+        case Layer::Kind::Rects:
+            painter.drawRects(&layer.rects[static_cast<size_t>(batch.first)], batch.count);
+            break;
+        case Layer::Kind::Polylines:
+            for(int i = batch.first; i < batch.first + batch.count; i++)
+            {
+                auto const& polyline = layer.polylines[static_cast<size_t>(i)];
+                painter.drawPolyline(&layer.points[static_cast<size_t>(polyline.first)],
+                                     polyline.second);
+            }
+            break;
+        case Layer::Kind::Texts:
+            break;
+        }
+    }
+    painter.setTransform(base);
+}
+
+//======= Scene::Layer Implementation ==========//
+
+void Scene::Layer::Extent::Add(qreal x, qreal y)
+{
+    x0 = std::min(x0, x);
+    y0 = std::min(y0, y);
+    x1 = std::max(x1, x);
+    y1 = std::max(y1, y);
+}
+
+void Scene::Layer::SetPen(QPen const& pen)
+{
+    style.pen = pen;
+    styleUsed = false;
+}
+
+void Scene::Layer::SetBrush(QBrush const& brush)
+{
+    style.brush = brush;
+    styleUsed   = false;
+}
+
+void Scene::Layer::SetFont(QFont const& font)
+{
+    style.font = font;
+    styleUsed  = false;
+}
+
+void Scene::Layer::SetAntialiasing(bool enabled)
+{
+    antialiasing = enabled;
+    this->Changed();
+}
+
+void Scene::Layer::SetVisible(bool visible)
+{
+    this->visible = visible;
+    changed       = true;
+}
+
+void Scene::Layer::Reserve(size_t lines, size_t points)
+{
+    this->lines.reserve(lines);
+    this->points.reserve(points);
+}
+
+void Scene::Layer::AddLine(QLineF const& line)
+{
+    lines.push_back(line);
+    Batch& batch = this->Append(Kind::Lines, static_cast<int>(lines.size()) - 1);
+    for(QPointF const& p: {line.p1(), line.p2()})
+    {
+        batch.bounds.Add(p.x(), p.y());
+        extent.Add(p.x(), p.y());
+    }
+}
+
+void Scene::Layer::AddLines(QLineF const* lines, size_t count)
+{
+    if(count == 0)
+        return;
+    this->lines.insert(this->lines.end(), lines, lines + count);
+    Batch& batch = this->Append(Kind::Lines, static_cast<int>(this->lines.size() - count));
+    batch.count += static_cast<int>(count) - 1;
+    for(size_t i = 0; i < count; i++)
+        for(QPointF const& p: {lines[i].p1(), lines[i].p2()})
+        {
+            batch.bounds.Add(p.x(), p.y());
+            extent.Add(p.x(), p.y());
+        }
+}
+
+void Scene::Layer::AddRect(QRectF const& rect)
+{
+    rects.push_back(rect);
+    Batch& batch = this->Append(Kind::Rects, static_cast<int>(rects.size()) - 1);
+    for(QPointF const& p: {rect.topLeft(), rect.bottomRight()})
+    {
+        batch.bounds.Add(p.x(), p.y());
+        extent.Add(p.x(), p.y());
+    }
+}
+
+void Scene::Layer::AddPolyline(QPointF const* points, int count)
+{
+    if(count < 2)
+        return;
+    polylines.emplace_back(static_cast<int>(this->points.size()), count);
+    this->points.insert(this->points.end(), points, points + count);
+    Batch& batch = this->Append(Kind::Polylines, static_cast<int>(polylines.size()) - 1);
+    for(int i = 0; i < count; i++)
+    {
+        batch.bounds.Add(points[i].x(), points[i].y());
+        extent.Add(points[i].x(), points[i].y());
+    }
+}
+
+void Scene::Layer::AddText(QPointF const& position, QString const& text)
+{
+    QStaticText staticText(text);
+    staticText.setTextFormat(Qt::PlainText);
+    // Laid out once, here
+    staticText.prepare(QTransform(), style.font);
+    texts.push_back(staticText);
+    textPositions.push_back(position);
+    QSizeF size = QFontMetricsF(style.font).boundingRect(text).size();
+    textSize = textSize.expandedTo(size);
+    Batch& batch = this->Append(Kind::Texts, static_cast<int>(texts.size()) - 1);
+    batch.bounds.Add(position.x(), position.y());
+    extent.Add(position.x(), position.y());
+}
+
+void Scene::Layer::Clear()
+{
+    styles.clear();
+    batches.clear();
+    lines.clear();
+    rects.clear();
+    points.clear();
+    polylines.clear();
+    texts.clear();
+    textPositions.clear();
+    styleUsed = false;
+    extent    = Extent();
+    margin    = 1.0;
+    textSize  = QSizeF();
+    this->Changed();
+}
+
+size_t Scene::Layer::Primitives() const
+{
+    return lines.size() + rects.size() + polylines.size() + texts.size();
+}
+
+Scene::Layer::Batch& Scene::Layer::Append(Kind kind, int index)
+{
+    this->Changed();
+    if(!styleUsed)
+    {
+        styles.push_back(style);
+        styleUsed = true;
+        margin = std::max(margin, style.pen.widthF() / 2.0);
+    }
+    int current = static_cast<int>(styles.size()) - 1;
+    if(batches.empty() || batches.back().kind != kind || batches.back().style != current)
+        batches.push_back(Batch{kind, current, index, 0, Extent()});
+    batches.back().count++;
+    return batches.back();
+}
+
+void Scene::Layer::Changed()
+{
+    changed = true;
+    stale   = true;
+}
@@ -0,0 +1,188 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <memory>
+#include <vector>
+#include <limits>
+#include <utility>
+#include <functional>
+
+#include <QPen>
+#include <QBrush>
+#include <QFont>
+#include <QImage>
+#include <QLineF>
+#include <QRectF>
+#include <QString>
+#include <QStaticText>
+#include <QTransform>
+
+class QPainter;
+
+/** Retained-mode drawing for widgets with many primitives.
+ *
+ *  Primitives are stored by the layers of the scene in contiguous arrays,
+ *  in world coordinates, and drawn in batches sharing a style with the
+ *  array overloads of QPainter (drawLines, drawRects). Nothing is rebuilt
+ *  by paintEvent:
+ *
+ *    Cached layers are rendered once into an image of their visible bounds,
+ *    and again only when they change or the viewport or transform change.
+ *    Painting them blits the exposed part of the image.
+ *
+ *    Other layers are drawn on each paint, clipped to the exposed rectangle,
+ *    skipping the batches outside of it. For small layers that change often.
+ *
+ *  Changes are not painted until Update(), which reports the union of the
+ *  old and new bounds of the modified layers to the update handler, so that
+ *  the widget repaints only that region:
+ *
+ *    Scene scene;
+ *    scene.SetUpdateHandler([this](QRect const& r){ this->update(r); });
+ *    Scene::Layer& grid = scene.AddLayer(true);
+ *    grid.SetPen(QPen(Qt::gray, 0));
+ *    grid.AddLine(...);
+ *    scene.Update();
+ *    // paintEvent
+ *    scene.Paint(painter, event->rect());
+ *
+ *  Text is drawn unscaled at the transformed position, with QStaticText so
+ *  that its layout is computed once.
+ */
+class Scene
+{
+public:
+    class Layer;
+    using UpdateHandler = std::function<void (QRect const& rect)>;
+
+    Scene() = default;
+    Scene(Scene const&) = delete;
+    Scene& operator=(Scene const&) = delete;
+
+    /** Layers are painted in the order they were added */
+    Layer& AddLayer(bool cached);
+
+    void SetUpdateHandler(UpdateHandler handler) { onUpdate = std::move(handler); }
+    /** Widget size in device independent pixels, and its pixel ratio */
+    void SetViewport(QSize const& size, qreal pixelRatio);
+    /** World to widget coordinates */
+    void SetTransform(QTransform const& transform);
+    QTransform const& Transform() const { return transform; }
+    /** Disabled, every layer is drawn on each paint (for comparisons) */
+    void SetCaching(bool enabled);
+
+    /** Reports the region changed since the last call to the update handler */
+    void Update();
+    /** Paints the exposed rectangle, in widget coordinates */
+    void Paint(QPainter& painter, QRect const& exposed);
+
+    size_t Primitives() const;
+
+private:
+    std::vector<std::unique_ptr<Layer>> layers;
+    UpdateHandler onUpdate;
+    QTransform    transform;
+    QSize         viewport;
+    qreal         pixelRatio = 1.0;
+    bool          caching    = true;
+
+    void  Invalidate();
+    /** Device pixels around the bounds of a layer touched by its pens */
+    qreal Padding(Layer const& layer) const;
+    QRect DeviceRect(Layer const& layer) const;
+    void  Render(Layer& layer);
+    void  Draw(QPainter& painter, Layer const& layer, QRectF const& visible) const;
+};
+
+/** Primitives sharing a transform and a cache. Styles are set before the
+ *  primitives they apply to, as with QPainter. */
+class Scene::Layer
+{
+public:
+    Layer(Layer const&) = delete;
+    Layer& operator=(Layer const&) = delete;
+
+    void SetPen(QPen const& pen);
+    void SetBrush(QBrush const& brush);
+    void SetFont(QFont const& font);
+    void SetAntialiasing(bool enabled);
+    void SetVisible(bool visible);
+
+    void Reserve(size_t lines, size_t points = 0);
+    void AddLine(QLineF const& line);
+    /** Same as AddLine() for each line, in a single batch */
+    void AddLines(QLineF const* lines, size_t count);
+    void AddRect(QRectF const& rect);
+    void AddPolyline(QPointF const* points, int count);
+    void AddText(QPointF const& position, QString const& text);
+    /** Removes the primitives, the styles are kept */
+    void Clear();
+
+    bool   Cached() const { return cached; }
+    bool   Empty()  const { return batches.empty(); }
+    size_t Primitives() const;
+
+private:
+    friend class Scene;
+    explicit Layer(bool cached): cached(cached) { }
+
+    enum class Kind { Lines, Rects, Polylines, Texts };
+
+    /** Bounding box, a QRectF would drop zero-sized boxes when united */
+    struct Extent
+    {
+        qreal x0 = std::numeric_limits<qreal>::max();
+        qreal y0 = std::numeric_limits<qreal>::max();
+        qreal x1 = std::numeric_limits<qreal>::lowest();
+        qreal y1 = std::numeric_limits<qreal>::lowest();
+        void   Add(qreal x, qreal y);
+        bool   Empty() const { return x0 > x1; }
+        QRectF Rect()  const { return Empty() ? QRectF() : QRectF(x0, y0, x1 - x0, y1 - y0); }
+    };
+
+    /** Consecutive primitives of the same kind and style */
+    struct Batch
+    {
+        Kind   kind;
+        int    style;
+        int    first;
+        int    count;
+        Extent bounds;
+    };
+
+    struct Style
+    {
+        QPen   pen;
+        QBrush brush;
+        QFont  font;
+    };
+
+    bool cached;
+    bool visible      = true;
+    bool antialiasing = true;
+    bool changed      = true;   // Since the last Update()
+    bool stale        = true;   // Cache to render again
+
+    Style               style;
+    bool                styleUsed = false;
+    std::vector<Style>  styles;
+    std::vector<Batch>  batches;
+    std::vector<QLineF> lines;
+    std::vector<QRectF> rects;
+    std::vector<QPointF> points;
+    std::vector<std::pair<int, int>> polylines;   // First point and size
+    std::vector<QStaticText> texts;
+    std::vector<QPointF>     textPositions;
+
+    Extent extent;
+    qreal  margin = 1.0;        // Half the widest pen, antialiasing included
+    QSizeF textSize;            // Largest text, drawn unscaled
+    QRect  painted;             // Device rectangle at the last Update()
+    QImage cache;
+    QRect  cacheRect;           // Part of the widget held by the cache
+
+    Batch& Append(Kind kind, int index);
+    void   Changed();
+};
+
+#endif // SCENE_H
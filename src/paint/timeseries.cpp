@@ -0,0 +1,107 @@
+#include "timeseries.h"
+
+#include <algorithm>
+
+//======= TimeSeries Implementation ==========//
+
+bool TimeSeries::Append(double x, double y)
+{
+    if(!xs.empty() && x < xs.back())
+        return false;
+    if(xs.size() % BlockSize == 0)
+    {
+        blockMin.push_back(y);
+        blockMax.push_back(y);
+    }
+    else
+    {
+        blockMin.back() = std::min(blockMin.back(), y);
+        blockMax.back() = std::max(blockMax.back(), y);
+    }
+    xs.push_back(x);
+    ys.push_back(y);
+    return true;
+}
+
+size_t TimeSeries::Append(double const* x, double const* y, size_t n)
+{
+    size_t appended = 0;
+    for(size_t i = 0; i < n; i++)
+        appended += this->Append(x[i], y[i]);
+    return appended;
+}
+
+void TimeSeries::Reserve(size_t n)
+{
+    xs.reserve(n);
+    ys.reserve(n);
+    blockMin.reserve(n / BlockSize + 1);
+    blockMax.reserve(n / BlockSize + 1);
+}
+
+void TimeSeries::Clear()
+{
+    xs.clear();
+    ys.clear();
+    blockMin.clear();
+    blockMax.clear();
+}
+
+size_t TimeSeries::LowerBound(double x) const
+{
+    return static_cast<size_t>(std::lower_bound(xs.begin(), xs.end(), x) - xs.begin());
+}
+
+void TimeSeries::Range(size_t first, size_t last, double& min, double& max) const
+{
+    min = max = ys[first];
+    auto scan = [&](size_t begin, size_t end){
+        for(size_t i = begin; i < end; i++)
+        {
+            min = std::min(min, ys[i]);
+            max = std::max(max, ys[i]);
+        }
+    };
+    size_t b0 = first / BlockSize;
+    size_t b1 = (last - 1) / BlockSize;
+    if(b0 == b1)
+    {
+        scan(first, last);
+        return;
+    }
+    // Partial blocks at both ends, whole blocks from their summaries
+    scan(first, (b0 + 1) * BlockSize);
+    for(size_t b = b0 + 1; b < b1; b++)
+    {
+        min = std::min(min, blockMin[b]);
+        max = std::max(max, blockMax[b]);
+    }
+    scan(b1 * BlockSize, last);
+}
+
+void TimeSeries::Decimate(double x0, double x1, std::vector<Column>& columns,
+                          size_t firstColumn) const
+{
+    size_t n = columns.size();
+    if(n == 0 || firstColumn >= n)
+        return;
+    double width = (x1 - x0) / static_cast<double>(n);
+    // Each column starts where the previous one ended
+    size_t begin = this->LowerBound(x0 + width * static_cast<double>(firstColumn));
+    for(size_t c = firstColumn; c < n; c++)
+    {
+        double edge = c + 1 == n ? x1 : x0 + width * static_cast<double>(c + 1);
+        // Searched from the start of the column only
+        auto   from = xs.begin() + static_cast<std::ptrdiff_t>(begin);
+        size_t end  = static_cast<size_t>(std::lower_bound(from, xs.end(), edge) - xs.begin());
+        Column& column = columns[c];
+        column.count = end - begin;
+        if(end > begin)
+        {
+            column.first = ys[begin];
+            column.last  = ys[end - 1];
+            this->Range(begin, end, column.min, column.max);
+        }
+        begin = end;
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef TIMESERIES_H
+#define TIMESERIES_H
+
+#include <vector>
+#include <cstddef>
+
+/** Append-only series of (x, y) points sorted by x, e.g. prices or Greeks
+ *  against time.
+ *
+ *  The minimum and maximum of y are kept for each block of BlockSize
+ *  points, updated as points are appended, so that the range of y over a
+ *  span of points costs O(span / BlockSize + BlockSize) instead of O(span).
+ *  This is what makes decimating 10M points to a few thousand pixel columns
+ *  fast enough to run on every zoom or pan.
+ */
+class TimeSeries
+{
+public:
+    static constexpr size_t BlockSize = 256;
+
+    /** Minimum and maximum of the points of a pixel column, the first and
+     *  last values connect it to its neighbours */
+    struct Column
+    {
+        size_t count = 0;
+        double first = 0.0;
+        double last  = 0.0;
+        double min   = 0.0;
+        double max   = 0.0;
+    };
+
+    /** Points with an x lower than the last one are ignored, returns false */
+    bool   Append(double x, double y);
+    size_t Append(double const* x, double const* y, size_t n);
+    void   Reserve(size_t n);
+    void   Clear();
+
+    size_t Size()  const { return xs.size(); }
+    bool   Empty() const { return xs.empty(); }
+    double X(size_t i) const { return xs[i]; }
+    double Y(size_t i) const { return ys[i]; }
+
+    /** First point with an x not lower than x */
+    size_t LowerBound(double x) const;
+    /** Minimum and maximum of y over the points [first, last), last > first */
+    void   Range(size_t first, size_t last, double& min, double& max) const;
+
+    /** Splits [x0, x1) into columns of equal width and fills
+     *  columns[firstColumn, columns.size()), the other ones are kept */
+    void   Decimate(double x0, double x1, std::vector<Column>& columns,
+                    size_t firstColumn = 0) const;
+
+private:
+    std::vector<double> xs;
+    std::vector<double> ys;
+    std::vector<double> blockMin;
+    std::vector<double> blockMax;
+};
+
+#endif // TIMESERIES_H
@@ -0,0 +1,409 @@
+#include "timeserieschart.h"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#include <QTimer>
+#include <QPainter>
+#include <QPaintEvent>
+#include <QWheelEvent>
+#include <QMouseEvent>
+
+#include "../common/instrument.h"
+
+namespace {
+
+// Room for the axis labels around the plot, in pixels
+constexpr int MarginLeft   = 64;
+constexpr int MarginRight  = 12;
+constexpr int MarginTop    = 12;
+constexpr int MarginBottom = 24;
+// Approximate number of grid lines per axis
+constexpr int Ticks        = 6;
+// Grid lines are not drawn beyond this count
+constexpr int MaxTicks     = 64;
+// Smallest span of an axis relative to its values, far above the double
+// resolution so that pixels and ticks map to distinct values
+constexpr double MinRelativeSpan = 1e-9;
+
+/** 1, 2 or 5 times a power of ten, close to range / Ticks */
+double TickStep(double range)
+{
+    double raw  = range / Ticks;
+    double unit = std::pow(10.0, std::floor(std::log10(raw)));
+    double f    = raw / unit;
+    return unit * (f < 1.5 ? 1.0 : f < 3.0 ? 2.0 : f < 7.0 ? 5.0 : 10.0);
+}
+
+double MinSpan(double a, double b)
+{
+    return MinRelativeSpan * std::max({1.0, std::fabs(a), std::fabs(b)});
+}
+
+/** fn(v) for the multiples v of the tick step in [lo, hi). Counts integer
+ *  tick indices, a step below the resolution of lo cannot stall it. */
+template<typename Callable>
+void ForEachTick(double lo, double hi, Callable fn)
+{
+    double step  = TickStep(hi - lo);
+    double first = std::ceil(lo / step);
+    double last  = std::floor(hi / step);
+    // Also false for NaN
+    if(!(last - first >= 0.0 && last - first < MaxTicks))
+        return;
+    int n = static_cast<int>(last - first);
+    for(int i = 0; i <= n; i++)
+    {
+        double v = (first + i) * step;
+        if(v < hi)
+            fn(v);
+    }
+}
+
+} // --- End of namespace --- //
+
+//======= TimeSeriesChart Implementation ==========//
+
+TimeSeriesChart::TimeSeriesChart(QWidget* parent)
+    : QWidget(parent),
+      grid(scene.AddLayer(true)),
+      plot(scene.AddLayer(true)),
+      cursor(scene.AddLayer(false)),
+      frame(new QTimer(this))
+{
+    // Every pixel is painted by paintEvent
+    this->setAttribute(Qt::WA_OpaquePaintEvent);
+    this->setMouseTracking(true);
+    this->setMinimumSize(240, 160);
+    scene.SetUpdateHandler([this](QRect const& rect){ this->update(rect); });
+    // Pixel columns, antialiasing would only blur them
+    plot.SetAntialiasing(false);
+
+    frame->setSingleShot(true);
+    frame->setInterval(16);
+    QObject::connect(frame, &QTimer::timeout, [this]{ this->Rebuild(); });
+}
+
+int TimeSeriesChart::AddSeries(QString const& name, QColor const& color)
+{
+    traces.push_back(Trace());
+    traces.back().name  = name;
+    traces.back().color = color;
+    viewChanged = true;
+    this->Schedule();
+    return static_cast<int>(traces.size()) - 1;
+}
+
+void TimeSeriesChart::Append(int series, double x, double y)
+{
+    traces[static_cast<size_t>(series)].data.Append(x, y);
+    this->Schedule();
+}
+
+void TimeSeriesChart::Append(int series, double const* x, double const* y, size_t n)
+{
+    traces[static_cast<size_t>(series)].data.Append(x, y, n);
+    this->Schedule();
+}
+
+void TimeSeriesChart::Reserve(int series, size_t n)
+{
+    traces[static_cast<size_t>(series)].data.Reserve(n);
+}
+
+void TimeSeriesChart::SetView(double x0, double x1)
+{
+    if(!(x1 >= x0) || !std::isfinite(x0) || !std::isfinite(x1))
+        return;
+    // Zooming stops at the smallest span, kept around the center
+    double span = MinSpan(x0, x1);
+    if(x1 - x0 < span)
+    {
+        double xm = 0.5 * (x0 + x1);
+        x0 = xm - 0.5 * span;
+        x1 = xm + 0.5 * span;
+    }
+    this->x0    = x0;
+    this->x1    = x1;
+    viewChanged = true;
+    this->Schedule();
+}
+
+void TimeSeriesChart::FitAll()
+{
+    double first = std::numeric_limits<double>::max();
+    double last  = std::numeric_limits<double>::lowest();
+    for(Trace const& t: traces)
+        if(!t.data.Empty())
+        {
+            first = std::min(first, t.data.X(0));
+            last  = std::max(last, t.data.X(t.data.Size() - 1));
+        }
+    if(first > last)
+        return;
+    // The window is half open, the last point is included
+    this->SetView(first, std::nextafter(last, std::numeric_limits<double>::max()));
+}
+
+void TimeSeriesChart::SetFollow(bool follow)
+{
+    this->follow = follow;
+    this->Schedule();
+}
+
+void TimeSeriesChart::resizeEvent(QResizeEvent*)
+{
+    scene.SetViewport(this->size(), this->devicePixelRatioF());
+    viewChanged = true;
+    // Ready for the paint event that follows
+    this->Rebuild();
+}
+
+void TimeSeriesChart::paintEvent(QPaintEvent* event)
+{
+    INSTRUMENT_SCOPE("TimeSeriesChart::paintEvent");
+    QPainter qp{this};
+    qp.fillRect(event->rect(), this->palette().base());
+    scene.Paint(qp, event->rect());
+}
+
+void TimeSeriesChart::wheelEvent(QWheelEvent* event)
+{
+    // Zooms around the point under the mouse
+    double factor = std::pow(0.998, event->angleDelta().y());
+    double xm     = this->ToWorldX(event->pos().x());
+    follow = false;
+    this->SetView(xm - (xm - x0) * factor, xm + (x1 - xm) * factor);
+    event->accept();
+}
+
+void TimeSeriesChart::mousePressEvent(QMouseEvent* event)
+{
+    if(event->button() != Qt::LeftButton)
+        return;
+    dragging  = true;
+    dragStart = event->pos().x();
+    dragX0    = x0;
+    dragX1    = x1;
+}
+
+void TimeSeriesChart::mouseMoveEvent(QMouseEvent* event)
+{
+    if(dragging)
+    {
+        double dx = (event->pos().x() - dragStart) * (dragX1 - dragX0)
+                  / std::max(this->PlotRect().width(), 1);
+        follow = false;
+        this->SetView(dragX0 - dx, dragX1 - dx);
+    }
+    cursorX = this->PlotRect().contains(event->pos()) ? event->pos().x() : -1;
+    this->BuildCursor();
+    scene.Update();
+}
+
+void TimeSeriesChart::mouseReleaseEvent(QMouseEvent* event)
+{
+    if(event->button() != Qt::LeftButton || !dragging)
+        return;
+    dragging = false;
+    // Panned up to the last points
+    if(x1 >= this->LastX())
+        this->SetFollow(true);
+}
+
+void TimeSeriesChart::mouseDoubleClickEvent(QMouseEvent*)
+{
+    this->FitAll();
+    this->SetFollow(true);
+}
+
+void TimeSeriesChart::leaveEvent(QEvent*)
+{
+    cursorX = -1;
+    this->BuildCursor();
+    scene.Update();
+}
+
+QRect TimeSeriesChart::PlotRect() const
+{
+    return this->rect().adjusted(MarginLeft, MarginTop, -MarginRight, -MarginBottom);
+}
+
+double TimeSeriesChart::LastX() const
+{
+    double last = std::numeric_limits<double>::lowest();
+    for(Trace const& t: traces)
+        if(!t.data.Empty())
+            last = std::max(last, t.data.X(t.data.Size() - 1));
+    return last;
+}
+
+double TimeSeriesChart::ToPixelX(double x) const
+{
+    QRect r = this->PlotRect();
+    return r.left() + (x - x0) / (x1 - x0) * r.width();
+}
+
+double TimeSeriesChart::ToPixelY(double y) const
+{
+    QRect r = this->PlotRect();
+    return r.bottom() - (y - y0) / (y1 - y0) * r.height();
+}
+
+double TimeSeriesChart::ToWorldX(double px) const
+{
+    QRect r = this->PlotRect();
+    return x0 + (px - r.left()) / std::max(r.width(), 1) * (x1 - x0);
+}
+
+void TimeSeriesChart::Schedule()
+{
+    if(!frame->isActive())
+        frame->start();
+}
+
+void TimeSeriesChart::Rebuild()
+{
+    INSTRUMENT_SCOPE("TimeSeriesChart::Rebuild");
+    frame->stop();
+    size_t width = static_cast<size_t>(std::max(this->PlotRect().width(), 1));
+
+    double last = this->LastX();
+    if(follow && last >= x1)
+    {
+        // Scrolls to the new points, the width of the window is kept
+        double span = x1 - x0;
+        x1 = std::nextafter(last, std::numeric_limits<double>::max());
+        x0 = x1 - span;
+        viewChanged = true;
+    }
+    for(Trace& t: traces)
+    {
+        if(viewChanged || t.columns.size() != width)
+        {
+            t.columns.assign(width, TimeSeries::Column());
+            t.data.Decimate(x0, x1, t.columns);
+        }
+        else if(t.decimated < t.data.Size() && t.data.X(t.decimated) < x1)
+        {
+            // Appended points only change the columns from the first new one,
+            // one before in case of rounding at the column edge
+            double column = std::floor((t.data.X(t.decimated) - x0) / (x1 - x0) * width) - 1.0;
+            size_t first  = static_cast<size_t>(std::max(column, 0.0));
+            t.data.Decimate(x0, x1, t.columns, std::min(first, width - 1));
+        }
+        t.decimated = t.data.Size();
+    }
+    viewChanged = false;
+
+    // The y axis fits the visible points
+    double lo = std::numeric_limits<double>::max();
+    double hi = std::numeric_limits<double>::lowest();
+    for(Trace const& t: traces)
+        for(TimeSeries::Column const& c: t.columns)
+            if(c.count > 0)
+            {
+                lo = std::min(lo, c.min);
+                hi = std::max(hi, c.max);
+            }
+    if(lo > hi)
+    {
+        lo = 0.0;
+        hi = 1.0;
+    }
+    double pad = std::max(hi > lo ? (hi - lo) * 0.05 : 0.5, MinSpan(lo, hi));
+    y0 = lo - pad;
+    y1 = hi + pad;
+
+    this->BuildGrid();
+    this->BuildPlot();
+    this->BuildCursor();
+    scene.Update();
+}
+
+void TimeSeriesChart::BuildGrid()
+{
+    QRect  r = this->PlotRect();
+    QRectF view(x0, y0, x1 - x0, y1 - y0);
+    if(view == gridView && r == gridRect)
+        return;
+    gridView = view;
+    gridRect = r;
+
+    grid.Clear();
+    grid.SetPen(QPen(this->palette().midlight().color(), 0));
+    ForEachTick(x0, x1, [&](double x){
+        grid.AddLine(QLineF(this->ToPixelX(x), r.top(), this->ToPixelX(x), r.bottom()));
+    });
+    ForEachTick(y0, y1, [&](double y){
+        grid.AddLine(QLineF(r.left(), this->ToPixelY(y), r.right(), this->ToPixelY(y)));
+    });
+
+    grid.SetPen(QPen(this->palette().dark().color(), 0));
+    grid.AddRect(QRectF(r));
+
+    grid.SetPen(QPen(this->palette().text().color()));
+    ForEachTick(x0, x1, [&](double x){
+        grid.AddText(QPointF(this->ToPixelX(x) - 16, r.bottom() + 16), QString::number(x, 'g', 6));
+    });
+    ForEachTick(y0, y1, [&](double y){
+        grid.AddText(QPointF(4, this->ToPixelY(y) + 4), QString::number(y, 'g', 6));
+    });
+}
+
+void TimeSeriesChart::BuildPlot()
+{
+    QRect r = this->PlotRect();
+    plot.Clear();
+    std::vector<QLineF> lines;
+    for(Trace const& t: traces)
+    {
+        lines.clear();
+        lines.reserve(t.columns.size() * 2);
+        bool    any = false;
+        QPointF previous;
+        for(size_t c = 0; c < t.columns.size(); c++)
+        {
+            TimeSeries::Column const& column = t.columns[c];
+            if(column.count == 0)
+                continue;
+            double  px = r.left() + static_cast<double>(c);
+            QPointF first(px, this->ToPixelY(column.first));
+            if(any)
+                lines.emplace_back(previous, first);
+            if(column.max > column.min)
+                lines.emplace_back(px, this->ToPixelY(column.max), px, this->ToPixelY(column.min));
+            previous = QPointF(px, this->ToPixelY(column.last));
+            any = true;
+        }
+        plot.SetPen(QPen(t.color, 0));
+        plot.AddLines(lines.data(), lines.size());
+    }
+}
+
+void TimeSeriesChart::BuildCursor()
+{
+    cursor.Clear();
+    if(cursorX < 0 || traces.empty())
+        return;
+    QRect r = this->PlotRect();
+    cursor.SetPen(QPen(this->palette().dark().color(), 0, Qt::DashLine));
+    cursor.AddLine(QLineF(cursorX, r.top(), cursorX, r.bottom()));
+
+    // Last point at or before the cursor of each series
+    double x = this->ToWorldX(cursorX);
+    QString text = QString("x = %1").arg(x, 0, 'g', 8);
+    for(Trace const& t: traces)
+    {
+        size_t i = t.data.LowerBound(x);
+        if(i < t.data.Size() && t.data.X(i) > x)
+            i = i > 0 ? i - 1 : t.data.Size();
+        else if(i == t.data.Size() && i > 0)
+            i--;
+        if(i < t.data.Size())
+            text += QString("   %1 = %2").arg(t.name).arg(t.data.Y(i), 0, 'g', 6);
+    }
+    cursor.SetPen(QPen(this->palette().text().color()));
+    cursor.AddText(QPointF(r.left() + 6, r.top() + 16), text);
+}
@@ -0,0 +1,106 @@
+#ifndef TIMESERIESCHART_H
+#define TIMESERIESCHART_H
+
+#include <vector>
+
+#include <QWidget>
+#include <QColor>
+#include <QString>
+
+#include "scene.h"
+#include "timeseries.h"
+
+class QTimer;
+
+/** Line chart of time series with millions of points, e.g. a spot price
+ *  and the Greeks of an option.
+ *
+ *  Each series is decimated to one column per pixel: the minimum and
+ *  maximum of its points in the column are joined by a vertical segment,
+ *  and consecutive columns by their last and first points. 10M points are
+ *  drawn as about 2 x width segments, handed to QPainter::drawLines() in
+ *  one array per series, without building a QPainterPath. The y axis fits
+ *  the visible points.
+ *
+ *  Only the visible x window is decimated, again on zoom (wheel), pan
+ *  (drag) or resize. Appended points are drawn at the next frame and only
+ *  the columns from the first new point on are decimated again. In follow
+ *  mode the window scrolls to keep the last points visible; panning to the
+ *  end resumes it and a double click fits all the points.
+ *
+ *  The axes and the series are cached layers of a Scene, so moving the
+ *  cursor readout does not redraw them.
+ */
+class TimeSeriesChart: public QWidget
+{
+public:
+    explicit TimeSeriesChart(QWidget* parent = nullptr);
+
+    /** Returns the index of the new series */
+    int  AddSeries(QString const& name, QColor const& color);
+    TimeSeries const& Series(int index) const { return traces[static_cast<size_t>(index)].data; }
+    /** Points with an x lower than the last one of the series are ignored */
+    void Append(int series, double x, double y);
+    void Append(int series, double const* x, double const* y, size_t n);
+    void Reserve(int series, size_t n);
+
+    /** Visible range of x, widened around its center to a span of at least
+     *  1e-9 times the magnitude of x */
+    void SetView(double x0, double x1);
+    void FitAll();
+    void SetFollow(bool follow);
+
+protected:
+    void resizeEvent(QResizeEvent* event) override;
+    void paintEvent(QPaintEvent* event) override;
+    void wheelEvent(QWheelEvent* event) override;
+    void mousePressEvent(QMouseEvent* event) override;
+    void mouseMoveEvent(QMouseEvent* event) override;
+    void mouseReleaseEvent(QMouseEvent* event) override;
+    void mouseDoubleClickEvent(QMouseEvent* event) override;
+    void leaveEvent(QEvent* event) override;
+
+private:
+    struct Trace
+    {
+        QString    name;
+        QColor     color;
+        TimeSeries data;
+        std::vector<TimeSeries::Column> columns;
+        size_t     decimated = 0;   // Points included in the columns
+    };
+
+    std::vector<Trace> traces;
+    Scene         scene;
+    Scene::Layer& grid;
+    Scene::Layer& plot;
+    Scene::Layer& cursor;
+    // Coalesces appends and view changes, one rebuild per frame
+    QTimer*       frame;
+
+    double x0 = 0.0, x1 = 1.0;
+    double y0 = 0.0, y1 = 1.0;
+    bool   follow      = true;
+    bool   viewChanged = true;      // All the columns are decimated again
+    bool   dragging    = false;
+    int    dragStart   = 0;
+    double dragX0 = 0.0, dragX1 = 0.0;
+    int    cursorX     = -1;
+    // View and plot area of the axes drawn last
+    QRectF gridView;
+    QRect  gridRect;
+
+    QRect  PlotRect() const;
+    double LastX() const;
+    double ToPixelX(double x) const;
+    double ToPixelY(double y) const;
+    double ToWorldX(double px) const;
+
+    void Schedule();
+    void Rebuild();
+    void BuildGrid();
+    void BuildPlot();
+    void BuildCursor();
+};
+
+#endif // TIMESERIESCHART_H
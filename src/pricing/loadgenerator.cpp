@@ -0,0 +1,242 @@
+#include "loadgenerator.h"
+
+#include <deque>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+
+#include <QTcpSocket>
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <QJsonObject>
+
+#include "../form1/blackscholes.h"
+
+namespace {
+
+// Price difference tolerated between the service and the local result
+constexpr double Tolerance = 1e-9;
+
+/** Option i of the batch, in the units of BlackScholesCall() */
+void MakeOption(double* o, int i)
+{
+    o[0] = 100.0;
+    o[1] = 50.0 + i % 100;
+    o[2] = 0.25 * (1 + (i / 100) % 8);
+    o[3] = 0.20 + 0.01 * (i % 7);
+    o[4] = 0.05;
+}
+
+} // --- End of namespace --- //
+
+struct LoadGenerator::Client
+{
+    QTcpSocket          socket;
+    QByteArray          input;
+    std::deque<int64_t> sent;   // Send time of the requests in flight
+    bool                alive = true;
+};
+
+//======= LoadGenerator Implementation ==========//
+
+LoadGenerator::LoadGenerator(QUrl const& url, Profile const& profile)
+    : url(url), profile(profile)
+{
+    this->profile.connections = std::max(profile.connections, 1);
+    this->profile.depth       = std::max(profile.depth, 1);
+    this->profile.batch       = std::max(profile.batch, 1);
+
+    int n = this->profile.batch;
+    std::vector<double> options(static_cast<size_t>(n) * BatchStride);
+    for(int i = 0; i < n; i++)
+        MakeOption(&options[static_cast<size_t>(i) * BatchStride], i);
+    expected.resize(static_cast<size_t>(n));
+    BlackScholesCallBatch(options.data(), expected.size(), expected.data());
+
+    QByteArray body;
+    if(profile.binary)
+        body = QByteArray(reinterpret_cast<const char*>(options.data()),
+                          static_cast<int>(options.size() * sizeof(double)));
+    else
+    {
+        QJsonArray items;
+        for(int i = 0; i < n; i++)
+        {
+            QJsonArray item;
+            for(int f = 0; f < BatchStride; f++)
+                item.append(options[static_cast<size_t>(i) * BatchStride + f]);
+            items.append(item);
+        }
+        body = QJsonDocument(QJsonObject{{"options", items}}).toJson(QJsonDocument::Compact);
+    }
+    // Built once, every request is the same
+    request = "POST " + url.path(QUrl::FullyEncoded).toLatin1() + " HTTP/1.1\r\n"
+              "Host: " + url.host().toLatin1() + ':' + QByteArray::number(url.port(80)) + "\r\n"
+              "Content-Type: " + (profile.binary ? "application/octet-stream"
+                                                 : "application/json") + "\r\n"
+              "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+              "\r\n" + body;
+}
+
+LoadGenerator::~LoadGenerator() = default;
+
+void LoadGenerator::Start(std::function<void ()> done)
+{
+    this->done = std::move(done);
+    started = Instrument::Now();
+    for(int i = 0; i < profile.connections; i++)
+    {
+        clients.push_back(std::make_unique<Client>());
+        Client& client = *clients.back();
+        client.socket.setSocketOption(QAbstractSocket::LowDelayOption, 1);
+        QObject::connect(&client.socket, &QTcpSocket::connected, [this, &client]{
+            this->Send(client);
+        });
+        QObject::connect(&client.socket, &QTcpSocket::readyRead, [this, &client]{
+            this->Read(client);
+        });
+        // errorOccurred() requires Qt 5.15
+        QObject::connect(&client.socket,
+                         QOverload<QAbstractSocket::SocketError>::of(&QAbstractSocket::error),
+                         [this, &client]{
+            this->Fail(client, client.socket.errorString());
+        });
+        client.socket.connectToHost(url.host(), static_cast<quint16>(url.port(80)));
+    }
+}
+
+void LoadGenerator::Send(Client& client)
+{
+    while(client.alive && client.sent.size() < static_cast<size_t>(profile.depth)
+          && issued < profile.requests)
+    {
+        client.socket.write(request);
+        client.sent.push_back(Instrument::Now());
+        issued++;
+    }
+}
+
+void LoadGenerator::Read(Client& client)
+{
+    client.input += client.socket.readAll();
+    while(client.alive)
+    {
+        int end = client.input.indexOf("\r\n\r\n");
+        if(end < 0)
+            return;
+        QList<QByteArray> lines = client.input.left(end).split('\n');
+        int status = lines[0].split(' ').value(1).toInt();
+        qint64 length = -1;
+        for(QByteArray const& line: lines)
+        {
+            int colon = line.indexOf(':');
+            if(line.left(colon).trimmed().toLower() == "content-length")
+                length = line.mid(colon + 1).trimmed().toLongLong();
+        }
+        if(length < 0)
+        {
+            this->Fail(client, "Response without Content-Length");
+            return;
+        }
+        if(client.input.size() < end + 4 + length)
+            return;
+        QByteArray body = client.input.mid(end + 4, static_cast<int>(length));
+        client.input.remove(0, end + 4 + static_cast<int>(length));
+        if(client.sent.empty())
+        {
+            this->Fail(client, "Unexpected response");
+            return;
+        }
+        latency.Record(Instrument::Now() - client.sent.front());
+        client.sent.pop_front();
+        if(status == 200)
+        {
+            completed++;
+            if(!checked)
+                this->Check(body);
+        }
+        else
+        {
+            failed++;
+            std::cout << " [ERROR] HTTP status " << status << ": "
+                      << body.trimmed().toStdString() << std::endl;
+        }
+        this->Send(client);
+        if(completed + failed >= profile.requests)
+            this->Finish();
+    }
+}
+
+void LoadGenerator::Check(QByteArray const& body)
+{
+    checked = true;
+    std::vector<double> prices;
+    if(profile.binary)
+    {
+        prices.resize(static_cast<size_t>(body.size()) / sizeof(double));
+        std::memcpy(prices.data(), body.constData(), prices.size() * sizeof(double));
+    }
+    else
+    {
+        QJsonArray items = QJsonDocument::fromJson(body).object().value("prices").toArray();
+        for(QJsonValue const& v: items)
+            prices.push_back(v.toDouble());
+    }
+    if(prices.size() != expected.size())
+    {
+        mismatches++;
+        std::cout << " [ERROR] " << prices.size() << " prices received, "
+                  << expected.size() << " expected" << std::endl;
+        return;
+    }
+    for(size_t i = 0; i < prices.size(); i++)
+        if(std::fabs(prices[i] - expected[i]) > Tolerance)
+            mismatches++;
+}
+
+void LoadGenerator::Fail(Client& client, QString const& error)
+{
+    if(!client.alive)
+        return;
+    client.alive = false;
+    // Requests in flight are lost, the other connections send the rest
+    failed += static_cast<qint64>(client.sent.size());
+    client.sent.clear();
+    client.socket.abort();
+    std::cout << " [ERROR] Connection failed: " << error.toStdString() << std::endl;
+    bool anyAlive = std::any_of(clients.begin(), clients.end(),
+                                [](std::unique_ptr<Client> const& c){ return c->alive; });
+    if(!anyAlive || completed + failed >= profile.requests)
+        this->Finish();
+}
+
+void LoadGenerator::Finish()
+{
+    if(finished != 0)
+        return;
+    finished = Instrument::Now();
+    if(done)
+        done();
+}
+
+void LoadGenerator::Report(std::ostream& os) const
+{
+    double seconds = std::max<int64_t>((finished ? finished : Instrument::Now()) - started, 1) / 1e9;
+    os << std::fixed << std::setprecision(1)
+       << " [INFO] " << completed << " requests of " << profile.batch << " options, "
+       << failed << " failed, on " << profile.connections << " connections, "
+       << profile.depth << " in flight each, " << (profile.binary ? "binary" : "JSON")
+       << std::endl
+       << " [INFO] " << completed / seconds << " requests/s, "
+       << completed * profile.batch / seconds << " options/s in " << seconds * 1e3 << " ms"
+       << std::endl
+       << std::setprecision(3)
+       << " [INFO] Latency (ms) p50 = " << latency.Percentile(0.50) / 1e6
+       << "  p90 = " << latency.Percentile(0.90) / 1e6
+       << "  p99 = " << latency.Percentile(0.99) / 1e6
+       << "  max = " << latency.Max() / 1e6 << std::endl;
+    if(mismatches > 0)
+        os << " [ERROR] " << mismatches << " prices differ from the local result" << std::endl;
+}
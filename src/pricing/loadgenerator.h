@@ -0,0 +1,82 @@
+#ifndef LOADGENERATOR_H
+#define LOADGENERATOR_H
+
+#include <iosfwd>
+#include <memory>
+#include <vector>
+#include <functional>
+
+#include <QUrl>
+#include <QByteArray>
+
+#include "../common/instrument.h"
+
+/** Load on a pricing service (see PricingServer), to size it for its
+ *  consumers.
+ *
+ *  Each connection keeps up to Profile::depth requests in flight, pipelined
+ *  on a keep-alive connection, and sends the next one as soon as a response
+ *  arrives, until Profile::requests responses were received. It uses raw
+ *  sockets on the calling thread: QNetworkAccessManager would cap the
+ *  connections at 6 per host and add its own queuing to the latency.
+ *
+ *  Every request prices the same batch of options, and the first response
+ *  is checked against prices computed locally.
+ */
+class LoadGenerator
+{
+public:
+    struct Profile
+    {
+        int    connections = 8;
+        int    depth       = 1;     // Requests in flight per connection
+        int    batch       = 64;    // Options per request
+        qint64 requests    = 10000;
+        bool   binary      = false;
+    };
+
+    LoadGenerator(QUrl const& url, Profile const& profile);
+    ~LoadGenerator();
+
+    LoadGenerator(LoadGenerator const&) = delete;
+    LoadGenerator& operator=(LoadGenerator const&) = delete;
+
+    /** done is called on this thread once all the responses arrived, or
+     *  all the connections failed */
+    void Start(std::function<void ()> done);
+
+    qint64 Completed()  const { return completed; }
+    qint64 Failed()     const { return failed; }
+    qint64 Mismatches() const { return mismatches; }
+
+    /** Round trip of a request, as seen by the client */
+    Instrument::Histogram const& Latency() const { return latency; }
+
+    void Report(std::ostream& os) const;
+
+private:
+    struct Client;
+
+    QUrl                    url;
+    Profile                 profile;
+    QByteArray              request;
+    std::vector<double>     expected;
+    std::vector<std::unique_ptr<Client>> clients;
+    std::function<void ()>  done;
+    qint64                  issued     = 0;
+    qint64                  completed  = 0;
+    qint64                  failed     = 0;
+    qint64                  mismatches = 0;
+    bool                    checked    = false;
+    int64_t                 started    = 0;
+    int64_t                 finished   = 0;
+    Instrument::Histogram   latency;
+
+    void Send(Client& client);
+    void Read(Client& client);
+    void Check(QByteArray const& body);
+    void Fail(Client& client, QString const& error);
+    void Finish();
+};
+
+#endif // LOADGENERATOR_H
@@ -0,0 +1,421 @@
+#include "pricingserver.h"
+
+#include <deque>
+#include <vector>
+#include <cstring>
+#include <ostream>
+#include <iomanip>
+#include <algorithm>
+
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QHostAddress>
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <QJsonObject>
+
+#include "../form1/blackscholes.h"
+#include "../common/task.h"
+
+namespace {
+
+// Request headers larger than this close the connection
+constexpr int    MaxHeaderSize = 64 * 1024;
+// Larger bodies are rejected with 413
+constexpr qint64 MaxBodySize   = 64 << 20;
+// Requests of a connection in progress before its input is left unread
+constexpr size_t MaxPipelined  = 64;
+// Options priced by each task of a batch
+constexpr size_t ChunkSize     = 4096;
+// Responses of a connection waiting to be sent above which its requests
+// are neither read nor priced, until the client reads them
+constexpr qint64 MaxUnsent     = 8 << 20;
+// Data buffered by a socket which is not read, TCP throttles the client
+constexpr qint64 ReadBuffer    = 1 << 20;
+
+const char* const FieldNames[BatchStride] = {"S", "K", "T", "sigma", "r"};
+
+QByteArray HttpResponse(QByteArray const& status, QByteArray const& type,
+                        QByteArray const& body, bool keepAlive)
+{
+    return "HTTP/1.1 " + status + "\r\n"
+           "Content-Type: " + type + "\r\n"
+           "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+           "Connection: " + (keepAlive ? "keep-alive" : "close") + "\r\n"
+           "\r\n" + body;
+}
+
+QByteArray ErrorBody(QString const& message)
+{
+    return QJsonDocument(QJsonObject{{"error", message}}).toJson(QJsonDocument::Compact) + '\n';
+}
+
+bool DecodeJson(QByteArray const& body, std::vector<double>& options, QString& error)
+{
+    QJsonParseError parseError;
+    QJsonDocument doc = QJsonDocument::fromJson(body, &parseError);
+    if(doc.isNull())
+    {
+        error = parseError.errorString();
+        return false;
+    }
+    QJsonArray items = doc.isArray() ? doc.array() : doc.object().value("options").toArray();
+    options.reserve(static_cast<size_t>(items.size()) * BatchStride);
+    for(int i = 0; i < items.size(); i++)
+    {
+        QJsonValue item = items.at(i);
+        QJsonArray  fields = item.toArray();
+        QJsonObject object = item.toObject();
+        for(int f = 0; f < BatchStride; f++)
+        {
+            QJsonValue v = item.isArray() ? fields.at(f) : object.value(FieldNames[f]);
+            if(!v.isDouble())
+            {
+                error = QString("Option %1: %2 is not a number").arg(i).arg(FieldNames[f]);
+                return false;
+            }
+            options.push_back(v.toDouble());
+        }
+    }
+    return true;
+}
+
+bool DecodeBinary(QByteArray const& body, std::vector<double>& options, QString& error)
+{
+    constexpr int OptionSize = BatchStride * sizeof(double);
+    if(body.size() % OptionSize != 0)
+    {
+        error = QString("Body size is not a multiple of %1 bytes").arg(OptionSize);
+        return false;
+    }
+    options.resize(static_cast<size_t>(body.size()) / sizeof(double));
+    std::memcpy(options.data(), body.constData(), static_cast<size_t>(body.size()));
+    return true;
+}
+
+QByteArray EncodeJson(std::vector<double> const& prices)
+{
+    QByteArray out;
+    out.reserve(static_cast<int>(prices.size()) * 20 + 16);
+    out += "{\"prices\": [";
+    for(size_t i = 0; i < prices.size(); i++)
+    {
+        if(i > 0)
+            out += ", ";
+        // Round trips to the same double
+        out += QByteArray::number(prices[i], 'g', 17);
+    }
+    out += "]}\n";
+    return out;
+}
+
+} // --- End of namespace --- //
+
+struct PricingServer::Connection
+{
+    QTcpSocket*        socket;     // nullptr once disconnected
+    QByteArray         input;      // Received and not processed yet
+    std::deque<JobPtr> pending;    // In the order of the requests
+    bool               close = false;
+};
+
+/** One request, from its body to its response */
+struct PricingServer::Job
+{
+    std::weak_ptr<Connection> conn;
+    bool                keepAlive = true;
+    bool                binary    = false;
+    int64_t             start     = 0;
+    QByteArray          body;
+    std::vector<double> options;
+    std::vector<double> prices;
+    std::atomic<size_t> chunks{0};
+    // Set on the server thread
+    bool                ready = false;
+    QByteArray          response;
+};
+
+//======= PricingServer Implementation ==========//
+
+PricingServer::PricingServer(int threads)
+{
+    pool.setMaxThreadCount(std::max(threads, 1));
+    server = new QTcpServer;
+    server->moveToThread(&thread);
+    QObject::connect(&thread, &QThread::finished, server, &QObject::deleteLater);
+    QObject::connect(server, &QTcpServer::newConnection, server, [this]{
+        this->OnConnection();
+    });
+    thread.setObjectName("PricingServer");
+    thread.start();
+}
+
+PricingServer::~PricingServer()
+{
+    QMetaObject::invokeMethod(server, [this]{
+        server->close();
+        // Sockets are children of the server, no request is accepted after this
+        for(QTcpSocket* socket: server->findChildren<QTcpSocket*>())
+            socket->abort();
+    }, Qt::BlockingQueuedConnection);
+    // Tasks post their responses to the server, which outlives them
+    pool.waitForDone();
+    thread.quit();
+    thread.wait();
+}
+
+bool PricingServer::Listen(quint16 port, QString* error)
+{
+    bool ok = false;
+    QMetaObject::invokeMethod(server, [&]{
+        ok = server->listen(QHostAddress::LocalHost, port);
+        if(ok)
+            this->port = server->serverPort();
+        else if(error)
+            *error = server->errorString();
+    }, Qt::BlockingQueuedConnection);
+    return ok;
+}
+
+QUrl PricingServer::Url(QString const& path) const
+{
+    return QUrl(QString("http://127.0.0.1:%1%2").arg(port).arg(path));
+}
+
+void PricingServer::Report(std::ostream& os) const
+{
+    os << std::fixed << std::setprecision(3)
+       << " [INFO] Server: " << requests << " requests, " << options << " options, "
+       << errors << " errors on " << connections << " connections, "
+       << this->Threads() << " pricing threads" << std::endl
+       << " [INFO] Service time (ms) p50 = " << latency.Percentile(0.50) / 1e6
+       << "  p90 = " << latency.Percentile(0.90) / 1e6
+       << "  p99 = " << latency.Percentile(0.99) / 1e6
+       << "  max = " << latency.Max() / 1e6 << std::endl;
+}
+
+void PricingServer::OnConnection()
+{
+    while(QTcpSocket* socket = server->nextPendingConnection())
+    {
+        connections++;
+        socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+        socket->setReadBufferSize(ReadBuffer);
+        auto conn = std::make_shared<Connection>();
+        conn->socket = socket;
+        QObject::connect(socket, &QTcpSocket::readyRead, socket, [this, conn]{
+            this->Process(conn);
+        });
+        // Resumes a connection stopped at the high-water mark
+        QObject::connect(socket, &QTcpSocket::bytesWritten, socket, [this, conn]{
+            this->Process(conn);
+        });
+        QObject::connect(socket, &QTcpSocket::disconnected, socket, [socket, conn]{
+            // Responses still being priced are dropped
+            conn->socket = nullptr;
+            socket->deleteLater();
+        });
+    }
+}
+
+void PricingServer::Process(ConnectionPtr const& conn)
+{
+    // Input is read from the socket only when a request is needed
+    auto read = [&]{
+        if(conn->socket->bytesAvailable() == 0)
+            return false;
+        conn->input += conn->socket->readAll();
+        return true;
+    };
+    while(conn->socket && !conn->close && conn->pending.size() < MaxPipelined
+          && conn->socket->bytesToWrite() < MaxUnsent)
+    {
+        int end = conn->input.indexOf("\r\n\r\n");
+        if(end < 0)
+        {
+            if(conn->input.size() > MaxHeaderSize)
+                conn->socket->abort();
+            else if(read())
+                continue;
+            return;
+        }
+        QList<QByteArray> lines = conn->input.left(end).split('\n');
+        QList<QByteArray> request = lines[0].trimmed().split(' ');
+        auto job = std::make_shared<Job>();
+        job->conn      = conn;
+        job->keepAlive = request.value(2) != "HTTP/1.0";
+        QByteArray type;
+        qint64 length = 0;
+        for(QByteArray const& line: lines)
+        {
+            int colon = line.indexOf(':');
+            QByteArray name  = line.left(colon).trimmed().toLower();
+            QByteArray value = line.mid(colon + 1).trimmed();
+            if(name == "content-length")
+                length = value.toLongLong();
+            else if(name == "content-type")
+                type = value.toLower();
+            else if(name == "connection")
+                job->keepAlive = value.toLower() != "close";
+        }
+        if(length < 0 || length > MaxBodySize)
+        {
+            // The body is not read, the connection cannot continue
+            errors++;
+            job->keepAlive = false;
+            job->response  = HttpResponse("413 Payload Too Large", "application/json",
+                                          ErrorBody("Body larger than 64 MB"), false);
+            job->ready     = true;
+            conn->close    = true;
+            conn->pending.push_back(job);
+            this->Flush(*conn);
+            return;
+        }
+        // Waits for the whole body
+        if(conn->input.size() < end + 4 + length)
+        {
+            if(read())
+                continue;
+            return;
+        }
+        job->body  = conn->input.mid(end + 4, static_cast<int>(length));
+        job->start = Instrument::Now();
+        conn->input.remove(0, end + 4 + static_cast<int>(length));
+        conn->close = !job->keepAlive;
+        requests++;
+        conn->pending.push_back(job);
+        this->Dispatch(conn, job, request.value(0), request.value(1), type);
+    }
+}
+
+void PricingServer::Dispatch(ConnectionPtr const& conn, JobPtr const& job, QByteArray const& method,
+                             QByteArray const& path, QByteArray const& type)
+{
+    QByteArray status;
+    QString    message;
+    if(path == "/price" && method == "POST")
+    {
+        if(type.startsWith("application/json") || type.startsWith("application/octet-stream"))
+        {
+            job->binary = type.startsWith("application/octet-stream");
+            pool.start(MakeTask([this, job]{ this->Run(job); }));
+            return;
+        }
+        status  = "415 Unsupported Media Type";
+        message = "Content-Type must be application/json or application/octet-stream";
+    }
+    else if(path == "/price")
+    {
+        status  = "405 Method Not Allowed";
+        message = "Use POST";
+    }
+    else if(path == "/stats" && method == "GET")
+    {
+        job->response = HttpResponse("200 OK", "application/json", this->Stats(), job->keepAlive);
+        job->ready    = true;
+        this->Flush(*conn);
+        return;
+    }
+    else
+    {
+        status  = "404 Not Found";
+        message = "Unknown path";
+    }
+    errors++;
+    job->response = HttpResponse(status, "application/json", ErrorBody(message), job->keepAlive);
+    job->ready    = true;
+    this->Flush(*conn);
+}
+
+void PricingServer::Run(JobPtr const& job)
+{
+    QString error;
+    bool ok = job->binary ? DecodeBinary(job->body, job->options, error)
+                          : DecodeJson(job->body, job->options, error);
+    job->body.clear();
+    if(!ok)
+    {
+        errors++;
+        this->Post(job, HttpResponse("400 Bad Request", "application/json",
+                                     ErrorBody(error), job->keepAlive));
+        return;
+    }
+    size_t n = job->options.size() / BatchStride;
+    job->prices.resize(n);
+    size_t chunks = std::max<size_t>((n + ChunkSize - 1) / ChunkSize, 1);
+    job->chunks = chunks;
+    // The other chunks go to idle threads, the first one is priced here
+    for(size_t c = 1; c < chunks; c++)
+        pool.start(MakeTask([this, job, c]{ this->PriceChunk(job, c); }));
+    this->PriceChunk(job, 0);
+}
+
+void PricingServer::PriceChunk(JobPtr const& job, size_t chunk)
+{
+    size_t n     = job->prices.size();
+    size_t first = chunk * ChunkSize;
+    size_t count = std::min(n - std::min(first, n), ChunkSize);
+    BlackScholesCallBatch(job->options.data() + first * BatchStride, count,
+                          job->prices.data() + first);
+    // The last chunk done encodes the response
+    if(job->chunks.fetch_sub(1) != 1)
+        return;
+    QByteArray body;
+    if(job->binary)
+        body = QByteArray(reinterpret_cast<const char*>(job->prices.data()),
+                          static_cast<int>(n * sizeof(double)));
+    else
+        body = EncodeJson(job->prices);
+    options += static_cast<qint64>(n);
+    this->Post(job, HttpResponse("200 OK", job->binary ? "application/octet-stream"
+                                                       : "application/json",
+                                 body, job->keepAlive));
+}
+
+void PricingServer::Post(JobPtr const& job, QByteArray response)
+{
+    QMetaObject::invokeMethod(server, [this, job, response]{
+        this->Deliver(job, response);
+    }, Qt::QueuedConnection);
+}
+
+void PricingServer::Deliver(JobPtr const& job, QByteArray const& response)
+{
+    latency.Record(Instrument::Now() - job->start);
+    ConnectionPtr conn = job->conn.lock();
+    if(!conn || !conn->socket)
+        return;
+    job->response = response;
+    job->ready    = true;
+    this->Flush(*conn);
+    // Input left unread while the pipeline was full
+    this->Process(conn);
+}
+
+void PricingServer::Flush(Connection& conn)
+{
+    while(!conn.pending.empty() && conn.pending.front()->ready)
+    {
+        conn.socket->write(conn.pending.front()->response);
+        conn.pending.pop_front();
+    }
+    if(conn.close && conn.pending.empty())
+        conn.socket->disconnectFromHost();
+}
+
+QByteArray PricingServer::Stats() const
+{
+    QJsonObject stats{
+        {"connections", connections.load()},
+        {"requests",    requests.load()},
+        {"options",     options.load()},
+        {"errors",      errors.load()},
+        {"threads",     this->Threads()},
+        {"latency_us",  QJsonObject{
+             {"p50", latency.Percentile(0.50) / 1e3},
+             {"p90", latency.Percentile(0.90) / 1e3},
+             {"p99", latency.Percentile(0.99) / 1e3},
+             {"max", latency.Max() / 1e3}}}
+    };
+    return QJsonDocument(stats).toJson(QJsonDocument::Compact) + '\n';
+}
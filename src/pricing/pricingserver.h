@@ -0,0 +1,88 @@
+#ifndef PRICINGSERVER_H
+#define PRICINGSERVER_H
+
+#include <iosfwd>
+#include <memory>
+#include <atomic>
+
+#include <QUrl>
+#include <QThread>
+#include <QThreadPool>
+
+#include "../common/instrument.h"
+
+class QTcpServer;
+
+/** Black-Scholes pricing served over HTTP/1.1 on the loopback interface.
+ *
+ *    POST /price   Content-Type: application/json
+ *                  {"options": [[S, K, T, sigma, r], ...]} or objects
+ *                  {"S": 100, "K": 95, "T": 0.5, "sigma": 0.2, "r": 0.05},
+ *                  answered by {"prices": [...]}
+ *    POST /price   Content-Type: application/octet-stream
+ *                  BatchStride doubles per option in host byte order,
+ *                  answered by one double per option
+ *    GET  /stats   Counters and service latency, JSON
+ *
+ *  Units are those of BlackScholesCall(): sigma and r are fractions, T in
+ *  years. Sockets are served by a dedicated thread, which only parses the
+ *  HTTP framing. Decoding, pricing and encoding run on a thread pool, large
+ *  batches split into chunks priced in parallel. Connections are kept alive
+ *  and pipelined requests are answered in order. A client that does not
+ *  read its responses is not served further: above a few MB waiting to be
+ *  sent, its requests are left unread until the responses drain.
+ */
+class PricingServer
+{
+public:
+    explicit PricingServer(int threads = QThread::idealThreadCount());
+    ~PricingServer();
+
+    PricingServer(PricingServer const&) = delete;
+    PricingServer& operator=(PricingServer const&) = delete;
+
+    /** Listens on 127.0.0.1, port 0 picks a free port */
+    bool Listen(quint16 port = 0, QString* error = nullptr);
+
+    QUrl Url(QString const& path) const;
+    int  Threads() const { return pool.maxThreadCount(); }
+
+    qint64 Connections() const { return connections.load(); }
+    qint64 Requests()    const { return requests.load(); }
+    qint64 Options()     const { return options.load(); }
+    qint64 Errors()      const { return errors.load(); }
+
+    /** From the end of a request to its response being written */
+    Instrument::Histogram const& Latency() const { return latency; }
+
+    void Report(std::ostream& os) const;
+
+private:
+    struct Connection;
+    struct Job;
+    using ConnectionPtr = std::shared_ptr<Connection>;
+    using JobPtr        = std::shared_ptr<Job>;
+
+    QThread             thread;
+    QTcpServer*         server;
+    QThreadPool         pool;
+    quint16             port = 0;
+    std::atomic<qint64> connections{0};
+    std::atomic<qint64> requests{0};
+    std::atomic<qint64> options{0};
+    std::atomic<qint64> errors{0};
+    Instrument::Histogram latency;
+
+    void OnConnection();
+    void Process(ConnectionPtr const& conn);
+    void Dispatch(ConnectionPtr const& conn, JobPtr const& job, QByteArray const& method,
+                  QByteArray const& path, QByteArray const& type);
+    void Run(JobPtr const& job);
+    void PriceChunk(JobPtr const& job, size_t chunk);
+    void Post(JobPtr const& job, QByteArray response);
+    void Deliver(JobPtr const& job, QByteArray const& response);
+    void Flush(Connection& conn);
+    QByteArray Stats() const;
+};
+
+#endif // PRICINGSERVER_H